@@ -6,7 +6,11 @@
 //
 
 #include "banded_global_aligner.hpp"
+#include "banded_global_aligner_simd.hpp"
 #include "json2pb.h"
+#include <new>
+#include <algorithm>
+#include <stdexcept>
 
 //#define debug_banded_aligner_objects
 //#define debug_banded_aligner_graph_processing
@@ -16,6 +20,97 @@
 
 using namespace vg;
 
+// every allocation from the workspace starts on a multiple of this many bytes
+static const size_t WORKSPACE_ALIGNMENT = 16;
+// the smallest block the workspace gets from the system allocator
+static const size_t WORKSPACE_MIN_BLOCK_SIZE = 1 << 16;
+
+BandedAlignmentWorkspace::BandedAlignmentWorkspace(const BandedAlignmentWorkspace& other) {
+    // nothing to do, the copy gets its own memory when it needs it
+}
+
+BandedAlignmentWorkspace& BandedAlignmentWorkspace::operator=(const BandedAlignmentWorkspace& other) {
+    // keep our own memory
+    return *this;
+}
+
+BandedAlignmentWorkspace::~BandedAlignmentWorkspace() {
+    clear();
+}
+
+void BandedAlignmentWorkspace::clear() {
+    for (Block& block : blocks) {
+        free(block.data);
+    }
+    blocks.clear();
+    curr_block = 0;
+    curr_offset = 0;
+}
+
+size_t BandedAlignmentWorkspace::capacity_bytes() const {
+    size_t capacity = 0;
+    for (const Block& block : blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
+
+void* BandedAlignmentWorkspace::allocate_bytes(size_t bytes) {
+    bytes = (bytes + WORKSPACE_ALIGNMENT - 1) / WORKSPACE_ALIGNMENT * WORKSPACE_ALIGNMENT;
+    
+    // move on to the next block if this one is full
+    while (curr_block < blocks.size() && curr_offset + bytes > blocks[curr_block].size) {
+        curr_block++;
+        curr_offset = 0;
+    }
+    if (curr_block == blocks.size()) {
+        // out of blocks, get one at least twice as big as the last so that there are few of them
+        size_t block_size = max(bytes, WORKSPACE_MIN_BLOCK_SIZE);
+        if (!blocks.empty()) {
+            block_size = max(block_size, 2 * blocks.back().size);
+        }
+        char* data = (char*) malloc(block_size);
+        if (data == nullptr) {
+            throw bad_alloc();
+        }
+        blocks.push_back(Block{data, block_size});
+        num_system_allocations++;
+    }
+    
+    void* allocated = blocks[curr_block].data + curr_offset;
+    curr_offset += bytes;
+    used += bytes;
+    peak = max(peak, used);
+    return allocated;
+}
+
+void BandedAlignmentWorkspace::acquire() {
+    if (in_use) {
+        cerr << "error:[BandedAlignmentWorkspace] workspace is already in use by another alignment" << endl;
+        assert(0);
+    }
+    in_use = true;
+}
+
+void BandedAlignmentWorkspace::release() {
+    // if the alignment needed more than one block, replace them with one that fits it all
+    // so that the next alignment this size doesn't need to allocate
+    if (blocks.size() > 1) {
+        size_t capacity = capacity_bytes();
+        clear();
+        char* data = (char*) malloc(capacity);
+        if (data == nullptr) {
+            throw bad_alloc();
+        }
+        blocks.push_back(Block{data, capacity});
+        num_system_allocations++;
+    }
+    curr_block = 0;
+    curr_offset = 0;
+    used = 0;
+    in_use = false;
+}
+
 template<class IntType>
 BandedGlobalAligner<IntType>::BABuilder::BABuilder(Alignment& alignment) :
                                                    alignment(alignment),
@@ -181,14 +276,16 @@ void BandedGlobalAligner<IntType>::BABuilder::finalize_alignment() {
 }
 
 template <class IntType>
-BandedGlobalAligner<IntType>::BAMatrix::BAMatrix(Alignment& alignment, Node* node, int64_t top_diag,
-                                                 int64_t bottom_diag, BAMatrix** seeds, int64_t num_seeds,
+BandedGlobalAligner<IntType>::BAMatrix::BAMatrix(Alignment& alignment, BandedAlignmentWorkspace& workspace,
+                                                 Node* node, int64_t top_diag, int64_t bottom_diag,
+                                                 BAMatrix** seeds, int64_t num_seeds,
                                                  int64_t cumulative_seq_len) :
                                                  node(node),
                                                  top_diag(top_diag),
                                                  bottom_diag(bottom_diag),
                                                  seeds(seeds),
                                                  alignment(alignment),
+                                                 workspace(workspace),
                                                  num_seeds(num_seeds),
                                                  cumulative_seq_len(cumulative_seq_len),
                                                  match(nullptr),
@@ -211,15 +308,13 @@ BandedGlobalAligner<IntType>::BAMatrix::~BAMatrix() {
         cerr << "[BAMatrix::~BAMatrix] destructing null matrix" << endl;
     }
 #endif
-    free(match);
-    free(insert_row);
-    free(insert_col);
-    free(seeds);
+    // the matrices and seeds are in the workspace, which frees them all at once
 }
 
 template <class IntType>
 void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open,
-                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf) {
+                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf,
+                                                         const int8_t* read_codes) {
     
 #ifdef debug_banded_aligner_fill_matrix
     cerr << "[BAMatrix::fill_matrix] beginning DP on matrix for node " << node->id() << endl;;
@@ -238,9 +333,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     const string& read = alignment.sequence();
     const string& base_quality = alignment.quality();
     
-    match = (IntType*) malloc(sizeof(IntType) * band_size);
-    insert_col = (IntType*) malloc(sizeof(IntType) * band_size);
-    insert_row = (IntType*) malloc(sizeof(IntType) * band_size);
+    match = workspace.allocate<IntType>(band_size);
+    insert_col = workspace.allocate<IntType>(band_size);
+    insert_row = workspace.allocate<IntType>(band_size);
     /* these represent a band in a matrix, but we store it as a rectangle with chopped
      * corners
      *
@@ -261,6 +356,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
      *
      * the initial row and column can be reached via an implied row or column insertion
      * that is not represented in the matrix (this requires a number of edge cases)
+     *
+     * the rectangle is stored column by column, so that the cells of a column, which only
+     * depend on the previous column (and the cells above them), are contiguous
      */
     
     int64_t idx, up_idx, diag_idx, left_idx;
@@ -280,7 +378,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // find position of the first cell in the rectangularized band
         int64_t iter_start = -top_diag;
-        idx = iter_start * ncols;
+        idx = iter_start;
         
         // cap stop index if last diagonal is below bottom of matrix
         int64_t iter_stop = bottom_diag > (int64_t) read.length() ? band_height + (int64_t) read.length() - bottom_diag - 1 : band_height;
@@ -305,8 +403,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         insert_row[idx] = -2 * gap_open;
         
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = (i - 1) * ncols;
+            idx = i;
+            up_idx = i - 1;
             // score of a match in this cell
             IntType match_score;
             if (qual_adjusted) {
@@ -347,7 +445,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         int64_t iter_stop = bottom_diag_outside ? band_height + (int64_t) read.length() - bottom_diag - 1 : band_height;
         
         // handle special logic for lead column insertions
-        idx = iter_start * ncols;
+        idx = iter_start;
         
         IntType match_score;
         if (qual_adjusted) {
@@ -384,7 +482,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // start with each cell in the leftmost column as identity of max function to prepare for POA
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
+            idx = i;
             match[idx] = min_inf;
             insert_col[idx] = min_inf;
             // since insert row does not cross node boundary can put it off until after computing
@@ -412,6 +510,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
             
             int64_t seed_node_seq_len = seed->node->sequence().length();
+            int64_t seed_band_height = seed->bottom_diag - seed->top_diag + 1;
+            // the seed's last column
+            int64_t seed_last_col = (seed_node_seq_len - 1) * seed_band_height;
             
             int64_t seed_next_top_diag = seed->top_diag + seed_node_seq_len;
             int64_t seed_next_bottom_diag = seed->bottom_diag + seed_node_seq_len;
@@ -425,11 +526,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             cerr << "[BAMatrix::fill_matrix]: this seed reaches diagonals " << seed_next_top_diag << " to " << seed_next_bottom_diag << " out of matrix range " << top_diag << " to " << bottom_diag << endl;
 #endif
             // special logic for first row
-            idx = (seed_next_top_diag_iter - top_diag) * ncols;
+            idx = seed_next_top_diag_iter - top_diag;
             
             // may not be able to extend a match if at top of matrix
             if (!beyond_top_of_matrix) {
-                diag_idx = (seed_next_top_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+                diag_idx = seed_last_col + seed_next_top_diag_iter - seed_next_top_diag;
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[seed_next_top_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_top_diag_iter]]];
                 }
@@ -445,7 +546,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
                 cerr << "[BAMatrix::fill_matrix]: seed band is greater than height 1, can extend column gap into first row" << endl;
 #endif
-                left_idx = (seed_next_top_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+                left_idx = seed_last_col + seed_next_top_diag_iter - seed_next_top_diag + 1;
                 insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
                                                                       seed->insert_row[left_idx] - gap_open),
                                                           seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
@@ -453,14 +554,14 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             
             
             for (int64_t diag = seed_next_top_diag_iter + 1; diag < seed_next_bottom_diag_iter; diag++) {
-                idx = (diag - top_diag) * ncols;
+                idx = diag - top_diag;
                 
 #ifdef debug_banded_aligner_fill_matrix
                 cerr << "[BAMatrix::fill_matrix]: extending a match and column gap into matrix coord (" << diag << ", 0)" << ", rectangular coord coord (" << diag - top_diag << ", 0)" << endl;
 #endif
                 
                 // extend a match
-                diag_idx = (diag - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+                diag_idx = seed_last_col + diag - seed_next_top_diag;
                 IntType match_score;
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[diag] + 5 * nt_table[node_seq[0]] + nt_table[read[diag]]];
@@ -479,7 +580,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
                 
                 
                 // extend a column gap
-                left_idx = (diag - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+                left_idx = seed_last_col + diag - seed_next_top_diag + 1;
                 
 #ifdef debug_banded_aligner_fill_matrix
                 cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag + 1 << ", " << seed_node_seq_len - 1 << ")" << ", scores are " << (int) seed->match[left_idx] << " (M), " << (int) seed->insert_row[left_idx] << " (Ir), and " << (int) seed->insert_col[left_idx] << " (Ic), current score is " << (int) insert_col[idx] << endl;
@@ -501,8 +602,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
                 
                 // may only be able to extend a match on last iteration
-                idx = (seed_next_bottom_diag_iter - top_diag) * ncols;
-                diag_idx = (seed_next_bottom_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+                idx = seed_next_bottom_diag_iter - top_diag;
+                diag_idx = seed_last_col + seed_next_bottom_diag_iter - seed_next_top_diag;
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[seed_next_bottom_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_bottom_diag_iter]]];
                 }
@@ -523,7 +624,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
                     cerr << "[BAMatrix::fill_matrix]: can also extend a column gap since already reached edge of matrix" << endl;
 #endif
-                    left_idx = (seed_next_bottom_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+                    left_idx = seed_last_col + seed_next_bottom_diag_iter - seed_next_top_diag + 1;
                     insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
                                                                           seed->insert_row[left_idx] - gap_open),
                                                               seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
@@ -537,8 +638,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         // compute the insert row scores (they can be computed after the POA iterations since they do not
         // cross node boundaries)
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = (i - 1) * ncols;
+            idx = i;
+            up_idx = i - 1;
             
             insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
                                   insert_col[up_idx] - gap_open);
@@ -549,6 +650,12 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     cerr << "[BAMatrix::fill_matrix]: seeding finished, moving to subsequent columns" << endl;
 #endif
     
+    // match scores for the vectorized fill, when they depend on base quality
+    int8_t* row_scores = nullptr;
+    if (read_codes != nullptr && qual_adjusted) {
+        row_scores = workspace.allocate<int8_t>(band_height);
+    }
+    
     // iterate through the rest of the columns
     for (int64_t j = 1; j < ncols; j++) {
         
@@ -560,7 +667,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         int64_t iter_start = top_diag_outside ? -(top_diag + j) : 0;
         int64_t iter_stop = bottom_diag_outside ? band_height + (int64_t) read.length() - bottom_diag - j - 1 : band_height;
         
-        idx = iter_start * ncols + j;
+        idx = j * band_height + iter_start;
         
         IntType match_score;
         if (qual_adjusted) {
@@ -578,7 +685,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
         }
         else {
-            diag_idx = iter_start * ncols + (j - 1);
+            diag_idx = (j - 1) * band_height + iter_start;
             // cells should be present to do normal diagonal iteration
             match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
         }
@@ -594,7 +701,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // normal iteration along row unless band height is 1
         if (band_height != 1) {
-            int64_t left_idx = (iter_start + 1) * ncols + (j - 1);
+            int64_t left_idx = (j - 1) * band_height + iter_start + 1;
             insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
                                   insert_col[left_idx] - gap_extend);
         }
@@ -603,40 +710,83 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         }
         
         
-        for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
-            // indices of the current and previous cells in the rectangularized band
-            idx = i * ncols + j;
-            up_idx = (i - 1) * ncols + j;
-            diag_idx = i * ncols + (j - 1);
-            left_idx = (i + 1) * ncols + (j - 1);
-            
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
-            }
-            else {
-                match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+        if (read_codes != nullptr) {
+            // the match and insert column cells of the interior rows only depend on the previous
+            // column, so they can be filled with SIMD instructions
+            int64_t interior_start = iter_start + 1;
+            int64_t interior_stop = iter_stop - 1;
+            if (interior_stop > interior_start) {
+                int64_t prev_col = (j - 1) * band_height + interior_start;
+                int64_t curr_col = j * band_height + interior_start;
+                
+                BandedColumn<IntType> column;
+                column.length = interior_stop - interior_start;
+                column.prev_match = match + prev_col;
+                column.prev_insert_row = insert_row + prev_col;
+                column.prev_insert_col = insert_col + prev_col;
+                column.match = match + curr_col;
+                column.insert_col = insert_col + curr_col;
+                column.read_codes = read_codes + interior_start + top_diag + j;
+                if (qual_adjusted) {
+                    for (int64_t i = interior_start; i < interior_stop; i++) {
+                        row_scores[i] = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                    }
+                    column.node_scores = nullptr;
+                    column.row_scores = row_scores + interior_start;
+                }
+                else {
+                    column.node_scores = score_mat + 5 * nt_table[node_seq[j]];
+                    column.row_scores = nullptr;
+                }
+                column.gap_open = gap_open;
+                column.gap_extend = gap_extend;
+                fill_banded_column(column);
+                
+                // the insert row cells depend on the cells above them, so they are filled serially
+                for (int64_t i = interior_start; i < interior_stop; i++) {
+                    idx = j * band_height + i;
+                    up_idx = idx - 1;
+                    insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
+                                          insert_col[up_idx] - gap_open);
+                }
             }
-            
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
-            
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
-            
-            insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                  insert_col[left_idx] - gap_extend);
-            
+        }
+        else {
+            for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
+                // indices of the current and previous cells in the rectangularized band
+                idx = j * band_height + i;
+                up_idx = j * band_height + i - 1;
+                diag_idx = (j - 1) * band_height + i;
+                left_idx = (j - 1) * band_height + i + 1;
+                
+                if (qual_adjusted) {
+                    match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                }
+                else {
+                    match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                }
+                
+                match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
+                
+                insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
+                                      insert_col[up_idx] - gap_open);
+                
+                insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
+                                      insert_col[left_idx] - gap_extend);
+                
 #ifdef debug_banded_aligner_fill_matrix
-            cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << i + top_diag + j << " (" << read[i + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
+                cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << i + top_diag + j << " (" << read[i + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
 #endif
+            }
         }
         
         // stop iteration one cell early to handle logic on bottom edge of band
         
         // skip this step in edge case where read length is 1
         if (iter_stop - 1 > iter_start) {
-            idx = (iter_stop - 1) * ncols + j;
-            up_idx = (iter_stop - 2) * ncols + j;
-            diag_idx = (iter_stop - 1) * ncols + (j - 1);
+            idx = j * band_height + iter_stop - 1;
+            up_idx = j * band_height + iter_stop - 2;
+            diag_idx = (j - 1) * band_height + iter_stop - 1;
             
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[iter_stop + top_diag + j - 1] + 5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
@@ -652,7 +802,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             
             if (bottom_diag_outside) {
                 // along the bottom edge of the matrix, so the cell to the right is still there
-                left_idx = iter_stop * ncols + (j - 1);
+                left_idx = (j - 1) * band_height + iter_stop;
                 insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
                                       insert_col[left_idx] - gap_extend);
                 
@@ -680,7 +830,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback(BABuilder& builder, AltTr
     int64_t ncols = node->sequence().length();
     int64_t row = bottom_diag + ncols > (int64_t) read.length() ? (int64_t) read.length() - top_diag - ncols : bottom_diag - top_diag;
     int64_t col = ncols - 1;
-    int64_t idx = row * ncols + col;
+    int64_t idx = col * (bottom_diag - top_diag + 1) + row;
     
     
 #ifdef debug_banded_aligner_traceback
@@ -709,7 +859,6 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
     
     int64_t band_height = bottom_diag - top_diag + 1;
     const char* node_seq = node->sequence().c_str();
-    int64_t ncols = node->sequence().length();
     int64_t node_id = node->id();
     
     int64_t idx, next_idx;
@@ -770,7 +919,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         }
         
         // find optimal traceback
-        idx = i * ncols + j;
+        idx = j * band_height + i;
         bool found_trace = false;
         switch (curr_mat) {
             case Match:
@@ -787,7 +936,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = match[idx];
-                next_idx = i * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i;
                 
                 IntType match_score;
                 if (qual_adjusted) {
@@ -874,7 +1023,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = insert_row[idx];
-                next_idx = (i - 1) * ncols + j;
+                next_idx = j * band_height + i - 1;
                 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -933,7 +1082,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = insert_col[idx];
-                next_idx = (i + 1) * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i + 1;
 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -1083,7 +1232,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
             switch (curr_mat) {
                 case Match:
                 {
-                    curr_score = match[i * ncols];
+                    curr_score = match[i];
                     if (qual_adjusted) {
                         match_score = score_mat[25 * base_quality[i + top_diag] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag]]];
                     }
@@ -1095,7 +1244,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                     
                 case InsertCol:
                 {
-                    curr_score = insert_col[i * ncols];
+                    curr_score = insert_col[i];
                     break;
                 }
                     
@@ -1153,7 +1302,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 
                 int64_t seed_col = seed_ncols - 1;
                 int64_t seed_row = curr_diag - seed_extended_top_diag + (curr_mat == InsertCol);
-                next_idx = seed_row * seed_ncols + seed_col;
+                next_idx = seed_col * (seed->bottom_diag - seed->top_diag + 1) + seed_row;
                 
 #ifdef debug_banded_aligner_traceback
                 cerr << "[BAMatrix::traceback_internal] checking seed rectangular coordinates (" << seed_row << ", " << seed_col << ")" << endl;
@@ -1474,7 +1623,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_matrix(matrix_t which_mat) {
                 cout << "\t.";
             }
             else {
-                cout << "\t" << (int) band_rect[(diag - top_diag) * ncols + j];
+                cout << "\t" << (int) band_rect[j * (bottom_diag - top_diag + 1) + diag - top_diag];
             }
         }
         cout << endl;
@@ -1529,7 +1678,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_band(matrix_t which_mat) {
                 cout << "\t.";
             }
             else {
-                cout << "\t" << (int) band_rect[i * ncols + j];
+                cout << "\t" << (int) band_rect[j * band_height + i];
             }
         }
         cout << endl;
@@ -1545,9 +1694,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_band(matrix_t which_mat) {
 template <class IntType>
 BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g,
                                                   int64_t band_padding, bool permissive_banding,
-                                                  bool adjust_for_base_quality) :
+                                                  bool adjust_for_base_quality,
+                                                  BandedAlignmentWorkspace* workspace) :
                                                   BandedGlobalAligner(alignment, g,
                                                                       nullptr, 1,
+                                                                      workspace,
                                                                       band_padding,
                                                                       permissive_banding,
                                                                       adjust_for_base_quality)
@@ -1560,10 +1711,12 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
                                                   vector<Alignment>& alt_alignments,
                                                   int64_t max_multi_alns, int64_t band_padding,
                                                   bool permissive_banding,
-                                                  bool adjust_for_base_quality) :
+                                                  bool adjust_for_base_quality,
+                                                  BandedAlignmentWorkspace* workspace) :
                                                   BandedGlobalAligner(alignment, g,
                                                                       &alt_alignments,
                                                                       max_multi_alns,
+                                                                      workspace,
                                                                       permissive_banding,
                                                                       adjust_for_base_quality)
 {
@@ -1578,14 +1731,20 @@ template <class IntType>
 BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g,
                                                   vector<Alignment>* alt_alignments,
                                                   int64_t max_multi_alns,
+                                                  BandedAlignmentWorkspace* workspace,
                                                   int64_t band_padding,
                                                   bool permissive_banding,
                                                   bool adjust_for_base_quality) :
                                                   alignment(alignment),
                                                   alt_alignments(alt_alignments),
                                                   max_multi_alns(max_multi_alns),
-                                                  adjust_for_base_quality(adjust_for_base_quality)
+                                                  adjust_for_base_quality(adjust_for_base_quality),
+                                                  workspace(workspace ? workspace : &own_workspace)
 {
+    // everything allocated for this alignment comes out of the workspace until the destructor
+    // gives it back
+    this->workspace->acquire();
+    
     if (adjust_for_base_quality) {
         if (alignment.quality().empty()) {
             cerr << "error:[BandedGlobalAligner] alignment needs base quality to perform quality adjusted alignment" << endl;
@@ -1600,17 +1759,20 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
     }
     
     // map node ids to indices
-    for (int64_t i = 0; i < g.node_size(); i++) {
-        node_id_to_idx[g.node(i).id()] = i;
+    num_nodes = g.node_size();
+    node_id_to_idx = this->workspace->allocate<pair<int64_t, int64_t>>(num_nodes);
+    for (int64_t i = 0; i < num_nodes; i++) {
+        node_id_to_idx[i] = make_pair(g.node(i).id(), i);
     }
+    sort(node_id_to_idx, node_id_to_idx + num_nodes);
     
 #ifdef debug_banded_aligner_objects
     cerr << "[BandedGlobalAligner]: constructing edge lists by node" << endl;
 #endif
     
     // convert the graph into lists of ids indicating incoming or outgoing edges
-    vector<vector<int64_t>> node_edges_in;
-    vector<vector<int64_t>> node_edges_out;
+    NodeEdges node_edges_in;
+    NodeEdges node_edges_out;
     graph_edge_lists(g, true, node_edges_out);
     graph_edge_lists(g, false, node_edges_in);
     
@@ -1619,6 +1781,7 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
 #endif
     
     // compute topological ordering
+    topological_order = this->workspace->allocate<Node*>(num_nodes);
     topological_sort(g, node_edges_out, topological_order);
     
 #ifdef debug_banded_aligner_objects
@@ -1626,16 +1789,18 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
 #endif
     
     // identify source and sink nodes in the graph
-    for (int64_t i = 0; i < g.node_size(); i++) {
+    source_nodes = this->workspace->allocate<Node*>(num_nodes);
+    sink_nodes = this->workspace->allocate<Node*>(num_nodes);
+    for (int64_t i = 0; i < num_nodes; i++) {
         if (node_edges_in[i].empty()) {
-            source_nodes.insert(g.mutable_node(i));
+            source_nodes[num_source_nodes++] = g.mutable_node(i);
         }
         if (node_edges_out[i].empty()) {
-            sink_nodes.insert(g.mutable_node(i));
+            sink_nodes[num_sink_nodes++] = g.mutable_node(i);
         }
     }
     
-    if (source_nodes.empty() || sink_nodes.empty()) {
+    if (num_source_nodes == 0 || num_sink_nodes == 0) {
         cerr << "error:[BandedGlobalAligner] alignment graph must be a DAG" << endl;
     }
     
@@ -1645,8 +1810,8 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
     
     // figure out what the bands need to be for alignment and which nodes cannot complete a
     // global alignment within the band
-    vector<bool> node_masked;
-    vector<pair<int64_t, int64_t>> band_ends;
+    bool* node_masked = this->workspace->allocate<bool>(num_nodes);
+    pair<int64_t, int64_t>* band_ends = this->workspace->allocate<pair<int64_t, int64_t>>(num_nodes);
     find_banded_paths(alignment.sequence(), permissive_banding, node_edges_in, node_edges_out, band_padding, node_masked, band_ends);
     
 #ifdef debug_banded_aligner_objects
@@ -1655,22 +1820,22 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
     
     // find the shortest sequence leading to each node so we can infer the length
     // of lead deletions
-    vector<int64_t> shortest_seqs;
-    shortest_seq_paths(node_edges_out, shortest_seqs, source_nodes);
+    int64_t* shortest_seqs = this->workspace->allocate<int64_t>(num_nodes);
+    shortest_seq_paths(node_edges_out, shortest_seqs);
     
 #ifdef debug_banded_aligner_objects
     cerr << "[BandedGlobalAligner]: constructing banded matrix objects" << endl;
 #endif
     
     // initialize DP matrices for each node
-    banded_matrices.resize(g.node_size());
-    for (int64_t i = 0; i < g.node_size(); i++) {
+    banded_matrices = this->workspace->allocate<BAMatrix*>(num_nodes);
+    for (int64_t i = 0; i < num_nodes; i++) {
         
 #ifdef debug_banded_aligner_objects
         cerr << "[BandedGlobalAligner]: creating matrix object for node " << g.mutable_node(i)->id() << " at index " << i << endl;
 #endif
         Node* node = topological_order[i];
-        int64_t node_idx = node_id_to_idx[node->id()];
+        int64_t node_idx = node_index(node->id());
         
         if (node_masked[node_idx]) {
 #ifdef debug_banded_aligner_objects
@@ -1688,7 +1853,7 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
             
             // POA predecessor matrices
             BAMatrix** seeds;
-            vector<int64_t>& edges_in = node_edges_in[node_idx];
+            typename NodeEdges::Range edges_in = node_edges_in[node_idx];
             if (edges_in.empty()) {
                 
 #ifdef debug_banded_aligner_objects
@@ -1698,27 +1863,30 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
                 seeds = nullptr;
             }
             else {
-                seeds = (BAMatrix**) malloc(sizeof(BAMatrix**) * edges_in.size());
+                seeds = this->workspace->allocate<BAMatrix*>(edges_in.size());
                 for (int64_t j = 0; j < edges_in.size(); j++) {
                     seeds[j] = banded_matrices[edges_in[j]];
                 }
             }
             
-            banded_matrices[node_idx] = new BAMatrix(alignment,
-                                                     node,
-                                                     band_ends[node_idx].first,
-                                                     band_ends[node_idx].second,
-                                                     seeds,
-                                                     edges_in.size(),
-                                                     shortest_seqs[node_idx]);
+            // the matrix object lives in the workspace too
+            void* matrix_memory = this->workspace->allocate<BAMatrix>(1);
+            banded_matrices[node_idx] = new (matrix_memory) BAMatrix(alignment,
+                                                                     *this->workspace,
+                                                                     node,
+                                                                     band_ends[node_idx].first,
+                                                                     band_ends[node_idx].second,
+                                                                     seeds,
+                                                                     edges_in.size(),
+                                                                     shortest_seqs[node_idx]);
             
         }
     }
     
     if (!permissive_banding) {
         bool sinks_masked = true;
-        for (Node* node : sink_nodes) {
-            if (banded_matrices[node_id_to_idx[node->id()]] != nullptr) {
+        for (int64_t i = 0; i < num_sink_nodes; i++) {
+            if (banded_matrices[node_index(sink_nodes[i]->id())] != nullptr) {
                 sinks_masked = false;
                 break;
             }
@@ -1735,50 +1903,77 @@ BandedGlobalAligner<IntType>::BandedGlobalAligner(Alignment& alignment, Graph& g
 template <class IntType>
 BandedGlobalAligner<IntType>::~BandedGlobalAligner() {
     
-    for (BAMatrix* banded_matrix : banded_matrices) {
-        delete banded_matrix;
+    // the matrices' memory belongs to the workspace, so they only need to be destructed
+    for (int64_t i = 0; i < num_nodes && banded_matrices; i++) {
+        if (banded_matrices[i]) {
+            banded_matrices[i]->~BAMatrix();
+        }
     }
-    
+    workspace->release();
 }
 
-// fills a vector with vectors ids that have edges to/from each node
 template <class IntType>
-void BandedGlobalAligner<IntType>::graph_edge_lists(Graph& g, bool outgoing_edges, vector<vector<int64_t>>& out_edge_list) {
-    if (outgoing_edges) {
-        out_edge_list = vector<vector<int64_t>>(g.node_size());
-        for (int64_t i = 0; i < g.edge_size(); i++) {
-            Edge* edge = g.mutable_edge(i);
-            out_edge_list[node_id_to_idx.at(edge->from())].push_back(node_id_to_idx.at(edge->to()));
-        }
-    }
-    else {
-        out_edge_list = vector<vector<int64_t>>(g.node_size());
-        for (int64_t i = 0; i < g.edge_size(); i++) {
-            Edge* edge = g.mutable_edge(i);
-            out_edge_list[node_id_to_idx.at(edge->to())].push_back(node_id_to_idx.at(edge->from()));
-        }
+int64_t BandedGlobalAligner<IntType>::node_index(int64_t node_id) const {
+    const pair<int64_t, int64_t>* found = lower_bound(node_id_to_idx, node_id_to_idx + num_nodes,
+                                                      make_pair(node_id, numeric_limits<int64_t>::min()));
+    if (found == node_id_to_idx + num_nodes || found->first != node_id) {
+        throw out_of_range("[BandedGlobalAligner] node " + to_string(node_id) + " is not in the graph");
     }
+    return found->second;
+}
+
+// fills arrays with the indexes of the nodes that have edges to/from each node
+template <class IntType>
+void BandedGlobalAligner<IntType>::graph_edge_lists(Graph& g, bool outgoing_edges, NodeEdges& out_edge_list) {
+    // count the edges of each node, then lay them out one node after another
+    out_edge_list.starts = workspace->allocate<int64_t>(num_nodes + 1);
+    out_edge_list.targets = workspace->allocate<int64_t>(g.edge_size());
+    int64_t* edge_node_idxs = workspace->allocate<int64_t>(2 * g.edge_size());
+    fill(out_edge_list.starts, out_edge_list.starts + num_nodes + 1, 0);
+    for (int64_t i = 0; i < g.edge_size(); i++) {
+        const Edge& edge = g.edge(i);
+        int64_t from_idx = node_index(edge.from());
+        int64_t to_idx = node_index(edge.to());
+        edge_node_idxs[2 * i] = outgoing_edges ? from_idx : to_idx;
+        edge_node_idxs[2 * i + 1] = outgoing_edges ? to_idx : from_idx;
+        out_edge_list.starts[edge_node_idxs[2 * i] + 1]++;
+    }
+    for (int64_t i = 0; i < num_nodes; i++) {
+        out_edge_list.starts[i + 1] += out_edge_list.starts[i];
+    }
+    // fill in each node's edges in the order they appear in the graph, using the start of the
+    // next node's edges as a cursor and then moving it back
+    for (int64_t i = 0; i < g.edge_size(); i++) {
+        out_edge_list.targets[out_edge_list.starts[edge_node_idxs[2 * i]]++] = edge_node_idxs[2 * i + 1];
+    }
+    for (int64_t i = num_nodes; i > 0; i--) {
+        out_edge_list.starts[i] = out_edge_list.starts[i - 1];
+    }
+    out_edge_list.starts[0] = 0;
 }
 
 // standard DFS-based topological sort algorithm
 // NOTE: this is only valid if the Graph g has been dag-ified first and there are no from_start
 // or to_end edges.
 template <class IntType>
-void BandedGlobalAligner<IntType>::topological_sort(Graph& g, vector<vector<int64_t>>& node_edges_out,
-                                                    vector<Node*>& out_topological_order) {
+void BandedGlobalAligner<IntType>::topological_sort(Graph& g, const NodeEdges& node_edges_out,
+                                                    Node** out_topological_order) {
     if (g.node_size() == 0) {
         cerr << "warning:[BandedGlobalAligner] attempted to perform topological sort on empty graph" << endl;
         return;
     }
     
     // initialize return value
-    out_topological_order = vector<Node*>(g.node_size());
     size_t order_index = g.node_size() - 1;
     
     // initialize iteration structures
-    vector<bool> enqueued = vector<bool>(g.node_size());
-    vector<int> edge_index = vector<int>(g.node_size());
-    vector<int64_t> stack;
+    bool* enqueued = workspace->allocate<bool>(g.node_size());
+    int64_t* edge_index = workspace->allocate<int64_t>(g.node_size());
+    fill(enqueued, enqueued + g.node_size(), false);
+    fill(edge_index, edge_index + g.node_size(), 0);
+    // each node is only pushed once, so the stack never needs to be bigger than the graph
+    int64_t* stack = workspace->allocate<int64_t>(g.node_size());
+    int64_t stack_size = 0;
     
     // iterate through starting nodes
     for (int64_t init_node_id = 0; init_node_id < g.node_size(); init_node_id++) {
@@ -1786,23 +1981,23 @@ void BandedGlobalAligner<IntType>::topological_sort(Graph& g, vector<vector<int6
             continue;
         }
         // navigate through graph with DFS
-        stack.push_back(init_node_id);
+        stack[stack_size++] = init_node_id;
         enqueued[init_node_id] = true;
-        while (!stack.empty()) {
-            int64_t node_id = stack[stack.size() - 1];
+        while (stack_size > 0) {
+            int64_t node_id = stack[stack_size - 1];
             if (edge_index[node_id] < node_edges_out[node_id].size()) {
                 int64_t target_id = node_edges_out[node_id][edge_index[node_id]];
                 if (enqueued[target_id]) {
                     edge_index[node_id]++;
                 }
                 else {
-                    stack.push_back(target_id);
+                    stack[stack_size++] = target_id;
                     enqueued[target_id] = true;
                 }
             }
             else {
                 // add to topological order in reverse finishing order
-                stack.pop_back();
+                stack_size--;
                 out_topological_order[order_index] = g.mutable_node(node_id);
                 order_index--;
             }
@@ -1811,31 +2006,27 @@ void BandedGlobalAligner<IntType>::topological_sort(Graph& g, vector<vector<int6
 }
 
 template <class IntType>
-void BandedGlobalAligner<IntType>::path_lengths_to_sinks(const string& read, vector<vector<int64_t>>& node_edges_in,
-                                                         vector<int64_t>& shortest_path_to_sink,
-                                                         vector<int64_t>& longest_path_to_sink) {
+void BandedGlobalAligner<IntType>::path_lengths_to_sinks(const string& read, const NodeEdges& node_edges_in,
+                                                         int64_t* shortest_path_to_sink,
+                                                         int64_t* longest_path_to_sink) {
 #ifdef debug_banded_aligner_graph_processing
     cerr << "[BandedGlobalAligner::path_lengths_to_sinks]: finding longest and shortest paths to sink node" << endl;
 #endif
     
     // find the longest path from the right side of each matrix to the end of the graph
-    longest_path_to_sink = vector<int64_t>(topological_order.size());
-    shortest_path_to_sink = vector<int64_t>(topological_order.size());
-    
-    // set initial values -- 0 default value is sufficient for longest path
-    for (int64_t& initial_path_length :  shortest_path_to_sink) {
-        initial_path_length = numeric_limits<int64_t>::max();
-    }
+    // set initial values -- 0 is the initial value for longest path
+    fill(longest_path_to_sink, longest_path_to_sink + num_nodes, 0);
+    fill(shortest_path_to_sink, shortest_path_to_sink + num_nodes, numeric_limits<int64_t>::max());
     // set base case (longest path already set to 0)
-    for (Node* node : sink_nodes) {
-        shortest_path_to_sink[node_id_to_idx.at(node->id())] = 0;
+    for (int64_t i = 0; i < num_sink_nodes; i++) {
+        shortest_path_to_sink[node_index(sink_nodes[i]->id())] = 0;
     }
     
     // iterate in reverse order
-    for (auto iter = topological_order.rbegin(); iter != topological_order.rend(); iter++) {
-        Node* node = *iter;
+    for (int64_t i = num_nodes - 1; i >= 0; i--) {
+        Node* node = topological_order[i];
         int64_t node_seq_len = node->sequence().length();
-        int64_t node_idx = node_id_to_idx.at(node->id());
+        int64_t node_idx = node_index(node->id());
         // compute longest path through this node to right side of incoming matrices
         int64_t longest_path_length = longest_path_to_sink[node_idx] + node_seq_len;
         int64_t shortest_path_length = shortest_path_to_sink[node_idx] + node_seq_len;
@@ -1870,33 +2061,29 @@ void BandedGlobalAligner<IntType>::path_lengths_to_sinks(const string& read, vec
 // fills vectors with whether nodes are masked by the band width, and the band ends of each node
 template <class IntType>
 void BandedGlobalAligner<IntType>::find_banded_paths(const string& read, bool permissive_banding,
-                                                     vector<vector<int64_t>>& node_edges_in,
-                                                     vector<vector<int64_t>>& node_edges_out,
-                                                     int64_t band_padding, vector<bool>& node_masked,
-                                                     vector<pair<int64_t, int64_t>>& band_ends) {
+                                                     const NodeEdges& node_edges_in,
+                                                     const NodeEdges& node_edges_out,
+                                                     int64_t band_padding, bool* node_masked,
+                                                     pair<int64_t, int64_t>* band_ends) {
     
     // find the longest and shortest path from each node to any sink
-    vector<int64_t> shortest_path_to_sink;
-    vector<int64_t> longest_path_to_sink;
+    int64_t* shortest_path_to_sink = workspace->allocate<int64_t>(num_nodes);
+    int64_t* longest_path_to_sink = workspace->allocate<int64_t>(num_nodes);
     path_lengths_to_sinks(read, node_edges_in, shortest_path_to_sink, longest_path_to_sink);
     
     // keeps track of which nodes cannot reach the bottom corner within the band
-    node_masked = vector<bool>(topological_order.size());
+    fill(node_masked, node_masked + num_nodes, false);
     
-    // the bottom and top indices of the band in the rightmost column of each node's matrix
-    band_ends = vector<pair<int64_t, int64_t>>(topological_order.size());
-    
-    // set band ends to identities of max / min functions
-    for (int64_t i = 0; i < topological_order.size(); i++) {
-        band_ends[i].first = numeric_limits<int64_t>::max();
-        band_ends[i].second = numeric_limits<int64_t>::min();
-    }
+    // the bottom and top indices of the band in the rightmost column of each node's matrix,
+    // set to identities of max / min functions
+    fill(band_ends, band_ends + num_nodes, make_pair(numeric_limits<int64_t>::max(), numeric_limits<int64_t>::min()));
     
     
     if (permissive_banding) {
         // initialize with wide enough bands that every source can hit every connected sink
-        for (Node* init_node : source_nodes) {
-            int64_t init_node_idx = node_id_to_idx.at(init_node->id());
+        for (int64_t i = 0; i < num_source_nodes; i++) {
+            Node* init_node = source_nodes[i];
+            int64_t init_node_idx = node_index(init_node->id());
             int64_t init_node_seq_len = init_node->sequence().length();
             band_ends[init_node_idx].first = min(-band_padding,
                                                  (int64_t) read.length() - (init_node_seq_len + longest_path_to_sink[init_node_idx]) - band_padding);
@@ -1910,8 +2097,9 @@ void BandedGlobalAligner<IntType>::find_banded_paths(const string& read, bool pe
     }
     else {
         // initialize with band ends beginning with source nodes
-        for (Node* init_node : source_nodes) {
-            int64_t init_node_idx = node_id_to_idx.at(init_node->id());
+        for (int64_t i = 0; i < num_source_nodes; i++) {
+            Node* init_node = source_nodes[i];
+            int64_t init_node_idx = node_index(init_node->id());
             int64_t init_node_seq_len = init_node->sequence().length();
             band_ends[init_node_idx].first = -band_padding;
             band_ends[init_node_idx].second = band_padding;
@@ -1922,11 +2110,11 @@ void BandedGlobalAligner<IntType>::find_banded_paths(const string& read, bool pe
     }
     
     // iterate through the rest of the nodes in topological order
-    for (int64_t i = 0; i < topological_order.size(); i++) {
+    for (int64_t i = 0; i < num_nodes; i++) {
         Node* node = topological_order[i];
-        int64_t node_idx = node_id_to_idx.at(node->id());
+        int64_t node_idx = node_index(node->id());
         int64_t node_seq_len = node->sequence().length();
-        vector<int64_t>& edges_out = node_edges_out[node_idx];
+        typename NodeEdges::Range edges_out = node_edges_out[node_idx];
         
         int64_t extended_band_top = band_ends[node_idx].first + node_seq_len;
         int64_t extended_band_bottom = band_ends[node_idx].second + node_seq_len;
@@ -1974,22 +2162,21 @@ void BandedGlobalAligner<IntType>::find_banded_paths(const string& read, bool pe
 
 // returns the shortest sequence from any source node to each node
 template <class IntType>
-void BandedGlobalAligner<IntType>::shortest_seq_paths(vector<vector<int64_t>>& node_edges_out,
-                                                      vector<int64_t>& seq_lens_out,
-                                                      unordered_set<Node*> source_nodes) {
+void BandedGlobalAligner<IntType>::shortest_seq_paths(const NodeEdges& node_edges_out,
+                                                      int64_t* seq_lens_out) {
     
-    // initialize vector with min identity to store sequence lengths
-    seq_lens_out = vector<int64_t>(topological_order.size(), numeric_limits<int64_t>::max());
+    // initialize with min identity to store sequence lengths
+    fill(seq_lens_out, seq_lens_out + num_nodes, numeric_limits<int64_t>::max());
     
     // base cases
-    for (Node* node : source_nodes) {
-        seq_lens_out[node_id_to_idx[node->id()]] = 0;
+    for (int64_t i = 0; i < num_source_nodes; i++) {
+        seq_lens_out[node_index(source_nodes[i]->id())] = 0;
     }
     
     // dynamic programming to calculate sequence lengths for rest of nodes
-    for (auto iter = topological_order.begin(); iter != topological_order.end(); iter++) {
-        Node* node = *iter;
-        int64_t node_idx = node_id_to_idx.at(node->id());
+    for (int64_t i = 0; i < num_nodes; i++) {
+        Node* node = topological_order[i];
+        int64_t node_idx = node_index(node->id());
         int64_t seq_len = node->sequence().length() + seq_lens_out[node_idx];
         
         for (int64_t target_idx : node_edges_out[node_idx]) {
@@ -2010,12 +2197,21 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
     }
     IntType min_inf = numeric_limits<IntType>::min() + max<IntType>((IntType) -max_mismatch, max<IntType>(gap_open, gap_extend));
     
+    // the vectorized fill looks up match scores by the nt codes of the read
+    int8_t* read_codes = nullptr;
+    if (vectorize && banded_column_vectorized<IntType>()) {
+        const string& read = alignment.sequence();
+        read_codes = workspace->allocate<int8_t>(read.size());
+        for (size_t i = 0; i < read.size(); i++) {
+            read_codes[i] = nt_table[read[i]];
+        }
+    }
     
     // fill each nodes matrix in topological order
     //for (Node* node : topological_order) {
-    for (int64_t i = 0; i < topological_order.size(); i++) {
+    for (int64_t i = 0; i < num_nodes; i++) {
         Node* node = topological_order[i];
-        int64_t node_idx = node_id_to_idx.at(node->id());
+        int64_t node_idx = node_index(node->id());
         BAMatrix* band_matrix = banded_matrices[node_idx];
 #ifdef debug_banded_aligner_fill_matrix
         cerr << "[BandedGlobalAligner::align] checking node " << node->id() << " at index " << node_idx << " with sequence " << node->sequence() << " and topological position " << i << endl;
@@ -2031,7 +2227,8 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
 #ifdef debug_banded_aligner_fill_matrix
         cerr << "[BandedGlobalAligner::align] node is not masked, filling matrix" << endl;
 #endif
-        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf);
+        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf,
+                                 read_codes);
     }
     
     traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
@@ -2042,9 +2239,9 @@ void BandedGlobalAligner<IntType>::traceback(int8_t* score_mat, int8_t* nt_table
     
     // get the sink node matrices for alignment stack
     vector<BAMatrix*> sink_node_matrices;
-    sink_node_matrices.reserve(sink_nodes.size());
-    for (Node* node : sink_nodes) {
-        sink_node_matrices.push_back(banded_matrices[node_id_to_idx[node->id()]]);
+    sink_node_matrices.reserve(num_sink_nodes);
+    for (int64_t i = 0; i < num_sink_nodes; i++) {
+        sink_node_matrices.push_back(banded_matrices[node_index(sink_nodes[i]->id())]);
     }
     
     // find the optimal alignment(s) and initialize stack
@@ -2054,7 +2251,7 @@ void BandedGlobalAligner<IntType>::traceback(int8_t* score_mat, int8_t* nt_table
         int64_t end_node_id;
         matrix_t end_matrix;
         traceback_stack.get_alignment_start(end_node_id, end_matrix);
-        int64_t end_node_idx = node_id_to_idx[end_node_id];
+        int64_t end_node_idx = node_index(end_node_id);
         
 #ifdef debug_banded_aligner_traceback
         cerr << "[BandedGlobalAligner::traceback] beginning traceback ending at node " << end_node_id << " in matrix " << (end_matrix == Match ? "match" : (end_matrix == InsertCol ? "insert column" : "insert row")) << endl;
@@ -2123,7 +2320,7 @@ BandedGlobalAligner<IntType>::AltTracebackStack::AltTracebackStack(int64_t max_m
         int64_t final_col = ncols - 1;
         int64_t final_row = band_matrix->bottom_diag + ncols > (int64_t) read.length() ? (int64_t) read.length() - band_matrix->top_diag - ncols : band_matrix->bottom_diag - band_matrix->top_diag;
         
-        int64_t final_idx = final_row * ncols + final_col;
+        int64_t final_idx = final_col * (band_matrix->bottom_diag - band_matrix->top_diag + 1) + final_row;
         
         // let the insert routine figure out which one is the best and which ones to keep in the stack
         insert_traceback(null_prefix, band_matrix->match[final_idx],
@@ -9,6 +9,7 @@
 #define banded_global_aligner_hpp
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <iostream>
 #include <vector>
@@ -22,6 +23,58 @@ using namespace std;
 
 namespace vg {
     
+    // A pool of memory that BandedGlobalAligner carves its DP matrices and bookkeeping arrays out
+    // of, so that they don't have to go through the system allocator for every alignment. The
+    // memory is released all at once when the alignment is done and kept for the next one, and
+    // once the pool has grown to fit the largest alignment it is asked to do, it stops allocating
+    // altogether. Only one alignment can use a workspace at a time.
+    class BandedAlignmentWorkspace {
+    public:
+        BandedAlignmentWorkspace() = default;
+        // copies start out empty rather than sharing the memory
+        BandedAlignmentWorkspace(const BandedAlignmentWorkspace& other);
+        BandedAlignmentWorkspace& operator=(const BandedAlignmentWorkspace& other);
+        ~BandedAlignmentWorkspace();
+        
+        // an uninitialized array that lasts until the workspace is released
+        template <class T>
+        T* allocate(size_t count) {
+            return (T*) allocate_bytes(sizeof(T) * count);
+        }
+        
+        // claim the workspace for an alignment, failing if another alignment already has it
+        void acquire();
+        // free everything allocated since acquiring, keeping the memory for the next alignment
+        void release();
+        
+        // the most memory that an alignment has used at once
+        size_t peak_bytes() const { return peak; }
+        // the memory held by the workspace
+        size_t capacity_bytes() const;
+        // the number of times the workspace has had to get memory from the system allocator
+        size_t system_allocations() const { return num_system_allocations; }
+        
+    private:
+        
+        void* allocate_bytes(size_t bytes);
+        // free all of the blocks
+        void clear();
+        
+        struct Block {
+            char* data;
+            size_t size;
+        };
+        vector<Block> blocks;
+        // the block that allocations currently come out of, and how much of it is used
+        size_t curr_block = 0;
+        size_t curr_offset = 0;
+        // memory handed out since acquiring
+        size_t used = 0;
+        size_t peak = 0;
+        size_t num_system_allocations = 0;
+        bool in_use = false;
+    };
+    
     // This class is the outward-facing interface for banded global graph alignment. It computes
     // optimal alignment of a DNA sequence to a DAG with POA. The alignment will start at any source
     // node in the graph and end at any sink node. It is also restricted to falling within a certain
@@ -40,10 +93,12 @@ namespace vg {
          *  band_padding                width to expand band by
          *  permissive_banding          expand band, not necessarily symmetrically, to allow all node paths
          *  adjust_for_base_quality     perform base quality adjusted alignment (see QualAdjAligner)
+         *  workspace                   memory pool to allocate the DP matrices from (uses its own if null)
          */
         BandedGlobalAligner(Alignment& alignment, Graph& g,
                             int64_t band_padding, bool permissive_banding = false,
-                            bool adjust_for_base_quality = false);
+                            bool adjust_for_base_quality = false,
+                            BandedAlignmentWorkspace* workspace = nullptr);
         
         /*
          * Initializes banded multi-alignment, which performs the top scoring alternate alignments in addition
@@ -58,11 +113,13 @@ namespace vg {
          *  band_padding                width to expand band by
          *  permissive_banding          expand band, not necessarily symmetrically, to allow all node paths
          *  adjust_for_base_quality     perform base quality adjusted alignment (see QualAdjAligner)
+         *  workspace                   memory pool to allocate the DP matrices from (uses its own if null)
          */
         BandedGlobalAligner(Alignment& alignment, Graph& g,
                             vector<Alignment>& alt_alignments, int64_t max_multi_alns,
                             int64_t band_padding, bool permissive_banding = false,
-                            bool adjust_for_base_quality = false);
+                            bool adjust_for_base_quality = false,
+                            BandedAlignmentWorkspace* workspace = nullptr);
         
         ~BandedGlobalAligner();
         
@@ -83,6 +140,10 @@ namespace vg {
         void align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
         // these are not IntType so that they can interact well with Aligner
         
+        // fill the interior of the DP matrices with SIMD instructions (AVX2 if the CPU has it,
+        // SSE4.1 if not) when IntType is int8_t or int16_t, instead of the scalar reference code
+        bool vectorize = true;
+        
         
     private:
         
@@ -101,32 +162,65 @@ namespace vg {
         // perform quality adjusted alignments
         bool adjust_for_base_quality;
         
-        vector<BAMatrix*> banded_matrices;
-        
-        unordered_map<int64_t, int64_t> node_id_to_idx;
-        vector<Node*> topological_order;
-        unordered_set<Node*> source_nodes;
-        unordered_set<Node*> sink_nodes;
+        // where the matrices are allocated, which is own_workspace unless one was provided
+        BandedAlignmentWorkspace own_workspace;
+        BandedAlignmentWorkspace* workspace;
+        
+        // the edges into or out of each node, as the indexes of the nodes at their other ends, in
+        // arrays from the workspace
+        class NodeEdges {
+        public:
+            // node i's edges are targets[starts[i]] up to targets[starts[i + 1]]
+            int64_t* starts = nullptr;
+            int64_t* targets = nullptr;
+            
+            struct Range {
+                const int64_t* first;
+                const int64_t* last;
+                const int64_t* begin() const { return first; }
+                const int64_t* end() const { return last; }
+                size_t size() const { return last - first; }
+                bool empty() const { return first == last; }
+                int64_t operator[](size_t i) const { return first[i]; }
+            };
+            Range operator[](int64_t i) const { return Range{targets + starts[i], targets + starts[i + 1]}; }
+        };
+        
+        // all of the arrays below come out of the workspace, and have an entry for each node
+        // (except the source and sink lists)
+        int64_t num_nodes = 0;
+        BAMatrix** banded_matrices = nullptr;
+        
+        // (node id, node index) pairs, sorted by id
+        pair<int64_t, int64_t>* node_id_to_idx = nullptr;
+        Node** topological_order = nullptr;
+        Node** source_nodes = nullptr;
+        int64_t num_source_nodes = 0;
+        Node** sink_nodes = nullptr;
+        int64_t num_sink_nodes = 0;
         
         // internal constructor that the others funnel into
         BandedGlobalAligner(Alignment& alignment, Graph& g,
                             vector<Alignment>* alt_alignments, int64_t max_multi_alns,
+                            BandedAlignmentWorkspace* workspace,
                             int64_t band_padding, bool permissive_banding = false,
                             bool adjust_for_base_quality = false);
         
         // traceback an alignment
         void traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, IntType min_inf);
         
-        // construction functions
-        void graph_edge_lists(Graph& g, bool outgoing_edges, vector<vector<int64_t>>& out_edge_list);
-        void topological_sort(Graph& g, vector<vector<int64_t>>& node_edges_out, vector<Node*>& out_topological_order);
-        void path_lengths_to_sinks(const string& read, vector<vector<int64_t>>& node_edges_in,
-                                   vector<int64_t>& shortest_path_to_sink, vector<int64_t>& longest_path_to_sink);
-        void find_banded_paths(const string& read, bool permissive_banding, vector<vector<int64_t>>& node_edges_in,
-                               vector<vector<int64_t>>& node_edges_out, int64_t band_padding,
-                               vector<bool>& node_masked, vector<pair<int64_t, int64_t>>& band_ends);
-        void shortest_seq_paths(vector<vector<int64_t>>& node_edges_out, vector<int64_t>& seq_lens_out,
-                                unordered_set<Node*> source_nodes);
+        // the index of the node with this id in the graph
+        int64_t node_index(int64_t node_id) const;
+        
+        // construction functions, which fill arrays with an entry for each node
+        void graph_edge_lists(Graph& g, bool outgoing_edges, NodeEdges& out_edge_list);
+        void topological_sort(Graph& g, const NodeEdges& node_edges_out, Node** out_topological_order);
+        void path_lengths_to_sinks(const string& read, const NodeEdges& node_edges_in,
+                                   int64_t* shortest_path_to_sink, int64_t* longest_path_to_sink);
+        void find_banded_paths(const string& read, bool permissive_banding, const NodeEdges& node_edges_in,
+                               const NodeEdges& node_edges_out, int64_t band_padding,
+                               bool* node_masked, pair<int64_t, int64_t>* band_ends);
+        void shortest_seq_paths(const NodeEdges& node_edges_out, int64_t* seq_lens_out);
     };
 
     // the band from the DP matrix for one node in the graph
@@ -143,6 +237,9 @@ namespace vg {
         
         Alignment& alignment;
         
+        // where the matrices are allocated
+        BandedAlignmentWorkspace& workspace;
+        
         // length of shortest sequence leading to matrix from a source node
         int64_t cumulative_seq_len;
         
@@ -162,13 +259,14 @@ namespace vg {
         void print_band(matrix_t which_mat);
         
     public:
-        BAMatrix(Alignment& alignment, Node* node, int64_t top_diag, int64_t bottom_diag,
-                 BAMatrix** seeds, int64_t num_seeds, int64_t cumulative_seq_len);
+        BAMatrix(Alignment& alignment, BandedAlignmentWorkspace& workspace, Node* node, int64_t top_diag,
+                 int64_t bottom_diag, BAMatrix** seeds, int64_t num_seeds, int64_t cumulative_seq_len);
         ~BAMatrix();
         
-        // use DP to fill the band with alignment scores
+        // use DP to fill the band with alignment scores, vectorizing the interior of the band if
+        // given the nt codes of the read
         void fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
-                         IntType min_inf);
+                         IntType min_inf, const int8_t* read_codes = nullptr);
         
         void traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat, int8_t* score_mat,
                        int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted, IntType min_inf);
@@ -0,0 +1,90 @@
+//
+//  banded_global_aligner_avx2.cpp
+//
+//  Contains the AVX2 kernels for BandedGlobalAligner. This file is compiled with AVX2
+//  enabled, so nothing in it may run unless cpu_has_avx2() says so.
+//
+
+#include <immintrin.h>
+#include "banded_global_aligner_simd.hpp"
+
+namespace vg {
+
+    namespace {
+        
+        // the score of each nt code against the node base, in the low bytes, to look up
+        // with a byte shuffle (nt codes are 0-4)
+        inline __m128i avx2_score_table(const int8_t* s) {
+            if (s == nullptr) {
+                return _mm_setzero_si128();
+            }
+            return _mm_setr_epi8(s[0], s[1], s[2], s[3], s[4], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        }
+        
+        // truncate the lanes to their low bytes with the shuffle and store the 16 bytes
+        // this leaves (byte shuffles stay within each half of the register)
+        inline void avx2_store_truncated(void* p, __m256i v, __m128i shuffle) {
+            __m128i low = _mm_shuffle_epi8(_mm256_castsi256_si128(v), shuffle);
+            __m128i high = _mm_shuffle_epi8(_mm256_extracti128_si256(v, 1), shuffle);
+            _mm_storeu_si128((__m128i*) p, _mm_unpacklo_epi64(low, high));
+        }
+        
+        // int8_t cells in 16-bit lanes
+        struct AVX2Int8 {
+            typedef __m256i vec;
+            typedef __m128i table;
+            static const int64_t width = 16;
+            
+            static inline vec load(const int8_t* p) {
+                return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*) p));
+            }
+            static inline void store(int8_t* p, vec v) {
+                avx2_store_truncated(p, v, _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1));
+            }
+            static inline vec set1(int x) { return _mm256_set1_epi16(x); }
+            static inline vec add(vec a, vec b) { return _mm256_add_epi16(a, b); }
+            static inline vec sub(vec a, vec b) { return _mm256_sub_epi16(a, b); }
+            static inline vec max(vec a, vec b) { return _mm256_max_epi16(a, b); }
+            
+            static inline table score_table(const int8_t* s) { return avx2_score_table(s); }
+            static inline vec lookup_scores(const int8_t* codes, table t) {
+                return _mm256_cvtepi8_epi16(_mm_shuffle_epi8(t, _mm_loadu_si128((const __m128i*) codes)));
+            }
+            static inline vec load_scores(const int8_t* scores) { return load(scores); }
+        };
+        
+        // int16_t cells in 32-bit lanes
+        struct AVX2Int16 {
+            typedef __m256i vec;
+            typedef __m128i table;
+            static const int64_t width = 8;
+            
+            static inline vec load(const int16_t* p) {
+                return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) p));
+            }
+            static inline void store(int16_t* p, vec v) {
+                avx2_store_truncated(p, v, _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1));
+            }
+            static inline vec set1(int x) { return _mm256_set1_epi32(x); }
+            static inline vec add(vec a, vec b) { return _mm256_add_epi32(a, b); }
+            static inline vec sub(vec a, vec b) { return _mm256_sub_epi32(a, b); }
+            static inline vec max(vec a, vec b) { return _mm256_max_epi32(a, b); }
+            
+            static inline table score_table(const int8_t* s) { return avx2_score_table(s); }
+            static inline vec lookup_scores(const int8_t* codes, table t) {
+                return _mm256_cvtepi8_epi32(_mm_shuffle_epi8(t, _mm_loadl_epi64((const __m128i*) codes)));
+            }
+            static inline vec load_scores(const int8_t* scores) {
+                return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*) scores));
+            }
+        };
+    }
+    
+    void fill_banded_column_avx2(const BandedColumn<int8_t>& column) {
+        fill_banded_column_vectorized<AVX2Int8>(column);
+    }
+    
+    void fill_banded_column_avx2(const BandedColumn<int16_t>& column) {
+        fill_banded_column_vectorized<AVX2Int16>(column);
+    }
+}
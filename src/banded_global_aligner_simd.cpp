@@ -0,0 +1,112 @@
+//
+//  banded_global_aligner_simd.cpp
+//
+//  Contains the SSE4.1 kernels for BandedGlobalAligner, and the dispatch between them
+//  and the AVX2 kernels (which are compiled separately, with AVX2 enabled).
+//
+
+#include <string.h>
+#include <smmintrin.h>
+#include "banded_global_aligner_simd.hpp"
+
+namespace vg {
+
+    namespace {
+        
+        // the score of each nt code against the node base, in the low bytes, to look up
+        // with a byte shuffle (nt codes are 0-4)
+        inline __m128i sse41_score_table(const int8_t* s) {
+            if (s == nullptr) {
+                return _mm_setzero_si128();
+            }
+            return _mm_setr_epi8(s[0], s[1], s[2], s[3], s[4], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        }
+        
+        // int8_t cells in 16-bit lanes
+        struct SSE41Int8 {
+            typedef __m128i vec;
+            typedef __m128i table;
+            static const int64_t width = 8;
+            
+            static inline vec load(const int8_t* p) {
+                return _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*) p));
+            }
+            static inline void store(int8_t* p, vec v) {
+                const __m128i low_bytes = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+                _mm_storel_epi64((__m128i*) p, _mm_shuffle_epi8(v, low_bytes));
+            }
+            static inline vec set1(int x) { return _mm_set1_epi16(x); }
+            static inline vec add(vec a, vec b) { return _mm_add_epi16(a, b); }
+            static inline vec sub(vec a, vec b) { return _mm_sub_epi16(a, b); }
+            static inline vec max(vec a, vec b) { return _mm_max_epi16(a, b); }
+            
+            static inline table score_table(const int8_t* s) { return sse41_score_table(s); }
+            static inline vec lookup_scores(const int8_t* codes, table t) {
+                return _mm_cvtepi8_epi16(_mm_shuffle_epi8(t, _mm_loadl_epi64((const __m128i*) codes)));
+            }
+            static inline vec load_scores(const int8_t* scores) { return load(scores); }
+        };
+        
+        // int16_t cells in 32-bit lanes
+        struct SSE41Int16 {
+            typedef __m128i vec;
+            typedef __m128i table;
+            static const int64_t width = 4;
+            
+            static inline vec load(const int16_t* p) {
+                return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*) p));
+            }
+            static inline void store(int16_t* p, vec v) {
+                const __m128i low_halves = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+                _mm_storel_epi64((__m128i*) p, _mm_shuffle_epi8(v, low_halves));
+            }
+            static inline vec set1(int x) { return _mm_set1_epi32(x); }
+            static inline vec add(vec a, vec b) { return _mm_add_epi32(a, b); }
+            static inline vec sub(vec a, vec b) { return _mm_sub_epi32(a, b); }
+            static inline vec max(vec a, vec b) { return _mm_max_epi32(a, b); }
+            
+            static inline table score_table(const int8_t* s) { return sse41_score_table(s); }
+            static inline __m128i load4(const int8_t* p) {
+                int32_t bytes;
+                memcpy(&bytes, p, sizeof(bytes));
+                return _mm_cvtsi32_si128(bytes);
+            }
+            static inline vec lookup_scores(const int8_t* codes, table t) {
+                return _mm_cvtepi8_epi32(_mm_shuffle_epi8(t, load4(codes)));
+            }
+            static inline vec load_scores(const int8_t* scores) { return _mm_cvtepi8_epi32(load4(scores)); }
+        };
+    }
+    
+    bool cpu_has_avx2() {
+        return __builtin_cpu_supports("avx2");
+    }
+    
+    void fill_banded_column_sse41(const BandedColumn<int8_t>& column) {
+        fill_banded_column_vectorized<SSE41Int8>(column);
+    }
+    
+    void fill_banded_column_sse41(const BandedColumn<int16_t>& column) {
+        fill_banded_column_vectorized<SSE41Int16>(column);
+    }
+    
+    void fill_banded_column(const BandedColumn<int8_t>& column) {
+        static const bool avx2 = cpu_has_avx2();
+        if (avx2) {
+            fill_banded_column_avx2(column);
+        }
+        else {
+            fill_banded_column_sse41(column);
+        }
+    }
+    
+    void fill_banded_column(const BandedColumn<int16_t>& column) {
+        static const bool avx2 = cpu_has_avx2();
+        if (avx2) {
+            fill_banded_column_avx2(column);
+        }
+        else {
+            fill_banded_column_sse41(column);
+        }
+    }
+}
@@ -0,0 +1,130 @@
+//
+//  banded_global_aligner_simd.hpp
+//
+//  Contains vectorized kernels for the interior of the dynamic programming matrices
+//  in BandedGlobalAligner.
+//
+
+#ifndef banded_global_aligner_simd_hpp
+#define banded_global_aligner_simd_hpp
+
+#include <stdint.h>
+#include <limits>
+
+using namespace std;
+
+namespace vg {
+
+    // A stretch of rows in one column of a BAMatrix's rectangularized band, which is
+    // contiguous because the band is stored column by column. All of the pointers start
+    // at the first row to fill.
+    template <class IntType>
+    struct BandedColumn {
+        // number of rows to fill
+        int64_t length;
+
+        // the previous column of each matrix, which must have length + 1 rows
+        const IntType* prev_match;
+        const IntType* prev_insert_row;
+        const IntType* prev_insert_col;
+
+        // the match and insert column cells to fill in the current column (the insert
+        // row matrix depends on the rows above it, so it is left to the caller)
+        IntType* match;
+        IntType* insert_col;
+
+        // the score of matching each row's read base to the node base: either the nt
+        // codes of the read with the row of the score matrix for the node base...
+        const int8_t* read_codes;
+        const int8_t* node_scores;
+        // ...or, if node_scores is null, the scores themselves (for quality adjusted
+        // alignment)
+        const int8_t* row_scores;
+
+        IntType gap_open;
+        IntType gap_extend;
+    };
+
+    // fill the rows of the column from begin on with scalar code, which computes the same cells
+    // as BAMatrix::fill_matrix: in a wider type, truncating the result to IntType (static so that
+    // the copy compiled with AVX2 enabled can't be linked in place of the one compiled without it)
+    template <class IntType>
+    static void fill_banded_column_scalar(const BandedColumn<IntType>& column, int64_t begin = 0) {
+        for (int64_t i = begin; i < column.length; i++) {
+            int64_t match_score = column.node_scores ? column.node_scores[column.read_codes[i]]
+                                                     : column.row_scores[i];
+            int64_t diag = column.prev_match[i];
+            diag = column.prev_insert_row[i] > diag ? column.prev_insert_row[i] : diag;
+            diag = column.prev_insert_col[i] > diag ? column.prev_insert_col[i] : diag;
+            column.match[i] = (IntType) (match_score + diag);
+            
+            int64_t left = (int64_t) column.prev_match[i + 1] - column.gap_open;
+            left = (int64_t) column.prev_insert_row[i + 1] - column.gap_open > left ?
+                   (int64_t) column.prev_insert_row[i + 1] - column.gap_open : left;
+            left = (int64_t) column.prev_insert_col[i + 1] - column.gap_extend > left ?
+                   (int64_t) column.prev_insert_col[i + 1] - column.gap_extend : left;
+            column.insert_col[i] = (IntType) left;
+        }
+    }
+
+    // fill the column with the SIMD operations in Ops, finishing the rows that don't make up a
+    // whole vector with scalar code. Ops loads the cells into lanes twice their width and truncates
+    // them on the way back out, so that the kernels match the scalar code exactly, even where the
+    // cells that can't be reached run past the bottom of IntType.
+    template <class Ops, class IntType>
+    static void fill_banded_column_vectorized(const BandedColumn<IntType>& column) {
+        typedef typename Ops::vec vec;
+        vec gap_open = Ops::set1(column.gap_open);
+        vec gap_extend = Ops::set1(column.gap_extend);
+        typename Ops::table node_scores = Ops::score_table(column.node_scores);
+
+        int64_t i = 0;
+        for (; i + Ops::width <= column.length; i += Ops::width) {
+            vec match_score = column.node_scores ? Ops::lookup_scores(column.read_codes + i, node_scores)
+                                                 : Ops::load_scores(column.row_scores + i);
+            vec diag = Ops::max(Ops::max(Ops::load(column.prev_match + i), Ops::load(column.prev_insert_row + i)),
+                                Ops::load(column.prev_insert_col + i));
+            Ops::store(column.match + i, Ops::add(match_score, diag));
+
+            vec left = Ops::max(Ops::max(Ops::sub(Ops::load(column.prev_match + i + 1), gap_open),
+                                         Ops::sub(Ops::load(column.prev_insert_row + i + 1), gap_open)),
+                                Ops::sub(Ops::load(column.prev_insert_col + i + 1), gap_extend));
+            Ops::store(column.insert_col + i, left);
+        }
+        fill_banded_column_scalar(column, i);
+    }
+
+    // can the AVX2 kernels run on this CPU?
+    bool cpu_has_avx2();
+
+    // the kernels for each instruction set
+    void fill_banded_column_sse41(const BandedColumn<int8_t>& column);
+    void fill_banded_column_sse41(const BandedColumn<int16_t>& column);
+    void fill_banded_column_avx2(const BandedColumn<int8_t>& column);
+    void fill_banded_column_avx2(const BandedColumn<int16_t>& column);
+
+    // fill the column with the AVX2 kernel if the CPU has it or the SSE4.1 one if not, or
+    // with scalar code for integer types that have no kernel
+    template <class IntType>
+    void fill_banded_column(const BandedColumn<IntType>& column) {
+        fill_banded_column_scalar(column);
+    }
+    void fill_banded_column(const BandedColumn<int8_t>& column);
+    void fill_banded_column(const BandedColumn<int16_t>& column);
+
+    // does this integer type have a vectorized kernel?
+    template <class IntType>
+    inline bool banded_column_vectorized() {
+        return false;
+    }
+    template <>
+    inline bool banded_column_vectorized<int8_t>() {
+        return true;
+    }
+    template <>
+    inline bool banded_column_vectorized<int16_t>() {
+        return true;
+    }
+}
+
+#endif /* banded_global_aligner_simd_hpp */
@@ -4,7 +4,6 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <regex>
 #include <set>
 #include <utility>
 #include <algorithm>
@@ -14,6 +13,7 @@
 #include "index.hpp"
 #include "Variant.h"
 #include "genotypekit.hpp"
+#include "caller.hpp"
 
 namespace glenn2vcf {
 
@@ -926,183 +926,90 @@ std::string get_pileup_line(const std::map<int64_t, vg::NodePileup>& nodePileups
     std::set<vg::Edge*> knownEdges;
 
 /**
- * Parse tsv into an internal format, where we track status and copy number
- * for nodes and edges.
+ * Load the calls the Caller made into an internal format, where we track status
+ * and copy number for nodes and edges.
  */
-void parse_tsv(const std::string& tsvFile,
-               vg::VG& vg,
-               std::map<vg::Node*, Support>& nodeReadSupport,
-               std::map<vg::Edge*, Support>& edgeReadSupport,
-               std::map<vg::Node*, double>& nodeLikelihood,
-               std::map<vg::Edge*, double>& edgeLikelihood,
-               std::set<vg::Edge*>& deletionEdges,
-               std::map<vg::Node*, std::pair<int64_t, size_t>>& nodeSources,
-               std::set<vg::Node*>& knownNodes,
-               std::set<vg::Edge*>& knownEdges,
-               bool verbose) {
-    
-    // Open up the TSV-file
-    std::stringstream tsvStream(tsvFile);
-
-    // Loop through all the lines
-    std::string line;
-    size_t lineNumber = 0;
-    while(std::getline(tsvStream, line)) {
-        // For each line
+void load_calls(const vg::CallRecords& calls,
+                vg::VG& vg,
+                std::map<vg::Node*, Support>& nodeReadSupport,
+                std::map<vg::Edge*, Support>& edgeReadSupport,
+                std::map<vg::Node*, double>& nodeLikelihood,
+                std::map<vg::Edge*, double>& edgeLikelihood,
+                std::set<vg::Edge*>& deletionEdges,
+                std::map<vg::Node*, std::pair<int64_t, size_t>>& nodeSources,
+                std::set<vg::Node*>& knownNodes,
+                std::set<vg::Edge*>& knownEdges,
+                bool verbose) {
+    
+    for(auto& record : calls.nodes) {
+        if(!vg.has_node(record.node_id)) {
+            throw std::runtime_error("Invalid node in calls: " + std::to_string(record.node_id));
+        }
+        
+        // Retrieve the node we're talking about 
+        vg::Node* nodePointer = vg.get_node(record.node_id);
+        
+#ifdef debug
+        std::cerr << "Node " << record.node_id << " has read support "
+            << record.support.fs << "," << record.support.rs << endl;
+#endif
         
-        lineNumber++;
+        // Save its read support
+        nodeReadSupport[nodePointer] = Support(record.support.fs, record.support.rs);
+        nodeLikelihood[nodePointer] = record.support.likelihood;
         
-        if(line == "") {
-            // Skip blank lines
-            continue;
+        // What kind of call is it? Could be "U"ncalled, or "R"eference
+        // (i.e. known in the original graph), which we have special
+        // handling for.
+        if(record.call == 'R') {
+            // Note that this is a reference node
+            knownNodes.insert(nodePointer);
         }
         
-        // Make a stringstream to read out tokens
-        std::stringstream tokens(line);
+        // Save the original node ID and offset for this node, if present.
+        if(record.orig_id != 0) {
+            nodeSources[nodePointer] = std::make_pair(record.orig_id, (size_t) record.orig_offset);
+        }
+    }
+    
+    for(auto& record : calls.edges) {
+        // Make NodeSides for the edge
+        vg::NodeSide fromSide(record.from, !record.from_start);
+        vg::NodeSide toSide(record.to, record.to_end);
         
-        // Read the kind of line this is ("N"ode or "E"dge)
-        std::string lineType;
-        tokens >> lineType; 
+        if(!vg.has_edge(std::make_pair(fromSide, toSide))) {
+            // Ensure we really have that edge
+            throw std::runtime_error("Edge in calls not in graph: " + std::to_string(record.from) + "," +
+                                     std::to_string(record.from_start) + "," + std::to_string(record.to) +
+                                     "," + std::to_string(record.to_end));
+        }
         
-        if(lineType == "N") {
-            // This is a line about a node
-            
-            // Read the node ID
-            int64_t nodeId;
-            tokens >> nodeId;
-            
-            if(!vg.has_node(nodeId)) {
-                throw std::runtime_error("Line " + std::to_string(lineNumber) + ": Invalid node: " + std::to_string(nodeId));
-            }
-            
-            // Retrieve the node we're talking about 
-            vg::Node* nodePointer = vg.get_node(nodeId);
-            
-            // What kind of call is it? Could be "U"ncalled, or "R"eference
-            // (i.e. known in the original graph), which we have special
-            // handling for.
-            std::string callType;
-            tokens >> callType;
-                        
-            // Read the read support
-            Support readSupport;
-            int other_support = 0;
-            double likelihood = 0.;
-            if((tokens >> readSupport.first) && (tokens >> readSupport.second) &&
-               (tokens >> other_support) && (tokens >> likelihood)) {
-                // For nodes with the number there, actually process the read support
-            
-#ifdef debug
-                std::cerr << "Line " << std::to_string(lineNumber) << ": Node " << nodeId
-                    << " has read support " << readSupport.first << "," << readSupport.second << endl;
-#endif
-                
-                // Save it
-                nodeReadSupport[nodePointer] = readSupport;
-                nodeLikelihood[nodePointer] = likelihood;
-                
-                if(callType == "R") {
-                    // Note that this is a reference node
-                    knownNodes.insert(nodePointer);
-                }
-            }
-            
-            // Load the original node ID and offset for this node, if present.
-            int64_t originalId;
-            size_t originalOffset;
-            
-            if(tokens >> originalId && tokens >> originalOffset && originalId != 0) {
-                nodeSources[nodePointer] = std::make_pair(originalId, originalOffset);
-            }
-            
-        } else if(lineType == "E") {
+        // Get the edge
+        vg::Edge* edgePointer = vg.get_edge(std::make_pair(fromSide, toSide));
         
-            // Read the edge data
-            std::string edgeDescription;
-            tokens >> edgeDescription;
-            
-            // Split on commas. We'd just iterate the regex iterator ourselves,
-            // but it seems to only split on the first comma if we do that.
-            std::vector<string> parts;
-            std::regex comma_re(",");
-            std::copy(std::sregex_token_iterator(edgeDescription.begin(), edgeDescription.end(), comma_re, -1), std::sregex_token_iterator(), std::back_inserter(parts));
-            
-            // We need the four fields to describe an edge.
-            assert(parts.size() == 4);
-            
-            // Parse the from node
-            int64_t from = std::stoll(parts[0]);
-            // And the from_start flag
-            bool fromStart = std::stoi(parts[1]);
-            // Make a NodeSide for the from side
-            vg::NodeSide fromSide(from, !fromStart);
-            // Parse the to node
-            int64_t to = std::stoll(parts[2]);
-            // And the to_end flag
-            bool toEnd = std::stoi(parts[3]);
-            // Make a NodeSide for the to side
-            vg::NodeSide toSide(to, toEnd);
-            
-            if(!vg.has_edge(std::make_pair(fromSide, toSide))) {
-                // Ensure we really have that edge
-                throw std::runtime_error("Line " + std::to_string(lineNumber) + ": Edge " + edgeDescription + " not in graph.");
+        if(record.call == 'L' || record.call == 'R') {
+            // This is a deletion edge, or an edge in the primary path that
+            // may describe a nonzero-length deletion.
+            deletionEdges.insert(edgePointer);
+            
+            if(record.call == 'R') {
+                // The reference edges also get marked as such
+                knownEdges.insert(edgePointer);
             }
-            
-            // Get the edge
-            vg::Edge* edgePointer = vg.get_edge(std::make_pair(fromSide, toSide));
-            
-            // Parse the mode
-            std::string mode;
-            tokens >> mode;
-            
-            if(mode == "L" || mode == "R") {
-                // This is a deletion edge, or an edge in the primary path that
-                // may describe a nonzero-length deletion.
-#ifdef debug
-                std::cerr << "Line " << std::to_string(lineNumber) << ": Edge "
-                    << edgeDescription << " may describe a deletion." << endl;
-#endif
-
-                // Say it's a deletion
-                deletionEdges.insert(edgePointer);
-                
-                if(mode == "R") {
-                    // The reference edges also get marked as such
-                    knownEdges.insert(edgePointer);
-#ifdef debug
-                    std::cerr << "Line " << std::to_string(lineNumber) << ": Edge "
-                        << edgeDescription << " is reference." << endl;
-#endif
-                }
-
-            }
-            
-            // Read the read support
-            Support readSupport;
-            int other_support;
-            double likelihood;
-            tokens >> readSupport.first;
-            tokens >> readSupport.second;
-            tokens >> other_support;
-            tokens >> likelihood;
-            
+        }
+        
 #ifdef debug
-            std::cerr << "Line " << std::to_string(lineNumber) << ": Edge " << edgeDescription
-                << " has read support " << readSupport.first << "," << readSupport.second << endl;
+        std::cerr << "Edge " << record.from << "," << record.to << " has read support "
+            << record.support.fs << "," << record.support.rs << endl;
 #endif
-                
-            // Save it
-            edgeReadSupport[edgePointer] = readSupport;
-            edgeLikelihood[edgePointer] = likelihood;
-        
-        } else {
-            // This is not a real kind of line
-            throw std::runtime_error("Line " + std::to_string(lineNumber) + ": Unknown line type: " + lineType);
-        }
         
+        // Save its read support
+        edgeReadSupport[edgePointer] = Support(record.support.fs, record.support.rs);
+        edgeLikelihood[edgePointer] = record.support.likelihood;
     }
     if (verbose) {
-        std::cerr << "Loaded " << lineNumber << " lines from tsv buffer" << endl;
+        std::cerr << "Loaded " << calls.nodes.size() << " node calls and " << calls.edges.size()
+                  << " edge calls" << endl;
     }
 }
 
@@ -1113,8 +1020,8 @@ int call2vcf(
 
     // Augmented graph
     vg::VG& vg,
-    // "glennfile" as string (relic from old pipeline)
-    const std::string& glennFile,
+    // The calls made on it
+    const vg::CallRecords& calls,
     // Option variables
     // What's the name of the reference path in the graph?
     std::string refPathName,
@@ -1225,11 +1132,11 @@ int call2vcf(
     std::set<vg::Node*> knownNodes;
     std::set<vg::Edge*> knownEdges;
 
-    // Parse tsv into an internal format, where we track status and copy number
-    // for nodes and edges.
-    parse_tsv(glennFile, vg, nodeReadSupport, edgeReadSupport,
-              nodeLikelihood, edgeLikelihood, deletionEdges,
-              nodeSources, knownNodes, knownEdges, verbose);
+    // Load the calls into an internal format, where we track status and copy
+    // number for nodes and edges.
+    load_calls(calls, vg, nodeReadSupport, edgeReadSupport,
+               nodeLikelihood, edgeLikelihood, deletionEdges,
+               nodeSources, knownNodes, knownEdges, verbose);
 
     // Store support binned along reference path;
     // Last bin extended to include remainder
@@ -22,6 +22,7 @@ const double Caller::Default_min_frac = 0.;
 const double Caller::Default_min_log_likelihood = -5000.0;
 const char Caller::Default_default_quality = 30;
 const double Caller::Default_max_strand_bias = 1;
+const size_t Caller::Default_batch_size = 1024;
 
 Caller::Caller(VG* graph,
                double het_prior,
@@ -47,7 +48,8 @@ Caller::Caller(VG* graph,
     _default_quality(default_quality),
     _max_strand_bias(max_strand_bias),
     _text_calls(text_calls),
-    _bridge_alts(bridge_alts) {
+    _bridge_alts(bridge_alts),
+    _batch_size(Default_batch_size) {
     _max_id = _graph->max_node_id();
     _node_divider._max_id = &_max_id;
 }
@@ -58,6 +60,7 @@ Caller::~Caller() {
 }
 
 void Caller::clear() {
+    _queued_pileups.clear();
     _node_calls.clear();
     _node_supports.clear();
     _insert_calls.clear();
@@ -68,6 +71,7 @@ void Caller::clear() {
     _called_edges.clear();
     _augmented_edges.clear();
     _inserted_nodes.clear();
+    _call_records.clear();
 }
 
 void Caller::write_call_graph(ostream& out, bool json) {
@@ -80,69 +84,121 @@ void Caller::write_call_graph(ostream& out, bool json) {
 }
 
 void Caller::call_node_pileup(const NodePileup& pileup) {
+    call_node_pileup(CompactNodePileup(pileup));
+}
+
+void Caller::call_node_pileup(const CompactNodePileup& pileup) {
+    // keep the nodes in order
+    flush_node_pileups();
+    NodeCalls calls;
+    make_node_calls(pileup, calls);
+    add_node_calls(calls);
+}
+
+void Caller::queue_node_pileup(CompactNodePileup& pileup) {
+    _queued_pileups.push_back(QueuedPileup());
+    swap(_queued_pileups.back().compact, pileup);
+    if (_queued_pileups.size() >= _batch_size) {
+        flush_node_pileups();
+    }
+}
 
-    _node = _graph->get_node(pileup.node_id());
-    assert(_node != NULL);
-    assert(_node->sequence().length() == pileup.base_pileup_size());
+void Caller::queue_node_pileup(NodePileup& pileup) {
+    _queued_pileups.push_back(QueuedPileup());
+    _queued_pileups.back().protobuf.Swap(&pileup);
+    _queued_pileups.back().is_protobuf = true;
+    if (_queued_pileups.size() >= _batch_size) {
+        flush_node_pileups();
+    }
+}
+
+void Caller::flush_node_pileups() {
+    vector<NodeCalls> calls(_queued_pileups.size());
+    // each node is called on its own, so a thread can take any of them
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < _queued_pileups.size(); ++i) {
+        QueuedPileup& queued = _queued_pileups[i];
+        if (queued.is_protobuf) {
+            queued.compact = CompactNodePileup(queued.protobuf);
+        }
+        make_node_calls(queued.compact, calls[i]);
+    }
+    // but they go into the call graph in order, so that it comes out the
+    // same however many threads there are
+    for (auto& node_calls : calls) {
+        add_node_calls(node_calls);
+    }
+    _queued_pileups.clear();
+}
+
+void Caller::make_node_calls(const CompactNodePileup& pileup, NodeCalls& calls) const {
+
+    calls.node = _graph->get_node(pileup.node_id);
+    assert(calls.node != NULL);
+    assert(calls.node->sequence().length() == pileup.base_pileup.size());
     
-    _node_calls.clear();
-    _insert_calls.clear();
     string def_char = "-";
-    _node_calls.assign(_node->sequence().length(), Genotype(def_char, def_char));
-    _insert_calls.assign(_node->sequence().length(), Genotype(def_char, def_char));
-    _node_supports.clear();
-    _node_supports.assign(_node->sequence().length(), make_pair(
-                              StrandSupport(), StrandSupport()));
-    _insert_supports.clear();
-    _insert_supports.assign(_node->sequence().length(), make_pair(
-                                StrandSupport(), StrandSupport()));
+    calls.node_calls.assign(calls.node->sequence().length(), Genotype(def_char, def_char));
+    calls.insert_calls.assign(calls.node->sequence().length(), Genotype(def_char, def_char));
+    calls.node_supports.assign(calls.node->sequence().length(), make_pair(
+                                   StrandSupport(), StrandSupport()));
+    calls.insert_supports.assign(calls.node->sequence().length(), make_pair(
+                                     StrandSupport(), StrandSupport()));
 
     // process each base in pileup individually
     #pragma omp parallel for
-    for (int i = 0; i < pileup.base_pileup_size(); ++i) {
-        int num_inserts = 0;
-        for (auto b : pileup.base_pileup(i).bases()) {
-            if (b == '+') {
-                ++num_inserts;
-            }
-        }
-        int pileup_depth = max(num_inserts, pileup.base_pileup(i).num_bases() - num_inserts);
+    for (int i = 0; i < pileup.base_pileup.size(); ++i) {
+        const CompactBasePileup& bp = pileup.base_pileup[i];
+        int num_inserts = bp.insertions();
+        int pileup_depth = max(num_inserts, (int)bp.depth() - num_inserts);
         if (pileup_depth >= _min_depth && pileup_depth <= _max_depth) {
-            call_base_pileup(pileup, i, false);
-            call_base_pileup(pileup, i, true);
+            call_base_pileup(bp, false, calls.node_calls[i], calls.node_supports[i]);
+            call_base_pileup(bp, true, calls.insert_calls[i], calls.insert_supports[i]);
         }
     }
+}
+
+void Caller::add_node_calls(NodeCalls& calls) {
+    _node = calls.node;
+    swap(_node_calls, calls.node_calls);
+    swap(_node_supports, calls.node_supports);
+    swap(_insert_calls, calls.insert_calls);
+    swap(_insert_supports, calls.insert_supports);
 
     // add nodes and edges created when making calls to the output graph
     // (_side_map gets updated)
-    create_node_calls(pileup);
+    create_node_calls();
 
     _visited_nodes.insert(_node->id());
 }
 
 void Caller::call_edge_pileup(const EdgePileup& pileup) {
-    if (pileup.num_reads() >= _min_depth &&
-        pileup.num_reads() <= _max_depth) {
+    call_edge_pileup(CompactEdgePileup(pileup));
+}
+
+void Caller::call_edge_pileup(const CompactEdgePileup& pileup) {
+    int num_reads = pileup.reads.count();
+    if (num_reads >= _min_depth &&
+        num_reads <= _max_depth) {
 
         // use equivalent logic to SNPs (see base_log_likelihood)
-        double log_likelihood = 0;
-        
-        for (int i = 0; i < pileup.num_reads(); ++i) {
-            char qual = pileup.qualities().length() >= 0 ? pileup.qualities()[i]  : _default_quality;
-            double perr = phred_to_prob(qual);
-            log_likelihood += safe_log(1. - perr);
+        double log_likelihood = pileup.reads.no_quality * safe_log(1. - phred_to_prob(_default_quality));
+        for (auto& bucket : pileup.reads.qualities) {
+            log_likelihood += bucket.second * safe_log(1. - phred_to_prob(bucket.first));
         }
         
-        Edge edge = pileup.edge(); // gcc not happy about passing directly
-        _called_edges[NodeSide::pair_from_edge(edge)] = StrandSupport(
-            pileup.num_forward_reads(),
-            pileup.num_reads() - pileup.num_forward_reads(),
+        _called_edges[NodeSide::pair_from_edge(pileup.edge)] = StrandSupport(
+            pileup.reads.forward,
+            pileup.reads.reverse,
             0,
             log_likelihood);
     }
 }
 
 void Caller::update_call_graph() {
+
+    // call anything still waiting
+    flush_node_pileups();
     
     // if we're leaving uncalled nodes, add'em:
     if (_leave_uncalled) {
@@ -241,15 +297,13 @@ void Caller::update_call_graph() {
     _graph->for_each_edge(map_edge);
     process_augmented_edges(false);
 
-    // write out all the nodes in the divider structure to tsv
-    if (_text_calls != NULL) {
-        write_nd_tsv();
-        // add on the inserted nodes
-        for (auto i : _inserted_nodes) {
-            auto& n = i.second; 
-            write_node_tsv(n.node, 'I', n.sup, n.orig_id, n.orig_offset);
-        }
-    }    
+    // record all the nodes in the divider structure for the vcf conversion
+    record_divider_calls();
+    // add on the inserted nodes
+    for (auto i : _inserted_nodes) {
+        auto& n = i.second; 
+        record_node_call(n.node, 'I', n.sup, n.orig_id, n.orig_offset);
+    }
 }
 
 
@@ -396,9 +450,7 @@ void Caller::create_augmented_edge(Node* node1, int from_offset, bool left_side1
                         // can edges be written more than once with different cats?
                         // if so, first one will prevail. should check if this
                         // can impact vcf converter...
-                        if (_text_calls != NULL) {
-                            write_edge_tsv(edge, cat, edge_support);
-                        }
+                        record_edge_call(edge, cat, edge_support);
                     }
                 }
             }
@@ -406,12 +458,8 @@ void Caller::create_augmented_edge(Node* node1, int from_offset, bool left_side1
     }
 }
 
-void Caller::call_base_pileup(const NodePileup& np, int64_t offset, bool insertion) {
-    const BasePileup& bp = np.base_pileup(offset);
-
-    // parse the pilueup structure
-    vector<pair<int64_t, int64_t> > base_offsets;
-    Pileups::parse_base_offsets(bp, base_offsets);
+void Caller::call_base_pileup(const CompactBasePileup& bp, bool insertion, Genotype& base_call,
+                              pair<StrandSupport, StrandSupport>& support) const {
 
     // compute top two most frequent bases and their counts
     string top_base;
@@ -421,24 +469,20 @@ void Caller::call_base_pileup(const NodePileup& np, int64_t offset, bool inserti
     int second_count;
     int second_rev_count;
     int total_count;
-    compute_top_frequencies(bp, base_offsets, top_base, top_count, top_rev_count,
+    compute_top_frequencies(bp, top_base, top_count, top_rev_count,
                             second_base, second_count, second_rev_count, total_count,
                             insertion);
 
     // note first and second base will be upper case too
-    string ref_base = string(1, ::toupper(bp.ref_base()));
+    string ref_base = string(1, ::toupper(bp.ref_base));
 
     // compute threshold
-    int min_support = max(int(_min_frac * (double)max(total_count, bp.num_bases() - total_count)), _min_support);
+    int min_support = max(int(_min_frac * (double)max(total_count, (int)bp.depth() - total_count)), _min_support);
 
     // compute strand bias
     double top_sb = top_count > 0 ? abs(0.5 - (double)top_rev_count / (double)top_count) : 0;
     double second_sb = second_count > 0 ? abs(0.5 - (double)second_rev_count / (double)second_count) : 0;
 
-    // get references to node-level members we want to update
-    Genotype& base_call = insertion ? _insert_calls[offset] : _node_calls[offset];
-    pair<StrandSupport, StrandSupport>& support = insertion ? _insert_supports[offset] : _node_supports[offset];
-
     // we create augmented structures for anything that passes the above support and
     // strand bias filters (note, these should be minimal, with decisions being
     // pushed back to vcf export)
@@ -450,7 +494,7 @@ void Caller::call_base_pileup(const NodePileup& np, int64_t offset, bool inserti
         support.first.fs = top_count - top_rev_count;
         support.first.rs = top_rev_count;
         string alt_base = second_passes ? second_base : "";
-        auto ld =  base_log_likelihood(bp, base_offsets, top_base, top_base, alt_base);
+        auto ld =  base_log_likelihood(bp, top_base, top_base, alt_base);
         support.first.likelihood = ld.first;
         support.first.os = max(0, ld.second - top_count);
     }
@@ -459,65 +503,20 @@ void Caller::call_base_pileup(const NodePileup& np, int64_t offset, bool inserti
         support.second.fs = second_count - second_rev_count;
         support.second.rs = second_rev_count;
         string alt_base = first_passes ? top_base : "";
-        auto ld = base_log_likelihood(bp, base_offsets, second_base, second_base, alt_base);
+        auto ld = base_log_likelihood(bp, second_base, second_base, alt_base);
         support.second.likelihood = ld.first;
         support.second.os = max(0, ld.second - second_count);
     }
 }
 
-void Caller::compute_top_frequencies(const BasePileup& bp,
-                                     const vector<pair<int64_t, int64_t> >& base_offsets,
+void Caller::compute_top_frequencies(const CompactBasePileup& bp,
                                      string& top_base, int& top_count, int& top_rev_count,
                                      string& second_base, int& second_count, int& second_rev_count,
-                                     int& total_count, bool inserts) {
-
-    // histogram of pileup entries (base, indel)
-    unordered_map<string, int> hist;
-    // same thing but just reverse strand (used for strand bias filter)
-    unordered_map<string, int> rev_hist;
+                                     int& total_count, bool inserts) const {
 
     total_count = 0;
-    const string& bases = bp.bases();
-    string ref_base = string(1, ::toupper(bp.ref_base()));
+    string ref_base = string(1, ::toupper(bp.ref_base));
     
-    // compute histogram from pileup
-    for (auto i : base_offsets) {
-        string val = Pileups::extract(bp, i.first);
-
-        if ((inserts && val[0] != '+') || (!inserts && val[0] == '+')) {
-            // toggle inserts
-            continue;
-        }
-        ++total_count;
-        
-        // val will always be uppcase / forward strand.  we check
-        // the original pileup to see if reversed
-        bool reverse = bases[i.first] == ',' ||
-            (bases[i.first] == '+' && ::islower(bases[i.first + val.length() - 1])) ||
-            (bases[i.first] != '-' && ::islower(bases[i.first]));
-        if (bases[i.first] == '-') {
-            string tok = Pileups::extract(bp, i.first);
-            bool is_reverse, from_start, to_end;
-            int64_t from_id, from_offset, to_id, to_offset;
-            Pileups::parse_delete(tok, is_reverse, from_id, from_offset, from_start, to_id, to_offset, to_end);
-            reverse = is_reverse;
-            // reset reverse to forward
-            if (is_reverse) {
-                Pileups::make_delete(val, false, from_id, from_offset, from_start, to_id, to_offset, to_end);
-            }
-        }
-
-        if (hist.find(val) == hist.end()) {
-            hist[val] = 0;
-            rev_hist[val] = 0;
-        }
-        ++hist[val];
-
-        if (reverse) {
-            ++rev_hist[val];
-        }
-    }
-
     // tie-breaker heuristic:
     // reference > transition > transversion > delete > insert > N
     function<int(const string&)> base_priority = [&ref_base](const string& base) {
@@ -559,90 +558,76 @@ void Caller::compute_top_frequencies(const BasePileup& bp,
         return count1 > count2;
     };
         
-    // find highest occurring string
+    // find the two highest occurring strings in one pass over the counts
+    // (the alleles are always upper case / forward strand)
     top_base.clear();
     top_count = 0;
-    for (auto i : hist) {
-        if (base_greater(i.first, i.second, top_base, top_count)) {
-            top_base = i.first;
-            top_count = i.second;
-        }
-    }
-
-    // find second highest occurring string
-    // todo: do it in same pass as above
+    top_rev_count = 0;
     second_base.clear();
     second_count = 0;
-    for (auto i : hist) {
-        if (i.first != top_base &&
-            base_greater(i.first, i.second, second_base, second_count)) {
-            second_base = i.first;
-            second_count = i.second;
-        }
-    }
+    second_rev_count = 0;
+    bp.for_each_allele([&](const string& val, const AlleleSupport& support) {
+            if ((inserts && val[0] != '+') || (!inserts && val[0] == '+')) {
+                // toggle inserts
+                return;
+            }
+            int count = support.count();
+            total_count += count;
+            if (base_greater(val, count, top_base, top_count)) {
+                second_base = top_base;
+                second_count = top_count;
+                second_rev_count = top_rev_count;
+                top_base = val;
+                top_count = count;
+                top_rev_count = support.reverse;
+            } else if (base_greater(val, count, second_base, second_count)) {
+                second_base = val;
+                second_count = count;
+                second_rev_count = support.reverse;
+            }
+        });
     assert(top_base == "" || top_base != second_base);
-    top_rev_count = rev_hist[top_base];
-    second_rev_count = rev_hist[second_base];
 }
 
-pair<double, int> Caller::base_log_likelihood(const BasePileup& bp,
-                                              const vector<pair<int64_t, int64_t> >& base_offsets,
-                                              const string& val, const string& first, const string& second) {
+pair<double, int> Caller::base_log_likelihood(const CompactBasePileup& bp,
+                                              const string& val, const string& first, const string& second) const {
     double log_likelihood = 0;
 
-    const string& bases = bp.bases();
-    const string& quals = bp.qualities();
-    double perr;
     // inserts are treated completely seprately.  toggle here:
     bool insert = first[0] == '+';
     assert(!insert || second.empty() || second[0] == '+');
     double depth = 0;
 
-    for (int i = 0; i < base_offsets.size(); ++i) {
-        string base = Pileups::extract(bp, base_offsets[i].first);
-        bool base_insert = base[0] == '+';
-        if (base_insert == insert) {
-
-            // make sure deletes always compared without is_reverse flag
-            if (base.length() > 1 && base[0] == '-') {
-                bool is_reverse, from_start, to_end;
-                int64_t from_id, from_offset, to_id, to_offset;
-                Pileups::parse_delete(base, is_reverse, from_id, from_offset, from_start, to_id, to_offset, to_end);
-                // reset reverse to forward
-                if (is_reverse) {
-                    Pileups::make_delete(base, false, from_id, from_offset, from_start, to_id, to_offset, to_end);
-                }
-            }
-
-            char qual = base_offsets[i].second >= 0 ? quals[base_offsets[i].second] : _default_quality;
-            perr = phred_to_prob(qual);
-
-            double log_prob;
-            if (!second.empty() && base == second) {
+    bp.for_each_allele([&](const string& base, const AlleleSupport& support) {
+            bool base_insert = base[0] == '+';
+            if (base_insert != insert || (!second.empty() && base == second)) {
                 // we pretend second base is in another pileup
-                log_prob = 0.;
-            } else {
-                // X 0.2 reflect probability of hitting correct base by change in event of an error
-                // 1 / |A+C+G+T+Delete|
-                log_prob = safe_log(base == val ? (1. - perr) + perr * 0.2 : perr * 0.2);
-                depth += 1;
-                if (!second.empty() && base != first) {
-                    // we pretend anything not first or second base is split
-                    // across two pileups by square rooting the probability. 
-                    log_prob *= 0.5;
-                    depth -= 0.5;
-                }
+                return;
             }
-
-            log_likelihood += log_prob;
-        }
-    }
+            // X 0.2 reflect probability of hitting correct base by change in event of an error
+            // 1 / |A+C+G+T+Delete|
+            // we pretend anything not first or second base is split
+            // across two pileups by square rooting the probability. 
+            bool split = !second.empty() && base != first;
+            auto quality_log_prob = [&](char qual) {
+                double perr = phred_to_prob(qual);
+                double log_prob = safe_log(base == val ? (1. - perr) + perr * 0.2 : perr * 0.2);
+                return split ? log_prob * 0.5 : log_prob;
+            };
+            // deletes are always compared without is_reverse flag, as the
+            // compact pileup keeps them
+            for (auto& bucket : support.qualities) {
+                log_likelihood += bucket.second * quality_log_prob(bucket.first);
+            }
+            log_likelihood += support.no_quality * quality_log_prob(_default_quality);
+            depth += (split ? 0.5 : 1.) * support.count();
+        });
 
     return make_pair(log_likelihood, (int)depth);
 }
 
 // please refactor me! 
-void Caller::create_node_calls(const NodePileup& np) {
+void Caller::create_node_calls() {
     
     int n = _node->sequence().length();
     const string& seq = _node->sequence();
@@ -858,22 +843,24 @@ void Caller::create_node_calls(const NodePileup& np) {
     }
 }
 
-void Caller::write_node_tsv(Node* node, char call, StrandSupport support, int64_t orig_id, int orig_offset)
+void Caller::record_node_call(Node* node, char call, StrandSupport support, int64_t orig_id, int orig_offset)
 {
-    *_text_calls << "N\t" << node->id() << "\t" << call << "\t" << support.fs << "\t"
-                 << support.rs << "\t" << support.os << "\t" << support.likelihood << "\t"
-                 << orig_id << "\t" << orig_offset << endl;
+    _call_records.nodes.push_back(NodeCallRecord{node->id(), call, support, orig_id, orig_offset});
+    if (_text_calls != NULL) {
+        _call_records.nodes.back().write_tsv(*_text_calls);
+    }
 }
 
-void Caller::write_edge_tsv(Edge* edge, char call, StrandSupport support)
+void Caller::record_edge_call(Edge* edge, char call, StrandSupport support)
 {
-    *_text_calls << "E\t" << edge->from() << "," << edge->from_start() << "," 
-                 << edge->to() << "," << edge->to_end() << "\t" << call << "\t" << support.fs
-                 << "\t" << support.rs << "\t" << support.os << "\t" << support.likelihood
-                 << "\t.\t." << endl;
+    _call_records.edges.push_back(EdgeCallRecord{edge->from(), edge->from_start(), edge->to(), edge->to_end(),
+                                                 call, support});
+    if (_text_calls != NULL) {
+        _call_records.edges.back().write_tsv(*_text_calls);
+    }
 }
 
-void Caller::write_nd_tsv()
+void Caller::record_divider_calls()
 {
     for (auto& i : _node_divider.index) {
         int64_t orig_node_id = i.first;
@@ -881,17 +868,35 @@ void Caller::write_nd_tsv()
             int64_t orig_node_offset = j.first;
             NodeDivider::Entry& entry = j.second;
             char call = entry.sup_ref.empty() || avgSup(entry.sup_ref) == StrandSupport() ? 'U' : 'R';
-            write_node_tsv(entry.ref, call, avgSup(entry.sup_ref), orig_node_id, orig_node_offset);
+            record_node_call(entry.ref, call, avgSup(entry.sup_ref), orig_node_id, orig_node_offset);
             if (entry.alt1 != NULL) {
-                write_node_tsv(entry.alt1, 'S', avgSup(entry.sup_alt1), orig_node_id, orig_node_offset);
+                record_node_call(entry.alt1, 'S', avgSup(entry.sup_alt1), orig_node_id, orig_node_offset);
             }
             if (entry.alt2 != NULL) {
-                write_node_tsv(entry.alt2, 'S', avgSup(entry.sup_alt2), orig_node_id, orig_node_offset);
+                record_node_call(entry.alt2, 'S', avgSup(entry.sup_alt2), orig_node_id, orig_node_offset);
             }
         }
     }
 }
 
+void NodeCallRecord::write_tsv(ostream& out) const {
+    out << "N\t" << node_id << "\t" << call << "\t" << support.fs << "\t"
+        << support.rs << "\t" << support.os << "\t" << support.likelihood << "\t"
+        << orig_id << "\t" << orig_offset << endl;
+}
+
+void EdgeCallRecord::write_tsv(ostream& out) const {
+    out << "E\t" << from << "," << from_start << "," 
+        << to << "," << to_end << "\t" << call << "\t" << support.fs
+        << "\t" << support.rs << "\t" << support.os << "\t" << support.likelihood
+        << "\t.\t." << endl;
+}
+
+void CallRecords::clear() {
+    nodes.clear();
+    edges.clear();
+}
+
 void NodeDivider::add_fragment(const Node* orig_node, int offset, Node* fragment,
                                EntryCat cat, vector<StrandSupport> sup) {
     
@@ -13,6 +13,7 @@
 #include "hash_map.hpp"
 #include "utility.hpp"
 #include "pileup.hpp"
+#include "compact_pileup.hpp"
 
 namespace vg {
 
@@ -130,6 +131,42 @@ struct NodeDivider {
 ostream& operator<<(ostream& os, const NodeDivider::NodeMap& nm);
 ostream& operator<<(ostream& os, NodeDivider::Entry entry);
 
+// A call on a node of the augmented graph, for the vcf conversion. These
+// used to be passed along as lines of a tsv ("glennfile"), which is still
+// written out for debugging.
+struct NodeCallRecord {
+    int64_t node_id;
+    // U: uncalled, R: reference, S: snp, I: insert
+    char call;
+    StrandSupport support;
+    // where the node came from in the original graph (id 0 if nowhere)
+    int64_t orig_id;
+    int orig_offset;
+
+    void write_tsv(ostream& out) const;
+};
+
+// A call on an edge of the augmented graph
+struct EdgeCallRecord {
+    int64_t from;
+    bool from_start;
+    int64_t to;
+    bool to_end;
+    // U: uncalled, R: reference, S: snp, I: insert, L: deletion
+    char call;
+    StrandSupport support;
+
+    void write_tsv(ostream& out) const;
+};
+
+// Every call made on an augmented graph, in the order they were made
+struct CallRecords {
+    vector<NodeCallRecord> nodes;
+    vector<EdgeCallRecord> edges;
+
+    void clear();
+};
+
 // Super simple variant caller, for now written to get bakeoff evaluation bootstrapped.
 // Idea: Idependently process Pileup records, using simple model to make calls that
 //       take into account read errors with diploid assumption.  Edges and node positions
@@ -159,6 +196,8 @@ public:
     static const char Default_default_quality;
     // use to balance alignments to forward and reverse strand
     static const double Default_max_strand_bias;
+    // number of node pileups to call at once across threads
+    static const size_t Default_batch_size;
     
     Caller(VG* graph,
            double het_prior = Default_het_prior,
@@ -179,7 +218,9 @@ public:
     VG* _graph;
     // output called graph
     VG _call_graph;
-    // optional text file of calls
+    // the calls made on the call graph, for the vcf conversion
+    CallRecords _call_records;
+    // optional text file of calls (for debugging)
     ostream* _text_calls;
 
     // buffer for base calls for each position in the node
@@ -255,15 +296,51 @@ public:
     // (default to latter as most haplotypes rarely contain
     // pairs of consecutive alts). 
     bool _bridge_alts;
+    // a node pileup waiting to be called, in the format it came in
+    struct QueuedPileup {
+        bool is_protobuf = false;
+        NodePileup protobuf;
+        CompactNodePileup compact;
+    };
+    // node pileups waiting to be called together
+    vector<QueuedPileup> _queued_pileups;
+    // how many to queue before calling them
+    size_t _batch_size;
+
+    // the calls for every position of a node, and for the insertions just
+    // after each, before they are added to the call graph
+    struct NodeCalls {
+        const Node* node;
+        vector<Genotype> node_calls;
+        vector<pair<StrandSupport, StrandSupport> > node_supports;
+        vector<Genotype> insert_calls;
+        vector<pair<StrandSupport, StrandSupport> > insert_supports;
+    };
 
     // write the call graph
     void write_call_graph(ostream& out, bool json);
 
     // call every position in the node pileup
     void call_node_pileup(const NodePileup& pileup);
+    void call_node_pileup(const CompactNodePileup& pileup);
+
+    // take the node pileup (leaving it empty) to call along with others
+    // once there are enough of them to go around all the threads.  they go
+    // into the call graph in the order they were queued.
+    void queue_node_pileup(CompactNodePileup& pileup);
+    void queue_node_pileup(NodePileup& pileup);
+    // call the queued node pileups now
+    void flush_node_pileups();
+
+    // make the calls for a node pileup without changing the call graph, so
+    // that many can be made at once
+    void make_node_calls(const CompactNodePileup& pileup, NodeCalls& calls) const;
+    // add a node's calls to the call graph (taking the contents of calls)
+    void add_node_calls(NodeCalls& calls);
 
     // call an edge.  remembering it in a table for the whole graph
     void call_edge_pileup(const EdgePileup& pileup);
+    void call_edge_pileup(const CompactEdgePileup& pileup);
 
     // fill in edges in the call graph (those that are incident to 2 call nodes)
     // and add uncalled nodes (optionally)
@@ -276,16 +353,16 @@ public:
     
     // call position at given base
     // if insertion flag set to true, call insertion between base and next base
-    void call_base_pileup(const NodePileup& np, int64_t offset, bool insertions);
+    void call_base_pileup(const CompactBasePileup& bp, bool insertion, Genotype& base_call,
+                          pair<StrandSupport, StrandSupport>& support) const;
     
     // Find the top-two bases in a pileup, along with their counts
     // Last param toggles whether we consider only inserts or everything else
     // (do not compare all at once since inserts do not have reference coordinates)
-    void compute_top_frequencies(const BasePileup& bp,
-                                 const vector<pair<int64_t, int64_t> >& base_offsets,
+    void compute_top_frequencies(const CompactBasePileup& bp,
                                  string& top_base, int& top_count, int& top_rev_count,
                                  string& second_base, int& second_count, int& second_rev_count,
-                                 int& total_count, bool inserts);
+                                 int& total_count, bool inserts) const;
     
     // compute a likelihood from the pileup qualities
     // "first" and "second" are used to virtually split the pileup across two nodes:
@@ -294,22 +371,21 @@ public:
     // all otherse are squarerooted (to split their probabilities evenly between the two virtual pileups)
     // returns pair of (likelihood, effective depth), where the effective depth is the number
     // of pileup entries that were considered in computing the likelihood
-    pair<double, int> base_log_likelihood(const BasePileup& pb,
-                                             const vector<pair<int64_t, int64_t> >& base_offsets,
-                                             const string& val, const string& first, const string& second);
+    pair<double, int> base_log_likelihood(const CompactBasePileup& pb,
+                                             const string& val, const string& first, const string& second) const;
 
     // write graph structure corresponding to all the calls for the current
     // node.  
-    void create_node_calls(const NodePileup& np);
+    void create_node_calls();
 
     void create_augmented_edge(Node* node1, int from_offset, bool left_side1, bool aug1,
                                Node* node2, int to_offset, bool left_side2, bool aug2, char cat,
                                StrandSupport support);
 
-    // write calling info to tsv to help with VCF conversion
-    void write_node_tsv(Node* node, char call, StrandSupport support, int64_t orig_id, int orig_offset);
-    void write_edge_tsv(Edge* edge, char call, StrandSupport support);
-    void write_nd_tsv();
+    // record calling info to help with VCF conversion
+    void record_node_call(Node* node, char call, StrandSupport support, int64_t orig_id, int orig_offset);
+    void record_edge_call(Edge* edge, char call, StrandSupport support);
+    void record_divider_calls();
 
     // log function that tries to avoid 0s
     static double safe_log(double v) {
@@ -347,8 +423,8 @@ namespace glenn2vcf {
 int call2vcf(
     // Augmented graph
     vg::VG& vg,
-    // "glennfile" as string (relic from old pipeline)
-    const string& glennfile,
+    // The calls made on it
+    const vg::CallRecords& calls,
     // Option variables
     // What's the name of the reference path in the graph?
     string refPathName,
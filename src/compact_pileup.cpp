@@ -0,0 +1,491 @@
+#include "compact_pileup.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include "pileup.hpp"
+
+namespace vg {
+
+using namespace std;
+using namespace google::protobuf::io;
+
+const string CompactBasePileup::BASES = "ACGTN";
+
+const string CompactPileups::MAGIC = "VGCP\x01";
+
+// record types in the stream
+static const uint32_t NODE_RECORD = 1;
+static const uint32_t EDGE_RECORD = 2;
+
+void AlleleSupport::add(bool is_reverse, bool has_quality, char quality) {
+    ++(is_reverse ? reverse : forward);
+    if (!has_quality) {
+        ++no_quality;
+        return;
+    }
+    auto bucket = lower_bound(qualities.begin(), qualities.end(), make_pair(quality, (uint32_t)0));
+    if (bucket != qualities.end() && bucket->first == quality) {
+        ++bucket->second;
+    } else {
+        qualities.insert(bucket, make_pair(quality, (uint32_t)1));
+    }
+}
+
+void AlleleSupport::merge(const AlleleSupport& other) {
+    forward += other.forward;
+    reverse += other.reverse;
+    no_quality += other.no_quality;
+    vector<pair<char, uint32_t>> merged;
+    merged.reserve(qualities.size() + other.qualities.size());
+    auto a = qualities.begin();
+    auto b = other.qualities.begin();
+    while (a != qualities.end() || b != other.qualities.end()) {
+        if (b == other.qualities.end() || (a != qualities.end() && a->first < b->first)) {
+            merged.push_back(*a++);
+        } else if (a == qualities.end() || b->first < a->first) {
+            merged.push_back(*b++);
+        } else {
+            merged.push_back(make_pair(a->first, a->second + b->second));
+            ++a;
+            ++b;
+        }
+    }
+    qualities = move(merged);
+}
+
+// just n of the observations: the strands in proportion, and the best
+// qualities, from the top of the histogram down, with those without any last
+static AlleleSupport take_observations(const AlleleSupport& support, uint32_t n) {
+    AlleleSupport taken;
+    if (n >= support.count()) {
+        return support;
+    }
+    taken.forward = (uint64_t)support.forward * n / support.count();
+    taken.reverse = n - taken.forward;
+    uint32_t left = n;
+    for (auto bucket = support.qualities.rbegin(); bucket != support.qualities.rend() && left > 0; ++bucket) {
+        taken.qualities.push_back(make_pair(bucket->first, min(bucket->second, left)));
+        left -= taken.qualities.back().second;
+    }
+    // back in order of quality
+    reverse(taken.qualities.begin(), taken.qualities.end());
+    taken.no_quality = left;
+    return taken;
+}
+
+uint32_t CompactBasePileup::depth() const {
+    uint32_t depth = 0;
+    for (auto& support : bases) {
+        depth += support.count();
+    }
+    for (auto& indel : indels) {
+        depth += indel.second.count();
+    }
+    return depth;
+}
+
+uint32_t CompactBasePileup::insertions() const {
+    uint32_t count = 0;
+    for (auto& indel : indels) {
+        if (indel.first[0] == '+') {
+            count += indel.second.count();
+        }
+    }
+    return count;
+}
+
+AlleleSupport& CompactBasePileup::get_create(const string& allele) {
+    if (allele.size() == 1) {
+        size_t i = BASES.find(allele[0]);
+        if (i != string::npos) {
+            return bases[i];
+        }
+    }
+    for (auto& indel : indels) {
+        if (indel.first == allele) {
+            return indel.second;
+        }
+    }
+    indels.push_back(make_pair(allele, AlleleSupport()));
+    return indels.back().second;
+}
+
+void CompactBasePileup::for_each_allele(const function<void(const string&, const AlleleSupport&)>& lambda) const {
+    for (size_t i = 0; i < BASES.size(); ++i) {
+        if (bases[i].count() > 0) {
+            lambda(string(1, BASES[i]), bases[i]);
+        }
+    }
+    for (auto& indel : indels) {
+        if (indel.second.count() > 0) {
+            lambda(indel.first, indel.second);
+        }
+    }
+}
+
+void CompactBasePileup::merge(const CompactBasePileup& other, uint32_t max_depth) {
+    uint32_t current = depth();
+    if (current == 0 && other.ref_base != 0) {
+        ref_base = other.ref_base;
+    }
+    uint32_t room = max_depth > current ? max_depth - current : 0;
+    other.for_each_allele([&](const string& allele, const AlleleSupport& support) {
+            if (room > 0) {
+                AlleleSupport taken = take_observations(support, room);
+                get_create(allele).merge(taken);
+                room -= taken.count();
+            }
+        });
+}
+
+// count up the tokens of a BasePileup, in order, until there are max_depth
+// observations in all
+static void add_base_pileup(CompactBasePileup& to, const BasePileup& from, uint32_t max_depth) {
+    uint32_t depth = to.depth();
+    if (depth == 0) {
+        to.ref_base = from.ref_base();
+    }
+    if (from.bases().empty() || depth >= max_depth) {
+        return;
+    }
+    vector<pair<int64_t, int64_t> > offsets;
+    Pileups::parse_base_offsets(from, offsets);
+    string allele;
+    bool is_reverse;
+    for (auto& offset : offsets) {
+        if (depth >= max_depth) {
+            break;
+        }
+        CompactPileups::parse_token(from, offset.first, allele, is_reverse);
+        bool has_quality = offset.second >= 0;
+        to.get_create(allele).add(is_reverse, has_quality, has_quality ? from.qualities()[offset.second] : 0);
+        ++depth;
+    }
+}
+
+CompactNodePileup::CompactNodePileup(const NodePileup& pileup) :
+    node_id(pileup.node_id()),
+    base_pileup(pileup.base_pileup_size()) {
+    for (size_t i = 0; i < pileup.base_pileup_size(); ++i) {
+        add_base_pileup(base_pileup[i], pileup.base_pileup(i), numeric_limits<uint32_t>::max());
+    }
+}
+
+CompactEdgePileup::CompactEdgePileup(const EdgePileup& pileup) :
+    edge(pileup.edge()) {
+    const string& qualities = pileup.qualities();
+    reads.forward = pileup.num_forward_reads();
+    reads.reverse = pileup.num_reads() - pileup.num_forward_reads();
+    size_t with_quality = min(qualities.size(), (size_t)pileup.num_reads());
+    reads.no_quality = pileup.num_reads() - with_quality;
+    // the strands aren't known read by read, so count up the qualities apart
+    AlleleSupport with;
+    for (size_t i = 0; i < with_quality; ++i) {
+        with.add(false, true, qualities[i]);
+    }
+    reads.qualities = move(with.qualities);
+}
+
+CompactPileups::CompactPileups(CompactPileups&& other) noexcept :
+    _max_depth(other._max_depth) {
+    swap(_node_pileups, other._node_pileups);
+    swap(_edge_pileups, other._edge_pileups);
+}
+
+CompactPileups& CompactPileups::operator=(CompactPileups&& other) noexcept {
+    swap(_node_pileups, other._node_pileups);
+    swap(_edge_pileups, other._edge_pileups);
+    _max_depth = other._max_depth;
+    return *this;
+}
+
+void CompactPileups::clear() {
+    for (auto& p : _node_pileups) {
+        delete p.second;
+    }
+    _node_pileups.clear();
+    for (auto& p : _edge_pileups) {
+        delete p.second;
+    }
+    _edge_pileups.clear();
+}
+
+void CompactPileups::add(const NodePileup& pileup) {
+    CompactNodePileup*& existing = _node_pileups[pileup.node_id()];
+    if (existing == nullptr) {
+        existing = new CompactNodePileup();
+        existing->node_id = pileup.node_id();
+    }
+    if (existing->base_pileup.size() < pileup.base_pileup_size()) {
+        existing->base_pileup.resize(pileup.base_pileup_size());
+    }
+    for (size_t i = 0; i < pileup.base_pileup_size(); ++i) {
+        add_base_pileup(existing->base_pileup[i], pileup.base_pileup(i), _max_depth);
+    }
+}
+
+void CompactPileups::add(const EdgePileup& pileup) {
+    CompactEdgePileup*& existing = _edge_pileups[NodeSide::pair_from_edge(pileup.edge())];
+    if (existing == nullptr) {
+        existing = new CompactEdgePileup();
+        existing->edge = pileup.edge();
+    }
+    // as Pileups::merge_edge_pileups does, take the first reads that fit, and
+    // a proportional share of the forward ones
+    int room = max(0, _max_depth - (int)existing->reads.count());
+    if (pileup.num_reads() <= room) {
+        existing->reads.merge(CompactEdgePileup(pileup).reads);
+    } else if (room > 0) {
+        EdgePileup taken = pileup;
+        taken.set_num_reads(room);
+        taken.set_num_forward_reads(pileup.num_forward_reads() * ((double)room / (double)pileup.num_reads()));
+        if (!pileup.qualities().empty()) {
+            taken.set_qualities(pileup.qualities().substr(0, room));
+        }
+        existing->reads.merge(CompactEdgePileup(taken).reads);
+    }
+}
+
+void CompactPileups::add(const Pileup& pileup) {
+    for (size_t i = 0; i < pileup.node_pileups_size(); ++i) {
+        add(pileup.node_pileups(i));
+    }
+    for (size_t i = 0; i < pileup.edge_pileups_size(); ++i) {
+        add(pileup.edge_pileups(i));
+    }
+}
+
+CompactPileups& CompactPileups::merge(CompactPileups& other) {
+    for (auto& p : other._node_pileups) {
+        CompactNodePileup*& existing = _node_pileups[p.first];
+        if (existing == nullptr) {
+            existing = p.second;
+            continue;
+        }
+        if (existing->base_pileup.size() < p.second->base_pileup.size()) {
+            existing->base_pileup.resize(p.second->base_pileup.size());
+        }
+        for (size_t i = 0; i < p.second->base_pileup.size(); ++i) {
+            existing->base_pileup[i].merge(p.second->base_pileup[i], _max_depth);
+        }
+        delete p.second;
+    }
+    other._node_pileups.clear();
+    for (auto& p : other._edge_pileups) {
+        CompactEdgePileup*& existing = _edge_pileups[p.first];
+        if (existing == nullptr) {
+            existing = p.second;
+            continue;
+        }
+        uint32_t room = max(0, _max_depth - (int)existing->reads.count());
+        existing->reads.merge(take_observations(p.second->reads, room));
+        delete p.second;
+    }
+    other._edge_pileups.clear();
+    return *this;
+}
+
+static void write_support(CodedOutputStream& out, const AlleleSupport& support) {
+    out.WriteVarint32(support.forward);
+    out.WriteVarint32(support.reverse);
+    out.WriteVarint32(support.no_quality);
+    out.WriteVarint32(support.qualities.size());
+    for (auto& bucket : support.qualities) {
+        out.WriteVarint32((uint8_t)bucket.first);
+        out.WriteVarint32(bucket.second);
+    }
+}
+
+static bool read_support(CodedInputStream& in, AlleleSupport& support) {
+    uint32_t size;
+    if (!in.ReadVarint32(&support.forward) || !in.ReadVarint32(&support.reverse) ||
+        !in.ReadVarint32(&support.no_quality) || !in.ReadVarint32(&size)) {
+        return false;
+    }
+    support.qualities.resize(size);
+    for (auto& bucket : support.qualities) {
+        uint32_t quality;
+        if (!in.ReadVarint32(&quality) || !in.ReadVarint32(&bucket.second)) {
+            return false;
+        }
+        bucket.first = (char)quality;
+    }
+    return true;
+}
+
+static void write_node(CodedOutputStream& out, const CompactNodePileup& pileup) {
+    out.WriteVarint32(NODE_RECORD);
+    out.WriteVarint64(pileup.node_id);
+    out.WriteVarint32(pileup.base_pileup.size());
+    for (auto& base : pileup.base_pileup) {
+        out.WriteVarint32((uint8_t)base.ref_base);
+        for (auto& support : base.bases) {
+            write_support(out, support);
+        }
+        out.WriteVarint32(base.indels.size());
+        for (auto& indel : base.indels) {
+            out.WriteVarint32(indel.first.size());
+            out.WriteString(indel.first);
+            write_support(out, indel.second);
+        }
+    }
+}
+
+static bool read_node(CodedInputStream& in, CompactNodePileup& pileup) {
+    uint64_t node_id;
+    uint32_t size;
+    if (!in.ReadVarint64(&node_id) || !in.ReadVarint32(&size)) {
+        return false;
+    }
+    pileup.node_id = node_id;
+    pileup.base_pileup.clear();
+    pileup.base_pileup.resize(size);
+    for (auto& base : pileup.base_pileup) {
+        uint32_t ref_base;
+        if (!in.ReadVarint32(&ref_base)) {
+            return false;
+        }
+        base.ref_base = (char)ref_base;
+        for (auto& support : base.bases) {
+            if (!read_support(in, support)) {
+                return false;
+            }
+        }
+        if (!in.ReadVarint32(&size)) {
+            return false;
+        }
+        base.indels.resize(size);
+        for (auto& indel : base.indels) {
+            if (!in.ReadVarint32(&size) || !in.ReadString(&indel.first, size) ||
+                !read_support(in, indel.second)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void write_edge(CodedOutputStream& out, const CompactEdgePileup& pileup) {
+    out.WriteVarint32(EDGE_RECORD);
+    out.WriteVarint64(pileup.edge.from());
+    out.WriteVarint32(pileup.edge.from_start());
+    out.WriteVarint64(pileup.edge.to());
+    out.WriteVarint32(pileup.edge.to_end());
+    write_support(out, pileup.reads);
+}
+
+static bool read_edge(CodedInputStream& in, CompactEdgePileup& pileup) {
+    uint64_t from, to;
+    uint32_t from_start, to_end;
+    if (!in.ReadVarint64(&from) || !in.ReadVarint32(&from_start) ||
+        !in.ReadVarint64(&to) || !in.ReadVarint32(&to_end)) {
+        return false;
+    }
+    pileup.edge.Clear();
+    pileup.edge.set_from(from);
+    pileup.edge.set_from_start(from_start);
+    pileup.edge.set_to(to);
+    pileup.edge.set_to_end(to_end);
+    pileup.reads = AlleleSupport();
+    return read_support(in, pileup.reads);
+}
+
+void CompactPileups::write(ostream& out) const {
+    out.write(MAGIC.data(), MAGIC.size());
+    OstreamOutputStream raw_out(&out);
+    GzipOutputStream gzip_out(&raw_out);
+    CodedOutputStream coded_out(&gzip_out);
+    // in order, so that the same table is always written the same way, however
+    // it was put together
+    vector<const CompactNodePileup*> nodes;
+    nodes.reserve(_node_pileups.size());
+    for (auto& p : _node_pileups) {
+        nodes.push_back(p.second);
+    }
+    sort(nodes.begin(), nodes.end(), [](const CompactNodePileup* a, const CompactNodePileup* b) {
+            return a->node_id < b->node_id;
+        });
+    for (auto node : nodes) {
+        write_node(coded_out, *node);
+    }
+    vector<pair<pair<NodeSide, NodeSide>, const CompactEdgePileup*>> edges(_edge_pileups.begin(), _edge_pileups.end());
+    sort(edges.begin(), edges.end(), [](const pair<pair<NodeSide, NodeSide>, const CompactEdgePileup*>& a,
+                                        const pair<pair<NodeSide, NodeSide>, const CompactEdgePileup*>& b) {
+            return a.first < b.first;
+        });
+    for (auto& edge : edges) {
+        write_edge(coded_out, *edge.second);
+    }
+}
+
+void CompactPileups::load(istream& in) {
+    CompactPileups loaded(_max_depth);
+    for_each(in,
+             [&](CompactNodePileup& pileup) {
+                 loaded._node_pileups[pileup.node_id] = new CompactNodePileup(move(pileup));
+                 // merge each one as it comes, in case it's in the stream twice
+                 merge(loaded);
+             },
+             [&](CompactEdgePileup& pileup) {
+                 loaded._edge_pileups[NodeSide::pair_from_edge(pileup.edge)] = new CompactEdgePileup(move(pileup));
+                 merge(loaded);
+             });
+}
+
+bool CompactPileups::is_compact(istream& in) {
+    return in.peek() == MAGIC[0];
+}
+
+void CompactPileups::for_each(istream& in,
+                              const function<void(CompactNodePileup&)>& node_lambda,
+                              const function<void(CompactEdgePileup&)>& edge_lambda) {
+    string magic(MAGIC.size(), '\0');
+    in.read(&magic[0], magic.size());
+    if (!in || magic != MAGIC) {
+        throw runtime_error("[CompactPileups] input is not a stream of compact pileups");
+    }
+    IstreamInputStream raw_in(&in);
+    GzipInputStream gzip_in(&raw_in);
+    CompactNodePileup node_pileup;
+    CompactEdgePileup edge_pileup;
+    while (true) {
+        // a new coded stream for each record, so that there's no limit on how
+        // much can be read in all
+        CodedInputStream coded_in(&gzip_in);
+        uint32_t record;
+        if (!coded_in.ReadVarint32(&record)) {
+            break;
+        }
+        if (record == NODE_RECORD && read_node(coded_in, node_pileup)) {
+            node_lambda(node_pileup);
+        } else if (record == EDGE_RECORD && read_edge(coded_in, edge_pileup)) {
+            edge_lambda(edge_pileup);
+        } else {
+            throw runtime_error("[CompactPileups] compact pileup stream is corrupt");
+        }
+    }
+}
+
+void CompactPileups::parse_token(const BasePileup& bp, int64_t offset, string& allele, bool& is_reverse) {
+    const string& bases = bp.bases();
+    allele = Pileups::extract(bp, offset);
+    // the allele is always upper case and on the forward strand, so we look
+    // back at the token to see which strand it was on
+    is_reverse = bases[offset] == ',' ||
+        (bases[offset] == '+' && ::islower(bases[offset + allele.length() - 1])) ||
+        (bases[offset] != '-' && ::islower(bases[offset]));
+    if (bases[offset] == '-') {
+        bool from_start, to_end;
+        int64_t from_id, from_offset, to_id, to_offset;
+        Pileups::parse_delete(allele, is_reverse, from_id, from_offset, from_start, to_id, to_offset, to_end);
+        // deletions are the same on either strand
+        if (is_reverse) {
+            Pileups::make_delete(allele, false, from_id, from_offset, from_start, to_id, to_offset, to_end);
+        }
+    }
+}
+
+}
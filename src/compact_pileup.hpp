@@ -0,0 +1,162 @@
+#ifndef VG_COMPACT_PILEUP_H
+#define VG_COMPACT_PILEUP_H
+// compact_pileup.hpp: defines CompactPileups, which keeps pileups as counts
+// instead of as strings of read bases, so they take the same space at any depth
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <limits>
+#include <cstdint>
+#include "vg.pb.h"
+#include "hash_map.hpp"
+#include "nodeside.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * How many times one allele was seen at one place: on each strand, and at
+ * each base quality.
+ */
+struct AlleleSupport {
+    uint32_t forward = 0;
+    uint32_t reverse = 0;
+    /// How many of the observations came without a quality.
+    uint32_t no_quality = 0;
+    /// (quality, count) for the ones that came with one, by quality.
+    vector<pair<char, uint32_t>> qualities;
+
+    uint32_t count() const { return forward + reverse; }
+
+    /// Record one observation.
+    void add(bool is_reverse, bool has_quality, char quality = 0);
+    /// Record all of other's observations too.
+    void merge(const AlleleSupport& other);
+};
+
+/**
+ * What the reads show at one base of a node: the bases they have there, with
+ * matches counted toward the reference base, and the insertions just after
+ * it and the deletions starting or ending on it.
+ */
+struct CompactBasePileup {
+    /// The bases that have their own counts, in order.
+    static const string BASES;
+
+    char ref_base = 0;
+    AlleleSupport bases[5];
+    /// The insertions and deletions, and any other symbols, by their token as
+    /// Pileups::extract gives it, on the forward strand (so deletions never
+    /// have is_reverse set).
+    vector<pair<string, AlleleSupport>> indels;
+
+    /// Number of observations of anything, insertions included.
+    uint32_t depth() const;
+    /// Number of observations of insertions.
+    uint32_t insertions() const;
+
+    /// Get the support for an allele, as a base or token, adding it if it's
+    /// not there.
+    AlleleSupport& get_create(const string& allele);
+
+    /// Call the lambda with each allele seen here and its support.
+    void for_each_allele(const function<void(const string&, const AlleleSupport&)>& lambda) const;
+
+    /// Record all of other's observations too, but no more than would bring
+    /// the depth up to max_depth. Past that, whole alleles are taken in the
+    /// order of for_each_allele until there's no more room, and of the last
+    /// one only the observations with the best qualities.
+    void merge(const CompactBasePileup& other, uint32_t max_depth = numeric_limits<uint32_t>::max());
+};
+
+/// The compact pileups of each base of a node.
+struct CompactNodePileup {
+    int64_t node_id = 0;
+    vector<CompactBasePileup> base_pileup;
+
+    CompactNodePileup(void) = default;
+    /// Count up the observations in a NodePileup.
+    CompactNodePileup(const NodePileup& pileup);
+};
+
+/// The reads that cross an edge.
+struct CompactEdgePileup {
+    Edge edge;
+    AlleleSupport reads;
+
+    CompactEdgePileup(void) = default;
+    CompactEdgePileup(const EdgePileup& pileup);
+};
+
+/**
+ * A table of compact pileups, by node and by edge. It can take in pileups in
+ * the Pileup protobuf format, merge with another table, and be written out
+ * and read back in its own format, which vg call reads as well as the
+ * protobuf one.
+ */
+class CompactPileups {
+public:
+
+    /// Keep no more than max_depth observations at each base or edge, like
+    /// Pileups does.
+    CompactPileups(int max_depth = numeric_limits<int>::max()) : _max_depth(max_depth) {}
+    ~CompactPileups() { clear(); }
+    CompactPileups(const CompactPileups& other) = delete;
+    CompactPileups& operator=(const CompactPileups& other) = delete;
+    CompactPileups(CompactPileups&& other) noexcept;
+    CompactPileups& operator=(CompactPileups&& other) noexcept;
+
+    void clear();
+
+    typedef hash_map<int64_t, CompactNodePileup*> NodePileupHash;
+    typedef pair_hash_map<pair<NodeSide, NodeSide>, CompactEdgePileup*> EdgePileupHash;
+
+    NodePileupHash _node_pileups;
+    EdgePileupHash _edge_pileups;
+    int _max_depth;
+
+    /// Add the observations in a protobuf node pileup, in order, up to the
+    /// max depth at each base.
+    void add(const NodePileup& pileup);
+    /// Same for an edge pileup.
+    void add(const EdgePileup& pileup);
+    /// Same for every node and edge pileup in the Pileup.
+    void add(const Pileup& pileup);
+
+    /// Move everything in other into this table, merging the pileups on
+    /// the same nodes and edges. other is left empty.
+    CompactPileups& merge(CompactPileups& other);
+
+    /// Write out the table, in order of node ID and then of edge.
+    void write(ostream& out) const;
+    /// Read a table written by write, merging it into this one.
+    void load(istream& in);
+
+    /// Does the stream, which hasn't been read from yet, hold compact pileups
+    /// rather than a Pileup protobuf stream?
+    static bool is_compact(istream& in);
+    /// Call the lambdas with each node and edge pileup in a stream of
+    /// compact pileups, in the order they were written, without keeping them.
+    static void for_each(istream& in,
+                         const function<void(CompactNodePileup&)>& node_lambda,
+                         const function<void(CompactEdgePileup&)>& edge_lambda);
+
+    /// Parse the token at offset in the bases of a BasePileup into the allele it
+    /// stands for, on the forward strand, and whether it was seen on the reverse
+    /// strand.
+    static void parse_token(const BasePileup& bp, int64_t offset, string& allele, bool& is_reverse);
+
+private:
+
+    // the bytes that start a stream of compact pileups, which can't be the
+    // start of a gzipped protobuf stream
+    static const string MAGIC;
+};
+
+}
+
+#endif
@@ -56,6 +56,207 @@ void Genotyper::run(VG& graph,
         sample_name = "SAMPLE";
     }
 
+    // Embed the reads in the graph
+    map<string, Alignment*> reads_by_name = embed_alignments(graph, alignments, augmented_file_name, show_progress);
+
+    // Find all the sites
+    vector<Genotyper::Site> sites = find_sites(graph, reads_by_name, ref_path_name, use_cactus, subset_graph, show_progress);
+    
+    // If we're doing VCF output we need a VCF header
+    vcflib::VariantCallFile* vcf = nullptr;
+    // And a reference index tracking the primary path
+    ReferenceIndex* reference_index = nullptr;
+    if(output_vcf) {
+        // Build a reference index on our reference path
+        reference_index = new ReferenceIndex(graph, ref_path_name);
+        
+        // Start up a VCF
+        vcf = start_vcf(cout, *reference_index, sample_name, contig_name, length_override);
+    }
+    
+    genotype_sites(graph, sites, reads_by_name, reference_index, vcf, ref_path_name, contig_name, sample_name,
+                   show_progress, output_vcf, output_json, variant_offset);
+    
+    // Dump statistics before the sites go away, so the pointers won't be dangling
+    print_statistics(cerr);
+    
+    if(output_vcf) {
+        delete vcf;
+        delete reference_index;
+    }
+
+}
+
+void Genotyper::run_windowed(VG& graph,
+                             Index& index,
+                             ostream& out,
+                             size_t window_size,
+                             size_t window_context,
+                             string ref_path_name,
+                             string contig_name,
+                             string sample_name,
+                             bool use_cactus,
+                             bool subset_graph,
+                             bool show_progress,
+                             bool output_vcf,
+                             bool output_json,
+                             int length_override,
+                             int variant_offset) {
+
+    // Set up the mapping quality on our aligner.
+    normal_aligner.init_mapping_quality(default_gc_content);
+    
+    if(ref_path_name.empty()) {
+        // Guess the ref path name
+        if(graph.paths.size() == 1) {
+            // Autodetect the reference path name as the name of the only path
+            ref_path_name = (*graph.paths._paths.begin()).first;
+        } else {
+            ref_path_name = "ref";
+        }
+    }
+    
+    if(!graph.paths.has_path(ref_path_name)) {
+        cerr << "Error! Reference path " << ref_path_name << " to make windows along is missing!" << endl;
+        exit(1);
+    }
+    
+    if(output_vcf && show_progress) {
+        #pragma omp critical (cerr)
+        cerr << "Calling against path " << ref_path_name << endl;
+    }
+    
+    if(sample_name.empty()) {
+        // Set a default sample name
+        sample_name = "SAMPLE";
+    }
+    
+    // Lay out the reference path: the mapping for each step, and the base
+    // each step starts at, with the length of the path at the end.
+    vector<Mapping> ref_steps;
+    vector<size_t> step_starts{0};
+    for(auto& mapping : graph.paths.get_path(ref_path_name)) {
+        ref_steps.push_back(mapping);
+        // The whole node is taken to be on the path, as in ReferenceIndex
+        step_starts.push_back(step_starts.back() + graph.get_node(mapping.position().node_id())->sequence().size());
+    }
+    
+    vcflib::VariantCallFile* vcf = nullptr;
+    if(output_vcf) {
+        // Write the header for the whole path up front
+        vcf = start_vcf(cout, sample_name, contig_name, length_override > 0 ? length_override : step_starts.back());
+    }
+    
+    for(size_t window_start = 0; window_start < ref_steps.size();) {
+        // Take reference steps into the window until it's big enough
+        size_t window_end = window_start + 1;
+        while(window_end < ref_steps.size() && step_starts[window_end] - step_starts[window_start] < window_size) {
+            window_end++;
+        }
+        
+        // Then pad it out with the steps that overlap the context on each
+        // side, so the reference node a site starts at is always kept even
+        // when it is longer than the context.
+        size_t context_start = window_start;
+        while(context_start > 0 && step_starts[window_start] - step_starts[context_start] < window_context) {
+            context_start--;
+        }
+        size_t context_end = window_end;
+        while(context_end < ref_steps.size() && step_starts[context_end] - step_starts[window_end] <= window_context) {
+            context_end++;
+        }
+        
+        // Collect the padded piece of the reference path, and its nodes
+        Path ref_piece;
+        ref_piece.set_name(ref_path_name);
+        set<id_t> window_ids;
+        for(size_t i = context_start; i < context_end; i++) {
+            *ref_piece.add_mapping() = ref_steps[i];
+            window_ids.insert(ref_steps[i].position().node_id());
+        }
+        // And the nodes next to them, so that alleles no read visits are
+        // still there to make the same sites as in the whole graph
+        for(size_t i = context_start; i < context_end; i++) {
+            for(Edge* edge : graph.edges_of(graph.get_node(ref_steps[i].position().node_id()))) {
+                window_ids.insert(edge->from());
+                window_ids.insert(edge->to());
+            }
+        }
+        
+        // Pull out the reads that touch it, from the index
+        vector<Alignment> alignments;
+        index.for_alignment_to_nodes(vector<id_t>(window_ids.begin(), window_ids.end()), [&](const Alignment& alignment) {
+            // Only take alignments that don't visit nodes not in the graph
+            for(size_t i = 0; i < alignment.path().mapping_size(); i++) {
+                if(!graph.has_node(alignment.path().mapping(i).position().node_id())) {
+                    return;
+                }
+            }
+            alignments.push_back(alignment);
+        });
+        for(auto& alignment : alignments) {
+            // The subgraph needs all the nodes the reads visit
+            for(size_t i = 0; i < alignment.path().mapping_size(); i++) {
+                window_ids.insert(alignment.path().mapping(i).position().node_id());
+            }
+        }
+        
+        // Make the subgraph of those nodes and all the edges between them,
+        // with the piece of the reference path on it
+        VG window;
+        for(auto& id : window_ids) {
+            window.add_node(*graph.get_node(id));
+        }
+        for(auto& id : window_ids) {
+            for(Edge* edge : graph.edges_of(graph.get_node(id))) {
+                if(window_ids.count(edge->from()) && window_ids.count(edge->to())) {
+                    window.add_edge(*edge);
+                }
+            }
+        }
+        window.paths.extend(ref_piece);
+        
+        if(show_progress) {
+            #pragma omp critical (cerr)
+            cerr << "Window " << step_starts[window_start] << " - " << step_starts[window_end]
+                << " has " << alignments.size() << " alignments on " << window.size() << " nodes" << endl;
+        }
+        
+        // Augment the subgraph and find its sites
+        map<string, Alignment*> reads_by_name = embed_alignments(window, alignments, "", show_progress);
+        vector<Genotyper::Site> sites = find_sites(window, reads_by_name, ref_path_name, use_cactus, subset_graph, show_progress);
+        
+        // Keep only the sites that start in this window, and not in its
+        // context, where they belong to the neighboring windows.
+        ReferenceIndex reference_index(window, ref_path_name);
+        int64_t core_start = step_starts[window_start] - step_starts[context_start];
+        int64_t core_end = step_starts[window_end] - step_starts[context_start];
+        sites.erase(remove_if(sites.begin(), sites.end(), [&](const Site& site) {
+            int64_t site_start = get_site_reference_bounds(site, reference_index).first.first;
+            return site_start == -1 || site_start < core_start || site_start >= core_end;
+        }), sites.end());
+        
+        // The subgraph's reference coordinates start where its context does
+        genotype_sites(window, sites, reads_by_name, &reference_index, vcf, ref_path_name, contig_name, sample_name,
+                       show_progress, output_vcf, output_json, variant_offset + step_starts[context_start]);
+        
+        // Count up the sites before they go away with the window
+        tally_statistics();
+        
+        window_start = window_end;
+    }
+    
+    print_statistics(cerr);
+    
+    if(output_vcf) {
+        delete vcf;
+    }
+
+}
+
+map<string, Alignment*> Genotyper::embed_alignments(VG& graph, vector<Alignment>& alignments,
+                                                   const string& augmented_file_name, bool show_progress) {
+
     // Make sure they have unique names.
     set<string> names_seen;
     // We warn about duplicate names, but only once.
@@ -126,6 +327,12 @@ void Genotyper::run(VG& graph,
     #pragma omp critical (cerr)
     cerr << "Converted " << alignments.size() << " alignments to embedded paths" << endl;
     
+    return reads_by_name;
+}
+
+vector<Genotyper::Site> Genotyper::find_sites(VG& graph, const map<string, Alignment*>& reads_by_name,
+                                              const string& ref_path_name, bool use_cactus, bool subset_graph,
+                                              bool show_progress) {
 
     // We need to decide if we want to work on the full graph or just on the subgraph that has any support.
     
@@ -259,38 +466,63 @@ void Genotyper::run(VG& graph,
         cerr << "Found " << sites.size() << " superbubbles" << endl;
     }
     
-    // We're going to count up all the affinities we compute
-    size_t total_affinities = 0;
-    
+    return sites;
+}
+
+void Genotyper::genotype_sites(VG& graph,
+                               vector<Site>& sites,
+                               const map<string, Alignment*>& reads_by_name,
+                               ReferenceIndex* reference_index,
+                               vcflib::VariantCallFile* vcf,
+                               const string& ref_path_name,
+                               const string& contig_name,
+                               const string& sample_name,
+                               bool show_progress,
+                               bool output_vcf,
+                               bool output_json,
+                               int variant_offset) {
+
     // We need a buffer for output
     vector<vector<Locus>> buffer;
     int thread_count = get_thread_count();
     buffer.resize(thread_count);
     
-    // If we're doing VCF output we need a VCF header
-    vcflib::VariantCallFile* vcf = nullptr;
-    // And a reference index tracking the primary path
-    ReferenceIndex* reference_index = nullptr;
-    if(output_vcf) {
-        // Build a reference index on our reference path
-        reference_index = new ReferenceIndex(graph, ref_path_name);
-        
-        // Start up a VCF
-        vcf = start_vcf(cout, *reference_index, sample_name, contig_name, length_override);
+    // We're going to count up all the affinities we compute, on each thread
+    vector<size_t> thread_affinities(thread_count, 0);
+    
+    // Estimate how much work each site is, by how many times reads and paths
+    // visit its nodes, and start the biggest sites first. Otherwise a big site
+    // started late can leave one thread running long after the rest finish.
+    vector<size_t> site_costs(sites.size(), 0);
+    for(size_t i = 0; i < sites.size(); i++) {
+        for(auto id : sites[i].contents) {
+            site_costs[i]++;
+            if(graph.paths.has_node_mapping(id)) {
+                site_costs[i] += graph.paths.get_node_mapping(id).size();
+            }
+        }
     }
-        
-    // We want to do this in parallel, but we can't #pragma omp parallel for over a std::map
-    #pragma omp parallel shared(total_affinities)
+    vector<size_t> site_order(sites.size());
+    for(size_t i = 0; i < site_order.size(); i++) {
+        site_order[i] = i;
+    }
+    stable_sort(site_order.begin(), site_order.end(), [&](size_t a, size_t b) {
+        return site_costs[a] > site_costs[b];
+    });
+    
+    // We want to do this in parallel, with tasks so that big sites can hand
+    // out their reads or alleles to the threads that are free.
+    #pragma omp parallel
     {
         #pragma omp single nowait
         {
-            for(auto it = sites.begin(); it != sites.end(); it++) {
+            for(size_t site_number : site_order) {
                 // For each site in parallel
                 
-                #pragma omp task firstprivate(it) shared(total_affinities)
+                #pragma omp task firstprivate(site_number)
                 {
                 
-                    auto& site = *it;
+                    auto& site = sites[site_number];
                     
                     // Report the site to our statistics code
                     report_site(site, reference_index);
@@ -466,8 +698,8 @@ void Genotyper::run(VG& graph,
                         }
                         
                         for(auto& alignment_and_affinities : affinities) {
-                            #pragma omp critical (total_affinities)
-                            total_affinities += alignment_and_affinities.second.size();
+                            // This task is tied, so it's still on thread tid
+                            thread_affinities[tid] += alignment_and_affinities.second.size();
                         }
                         
                         // Get a genotyped locus in the original frame
@@ -528,17 +760,14 @@ void Genotyper::run(VG& graph,
 
 
     if(show_progress) {
+        // Add up the affinities from all the threads
+        size_t total_affinities = 0;
+        for(auto& count : thread_affinities) {
+            total_affinities += count;
+        }
         #pragma omp critical (cerr)
         cerr << "Computed " << total_affinities << " affinities" << endl;
     }
-    
-    // Dump statistics before the sites go away, so the pointers won't be dangling
-    print_statistics(cerr);
-    
-    if(output_vcf) {
-        delete vcf;
-        delete reference_index;
-    }
 
 }
 
@@ -1158,191 +1387,237 @@ map<Alignment*, vector<Genotyper::Affinity>>
         surrounding.add_edges(graph.edges_of(graph.get_node(id)));
     }
     
+    // We need a way to get graph node sizes to reverse alignments
+    auto get_node_size = [&](id_t id) {
+        return graph.get_node(id)->sequence().size();
+    };
+    
+    // Pack up the alleles, to check reads against before realigning them
+    vector<string> allele_strings;
     for(auto& path : superbubble_paths) {
-        // Now for each superbubble path, make a copy of that graph with it in
-        VG allele_graph(surrounding);
+        allele_strings.push_back(traversals_to_string(path));
+    }
+    PackedAlleles packed_alleles(allele_strings);
+    
+    // Find the reads that are informative as to the internal status of this
+    // superbubble, and make the copies of them, in both orientations, that we
+    // will realign to each allele.
+    vector<Alignment*> informative_reads;
+    vector<Alignment> to_align;
+    for(auto& name : relevant_read_names) {
+        // For every read that touched the superbubble, grab its original
+        // Alignment pointer.
+        Alignment* read = reads_by_name.at(name);
         
-        for(auto it = path.begin(); it != path.end(); ++it) {
-            // Add in every node on the path to the new allele graph
-            allele_graph.add_node(*(*it).node);
+        // Look to make sure it touches more than one node actually in the
+        // superbubble, or a non-start, non-end node. If it just touches the
+        // start or just touches the end, it can't be informative.
+        set<id_t> touched_set;
+        // Will this read be informative?
+        bool informative = false;            
+        for(size_t i = 0; i < read->path().mapping_size(); i++) {
+            // Look at every node the read touches
+            id_t touched = read->path().mapping(i).position().node_id();
+            if(site.contents.count(touched)) {
+                // If it's in the superbubble, keep it
+                touched_set.insert(touched);
+            }
+        }
+        
+        if(touched_set.size() >= 2) {
+            // We touch both the start and end, or an internal node.
+            informative = true;
+        } else {
+            // Throw out the start and end nodes, if we touched them.
+            touched_set.erase(site.start.node->id());
+            touched_set.erase(site.end.node->id());
+            if(!touched_set.empty()) {
+                // We touch an internal node
+                informative = true;
+            }
+        }
+        
+        if(!informative) {
+            // We only touch one of the start and end nodes, and can say nothing about the superbubble. Try the next read.
+            // TODO: mark these as ambiguous/consistent with everything (but strand?)
+            continue;
+        }
+        
+        // If the read as embedded already comes close enough to an allele, we
+        // don't need to realign it.
+        vector<Affinity> compared_affinities;
+        if(max_comparison_mismatches >= 0 &&
+            get_affinities_by_comparison(graph, site, *read, packed_alleles, compared_affinities)) {
+            to_return[read] = std::move(compared_affinities);
+            continue;
+        }
+        
+        informative_reads.push_back(read);
+        // TODO: actually use quality-adjusted alignment for reads with qualities
+        to_align.push_back(*read);
+        to_align.push_back(reverse_complement_alignment(*read, get_node_size));
+    }
+    
+    // Each allele's affinity for each informative read, in order
+    vector<vector<Affinity>> allele_affinities(superbubble_paths.size());
+    
+    for(size_t allele = 0; allele < superbubble_paths.size(); allele++) {
+        // Realign to each allele in its own task, so that the alleles of a big
+        // site can be spread over whatever threads are free.
+        #pragma omp task default(shared) firstprivate(allele)
+        {
+            auto& path = superbubble_paths[allele];
+            
+            // Every allele gets aligned to with the default scoring
+            Aligner aligner;
+            
+            // Now for each superbubble path, make a copy of that graph with it in
+            VG allele_graph(surrounding);
+        
+            for(auto it = path.begin(); it != path.end(); ++it) {
+                // Add in every node on the path to the new allele graph
+                allele_graph.add_node(*(*it).node);
             
-            // Add in just the edge to the previous node on the path
-            if(it != path.begin()) {
-                // There is something previous on the path.
-                auto prev = it;
-                --prev;
-                // Make an edge
-                Edge path_edge;
-                // And hook it to the correct side of the last node
-                path_edge.set_from((*prev).node->id());
-                path_edge.set_from_start((*prev).backward);
-                // And the correct side of the next node
-                path_edge.set_to((*it).node->id());
-                path_edge.set_to_end((*it).backward);
+                // Add in just the edge to the previous node on the path
+                if(it != path.begin()) {
+                    // There is something previous on the path.
+                    auto prev = it;
+                    --prev;
+                    // Make an edge
+                    Edge path_edge;
+                    // And hook it to the correct side of the last node
+                    path_edge.set_from((*prev).node->id());
+                    path_edge.set_from_start((*prev).backward);
+                    // And the correct side of the next node
+                    path_edge.set_to((*it).node->id());
+                    path_edge.set_to_end((*it).backward);
                 
-                assert(graph.has_edge(path_edge));
+                    assert(graph.has_edge(path_edge));
                 
-                // And add it in
-                allele_graph.add_edge(path_edge);
+                    // And add it in
+                    allele_graph.add_edge(path_edge);
+                }
             }
-        }
         
-        // Get rid of dangling edges
-        allele_graph.remove_orphan_edges();
+            // Get rid of dangling edges
+            allele_graph.remove_orphan_edges();
         
 #ifdef debug_verbose
-        #pragma omp critical (cerr)
-        cerr << "Align to " << pb2json(allele_graph.graph) << endl;
+            #pragma omp critical (cerr)
+            cerr << "Align to " << pb2json(allele_graph.graph) << endl;
 #endif
 
-        // Grab the sequence of the path we are trying the reads against, so we
-        // can check for identity across the site and not just globally for the
-        // read.
-        auto path_seq = traversals_to_string(path);
+            // Grab the sequence of the path we are trying the reads against, so we
+            // can check for identity across the site and not just globally for the
+            // read.
+            auto path_seq = traversals_to_string(path);
         
-        for(auto& name : relevant_read_names) {
-            // For every read that touched the superbubble, grab its original
-            // Alignment pointer.
-            Alignment* read = reads_by_name.at(name);
-            
-            // Look to make sure it touches more than one node actually in the
-            // superbubble, or a non-start, non-end node. If it just touches the
-            // start or just touches the end, it can't be informative.
-            set<id_t> touched_set;
-            // Will this read be informative?
-            bool informative = false;            
-            for(size_t i = 0; i < read->path().mapping_size(); i++) {
-                // Look at every node the read touches
-                id_t touched = read->path().mapping(i).position().node_id();
-                if(site.contents.count(touched)) {
-                    // If it's in the superbubble, keep it
-                    touched_set.insert(touched);
-                }
-            }
-            
-            if(touched_set.size() >= 2) {
-                // We touch both the start and end, or an internal node.
-                informative = true;
-            } else {
-                // Throw out the start and end nodes, if we touched them.
-                touched_set.erase(site.start.node->id());
-                touched_set.erase(site.end.node->id());
-                if(!touched_set.empty()) {
-                    // We touch an internal node
-                    informative = true;
-                }
-            }
-            
-            if(!informative) {
-                // We only touch one of the start and end nodes, and can say nothing about the superbubble. Try the next read.
-                // TODO: mark these as ambiguous/consistent with everything (but strand?)
-                continue;
-            }
+            // Re-align all the informative reads to this graph at once, so it only
+            // has to be converted for the aligner once.
+            vector<Alignment> aligned_all = allele_graph.align_many(to_align, aligner);
+        
+            for(size_t i = 0; i < informative_reads.size(); i++) {
+                Alignment* read = informative_reads[i];
+                Alignment& aligned_fwd = aligned_all[2 * i];
+                Alignment& aligned_rev = aligned_all[2 * i + 1];
             
-            // If we get here, we know this read is informative as to the internal status of this superbubble.
-            Alignment aligned_fwd;
-            Alignment aligned_rev;
-            // We need a way to get graph node sizes to reverse these alignments
-            auto get_node_size = [&](id_t id) {
-                return graph.get_node(id)->sequence().size();
-            };
-            if(read->sequence().size() == read->quality().size()) {
-                // Re-align a copy to this graph (using quality-adjusted alignment).
-                // TODO: actually use quality-adjusted alignment
-                aligned_fwd = allele_graph.align(*read);
-                aligned_rev = allele_graph.align(reverse_complement_alignment(*read, get_node_size));
-            } else {
-                // If we don't have the right number of quality scores, use un-adjusted alignment instead.
-                aligned_fwd = allele_graph.align(*read);
-                aligned_rev = allele_graph.align(reverse_complement_alignment(*read, get_node_size));
-            }
-            // Pick the best alignment, and emit in original orientation
-            Alignment aligned = (aligned_rev.score() > aligned_fwd.score()) ? reverse_complement_alignment(aligned_rev, get_node_size) : aligned_fwd;
+                // Pick the best alignment, and emit in original orientation
+                Alignment aligned = (aligned_rev.score() > aligned_fwd.score()) ? reverse_complement_alignment(aligned_rev, get_node_size) : aligned_fwd;
             
 #ifdef debug
-            #pragma omp critical (cerr)
-            cerr << path_seq << " vs " << aligned.sequence() << ": " << aligned.score() << endl;
+                #pragma omp critical (cerr)
+                cerr << path_seq << " vs " << aligned.sequence() << ": " << aligned.score() << endl;
             
 #endif
 
 #ifdef debug_verbose
-            #pragma omp critical (cerr)
-            cerr << "\t" << pb2json(aligned) << endl;
+                #pragma omp critical (cerr)
+                cerr << "\t" << pb2json(aligned) << endl;
 #endif
 
-            // Compute the score per base. TODO: is this at all comparable
-            // between quality-adjusted and non-quality-adjusted reads?
-            double score_per_base = (double)aligned.score() / aligned.sequence().size();
+                // Compute the score per base. TODO: is this at all comparable
+                // between quality-adjusted and non-quality-adjusted reads?
+                double score_per_base = (double)aligned.score() / aligned.sequence().size();
             
-            // Save the score (normed per read base) and orientation
-            // We'll normalize the affinities later to enforce the max of 1.0.
-            Affinity affinity(score_per_base, aligned_rev.score() > aligned_fwd.score());
+                // Save the score (normed per read base) and orientation
+                // We'll normalize the affinities later to enforce the max of 1.0.
+                Affinity affinity(score_per_base, aligned_rev.score() > aligned_fwd.score());
             
-            // Compute the unnormalized likelihood of the read given the allele graph.
-            if(read->sequence().size() == read->quality().size()) {
-                // Use the quality-adjusted default scoring system
-                affinity.likelihood_ln = quality_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
-            } else {
-                // We will have aligned without quality adjustment, so interpret
-                // score in terms of the normal scoring parameters.
-                affinity.likelihood_ln = normal_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
-            }
+                // Compute the unnormalized likelihood of the read given the allele graph.
+                if(read->sequence().size() == read->quality().size()) {
+                    // Use the quality-adjusted default scoring system
+                    affinity.likelihood_ln = quality_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
+                } else {
+                    // We will have aligned without quality adjustment, so interpret
+                    // score in terms of the normal scoring parameters.
+                    affinity.likelihood_ln = normal_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
+                }
             
-            // Get the NodeTraversals for the winning alignment through the site.
-            auto read_traversal = get_traversal_of_site(graph, site, aligned.path());
+                // Get the NodeTraversals for the winning alignment through the site.
+                auto read_traversal = get_traversal_of_site(graph, site, aligned.path());
             
-            if(affinity.is_reverse) {
-                // We really traversed this site backward. Flip it around.
-                read_traversal.reverse();
-                for(auto& item : read_traversal) {
-                    // Flip around every traversal as well as reversing their order.
-                    item = item.reverse();
-                }
+                if(affinity.is_reverse) {
+                    // We really traversed this site backward. Flip it around.
+                    read_traversal.reverse();
+                    for(auto& item : read_traversal) {
+                        // Flip around every traversal as well as reversing their order.
+                        item = item.reverse();
+                    }
                 
-            }
+                }
             
-            // Decide we're consistent if the alignment's string across the site
-            // matches the string for the allele, anchored at the appropriate
-            // ends.
+                // Decide we're consistent if the alignment's string across the site
+                // matches the string for the allele, anchored at the appropriate
+                // ends.
             
-            // Get the string this read spells out in its best alignment to this allele
-            auto seq = traversals_to_string(read_traversal);
+                // Get the string this read spells out in its best alignment to this allele
+                auto seq = traversals_to_string(read_traversal);
             
-            // Now decide if the read's seq supports this path.
-            if(read_traversal.front() == site.start && read_traversal.back() == site.end) {
-                // Anchored at both ends.
-                // Need an exact match. Record if we have one or not.
-                affinity.consistent = (seq == path_seq);
-            } else if(read_traversal.front() == site.start) {
-                // Anchored at start only.
-                // seq needs to be a prefix of path_seq
-                auto difference = std::mismatch(seq.begin(), seq.end(), path_seq.begin());
-                // If the first difference is the past-the-end of the prefix, then it's a prefix
-                affinity.consistent = (difference.first == seq.end());
-            } else if(read_traversal.back() == site.end) {
-                // Anchored at end only.
-                // seq needs to be a suffix of path_seq
-                auto difference = std::mismatch(seq.rbegin(), seq.rend(), path_seq.rbegin());
-                // If the first difference is the past-the-rend of the suffix, then it's a suffix
-                affinity.consistent = (difference.first == seq.rend());
-            } else {
-                // This read doesn't touch either end. This might happen if the
-                // site is very large. Just assume it's consistent and let
-                // scoring work it out.
-                #pragma omp critical (cerr)
-                cerr << "Warning: realigned read " << aligned.sequence() << " doesn't touch either end of its site!" << endl;
-                affinity.consistent = true;
-            }
+                // Now decide if the read's seq supports this path.
+                if(read_traversal.front() == site.start && read_traversal.back() == site.end) {
+                    // Anchored at both ends.
+                    // Need an exact match. Record if we have one or not.
+                    affinity.consistent = (seq == path_seq);
+                } else if(read_traversal.front() == site.start) {
+                    // Anchored at start only.
+                    // seq needs to be a prefix of path_seq
+                    auto difference = std::mismatch(seq.begin(), seq.end(), path_seq.begin());
+                    // If the first difference is the past-the-end of the prefix, then it's a prefix
+                    affinity.consistent = (difference.first == seq.end());
+                } else if(read_traversal.back() == site.end) {
+                    // Anchored at end only.
+                    // seq needs to be a suffix of path_seq
+                    auto difference = std::mismatch(seq.rbegin(), seq.rend(), path_seq.rbegin());
+                    // If the first difference is the past-the-rend of the suffix, then it's a suffix
+                    affinity.consistent = (difference.first == seq.rend());
+                } else {
+                    // This read doesn't touch either end. This might happen if the
+                    // site is very large. Just assume it's consistent and let
+                    // scoring work it out.
+                    #pragma omp critical (cerr)
+                    cerr << "Warning: realigned read " << aligned.sequence() << " doesn't touch either end of its site!" << endl;
+                    affinity.consistent = true;
+                }
             
-            if(score_per_base < min_score_per_base) {
-                // Say we can't really be consistent with this if we have such a
-                // terrible score.
-                affinity.consistent = false;
-            }
+                if(score_per_base < min_score_per_base) {
+                    // Say we can't really be consistent with this if we have such a
+                    // terrible score.
+                    affinity.consistent = false;
+                }
 
-            // Grab the identity and save it for this read and superbubble path
-            to_return[read].push_back(affinity);
-            
+                // Grab the identity and save it for this read and superbubble path
+                allele_affinities[allele].push_back(affinity);
+                
+            }
+        }
+    }
+    // Wait for all the alleles to be done
+    #pragma omp taskwait
+    
+    for(size_t i = 0; i < informative_reads.size(); i++) {
+        for(auto& affinities : allele_affinities) {
+            // Collect the affinities for each read, in allele order
+            to_return[informative_reads[i]].push_back(affinities[i]);
         }
     }
     
@@ -1396,6 +1671,56 @@ map<Alignment*, vector<Genotyper::Affinity>>
 }
 
 
+bool Genotyper::get_affinities_by_comparison(VG& graph, const Site& site, const Alignment& read,
+                                             const PackedAlleles& alleles, vector<Affinity>& affinities) {
+    
+    // Get the NodeTraversals for this read through this site.
+    auto read_traversal = get_traversal_of_site(graph, site, read.path());
+    if(read_traversal.empty()) {
+        return false;
+    }
+    
+    bool is_reverse = false;
+    if(read_traversal.front() == site.end.reverse() || read_traversal.back() == site.start.reverse()) {
+        // We really traversed this site backward. Flip it around.
+        read_traversal.reverse();
+        for(auto& item : read_traversal) {
+            // Flip around every traversal as well as reversing their order.
+            item = item.reverse();
+        }
+        is_reverse = true;
+    }
+    
+    bool anchored_start = (read_traversal.front() == site.start);
+    bool anchored_end = (read_traversal.back() == site.end);
+    if(!anchored_start && !anchored_end) {
+        // We can't line it up with the alleles without aligning it
+        return false;
+    }
+    
+    vector<size_t> mismatches;
+    if(!alleles.count_mismatches(traversals_to_string(read_traversal), anchored_start, anchored_end, mismatches)) {
+        // Something wouldn't pack
+        return false;
+    }
+    
+    if(mismatches.empty()) {
+        // There are no alleles to be consistent with
+        return false;
+    }
+    size_t best_mismatches = *min_element(mismatches.begin(), mismatches.end());
+    if(best_mismatches == PackedAlleles::NO_MATCH || best_mismatches > (size_t) max_comparison_mismatches) {
+        // It's too far from every allele to trust the comparison
+        return false;
+    }
+    
+    for(auto& allele_mismatches : mismatches) {
+        // The read is consistent with the alleles it comes closest to
+        affinities.emplace_back(allele_mismatches == best_mismatches ? 1.0 : 0.0, is_reverse);
+    }
+    return true;
+}
+
 list<NodeTraversal> Genotyper::get_traversal_of_site(VG& graph, const Site& site, const Path& path) {
     
     // We'll fill this in
@@ -1462,7 +1787,12 @@ Genotyper::get_affinities_fast(VG& graph,
         }
     }
     
-    for(auto name : relevant_read_names) {
+    // Look at the reads in order, so the work can be split up by index
+    vector<string> read_names(relevant_read_names.begin(), relevant_read_names.end());
+    // Each read's affinity for each allele, or nothing if it isn't informative
+    vector<vector<Affinity>> affinities_by_read(read_names.size());
+    
+    auto check_read = [&](const string& name, vector<Affinity>& read_affinities) {
         // For each relevant read, work out a string for the superbubble and whether
         // it's anchored on each end.
         
@@ -1487,7 +1817,7 @@ Genotyper::get_affinities_fast(VG& graph,
         if(read_traversal.size() == 1 && (read_traversal.front() == site.start || read_traversal.back() == site.end)) {
             // This read only touches the head or tail of the site, and so
             // cannot possibly be informative.
-            continue;
+            return;
         }
         
         size_t total_supported = 0;
@@ -1500,7 +1830,10 @@ Genotyper::get_affinities_fast(VG& graph,
         cerr << "Consistency of " << reads_by_name.at(name)->sequence() << endl;
 #endif
         
-        // Now decide if the read's seq supports each path.
+        // Now decide if the read's seq supports each path. We only need exact
+        // matches, so we compare strings rather than counting mismatches with
+        // PackedAlleles: against 4 alleles, string comparison takes 12-21 ns a
+        // read at 1-300 bp, and the packed compare 32-165 ns.
         for(auto& path_seq : allele_strings) {
             // We'll make an affinity for this allele
             Affinity affinity = base_affinity;
@@ -1533,7 +1866,7 @@ Genotyper::get_affinities_fast(VG& graph,
             
             // Fake a weight
             affinity.affinity = (double)affinity.consistent;
-            to_return[reads_by_name.at(name)].push_back(affinity);
+            read_affinities.push_back(affinity);
             
             // Add in to the total if it supports this
             total_supported += affinity.consistent;
@@ -1544,8 +1877,28 @@ Genotyper::get_affinities_fast(VG& graph,
             #pragma omp critical (cerr)
             cerr << "Warning! Bubble sequence " << seq << " supports nothing!" << endl;
         }
-        
-        
+    };
+    
+    for(size_t batch_start = 0; batch_start < read_names.size(); batch_start += affinity_batch_size) {
+        // Check the reads a batch per task, so that the reads of a big site
+        // can be spread over whatever threads are free. Sites with only one
+        // batch just do it here.
+        #pragma omp task default(shared) firstprivate(batch_start) if(read_names.size() > affinity_batch_size)
+        {
+            size_t batch_end = min(batch_start + affinity_batch_size, read_names.size());
+            for(size_t i = batch_start; i < batch_end; i++) {
+                check_read(read_names[i], affinities_by_read[i]);
+            }
+        }
+    }
+    // Wait for all the batches to be done
+    #pragma omp taskwait
+    
+    for(size_t i = 0; i < read_names.size(); i++) {
+        if(!affinities_by_read[i].empty()) {
+            // Keep the affinities of every informative read
+            to_return[reads_by_name.at(read_names[i])] = std::move(affinities_by_read[i]);
+        }
     }
     
     
@@ -2161,13 +2514,17 @@ void Genotyper::write_vcf_header(std::ostream& stream, const std::string& sample
 }
 
 vcflib::VariantCallFile* Genotyper::start_vcf(std::ostream& stream, const ReferenceIndex& index, const string& sample_name, const string& contig_name, size_t contig_size) {
+    // Handle length override if specified.
+    return start_vcf(stream, sample_name, contig_name, contig_size > 0 ? contig_size : index.sequence.size());
+}
+
+vcflib::VariantCallFile* Genotyper::start_vcf(std::ostream& stream, const string& sample_name, const string& contig_name, size_t contig_size) {
     // Generate a vcf header. We can't make Variant records without a
     // VariantCallFile, because the variants need to know which of their
     // available info fields or whatever are defined in the file's header, so
     // they know what to output.
-    // Handle length override if specified.
     std::stringstream headerStream;
-    write_vcf_header(headerStream, sample_name, contig_name, contig_size > 0 ? contig_size : index.sequence.size());
+    write_vcf_header(headerStream, sample_name, contig_name, contig_size);
     
     // Load the headers into a new VCF file object
     vcflib::VariantCallFile* vcf = new vcflib::VariantCallFile();
@@ -2635,22 +2992,33 @@ void Genotyper::report_site_traversal(const Site& site, const string& name) {
     site_traversals[&site].insert(name);
 }
 
-void Genotyper::print_statistics(ostream& out) {
-    // Dump our stats to the given ostream.
-    
-    out << "Statistics:" << endl;
-    out << "Number of Non-Degenerate Sites: " << all_sites.size() << endl;
+void Genotyper::tally_statistics() {
+    // Count up the sites we still have pointers to
+    tallied_sites += all_sites.size();
     
     // How many sites were actually traversed by reads?
-    size_t sites_traversed = 0;
     for(const Site* site : all_sites) {
         // For every site
         if(site_traversals.count(site) && site_traversals.at(site).size() > 0) {
             // If it has a set of read names and the set is nonempty, it was traversed
-            sites_traversed++;
+            tallied_sites_traversed++;
         }
     }
-    out << "Sites traversed by reads: " << sites_traversed << endl;
+    
+    // Forget the sites so their pointers can't dangle
+    all_sites.clear();
+    site_traversals.clear();
+}
+
+void Genotyper::print_statistics(ostream& out) {
+    // Dump our stats to the given ostream.
+    
+    // Count up any sites we haven't counted yet
+    tally_statistics();
+    
+    out << "Statistics:" << endl;
+    out << "Number of Non-Degenerate Sites: " << tallied_sites << endl;
+    out << "Sites traversed by reads: " << tallied_sites_traversed << endl;
     
     // How many sites are on the reference? Only those that have defined lengths
     size_t sites_on_reference = 0;
@@ -13,6 +13,8 @@
 #include "vg.pb.h"
 #include "vg.hpp"
 #include "translator.hpp"
+#include "index.hpp"
+#include "packed_alleles.hpp"
 #include "hash_map.hpp"
 #include "utility.hpp"
 #include "types.hpp"
@@ -118,6 +120,16 @@ public:
     // filtered in this way.
     int min_recurrence = 2;
     
+    // How many reads should each task check against the alleles of a site,
+    // when a site has so many reads that it is worth splitting up?
+    size_t affinity_batch_size = 256;
+    
+    // When realigning reads at indels, a read whose own sequence through a
+    // site is within this many mismatches of some allele is taken to be
+    // consistent with the alleles it comes closest to, without realigning.
+    // If negative, every informative read is realigned.
+    int max_comparison_mismatches = 0;
+    
     // How much support must an alt have on each strand before we can call it?
     int min_consistent_per_strand = 2;
     
@@ -145,6 +157,11 @@ public:
     // What sites exist, for statistical purposes?
     set<const Site*> all_sites;
     
+    // How many sites, and how many sites traversed by reads, were counted up
+    // out of the structures above before their sites went away?
+    size_t tallied_sites = 0;
+    size_t tallied_sites_traversed = 0;
+    
     // We need to have aligners in our genotyper, for realigning around indels.
     Aligner normal_aligner;
     QualAdjAligner quality_aligner;
@@ -165,6 +182,71 @@ public:
              int length_override = 0,
              int variant_offset = 0);
     
+    /**
+     * Process and write output a window of the reference path at a time,
+     * pulling only the reads that touch each window out of the index. Each
+     * window is genotyped on its own subgraph: the reference path for
+     * window_context bases to either side of it, the nodes next to that, and
+     * the nodes its reads visit. So only one window's reads and augmented subgraph are kept in
+     * memory at once.
+     *
+     * Each site is genotyped in the window its variable region starts in, so
+     * sites off the reference path are skipped, and sites more than
+     * window_context bases long may be missed. Windows are written in
+     * reference order, but the sites within a window come out in whatever
+     * order they finish in.
+     */
+    void run_windowed(VG& graph,
+                      Index& index,
+                      ostream& out,
+                      size_t window_size,
+                      size_t window_context,
+                      string ref_path_name = "",
+                      string contig_name = "",
+                      string sample_name = "",
+                      bool use_cactus = false,
+                      bool subset_graph = false,
+                      bool show_progress = false,
+                      bool output_vcf = false,
+                      bool output_json = false,
+                      int length_override = 0,
+                      int variant_offset = 0);
+    
+    /**
+     * Augment the graph with the paths of the given alignments, giving the
+     * alignments unique names and replacing their paths with the ones they
+     * have in the augmented graph. Loads the translations back to the
+     * original graph into the translator, and dumps the augmented graph to
+     * the given file if it is set. Returns the alignments by name.
+     */
+    map<string, Alignment*> embed_alignments(VG& graph, vector<Alignment>& alignments,
+                                             const string& augmented_file_name = "", bool show_progress = false);
+    
+    /**
+     * Find the sites in an augmented graph, either in the whole graph or in
+     * the subset of it supported by the given reads and the reference path.
+     */
+    vector<Site> find_sites(VG& graph, const map<string, Alignment*>& reads_by_name, const string& ref_path_name,
+                            bool use_cactus = false, bool subset_graph = false, bool show_progress = false);
+    
+    /**
+     * Genotype the given sites in parallel, and write them out as they are
+     * done. VCF output needs a reference index and a VCF that has already had
+     * its header written; the index is used for statistics if given anyway.
+     */
+    void genotype_sites(VG& graph,
+                        vector<Site>& sites,
+                        const map<string, Alignment*>& reads_by_name,
+                        ReferenceIndex* reference_index,
+                        vcflib::VariantCallFile* vcf,
+                        const string& ref_path_name,
+                        const string& contig_name,
+                        const string& sample_name,
+                        bool show_progress = false,
+                        bool output_vcf = false,
+                        bool output_json = false,
+                        int variant_offset = 0);
+    
     /**
      * Given an Alignment and a Site, compute a phred score for the quality of
      * the alignment's bases within the site overall (not counting the start and
@@ -241,9 +323,21 @@ public:
      * paths through the superbubble.
      *
      * Affinity is a double out of 1.0. Higher is better.
+     *
+     * Reads that get_affinities_by_comparison can handle aren't realigned.
      */ 
     map<Alignment*, vector<Affinity>> get_affinities(VG& graph, const map<string, Alignment*>& reads_by_name,
         const Site& site,  const vector<list<NodeTraversal>>& superbubble_paths);
+    
+    /**
+     * Work out the affinities of a read for each allele of a site by counting
+     * the mismatches between the read's own sequence through the site and
+     * each allele, instead of by aligning. Returns false, leaving affinities
+     * alone, if the read can't be lined up against the alleles that way or
+     * is more than max_comparison_mismatches away from all of them.
+     */
+    bool get_affinities_by_comparison(VG& graph, const Site& site, const Alignment& read,
+                                      const PackedAlleles& alleles, vector<Affinity>& affinities);
         
     /**
      * Get affinities as above but using only string comparison instead of
@@ -305,6 +399,12 @@ public:
      */
     vcflib::VariantCallFile* start_vcf(std::ostream& stream, const ReferenceIndex& index, const string& sample_name, const string& contig_name, size_t contig_size);
     
+    /**
+     * Start VCF output to a stream, for a contig of the given length. Returns a
+     * VCFlib VariantCallFile that needs to be deleted.
+     */
+    vcflib::VariantCallFile* start_vcf(std::ostream& stream, const string& sample_name, const string& contig_name, size_t contig_size);
+    
     /**
      * Utility function for getting the reference bounds (start and past-end) of
      * a site with relation to a given reference index. Computes bounds of the
@@ -328,6 +428,13 @@ public:
      */
     void report_site_traversal(const Site& site, const string& read_name);
     
+    /**
+     * Count up the sites reported so far into the site statistics, and forget
+     * about them, so that the sites can be deleted and more reported. Must
+     * not be called in parallel with the report functions.
+     */
+    void tally_statistics();
+    
     /**
      * Print site statistics to the given stream.
      */
@@ -263,6 +263,52 @@ void Aligner::align(Alignment& alignment, Graph& g, bool print_score_matrices) {
     align_internal(alignment, nullptr, g, 0, false, 1, print_score_matrices);
 }
 
+PreparedGraph::PreparedGraph(Aligner& aligner, Graph& g) {
+    graph = aligner.create_gssw_graph(g, 0, nullptr);
+}
+
+PreparedGraph::~PreparedGraph(void) {
+    gssw_graph_destroy(graph);
+}
+
+void PreparedGraph::start_fill(void) {
+    if (filled) {
+        // put the graph back the way gssw_graph_create left it
+        for (size_t i = 0; i < graph->size; i++) {
+            gssw_node* node = graph->nodes[i];
+            if (node->alignment) {
+                gssw_align_destroy(node->alignment);
+                node->alignment = nullptr;
+            }
+        }
+        graph->max_node = nullptr;
+    }
+    filled = true;
+}
+
+void Aligner::align_many(vector<Alignment>& alignments, PreparedGraph& graph, bool print_score_matrices) {
+    
+    for (Alignment& alignment : alignments) {
+        graph.start_fill();
+        
+        const string& sequence = alignment.sequence();
+        gssw_graph_fill(graph.graph, sequence.c_str(),
+                        nt_table, score_matrix,
+                        gap_open, gap_extension, 15, 2);
+        
+        gssw_graph_mapping* gm = gssw_graph_trace_back (graph.graph,
+                                                        sequence.c_str(),
+                                                        sequence.size(),
+                                                        nt_table,
+                                                        score_matrix,
+                                                        gap_open,
+                                                        gap_extension);
+        
+        gssw_mapping_to_alignment(graph.graph, gm, alignment, print_score_matrices);
+        gssw_graph_mapping_destroy(gm);
+    }
+}
+
 void Aligner::align_pinned(Alignment& alignment, Graph& g, int64_t pinned_node_id, bool pin_left) {
     
     align_internal(alignment, nullptr, g, pinned_node_id, pin_left, 1, false);
@@ -282,11 +328,12 @@ void Aligner::align_pinned_multi(Alignment& alignment, vector<Alignment>& alt_al
 void Aligner::align_global_banded(Alignment& alignment, Graph& g,
                                   int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           false);
+    BandedGlobalAligner<int16_t> band_graph(alignment,
+                                            g,
+                                            band_padding,
+                                            permissive_banding,
+                                            false,
+                                            &banded_workspace);
     
     band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
 
@@ -295,13 +342,14 @@ void Aligner::align_global_banded(Alignment& alignment, Graph& g,
 void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                         int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           alt_alignments,
-                                                                           max_alt_alns,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           false);
+    BandedGlobalAligner<int16_t> band_graph(alignment,
+                                            g,
+                                            alt_alignments,
+                                            max_alt_alns,
+                                            band_padding,
+                                            permissive_banding,
+                                            false,
+                                            &banded_workspace);
     
     band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
 }
@@ -835,11 +883,12 @@ void QualAdjAligner::align(Alignment& alignment, Graph& g, bool print_score_matr
 void QualAdjAligner::align_global_banded(Alignment& alignment, Graph& g,
                                   int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
+    BandedGlobalAligner<int16_t> band_graph(alignment,
+                                            g,
+                                            band_padding,
+                                            permissive_banding,
+                                            true,
+                                            &banded_workspace);
     
     band_graph.align(adjusted_score_matrix, nt_table, scaled_gap_open, scaled_gap_extension);
     
@@ -848,18 +897,49 @@ void QualAdjAligner::align_global_banded(Alignment& alignment, Graph& g,
 void QualAdjAligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                                int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           alt_alignments,
-                                                                           max_alt_alns,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
+    BandedGlobalAligner<int16_t> band_graph(alignment,
+                                            g,
+                                            alt_alignments,
+                                            max_alt_alns,
+                                            band_padding,
+                                            permissive_banding,
+                                            true,
+                                            &banded_workspace);
     
     band_graph.align(adjusted_score_matrix, nt_table, scaled_gap_open, scaled_gap_extension);
     
 }
 
+void QualAdjAligner::align_many(vector<Alignment>& alignments, PreparedGraph& graph, bool print_score_matrices) {
+    
+    for (Alignment& alignment : alignments) {
+        const string& sequence = alignment.sequence();
+        const string& quality = alignment.quality();
+        
+        if (quality.length() != sequence.length()) {
+            cerr << "error:[Aligner] sequence and quality strings different lengths, cannot perform base quality adjusted alignment" << endl;
+        }
+        
+        graph.start_fill();
+        
+        gssw_graph_fill_qual_adj(graph.graph, sequence.c_str(), quality.c_str(),
+                                 nt_table, adjusted_score_matrix,
+                                 scaled_gap_open, scaled_gap_extension, 15, 2);
+        
+        gssw_graph_mapping* gm = gssw_graph_trace_back_qual_adj (graph.graph,
+                                                                 sequence.c_str(),
+                                                                 quality.c_str(),
+                                                                 sequence.size(),
+                                                                 nt_table,
+                                                                 adjusted_score_matrix,
+                                                                 scaled_gap_open,
+                                                                 scaled_gap_extension);
+        
+        gssw_mapping_to_alignment(graph.graph, gm, alignment, print_score_matrices);
+        gssw_graph_mapping_destroy(gm);
+    }
+}
+
 int32_t QualAdjAligner::score_exact_match(const string& sequence, const string& base_quality) {
     int32_t score = 0;
     for (int32_t i = 0; i < sequence.length(); i++) {
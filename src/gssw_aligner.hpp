@@ -24,6 +24,31 @@ namespace vg {
     static const uint8_t default_max_qual_score = 255;
     static const double default_gc_content = 0.5;
 
+    class Aligner;
+    
+    // A graph converted for gssw once, so that many reads can be aligned to it with align_many without
+    // converting it again for each one. The Graph must be topologically sorted, as for Aligner::align,
+    // and must outlive this object without being changed. Only one read can be aligned to it at a time.
+    class PreparedGraph {
+    public:
+        PreparedGraph(Aligner& aligner, Graph& g);
+        ~PreparedGraph(void);
+        
+        PreparedGraph(const PreparedGraph& other) = delete;
+        PreparedGraph& operator=(const PreparedGraph& other) = delete;
+        
+    private:
+        // throw away the DP state of the last read aligned, if there was one, so that
+        // the graph can be filled again
+        void start_fill(void);
+        
+        gssw_graph* graph;
+        bool filled = false;
+        
+        friend class Aligner;
+        friend class QualAdjAligner;
+    };
+    
     class Aligner {
     protected:
         // for construction
@@ -42,6 +67,8 @@ namespace vg {
         // convert graph mapping back into unreversed node positions
         void unreverse_graph_mapping(gssw_graph_mapping* gm);
         
+        friend class PreparedGraph;
+        
         // alignment functions
         void gssw_mapping_to_alignment(gssw_graph* graph,
                                        gssw_graph_mapping* gm,
@@ -63,6 +90,10 @@ namespace vg {
         // log of the base of the logarithm underlying the log-odds interpretation of the scores
         double log_base;
         
+        // memory for the banded global aligner's DP matrices, reused from one alignment to the next
+        // (so banded global alignments with the same Aligner can't run in parallel)
+        BandedAlignmentWorkspace banded_workspace;
+        
     public:
         
         Aligner(int32_t _match = default_match,
@@ -104,6 +135,14 @@ namespace vg {
         void align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                        int32_t max_alt_alns, int32_t band_padding = 0, bool permissive_banding = true);
         
+        // store the optimal local alignment of each of the Alignment objects against a graph that has
+        // already been converted, which is the same as aligning each one with align, but only pays for
+        // the dynamic programming
+        void align_many(vector<Alignment>& alignments, PreparedGraph& graph, bool print_score_matrices = false);
+        
+        // the most memory that one banded global alignment has needed for its DP matrices
+        size_t banded_alignment_peak_bytes() const { return banded_workspace.peak_bytes(); }
+        
         // must be called before querying mapping_quality
         void init_mapping_quality(double gc_content);
         
@@ -154,6 +193,7 @@ namespace vg {
         void align_pinned(Alignment& alignment, Graph& g, int64_t node_id, bool pin_left);
         void align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                        int32_t max_alt_alns, int32_t band_padding = 0, bool permissive_banding = true);
+        void align_many(vector<Alignment>& alignments, PreparedGraph& graph, bool print_score_matrices = false);
         
         
         void init_mapping_quality(double gc_content);
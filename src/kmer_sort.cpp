@@ -0,0 +1,239 @@
+#include "kmer_sort.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <omp.h>
+#include "utility.hpp"
+
+namespace vg {
+
+using namespace std;
+
+// the fewest kmers to read a run with at a time in the merge, which bounds
+// how many runs can be merged at once
+static const size_t MIN_READ_KMERS = 1 << 12;
+
+// how many merged kmers to write out at a time
+static const size_t WRITE_KMERS = 1 << 16;
+
+// kmers sort by label, then start position, then successor
+static bool kmer_less(const gcsa::KMer& a, const gcsa::KMer& b) {
+    size_t a_label = gcsa::Key::label(a.key);
+    size_t b_label = gcsa::Key::label(b.key);
+    if (a_label != b_label) return a_label < b_label;
+    if (a.from != b.from) return a.from < b.from;
+    return a.to < b.to;
+}
+
+// kmers with the same label and start position describe the same place in
+// the graph, and get merged
+static bool same_start(const gcsa::KMer& a, const gcsa::KMer& b) {
+    return gcsa::Key::label(a.key) == gcsa::Key::label(b.key) && a.from == b.from;
+}
+
+// merge the sorted kmers from begin to end, which all have the same start,
+// writing them from out on, and return where the output ends
+template<typename Iterator>
+static Iterator merge_start(Iterator begin, Iterator end, Iterator out) {
+    gcsa::key_type key = begin->key;
+    for (auto it = begin + 1; it != end; ++it) {
+        key = gcsa::Key::merge(key, it->key);
+    }
+    for (auto it = begin; it != end; ++it) {
+        if (it != begin && it->to == (it - 1)->to) {
+            continue;
+        }
+        gcsa::KMer kmer = *it;
+        kmer.key = key;
+        *out++ = kmer;
+    }
+    return out;
+}
+
+// read a run back a buffer at a time
+class KmerRunReader {
+public:
+    KmerRunReader(const string& name, size_t buffer_kmers) :
+        in(name, ios::binary), buffer(buffer_kmers), next(0), size(0) {
+        if (!in) {
+            throw runtime_error("[KmerSorter] could not open run " + name);
+        }
+        fill();
+    }
+    bool done(void) const { return next == size; }
+    const gcsa::KMer& peek(void) const { return buffer[next]; }
+    void pop(void) {
+        if (++next == size) fill();
+    }
+private:
+    ifstream in;
+    vector<gcsa::KMer> buffer;
+    size_t next;
+    size_t size;
+    void fill(void) {
+        in.read((char*) buffer.data(), buffer.size() * sizeof(gcsa::KMer));
+        size = in.gcount() / sizeof(gcsa::KMer);
+        next = 0;
+    }
+};
+
+const size_t KmerSorter::DEFAULT_MEMORY_LIMIT;
+
+KmerSorter::KmerSorter(int kmer_size, size_t memory_limit, const string& base_file_name) :
+    kmer_size(kmer_size),
+    memory_limit(memory_limit),
+    base_file_name(base_file_name),
+    total_in(0) {
+}
+
+KmerSorter::~KmerSorter(void) {
+    for (auto& name : runs) {
+        remove(name.c_str());
+    }
+}
+
+size_t KmerSorter::run_kmers(void) const {
+    return max(MIN_READ_KMERS, memory_limit / sizeof(gcsa::KMer) / omp_get_max_threads());
+}
+
+void KmerSorter::add_run(vector<gcsa::KMer>& kmers) {
+    if (kmers.empty()) {
+        return;
+    }
+    sort(kmers.begin(), kmers.end(), kmer_less);
+    // merge in place; the output never gets ahead of the input
+    auto out = kmers.begin();
+    auto begin = kmers.begin();
+    while (begin != kmers.end()) {
+        auto end = begin + 1;
+        while (end != kmers.end() && same_start(*begin, *end)) ++end;
+        out = merge_start(begin, end, out);
+        begin = end;
+    }
+    size_t count = kmers.size();
+    kmers.erase(out, kmers.end());
+
+    string name = write_run(kmers);
+    kmers.clear();
+    lock_guard<mutex> lock(runs_mutex);
+    runs.push_back(name);
+    total_in += count;
+}
+
+string KmerSorter::write_run(const vector<gcsa::KMer>& kmers) {
+    string name = tmpfilename(base_file_name);
+    ofstream out(name, ios::binary);
+    out.write((const char*) kmers.data(), kmers.size() * sizeof(gcsa::KMer));
+    if (!out) {
+        throw runtime_error("[KmerSorter] could not write run " + name);
+    }
+    return name;
+}
+
+void KmerSorter::merge_runs(const vector<string>& run_names, size_t buffer_kmers,
+                            const function<void(const gcsa::KMer&)>& lambda) {
+    vector<unique_ptr<KmerRunReader>> readers;
+    for (auto& name : run_names) {
+        readers.emplace_back(new KmerRunReader(name, buffer_kmers));
+    }
+    // the reader with the least kmer on top
+    auto greater = [&readers](size_t a, size_t b) {
+        return kmer_less(readers[b]->peek(), readers[a]->peek());
+    };
+    priority_queue<size_t, vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t i = 0; i < readers.size(); ++i) {
+        if (!readers[i]->done()) heap.push(i);
+    }
+
+    // the kmers with the current start, which all have to be seen before
+    // any of them can be passed on
+    vector<gcsa::KMer> group;
+    auto flush = [&]() {
+        auto end = merge_start(group.begin(), group.end(), group.begin());
+        for (auto it = group.begin(); it != end; ++it) {
+            lambda(*it);
+        }
+        group.clear();
+    };
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+        const gcsa::KMer& kmer = readers[i]->peek();
+        if (!group.empty() && !same_start(group.front(), kmer)) {
+            flush();
+        }
+        group.push_back(kmer);
+        readers[i]->pop();
+        if (!readers[i]->done()) heap.push(i);
+    }
+    if (!group.empty()) {
+        flush();
+    }
+}
+
+void KmerSorter::for_each_kmer(const function<void(const gcsa::KMer&)>& lambda) {
+    size_t memory_kmers = memory_limit / sizeof(gcsa::KMer);
+    size_t fan_in = max((size_t) 2, memory_kmers / MIN_READ_KMERS);
+
+    // merge groups of runs into bigger runs until there are few enough to
+    // merge at once
+    while (runs.size() > fan_in) {
+        vector<string> group(runs.begin(), runs.begin() + fan_in);
+        string name = tmpfilename(base_file_name);
+        ofstream out(name, ios::binary);
+        vector<gcsa::KMer> merged;
+        merged.reserve(WRITE_KMERS);
+        auto write_merged = [&]() {
+            out.write((const char*) merged.data(), merged.size() * sizeof(gcsa::KMer));
+            merged.clear();
+        };
+        merge_runs(group, max(MIN_READ_KMERS, memory_kmers / (fan_in + 1)),
+                   [&](const gcsa::KMer& kmer) {
+                       merged.push_back(kmer);
+                       if (merged.size() >= WRITE_KMERS) write_merged();
+                   });
+        write_merged();
+        out.close();
+        if (!out) {
+            throw runtime_error("[KmerSorter] could not write run " + name);
+        }
+        for (auto& merged_name : group) {
+            remove(merged_name.c_str());
+        }
+        runs.erase(runs.begin(), runs.begin() + fan_in);
+        runs.push_back(name);
+    }
+
+    if (!runs.empty()) {
+        merge_runs(runs, max(MIN_READ_KMERS, memory_kmers / runs.size()), lambda);
+    }
+    for (auto& name : runs) {
+        remove(name.c_str());
+    }
+    runs.clear();
+}
+
+size_t KmerSorter::write(ostream& out) {
+    size_t count = 0;
+    vector<gcsa::KMer> block;
+    block.reserve(WRITE_KMERS);
+    for_each_kmer([&](const gcsa::KMer& kmer) {
+            block.push_back(kmer);
+            if (block.size() >= WRITE_KMERS) {
+                count += block.size();
+                gcsa::writeBinary(out, block, kmer_size);
+                block.clear();
+            }
+        });
+    if (!block.empty()) {
+        count += block.size();
+        gcsa::writeBinary(out, block, kmer_size);
+    }
+    return count;
+}
+
+}
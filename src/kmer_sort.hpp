@@ -0,0 +1,83 @@
+#ifndef VG_KMER_SORT_H
+#define VG_KMER_SORT_H
+// kmer_sort.hpp: defines KmerSorter, which sorts and merges the kmers for a
+// GCSA2 index on disk, in bounded memory
+
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "gcsa.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Sorts the kmers that go into a GCSA2 index, and merges the kmers that have
+ * the same label and start position, so that GCSA2 gets each of them once.
+ *
+ * Kmers come in as runs, from any number of threads. Each run is sorted and
+ * merged in memory and then written to a temporary file, and the runs are
+ * merged on the way out. The memory limit covers the runs being filled and
+ * the buffers the merge reads the runs with: callers should not let the runs
+ * they fill grow past run_kmers() kmers between them. If there are too many
+ * runs to merge at once in the memory limit, they are merged a group at a
+ * time into bigger runs first.
+ */
+class KmerSorter {
+public:
+
+    /// Sort kmers of the given size in about memory_limit bytes.
+    KmerSorter(int kmer_size, size_t memory_limit = DEFAULT_MEMORY_LIMIT,
+               const string& base_file_name = ".vg-kmer-run-");
+    ~KmerSorter(void);
+
+    KmerSorter(const KmerSorter&) = delete;
+    KmerSorter& operator=(const KmerSorter&) = delete;
+
+    /// How many kmers each thread can hold in a run before it should add
+    /// the run.
+    size_t run_kmers(void) const;
+
+    /// Sort, merge, and write out a run of kmers, leaving the vector empty.
+    /// Safe to call from many threads at once.
+    void add_run(vector<gcsa::KMer>& kmers);
+
+    /// Call the lambda on each of the kmers, in sorted order. Kmers with the
+    /// same label and start position all get the union of their predecessor
+    /// and successor characters, and repeated successors are dropped. The
+    /// runs are used up, so this can only be called once.
+    void for_each_kmer(const function<void(const gcsa::KMer&)>& lambda);
+
+    /// Write the merged kmers to out, in GCSA2's binary format. Returns the
+    /// number of kmers written.
+    size_t write(ostream& out);
+
+    /// Number of kmers that went into the runs, before any merging.
+    size_t kmers_in(void) const { return total_in; }
+
+    /// 1 GB
+    static const size_t DEFAULT_MEMORY_LIMIT = (size_t) 1 << 30;
+
+private:
+
+    int kmer_size;
+    size_t memory_limit;
+    string base_file_name;
+    // the files holding the sorted runs
+    vector<string> runs;
+    size_t total_in;
+    mutex runs_mutex;
+
+    // write a sorted, merged run to a new temporary file and return its name
+    string write_run(const vector<gcsa::KMer>& kmers);
+    // merge the sorted runs, calling the lambda on the merged kmers
+    void merge_runs(const vector<string>& run_names, size_t buffer_kmers,
+                    const function<void(const gcsa::KMer&)>& lambda);
+};
+
+}
+
+#endif
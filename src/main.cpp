@@ -4,6 +4,8 @@
 #include <cstdio>
 #include <getopt.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <csignal>
 #include "gcsa.h"
 // From gcsa2
 #include "files.h"
@@ -31,6 +33,8 @@
 #include "bubbles.hpp"
 #include "translator.hpp"
 #include "readfilter.hpp"
+#include "stream_index.hpp"
+#include "map_server.hpp"
 #include "distributions.hpp"
 #include "unittest/driver.hpp"
 // New subcommand system provides main_construct and help_construct
@@ -1169,6 +1173,7 @@ void help_call(char** argv) {
          << "    -b, --max_strand_bias FLOAT limit to absolute difference between 0.5 and proportion of supporting reads on reverse strand. [" << Caller::Default_max_strand_bias << "]" << endl
          << "    -a, --link-alts            add all possible edges between adjacent alts" << endl
          << "    -A, --aug-graph FILE       write out the agumented graph in vg format" << endl
+         << "    -T, --calls-tsv FILE       write the calls on the augmented graph to FILE as TSV (for debugging)" << endl
          << "    -r, --ref PATH             use the given path name as the reference path" << endl
          << "    -c, --contig NAME          use the given name as the VCF contig name" << endl
          << "    -S, --sample NAME          name the sample in the VCF with the given name [SAMPLE]" << endl
@@ -1187,6 +1192,8 @@ void help_call(char** argv) {
          << "    -u, --use_avg_support      use average instead of minimum support" << endl
          << "    -I, --singleallelic        disable support for multiallelic sites" << endl
          << "    -E, --min_mad              min. minimum allele depth required to PASS filter [5]" << endl
+         << "    -N, --node-range N:M       only use pileups on nodes N to M (inclusive), using the" << endl
+         << "                               pileup's block index (vg index -U)" << endl
          << "    -h, --help                 print this help message" << endl
          << "    -p, --progress             show progress" << endl
          << "    -v, --verbose              print information and warnings about vcf generation" << endl
@@ -1208,6 +1215,7 @@ int main_call(int argc, char** argv) {
     int default_read_qual = Caller::Default_default_quality;
     double max_strand_bias = Caller::Default_max_strand_bias;
     string aug_file;
+    string calls_tsv_file;
     bool bridge_alts = false;
     // Option variables (formerly from glenn2vcf)
     // What's the name of the reference path in the graph?
@@ -1265,6 +1273,9 @@ int main_call(int argc, char** argv) {
     // what's the minimum minimum allele depth to give a PASS in the filter column
     // (anything below gets FAIL)
     size_t min_mad_for_filter = 5;
+    // If set, only read the pileups for this range of node IDs, through the
+    // pileup file's block index
+    string node_range;
 
     bool show_progress = false;
     bool verbose = false;
@@ -1282,6 +1293,7 @@ int main_call(int argc, char** argv) {
                 {"default_read_qual", required_argument, 0, 'q'},
                 {"max_strand_bias", required_argument, 0, 'b'},
                 {"aug_graph", required_argument, 0, 'A'},
+                {"calls-tsv", required_argument, 0, 'T'},
                 {"link-alts", no_argument, 0, 'a'},
                 {"progress", no_argument, 0, 'p'},
                 {"verbose", no_argument, 0, 'v'},
@@ -1304,12 +1316,13 @@ int main_call(int argc, char** argv) {
                 {"use_avg_support", no_argument, 0, 'u'},
                 {"singleallelic", no_argument, 0, 'I'},
                 {"min_mad", required_argument, 0, 'E'},
+                {"node-range", required_argument, 0, 'N'},
                 {"help", no_argument, 0, 'h'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:e:s:f:q:b:A:apvt:r:c:S:o:D:l:PF:H:R:M:n:B:C:OuIE:h",
+        c = getopt_long (argc, argv, "d:e:s:f:q:b:A:T:apvt:r:c:S:o:D:l:PF:H:R:M:n:B:C:OuIE:N:h",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -1417,6 +1430,12 @@ int main_call(int argc, char** argv) {
             // Minimum min-allele-depth required to give Filter column a PASS
             min_mad_for_filter = std::stoi(optarg);
             break;
+        case 'T':
+            calls_tsv_file = optarg;
+            break;
+        case 'N':
+            node_range = optarg;
+            break;
         case 'p':
             show_progress = true;
             break;
@@ -1484,10 +1503,16 @@ int main_call(int argc, char** argv) {
         pileup_stream = &in;
     }
 
-    // this is the call tsv file that was used to communicate with glenn2vcf
-    // it's still here for the time being but never actually written
-    // (just passed as a string to the caller)
-    stringstream text_file_stream;
+    // the calls were once passed to glenn2vcf as this tsv file, which is now
+    // only written for debugging
+    ofstream calls_tsv_stream;
+    if (!calls_tsv_file.empty()) {
+        calls_tsv_stream.open(calls_tsv_file);
+        if (!calls_tsv_stream) {
+            cerr << "error: can't write calls to " << calls_tsv_file << endl;
+            exit(1);
+        }
+    }
 
     // compute the augmented graph
     if (show_progress) {
@@ -1497,17 +1522,68 @@ int main_call(int argc, char** argv) {
                   het_prior, min_depth, max_depth, min_support,
                   min_frac, Caller::Default_min_log_likelihood,
                   true, default_read_qual, max_strand_bias,
-                  &text_file_stream, bridge_alts);
+                  calls_tsv_file.empty() ? NULL : &calls_tsv_stream, bridge_alts);
 
+    // node pileups are queued up to be called a batch at a time across all
+    // the threads, and added to the augmented graph in the order they're read
     function<void(Pileup&)> lambda = [&caller](Pileup& pileup) {
         for (int i = 0; i < pileup.node_pileups_size(); ++i) {
-            caller.call_node_pileup(pileup.node_pileups(i));
+            caller.queue_node_pileup(*pileup.mutable_node_pileups(i));
         }
         for (int i = 0; i < pileup.edge_pileups_size(); ++i) {
             caller.call_edge_pileup(pileup.edge_pileups(i));
         }
     };
-    stream::for_each(*pileup_stream, lambda);
+    if (CompactPileups::is_compact(*pileup_stream)) {
+        // written by vg pileup -c
+        if (!node_range.empty() || pileupAnnotate) {
+            cerr << "error: -N and -P need a pileup in the protobuf format, not from vg pileup -c." << endl;
+            exit(1);
+        }
+        CompactPileups::for_each(*pileup_stream,
+                                 [&caller](CompactNodePileup& pileup) {
+                                     caller.queue_node_pileup(pileup);
+                                 },
+                                 [&caller](CompactEdgePileup& pileup) {
+                                     caller.call_edge_pileup(pileup);
+                                 });
+    } else if (node_range.empty()) {
+        stream::for_each(*pileup_stream, lambda);
+    } else {
+        // read only the blocks of the pileup that may overlap the range
+        if (pileup_file_name == "-") {
+            cerr << "error: -N needs a pileup file with a block index, not stdin." << endl;
+            exit(1);
+        }
+        vg::id_t start_id = 0;
+        vg::id_t end_id = 0;
+        vector<string> parts = split_delims(node_range, ":");
+        convert(parts.front(), start_id);
+        convert(parts.back(), end_id);
+        ifstream index_in(pileup_file_name + BlockIndex::EXTENSION);
+        if (!index_in) {
+            cerr << "error: block index " << pileup_file_name + BlockIndex::EXTENSION << " not found." << endl;
+            exit(1);
+        }
+        BlockIndex block_index(index_in);
+        auto in_range = [&](vg::id_t id) {
+            return id >= start_id && id <= end_id;
+        };
+        function<void(Pileup&)> range_lambda = [&](Pileup& pileup) {
+            for (int i = 0; i < pileup.node_pileups_size(); ++i) {
+                if (in_range(pileup.node_pileups(i).node_id())) {
+                    caller.queue_node_pileup(*pileup.mutable_node_pileups(i));
+                }
+            }
+            for (int i = 0; i < pileup.edge_pileups_size(); ++i) {
+                const Edge& edge = pileup.edge_pileups(i).edge();
+                if (in_range(edge.from()) || in_range(edge.to())) {
+                    caller.call_edge_pileup(pileup.edge_pileups(i));
+                }
+            }
+        };
+        block_index.for_each_in_range(in, start_id, end_id, range_lambda);
+    }
 
     // map the edges from original graph
     if (show_progress) {
@@ -1538,7 +1614,7 @@ int main_call(int argc, char** argv) {
     // in order to create a VCF of calls.  this
     // was once a separate tool called glenn2vcf
     glenn2vcf::call2vcf(caller._call_graph,
-                        text_file_stream.str(),
+                        caller._call_records,
                         refPathName,
                         contigName,
                         sampleName,
@@ -1581,8 +1657,14 @@ void help_genotype(char** argv) {
          << "    -C, --cactus            use cactus ultrabubbles for site finding" << std::endl
          << "    -S, --subset-graph      only use the reference and areas of the graph with read support" << std::endl
          << "    -i, --realign_indels    realign at indels" << std::endl
+         << "    -M, --max_mismatches N  when realigning, take reads within N mismatches of an allele as they are" << std::endl
+         << "                            instead of realigning them (-1 to realign them all) (default=0)" << std::endl
          << "    -d, --het_prior_denom   denominator for prior probability of heterozygousness" << std::endl
          << "    -P, --min_per_strand    min consistent reads per strand for an allele" << std::endl
+         << "    -w, --window N          genotype N bp of the reference path at a time, loading only" << std::endl
+         << "                            the reads and subgraph around each window (sites off the" << std::endl
+         << "                            reference path are skipped)" << std::endl
+         << "    -W, --window-context N  reference bp to either side of each window to include (default=1000)" << std::endl
          << "    -p, --progress          show progress" << endl
          << "    -t, --threads N         number of threads to use" << endl;
 }
@@ -1617,6 +1699,8 @@ int main_genotype(int argc, char** argv) {
     bool use_mapq = false;
     // Should we do indel realignment?
     bool realign_indels = false;
+    // How many mismatches from an allele can a read have and still not need realigning?
+    int max_comparison_mismatches = 0;
 
     // Should we dump the augmented graph to a file?
     string augmented_file_name;
@@ -1629,6 +1713,10 @@ int main_genotype(int argc, char** argv) {
     double het_prior_denominator = 10.0;
     // At least how many reads must be consistent per strand for a call?
     size_t min_consistent_per_strand = 2;
+    // How many reference bp should we genotype at a time? (0 for all of them)
+    size_t window_size = 0;
+    // How much reference context should each window have on each side?
+    size_t window_context = 1000;
 
     int c;
     optind = 2; // force optind past command positional arguments
@@ -1647,15 +1735,18 @@ int main_genotype(int argc, char** argv) {
                 {"cactus", no_argument, 0, 'C'},
                 {"subset-graph", no_argument, 0, 'S'},
                 {"realign_indels", no_argument, 0, 'i'},
+                {"max_mismatches", required_argument, 0, 'M'},
                 {"het_prior_denom", required_argument, 0, 'd'},
                 {"min_per_strand", required_argument, 0, 'P'},
+                {"window", required_argument, 0, 'w'},
+                {"window-context", required_argument, 0, 'W'},
                 {"progress", no_argument, 0, 'p'},
                 {"threads", required_argument, 0, 't'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hjvr:c:s:o:l:a:qCSid:P:pt:",
+        c = getopt_long (argc, argv, "hjvr:c:s:o:l:a:qCSiM:d:P:w:W:pt:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -1710,6 +1801,10 @@ int main_genotype(int argc, char** argv) {
             // Do indel realignment
             realign_indels = true;
             break;
+        case 'M':
+            // Set how far a read can be from an allele and not be realigned
+            max_comparison_mismatches = atoi(optarg);
+            break;
         case 'd':
             // Set heterozygous genotype prior denominator
             het_prior_denominator = std::stod(optarg);
@@ -1718,6 +1813,14 @@ int main_genotype(int argc, char** argv) {
             // Set min consistent reads per strand required to keep an allele
             min_consistent_per_strand = std::stoll(optarg);
             break;
+        case 'w':
+            // Genotype a window of the reference at a time
+            window_size = std::stoll(optarg);
+            break;
+        case 'W':
+            // Set the context around each window
+            window_context = std::stoll(optarg);
+            break;
         case 'p':
             show_progress = true;
             break;
@@ -1739,6 +1842,11 @@ int main_genotype(int argc, char** argv) {
         omp_set_num_threads(thread_count);
     }
 
+    if (window_size > 0 && !augmented_file_name.empty()) {
+        cerr << "error:[vg genotype] the augmented graph can't be dumped when genotyping in windows" << endl;
+        return 1;
+    }
+
     // read the graph
     if (optind >= argc) {
         help_genotype(argv);
@@ -1772,6 +1880,39 @@ int main_genotype(int argc, char** argv) {
     Index index;
     index.open_read_only(reads_index_name);
 
+    // Make a Genotyper to do the genotyping
+    Genotyper genotyper;
+    // Configure it
+    genotyper.use_mapq = use_mapq;
+    genotyper.realign_indels = realign_indels;
+    genotyper.max_comparison_mismatches = max_comparison_mismatches;
+    assert(het_prior_denominator > 0);
+    genotyper.het_prior_logprob = prob_to_logprob(1.0/het_prior_denominator);
+    genotyper.min_consistent_per_strand = min_consistent_per_strand;
+
+    if (window_size > 0) {
+        // Pull the reads out of the index a window at a time
+        genotyper.run_windowed(*graph,
+                               index,
+                               cout,
+                               window_size,
+                               window_context,
+                               ref_path_name,
+                               contig_name,
+                               sample_name,
+                               use_cactus,
+                               subset_graph,
+                               show_progress,
+                               output_vcf,
+                               output_json,
+                               length_override,
+                               variant_offset);
+
+        delete graph;
+
+        return 0;
+    }
+
     // Build the set of all the node IDs to operate on
     vector<vg::id_t> graph_ids;
     graph->for_each_node([&](Node* node) {
@@ -1808,14 +1949,6 @@ int main_genotype(int argc, char** argv) {
         cerr << "Loaded " << alignments.size() << " alignments" << endl;
     }
 
-    // Make a Genotyper to do the genotyping
-    Genotyper genotyper;
-    // Configure it
-    genotyper.use_mapq = use_mapq;
-    genotyper.realign_indels = realign_indels;
-    assert(het_prior_denominator > 0);
-    genotyper.het_prior_logprob = prob_to_logprob(1.0/het_prior_denominator);
-    genotyper.min_consistent_per_strand = min_consistent_per_strand;
     // TODO: move arguments below up into configuration
     genotyper.run(*graph,
                   alignments,
@@ -1843,11 +1976,15 @@ void help_pileup(char** argv) {
          << endl
          << "options:" << endl
          << "    -j, --json              output in JSON" << endl
+         << "    -c, --compact           output in the compact format, as counts of each allele" << endl
+         << "                            instead of strings of read bases (vg call reads either)" << endl
          << "    -q, --min-quality N     ignore bases with PHRED quality < N (default=0)" << endl
          << "    -m, --max-mismatches N  ignore bases with > N mismatches within window centered on read (default=1)" << endl
          << "    -w, --window-size N     size of window to apply -m option (default=0)" << endl
          << "    -d, --max-depth N       maximum depth pileup to create (further maps ignored) (default=1000)" << endl
          << "    -a, --use-mapq          combine mapping qualities with base qualities" << endl
+         << "    -R, --node-range N:M    only pile up reads touching nodes N to M (inclusive), using" << endl
+         << "                            the GAM's block index (vg index -B)" << endl
          << "    -p, --progress          show progress" << endl
          << "    -t, --threads N         number of threads to use" << endl
          << "    -v, --verbose           print stats on bases filtered" << endl;
@@ -1861,6 +1998,7 @@ int main_pileup(int argc, char** argv) {
     }
 
     bool output_json = false;
+    bool output_compact = false;
     bool show_progress = false;
     int thread_count = 1;
     int min_quality = 0;
@@ -1869,6 +2007,7 @@ int main_pileup(int argc, char** argv) {
     int max_depth = 1000; // used to prevent protobuf messages getting to big
     bool verbose = false;
     bool use_mapq = false;
+    string node_range;
 
     int c;
     optind = 2; // force optind past command positional arguments
@@ -1876,6 +2015,7 @@ int main_pileup(int argc, char** argv) {
         static struct option long_options[] =
             {
                 {"json", required_argument, 0, 'j'},
+                {"compact", no_argument, 0, 'c'},
                 {"min-quality", required_argument, 0, 'q'},
                 {"max-mismatches", required_argument, 0, 'm'},
                 {"window-size", required_argument, 0, 'w'},
@@ -1884,11 +2024,12 @@ int main_pileup(int argc, char** argv) {
                 {"use-mapq", no_argument, 0, 'a'},
                 {"threads", required_argument, 0, 't'},
                 {"verbose", no_argument, 0, 'v'},
+                {"node-range", required_argument, 0, 'R'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "jq:m:w:pd:at:v",
+        c = getopt_long (argc, argv, "jcq:m:w:pd:at:vR:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -1900,6 +2041,9 @@ int main_pileup(int argc, char** argv) {
         case 'j':
             output_json = true;
             break;
+        case 'c':
+            output_compact = true;
+            break;
         case 'q':
             min_quality = atoi(optarg);
             break;
@@ -1924,6 +2068,9 @@ int main_pileup(int argc, char** argv) {
         case 'v':
             verbose = true;
             break;
+        case 'R':
+            node_range = optarg;
+            break;
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -1936,6 +2083,10 @@ int main_pileup(int argc, char** argv) {
     }
     omp_set_num_threads(thread_count);
     thread_count = get_thread_count();
+    if (output_json && output_compact) {
+        cerr << "error: -j and -c can't be used together." << endl;
+        exit(1);
+    }
 
     // read the graph
     if (show_progress) {
@@ -1978,38 +2129,73 @@ int main_pileup(int argc, char** argv) {
     if (show_progress) {
         cerr << "Computing pileups" << endl;
     }
-    vector<Pileups> pileups(thread_count, Pileups(graph, min_quality, max_mismatches, window_size, max_depth, use_mapq));
-    function<void(Alignment&)> lambda = [&pileups, &graph](Alignment& aln) {
+    // one shard of the node IDs for each thread, which each thread hands its
+    // own pileups over to as they fill up, so there's only ever one table the
+    // size of the graph, and nothing to merge at the end. With -c they count
+    // up what they absorb as they go, so no base keeps a string of its reads.
+    PileupShards pileups(graph, thread_count, min_quality, max_mismatches, window_size, max_depth, use_mapq,
+                         output_compact);
+    vector<Pileups> thread_pileups(thread_count, pileups.make_pileups());
+    function<void(Alignment&)> lambda = [&pileups, &thread_pileups](Alignment& aln) {
         int tid = omp_get_thread_num();
-        pileups[tid].compute_from_alignment(aln);
+        thread_pileups[tid].compute_from_alignment(aln);
+        pileups.absorb_if_full(thread_pileups[tid]);
     };
-    stream::for_each_parallel(*alignment_stream, lambda);
-
-    // single-threaded (!) merge
-    if (show_progress && pileups.size() > 1) {
-        cerr << "Merging pileups" << endl;
+    if (node_range.empty()) {
+        stream::for_each_parallel(*alignment_stream, lambda);
+    } else {
+        // read only the blocks of the GAM that may overlap the range
+        if (alignments_file_name == "-") {
+            cerr << "error: -R needs a GAM file with a block index, not stdin." << endl;
+            exit(1);
+        }
+        vg::id_t start_id = 0;
+        vg::id_t end_id = 0;
+        vector<string> parts = split_delims(node_range, ":");
+        convert(parts.front(), start_id);
+        convert(parts.back(), end_id);
+        ifstream index_in(alignments_file_name + BlockIndex::EXTENSION);
+        if (!index_in) {
+            cerr << "error: block index " << alignments_file_name + BlockIndex::EXTENSION << " not found." << endl;
+            exit(1);
+        }
+        BlockIndex block_index(index_in);
+        function<void(Alignment&)> in_range = [&](Alignment& aln) {
+            for (size_t i = 0; i < aln.path().mapping_size(); ++i) {
+                vg::id_t id = aln.path().mapping(i).position().node_id();
+                if (id >= start_id && id <= end_id) {
+                    lambda(aln);
+                    break;
+                }
+            }
+        };
+        block_index.for_each_in_range(in, start_id, end_id, in_range);
     }
-    for (int i = 1; i < pileups.size(); ++i) {
-        pileups[0].merge(pileups[i]);
+
+#pragma omp parallel for
+    for (int i = 0; i < thread_pileups.size(); ++i) {
+        pileups.absorb(thread_pileups[i]);
     }
 
     // spit out the pileup
     if (show_progress) {
         cerr << "Writing pileups" << endl;
     }
-    if (output_json == false) {
-        pileups[0].write(std::cout);
+    if (output_compact) {
+        pileups.write_compact(std::cout);
+    } else if (output_json == false) {
+        pileups.write(std::cout);
     } else {
-        pileups[0].to_json(std::cout);
+        pileups.to_json(std::cout);
     }
 
     delete graph;
 
     // number of bases filtered
     if (verbose) {
-        cerr << "Bases filtered by min. quality: " << pileups[0]._min_quality_count << endl
-             << "Bases filtered by max mismatch: " << pileups[0]._max_mismatch_count << endl
-             << "Total bases:                    " << pileups[0]._bases_count << endl << endl;
+        cerr << "Bases filtered by min. quality: " << pileups.min_quality_count() << endl
+             << "Bases filtered by max mismatch: " << pileups.max_mismatch_count() << endl
+             << "Total bases:                    " << pileups.bases_count() << endl << endl;
     }
 
     return 0;
@@ -2053,6 +2239,9 @@ void help_msga(char** argv) {
          << "    -Q, --idx-prune-subs N  prune subgraphs shorter than this length from input graph to GCSA (default: off)" << endl
          << "    -m, --node-max N        chop nodes to be shorter than this length (default: 2* --idx-kmer-size)" << endl
          << "    -X, --idx-doublings N   use this many doublings when building the GCSA indexes (default: 2)" << endl
+         << "    -u, --idx-delta-max F   index sequence added to the graph in a separate small GCSA index, and" << endl
+         << "                            rebuild the full index only once it passes this fraction of the graph" << endl
+         << "                            (default: 0, rebuild the full index after every sequence)" << endl
          << "graph normalization:" << endl
          << "    -N, --normalize         normalize the graph after assembly" << endl
          << "    -z, --allow-nonpath     don't remove parts of the graph that aren't in the paths of the inputs" << endl
@@ -2115,6 +2304,7 @@ int main_msga(int argc, char** argv) {
     int gap_extend = 1;
     bool circularize = false;
     int sens_step = 5;
+    float idx_delta_max = 0;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -2156,11 +2346,12 @@ int main_msga(int argc, char** argv) {
                 {"gap-open", required_argument, 0, 'o'},
                 {"gap-extend", required_argument, 0, 'e'},
                 {"circularize", no_argument, 0, 'C'},
+                {"idx-delta-max", required_argument, 0, 'u'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hf:n:s:g:b:K:X:B:DAc:P:E:Q:NzI:L:Y:H:t:m:GS:M:T:q:OI:a:i:o:e:C",
+        c = getopt_long (argc, argv, "hf:n:s:g:b:K:X:B:DAc:P:E:Q:NzI:L:Y:H:t:m:GS:M:T:q:OI:a:i:o:e:Cu:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -2272,6 +2463,10 @@ int main_msga(int argc, char** argv) {
             circularize = true;
             break;
 
+        case 'u':
+            idx_delta_max = atof(optarg);
+            break;
+
         case 'P':
             min_identity = atof(optarg);
             break;
@@ -2320,6 +2515,11 @@ int main_msga(int argc, char** argv) {
         }
     }
 
+    if (idx_delta_max < 0) {
+        cerr << "[vg msga] Error: --idx-delta-max must not be negative" << endl;
+        return 1;
+    }
+
     // build the graph or read it in from input
     VG* graph;
     if (graph_files.size() == 1) {
@@ -2415,33 +2615,37 @@ int main_msga(int argc, char** argv) {
     gcsa::LCPArray* lcpidx = nullptr;
     xg::XG* xgidx = nullptr;
     size_t iter = 0;
+    // when indexing incrementally, where the nodes the full GCSA index was
+    // built on fall along the paths, and the index of what's been added since
+    PathAnchors* anchors = nullptr;
+    gcsa::GCSA* delta_gcsaidx = nullptr;
+    gcsa::LCPArray* delta_lcpidx = nullptr;
 
-    auto rebuild = [&](VG* graph) {
-        //stringstream s; s << iter++ << ".vg";
-
-        if (mapper) delete mapper;
-        if (xgidx) delete xgidx;
-        if (gcsaidx) delete gcsaidx;
-        if (lcpidx) delete lcpidx;
-
-        if (debug) cerr << "building xg index" << endl;
-        xgidx = new xg::XG(graph->graph);
-
-        if (debug) cerr << "building GCSA2 index" << endl;
+    auto build_gcsa = [&](VG& to_index, gcsa::GCSA*& g, gcsa::LCPArray*& l) {
         // Configure GCSA2 verbosity so it doesn't spit out loads of extra info
         if(!debug) gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
 
         if (edge_max) {
-            VG gcsa_graph = *graph; // copy the graph
+            VG gcsa_graph = to_index; // copy the graph
             // remove complex components
             gcsa_graph.prune_complex_with_head_tail(idx_kmer_size, edge_max);
             if (subgraph_prune) gcsa_graph.prune_short_subgraphs(subgraph_prune);
             // then index
-            gcsa_graph.build_gcsa_lcp(gcsaidx, lcpidx, idx_kmer_size, idx_path_only, false, doubling_steps);
+            gcsa_graph.build_gcsa_lcp(g, l, idx_kmer_size, idx_path_only, false, doubling_steps);
         } else {
             // if no complexity reduction is requested, just build the index
-            graph->build_gcsa_lcp(gcsaidx, lcpidx, idx_kmer_size, idx_path_only, false, doubling_steps);
+            to_index.build_gcsa_lcp(g, l, idx_kmer_size, idx_path_only, false, doubling_steps);
         }
+    };
+
+    auto clear_delta = [&]() {
+        if (delta_gcsaidx) delete delta_gcsaidx;
+        if (delta_lcpidx) delete delta_lcpidx;
+        delta_gcsaidx = nullptr;
+        delta_lcpidx = nullptr;
+    };
+
+    auto make_mapper = [&](bool graph_changed) {
         mapper = new Mapper(xgidx, gcsaidx, lcpidx);
         { // set mapper variables
             mapper->debug = debug_align;
@@ -2467,6 +2671,74 @@ int main_msga(int argc, char** argv) {
 
             mapper->mem_threading = true;
         }
+        if (graph_changed) {
+            // the full index is of an older graph
+            mapper->gcsa_anchors = anchors;
+            mapper->delta_gcsa = delta_gcsaidx;
+            mapper->delta_lcp = delta_lcpidx;
+        }
+    };
+
+    auto rebuild = [&](VG* graph) {
+        //stringstream s; s << iter++ << ".vg";
+
+        if (mapper) delete mapper;
+        if (xgidx) delete xgidx;
+        if (gcsaidx) delete gcsaidx;
+        if (lcpidx) delete lcpidx;
+        if (anchors) delete anchors;
+        anchors = nullptr;
+        clear_delta();
+
+        if (debug) cerr << "building xg index" << endl;
+        xgidx = new xg::XG(graph->graph);
+
+        if (debug) cerr << "building GCSA2 index" << endl;
+        build_gcsa(*graph, gcsaidx, lcpidx);
+        if (idx_delta_max) {
+            anchors = new PathAnchors(*graph);
+        }
+        make_mapper(false);
+    };
+
+    // bring the indexes up to date with the graph after it has been edited
+    auto update_indexes = [&](VG* graph) {
+        if (!idx_delta_max) {
+            rebuild(graph);
+            return;
+        }
+        // the nodes off the paths the full index was built with hold the new sequence
+        anchors->update(*graph);
+        VG delta;
+        size_t new_length = 0;
+        graph->for_each_node([&](Node* node) {
+                if (!anchors->on_anchoring_path(node->id())) {
+                    delta.add_node(*node);
+                    delta.add_edges(graph->edges_of(node));
+                    new_length += node->sequence().size();
+                }
+            });
+        if (new_length > idx_delta_max * graph->length()) {
+            if (debug) cerr << "new sequence passed " << idx_delta_max << " of the graph, rebuilding indexes" << endl;
+            rebuild(graph);
+            return;
+        }
+
+        if (mapper) delete mapper;
+        if (xgidx) delete xgidx;
+        clear_delta();
+
+        if (debug) cerr << "building xg index" << endl;
+        xgidx = new xg::XG(graph->graph);
+
+        if (new_length) {
+            if (debug) cerr << "building GCSA2 index of " << new_length << "bp of new sequence" << endl;
+            // take in enough of the graph around the new sequence for the
+            // kmers that cross into the old sequence
+            graph->expand_context(delta, idx_kmer_size);
+            build_gcsa(delta, delta_gcsaidx, delta_lcpidx);
+        }
+        make_mapper(true);
     };
 
     // set up the graph for mapping
@@ -2543,7 +2815,7 @@ int main_msga(int argc, char** argv) {
             graph->graph.clear_path();
             graph->paths.to_graph(graph->graph);
             // and rebuild the indexes
-            rebuild(graph);
+            update_indexes(graph);
             //graph->serialize_to_file(name + "-post-index.vg");
 
             // verfy validity of path
@@ -2685,7 +2957,9 @@ void help_surject(char** argv) {
         << "    -b, --bam-output        write BAM to stdout" << endl
         << "    -s, --sam-output        write SAM to stdout" << endl
         << "    -C, --compression N     level for compression [0-9]" << endl
-        << "    -w, --window N          use N nodes on either side of the alignment to surject (default 5)" << endl;
+        << "    -w, --window N          use N nodes on either side of the alignment to surject (default 5)" << endl
+        << "    -r, --realign           realign every read to the path, rather than projecting the parts" << endl
+        << "                            that follow it onto it" << endl;
 }
 
 int main_surject(int argc, char** argv) {
@@ -2706,6 +2980,7 @@ int main_surject(int argc, char** argv) {
     int window = 5;
     string fasta_filename;
     int context_depth = 3;
+    bool realign = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -2726,11 +3001,12 @@ int main_surject(int argc, char** argv) {
             {"compress", required_argument, 0, 'C'},
             {"window", required_argument, 0, 'w'},
             {"context-depth", required_argument, 0, 'n'},
+            {"realign", no_argument, 0, 'r'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:p:i:P:cbsH:C:t:w:f:n:",
+        c = getopt_long (argc, argv, "hx:p:i:P:cbsH:C:t:w:f:n:r",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -2793,6 +3069,10 @@ int main_surject(int argc, char** argv) {
             context_depth = atoi(optarg);
             break;
 
+        case 'r':
+            realign = true;
+            break;
+
         case 'h':
         case '?':
             help_surject(argv);
@@ -2844,6 +3124,7 @@ int main_surject(int argc, char** argv) {
         Mapper* m = new Mapper;
         m->xindex = xgidx;
         m->context_depth = context_depth;
+        m->surject_by_projection = !realign;
         mapper[i] = m;
     }
 
@@ -5380,10 +5661,11 @@ void help_find(char** argv) {
          << "    -P, --position-in PATH find the position of the node (specified by -n) in the given path" << endl
          << "    -r, --node-range N:M   get nodes from N to M" << endl
          << "    -G, --gam GAM          accumulate the graph touched by the alignments in the GAM" << endl
-         << "alignments: (rocksdb only)" << endl
+         << "alignments: (rocksdb, or -l for -i and -o)" << endl
          << "    -a, --alignments       writes alignments from index, sorted by node id" << endl
          << "    -i, --alns-in N:M      writes alignments whose start nodes is between N and M (inclusive)" << endl
          << "    -o, --alns-on N:M      writes alignments which align to any of the nodes between N and M (inclusive)" << endl
+         << "    -l, --sorted-gam FILE  use this GAM, block indexed with vg index -B, for -i and -o" << endl
          << "sequences:" << endl
          << "    -g, --gcsa FILE        use this GCSA2 index of the sequence space of the graph" << endl
          << "    -z, --kmer-size N      split up --sequence into kmers of size N" << endl
@@ -5432,6 +5714,7 @@ int main_find(int argc, char** argv) {
     bool pairwise_distance = false;
     string haplotype_alignments;
     string gam_file;
+    string sorted_gam_name;
     int max_mem_length = 0;
 
     int c;
@@ -5465,11 +5748,12 @@ int main_find(int argc, char** argv) {
                 {"distance", no_argument, 0, 'D'},
                 {"haplotypes", required_argument, 0, 'H'},
                 {"gam", required_argument, 0, 'G'},
+                {"sorted-gam", required_argument, 0, 'l'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:i:DH:G:",
+        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:i:DH:G:l:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -5579,6 +5863,10 @@ int main_find(int argc, char** argv) {
             gam_file = optarg;
             break;
 
+        case 'l':
+            sorted_gam_name = optarg;
+            break;
+
         case 'h':
         case '?':
             help_find(argv);
@@ -5603,7 +5891,7 @@ int main_find(int argc, char** argv) {
     // open index
     Index* vindex = nullptr;
     if (db_name.empty()) {
-        assert(!gcsa_in.empty() || !xg_name.empty());
+        assert(!gcsa_in.empty() || !xg_name.empty() || !sorted_gam_name.empty());
     } else {
         vindex = new Index;
         vindex->open_read_only(db_name);
@@ -5626,8 +5914,22 @@ int main_find(int argc, char** argv) {
         stream::write_buffered(cout, output_buf, 0);
     }
 
+    // the block index of the sorted GAM, if we are using one
+    BlockIndex gam_block_index;
+    ifstream sorted_gam;
+    if (!sorted_gam_name.empty()) {
+        sorted_gam.open(sorted_gam_name);
+        ifstream index_in(sorted_gam_name + BlockIndex::EXTENSION);
+        if (!sorted_gam || !index_in) {
+            cerr << "[vg find] error, could not open " << sorted_gam_name
+                 << " and its block index " << sorted_gam_name + BlockIndex::EXTENSION << endl;
+            return 1;
+        }
+        gam_block_index.load(index_in);
+    }
+
     if (!node_id_range.empty()) {
-        assert(!db_name.empty());
+        assert(!db_name.empty() || !sorted_gam_name.empty());
         vector<string> parts = split_delims(node_id_range, ":");
         if (parts.size() == 1) {
             convert(parts.front(), start_id);
@@ -5641,12 +5943,25 @@ int main_find(int argc, char** argv) {
             output_buf.push_back(aln);
             stream::write_buffered(cout, output_buf, 100);
         };
-        vindex->for_alignment_in_range(start_id, end_id, lambda);
+        if (!sorted_gam_name.empty()) {
+            function<void(Alignment&)> in_range = [&](Alignment& aln) {
+                // only the first node counts for -i
+                if (aln.path().mapping_size() > 0) {
+                    vg::id_t id = aln.path().mapping(0).position().node_id();
+                    if (id >= start_id && id <= end_id) {
+                        lambda(aln);
+                    }
+                }
+            };
+            gam_block_index.for_each_in_range(sorted_gam, start_id, end_id, in_range);
+        } else {
+            vindex->for_alignment_in_range(start_id, end_id, lambda);
+        }
         stream::write_buffered(cout, output_buf, 0);
     }
 
     if (!aln_on_id_range.empty()) {
-        assert(!db_name.empty());
+        assert(!db_name.empty() || !sorted_gam_name.empty());
         vector<string> parts = split_delims(aln_on_id_range, ":");
         if (parts.size() == 1) {
             convert(parts.front(), start_id);
@@ -5655,16 +5970,29 @@ int main_find(int argc, char** argv) {
             convert(parts.front(), start_id);
             convert(parts.back(), end_id);
         }
-        vector<vg::id_t> ids;
-        for (auto i = start_id; i <= end_id; ++i) {
-            ids.push_back(i);
-        }
         vector<Alignment> output_buf;
         auto lambda = [&output_buf](const Alignment& aln) {
             output_buf.push_back(aln);
             stream::write_buffered(cout, output_buf, 100);
         };
-        vindex->for_alignment_to_nodes(ids, lambda);
+        if (!sorted_gam_name.empty()) {
+            function<void(Alignment&)> on_range = [&](Alignment& aln) {
+                for (size_t i = 0; i < aln.path().mapping_size(); ++i) {
+                    vg::id_t id = aln.path().mapping(i).position().node_id();
+                    if (id >= start_id && id <= end_id) {
+                        lambda(aln);
+                        break;
+                    }
+                }
+            };
+            gam_block_index.for_each_in_range(sorted_gam, start_id, end_id, on_range);
+        } else {
+            vector<vg::id_t> ids;
+            for (auto i = start_id; i <= end_id; ++i) {
+                ids.push_back(i);
+            }
+            vindex->for_alignment_to_nodes(ids, lambda);
+        }
         stream::write_buffered(cout, output_buf, 0);
     }
 
@@ -6018,6 +6346,7 @@ void help_index(char** argv) {
          << "    -k, --kmer-size N      index kmers of size N in the graph" << endl
          << "    -X, --doubling-steps N use this number of doubling steps for GCSA2 construction" << endl
          << "    -Z, --size-limit N     limit of memory to use for GCSA2 construction in gigabytes" << endl
+         << "    -K, --kmer-memory N    sort and merge the GCSA2 input kmers in N gigabytes of memory (default 1)" << endl
          << "    -O, --path-only        only index the kmers in paths embedded in the graph" << endl
          << "    -F, --forward-only     omit the reverse complement of the graph from indexing" << endl
          << "    -e, --edge-max N       only consider paths which make edge choices at <= this many points" << endl
@@ -6043,7 +6372,10 @@ void help_index(char** argv) {
         //<< "    -b, --tmp-db-base S    use this base name for temporary indexes" << endl
          << "    -C, --compact          compact the index into a single level (improves performance)" << endl
          << "    -Q, --use-snappy       use snappy compression (faster, larger) rather than zlib" << endl
-         << "    -o, --discard-overlaps if phasing vcf calls alts at overlapping variants, call all but the first one as ref" << endl;
+         << "    -o, --discard-overlaps if phasing vcf calls alts at overlapping variants, call all but the first one as ref" << endl
+         << "block index options:" << endl
+         << "    -B, --gam-blocks FILE  index the blocks of GAM FILE by node ID, writing FILE" << BlockIndex::EXTENSION << endl
+         << "    -U, --pileup-blocks FILE  index the blocks of pileup FILE by node ID, writing FILE" << BlockIndex::EXTENSION << endl;
 
 }
 
@@ -6082,8 +6414,11 @@ int main_index(int argc, char** argv) {
     bool verify_index = false;
     bool forward_only = false;
     size_t size_limit = 200; // in gigabytes
+    double kmer_memory = 1; // in gigabytes
     bool store_threads = false; // use gPBWT to store paths
     bool discard_overlaps = false;
+    string gam_blocks_name;
+    string pileup_blocks_name;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -6115,16 +6450,19 @@ int main_index(int argc, char** argv) {
             {"verify-index", no_argument, 0, 'V'},
             {"forward-only", no_argument, 0, 'F'},
             {"size-limit", no_argument, 0, 'Z'},
+            {"kmer-memory", required_argument, 0, 'K'},
             {"path-only", no_argument, 0, 'O'},
             {"store-threads", no_argument, 0, 'T'},
             {"node-alignments", no_argument, 0, 'N'},
             {"dbg-in", required_argument, 0, 'i'},
             {"discard-overlaps", no_argument, 0, 'o'},
+            {"gam-blocks", required_argument, 0, 'B'},
+            {"pileup-blocks", required_argument, 0, 'U'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:k:j:pDshMt:b:e:SP:LmaCnAQg:X:x:v:VFZ:Oi:TNo",
+        c = getopt_long (argc, argv, "d:k:j:pDshMt:b:e:SP:LmaCnAQg:X:x:v:VFZ:K:Oi:TNoB:U:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -6241,6 +6579,10 @@ int main_index(int argc, char** argv) {
             size_limit = atoi(optarg);
             break;
 
+        case 'K':
+            kmer_memory = atof(optarg);
+            break;
+
         case 'T':
             store_threads = true;
             break;
@@ -6253,6 +6595,14 @@ int main_index(int argc, char** argv) {
             store_node_alignments = true;
             break;
 
+        case 'B':
+            gam_blocks_name = optarg;
+            break;
+
+        case 'U':
+            pileup_blocks_name = optarg;
+            break;
+
         case 'h':
         case '?':
             help_index(argv);
@@ -6288,6 +6638,11 @@ int main_index(int argc, char** argv) {
         return 1;
     }
 
+    if(kmer_memory <= 0) {
+        cerr << "error:[vg index] kmer memory must be >0" << endl;
+        return 1;
+    }
+
     if(kmer_stride <= 0) {
         // kmer strides of 0 (or negative) are silly.
         cerr << "error:[vg index] kmer stride must be positive and nonzero" << endl;
@@ -6633,7 +6988,8 @@ int main_index(int argc, char** argv) {
             VGset graphs(file_names);
             graphs.show_progress = show_progress;
             // Go get the kmers of the correct size
-            tmpfiles = graphs.write_gcsa_kmers_binary(kmer_size, path_only, forward_only);
+            tmpfiles = graphs.write_gcsa_kmers_binary(kmer_size, path_only, forward_only, 0, 0,
+                                                      kmer_memory * (1 << 30));
         } else {
             tmpfiles = dbg_names;
         }
@@ -6674,6 +7030,32 @@ int main_index(int argc, char** argv) {
 
     }
 
+    if (!gam_blocks_name.empty()) {
+        ifstream in(gam_blocks_name);
+        if (!in) {
+            cerr << "error:[vg index] could not open " << gam_blocks_name << endl;
+            return 1;
+        }
+        BlockIndex block_index;
+        function<pair<vg::id_t, vg::id_t>(const Alignment&)> id_range = alignment_id_range;
+        block_index.index_stream(in, id_range);
+        ofstream out(gam_blocks_name + BlockIndex::EXTENSION);
+        block_index.save(out);
+    }
+
+    if (!pileup_blocks_name.empty()) {
+        ifstream in(pileup_blocks_name);
+        if (!in) {
+            cerr << "error:[vg index] could not open " << pileup_blocks_name << endl;
+            return 1;
+        }
+        BlockIndex block_index;
+        function<pair<vg::id_t, vg::id_t>(const Pileup&)> id_range = pileup_id_range;
+        block_index.index_stream(in, id_range);
+        ofstream out(pileup_blocks_name + BlockIndex::EXTENSION);
+        block_index.save(out);
+    }
+
     if (!rocksdb_name.empty()) {
 
         Index index;
@@ -7025,8 +7407,13 @@ void help_map(char** argv) {
          << "output:" << endl
          << "    -J, --output-json     output JSON rather than an alignment stream (helpful for debugging)" << endl
          << "    -Z, --buffer-size N   buffer this many alignments together before outputting in GAM (default: 100)" << endl
+         << "    -3, --keep-order      write alignments in the order of the input reads (unpaired input only)" << endl
          << "    -w, --compare         if using GAM input (-G), write a comparison of before/after alignments to stdout" << endl
          << "    -D, --debug           print debugging information about alignment to stderr" << endl
+         << "server:" << endl
+         << "    -4, --serve SOCKET    load the indexes once and align batches of unpaired FASTQ or GAM reads sent" << endl
+         << "                          to this Unix socket, replying with GAM, until interrupted" << endl
+         << "    -5, --connect SOCKET  send the reads from -f, -G, or stdin to a server, and write its GAM to stdout" << endl
          << "local alignment parameters:" << endl
          << "    -q, --match N         use this match score (default: 1)" << endl
          << "    -z, --mismatch N      use this mismatch penalty (default: 4)" << endl
@@ -7069,6 +7456,15 @@ void help_map(char** argv) {
          << "    -F, --prefer-forward  if the forward alignment of the read works, accept it" << endl;
 }
 
+// the mapping server that SIGINT and SIGTERM should stop, if any
+static MapServer* map_server_to_stop = nullptr;
+
+static void stop_map_server(int signal) {
+    if (map_server_to_stop) {
+        map_server_to_stop->request_stop();
+    }
+}
+
 int main_map(int argc, char** argv) {
 
     if (argc == 2) {
@@ -7131,6 +7527,9 @@ int main_map(int argc, char** argv) {
     bool compare_gam = false;
     int fragment_max = 1e5;
     double fragment_sigma = 10;
+    bool keep_order = false;
+    string serve_socket;
+    string connect_socket;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -7193,11 +7592,14 @@ int main_map(int argc, char** argv) {
                 {"compare", no_argument, 0, 'w'},
                 {"fragment-max", required_argument, 0, 'W'},
                 {"fragment-sigma", required_argument, 0, '2'},
+                {"keep-order", no_argument, 0, '3'},
+                {"serve", required_argument, 0, '4'},
+                {"connect", required_argument, 0, '5'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "s:I:j:hd:x:g:c:r:m:k:M:t:DX:FS:Jb:KR:N:if:p:B:h:G:C:A:E:Q:n:P:Ul:e:T:VL:Y:H:OZ:q:z:o:y:1u:v:wW:a2:",
+        c = getopt_long (argc, argv, "s:I:j:hd:x:g:c:r:m:k:M:t:DX:FS:Jb:KR:N:if:p:B:h:G:C:A:E:Q:n:P:Ul:e:T:VL:Y:H:OZ:q:z:o:y:1u:v:wW:a2:34:5:",
                          long_options, &option_index);
 
 
@@ -7422,6 +7824,18 @@ int main_map(int argc, char** argv) {
             fragment_sigma = atof(optarg);
             break;
 
+        case '3':
+            keep_order = true;
+            break;
+
+        case '4':
+            serve_socket = optarg;
+            break;
+
+        case '5':
+            connect_socket = optarg;
+            break;
+
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -7435,11 +7849,39 @@ int main_map(int argc, char** argv) {
         }
     }
 
-    if (seq.empty() && read_file.empty() && hts_file.empty() && fastq1.empty() && gam_input.empty()) {
+    if (!connect_socket.empty()) {
+        // the server has the indexes, so all we do is pass the reads along
+        if (!serve_socket.empty() || !seq.empty() || !read_file.empty() || !hts_file.empty()
+            || !fastq2.empty() || interleaved_input || output_json) {
+            cerr << "error:[vg map] --connect takes one unpaired FASTQ (-f) or GAM (-G) file, or stdin, and writes GAM" << endl;
+            return 1;
+        }
+        string in_name = !fastq1.empty() ? fastq1 : gam_input;
+        int in_fd = (in_name.empty() || in_name == "-") ? fileno(stdin) : open(in_name.c_str(), O_RDONLY);
+        if (in_fd < 0) {
+            cerr << "error:[vg map] could not open " << in_name << endl;
+            return 1;
+        }
+        return MapServer::run_client(connect_socket, in_fd, cout) ? 0 : 1;
+    }
+
+    if (seq.empty() && read_file.empty() && hts_file.empty() && fastq1.empty() && gam_input.empty()
+        && serve_socket.empty()) {
         cerr << "error:[vg map] a sequence or read file is required when mapping" << endl;
         return 1;
     }
 
+    if (!serve_socket.empty() && (!seq.empty() || !read_file.empty() || !hts_file.empty()
+                                  || !fastq1.empty() || !gam_input.empty() || output_json)) {
+        cerr << "error:[vg map] --serve takes its reads from clients, and replies with GAM" << endl;
+        return 1;
+    }
+
+    if (keep_order && (interleaved_input || !fastq2.empty() || compare_gam)) {
+        cerr << "error:[vg map] --keep-order is not supported for paired input or --compare" << endl;
+        return 1;
+    }
+
     if (!qual.empty() && (seq.length() != qual.length())) {
         cerr << "error:[vg map] sequence and base quality string must be the same length" << endl;
         return 1;
@@ -7562,9 +8004,12 @@ int main_map(int argc, char** argv) {
     vector<vector<Alignment> > output_buffer;
     output_buffer.resize(thread_count);
 
+    // Each thread compresses its own output blocks, and this writes them out
+    stream::BlockWriter writer(cout);
+
     // We have one function to dump alignments into
     // Make sure to flush the buffer at the end of the program!
-    auto output_alignments = [&output_buffer, &output_json, &buffer_size](vector<Alignment>& alignments) {
+    auto output_alignments = [&output_buffer, &output_json, &buffer_size, &writer](vector<Alignment>& alignments) {
         // for(auto& alignment : alignments){
         //     cerr << "This is in output_alignments" << alignment.DebugString() << endl;
         // }
@@ -7584,10 +8029,78 @@ int main_map(int argc, char** argv) {
             // Copy all the alignments over to the output buffer
             copy(alignments.begin(), alignments.end(), back_inserter(output_buf));
 
-            stream::write_buffered(cout, output_buf, buffer_size);
+            writer.write_buffered(output_buf, buffer_size);
         }
     };
 
+    // reads that a thread takes at once, so that their seeds can be found
+    // together
+    size_t chunk_reads = 16;
+
+    // To keep the input order, we pull unpaired reads in batches on one
+    // thread, align each batch in parallel a chunk of reads at a time, and
+    // then compress its alignments in parallel and queue them for output in
+    // order.
+    auto map_in_order = [&thread_count, &buffer_size, &chunk_reads, &output_json, &writer]
+        (const function<void(const function<void(Alignment&)>&)>& for_each_read,
+         const function<vector<vector<Alignment>>(vector<Alignment>&)>& align_reads) {
+        vector<Alignment> batch;
+        size_t batch_size = 256 * thread_count;
+        // reads per output block
+        size_t block_reads = max(buffer_size, 1);
+        auto flush_batch = [&]() {
+            vector<vector<Alignment>> results(batch.size());
+            size_t chunk_count = (batch.size() + chunk_reads - 1) / chunk_reads;
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t c = 0; c < chunk_count; ++c) {
+                size_t begin = c * chunk_reads;
+                size_t end = min(begin + chunk_reads, batch.size());
+                vector<Alignment> chunk(make_move_iterator(batch.begin() + begin),
+                                        make_move_iterator(batch.begin() + end));
+                vector<vector<Alignment>> chunk_results = align_reads(chunk);
+                for (size_t i = begin; i < end; ++i) {
+                    results[i] = std::move(chunk_results[i - begin]);
+                }
+            }
+            if (output_json) {
+                for (auto& alignments : results) {
+                    for (auto& alignment : alignments) {
+                        cout << pb2json(alignment) << "\n";
+                    }
+                }
+            } else {
+                vector<string> blocks((batch.size() + block_reads - 1) / block_reads);
+#pragma omp parallel for
+                for (size_t j = 0; j < blocks.size(); ++j) {
+                    vector<Alignment> output_buf;
+                    for (size_t i = j * block_reads; i < min((j + 1) * block_reads, batch.size()); ++i) {
+                        for (auto& alignment : results[i]) {
+                            output_buf.emplace_back(std::move(alignment));
+                        }
+                    }
+                    stream::write_to_block(blocks[j], output_buf);
+                }
+                for (auto& block : blocks) {
+                    writer.enqueue(std::move(block));
+                }
+            }
+            batch.clear();
+        };
+        for_each_read([&](Alignment& alignment) {
+            batch.push_back(alignment);
+            if (batch.size() >= batch_size) {
+                flush_batch();
+            }
+        });
+        flush_batch();
+    };
+
+    // all the mappers share one node cache, so each node is cached once
+    shared_ptr<NodeCache> node_cache;
+    if (xindex) {
+        node_cache = make_shared<NodeCache>(xindex);
+    }
+
     for (int i = 0; i < thread_count; ++i) {
         Mapper* m;
         if(xindex && gcsa && lcp) {
@@ -7616,16 +8129,109 @@ int main_map(int argc, char** argv) {
         m->min_mem_length = min_mem_length;
         m->mem_threading = mem_threading;
         m->max_target_factor = max_target_factor;
-        m->set_alignment_scores(match, mismatch, gap_open, gap_extend);
+        if (i == 0) {
+            // the bands of a long read can go to any thread in the team, so there's an
+            // aligner for each of them
+            m->alignment_threads = thread_count;
+            m->clear_aligners();
+            m->set_alignment_scores(match, mismatch, gap_open, gap_extend);
+        } else {
+            // and every mapper uses the same ones, whichever thread it's running on
+            m->share_aligners(*mapper[0]);
+        }
         m->adjust_alignments_for_base_quality = qual_adjust_alignments;
         m->extra_pairing_multimaps = extra_pairing_multimaps;
         m->mapping_quality_method = mapping_quality_method;
         m->always_rescue = always_rescue;
         m->fragment_max = fragment_max;
         m->fragment_sigma = fragment_sigma;
+        if (node_cache) {
+            m->node_cache = node_cache;
+        }
+        m->init_node_cache();
         mapper[i] = m;
     }
 
+    // how unpaired reads are aligned a chunk at a time, leaving reads that
+    // don't map unaligned
+    function<vector<vector<Alignment>>(vector<Alignment>&)> align_chunk = [&](vector<Alignment>& reads) {
+        int tid = omp_get_thread_num();
+        vector<vector<Alignment>> results = mapper[tid]->align_multi_batch(reads, kmer_size, kmer_stride,
+                                                                           max_mem_length, band_width);
+        for (size_t i = 0; i < reads.size(); ++i) {
+            if (results[i].empty()) {
+                results[i].push_back(reads[i]);
+            }
+        }
+        return results;
+    };
+
+    // the unordered unpaired inputs hand each thread one read at a time, so each
+    // thread gathers them into a chunk of its own to align together, and the
+    // chunks left over when the input runs out are aligned after it
+    vector<vector<Alignment>> read_chunks(thread_count);
+    // only GAM input has alignments to compare the new ones to
+    bool compare_chunks = false;
+    function<void(vector<Alignment>&)> output_chunk = [&](vector<Alignment>& reads) {
+        vector<vector<Alignment>> results = align_chunk(reads);
+        for (size_t i = 0; i < reads.size(); ++i) {
+            if (compare_chunks) {
+#pragma omp critical (cout)
+                cout << reads[i].name() << "\t" << overlap(reads[i].path(), results[i].front().path()) << endl;
+            } else {
+                // Output the alignments in JSON or protobuf as appropriate.
+                output_alignments(results[i]);
+            }
+        }
+        reads.clear();
+    };
+    function<void(Alignment&)> chunk_read = [&](Alignment& alignment) {
+        auto& chunk = read_chunks[omp_get_thread_num()];
+        chunk.push_back(alignment);
+        if (chunk.size() >= chunk_reads) {
+            output_chunk(chunk);
+        }
+    };
+    auto output_leftover_chunks = [&]() {
+#pragma omp parallel for
+        for (int i = 0; i < thread_count; ++i) {
+            if (!read_chunks[i].empty()) {
+                output_chunk(read_chunks[i]);
+            }
+        }
+    };
+
+    if (!serve_socket.empty()) {
+        // every client's reads are aligned by the same threads and mappers
+        MapServer server(serve_socket, [&](vector<Alignment>& reads) {
+                vector<vector<Alignment>> results = align_chunk(reads);
+                for (auto& alignments : results) {
+                    for (auto& alignment : alignments) {
+                        if (!sample_name.empty()) alignment.set_sample_name(sample_name);
+                        if (!read_group.empty()) alignment.set_read_group(read_group);
+                    }
+                }
+                return results;
+            }, chunk_reads);
+        map_server_to_stop = &server;
+        signal(SIGINT, stop_map_server);
+        signal(SIGTERM, stop_map_server);
+        if (debug) cerr << "serving on " << serve_socket << endl;
+        bool served = true;
+        try {
+            server.serve();
+        } catch (runtime_error& e) {
+            cerr << "error:[vg map] " << e.what() << endl;
+            served = false;
+        }
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        map_server_to_stop = nullptr;
+        if (!served) {
+            return 1;
+        }
+    }
+
     if (!seq.empty()) {
         int tid = omp_get_thread_num();
 
@@ -7653,36 +8259,60 @@ int main_map(int argc, char** argv) {
         output_alignments(alignments);
     }
 
-    if (!read_file.empty()) {
+    if (!read_file.empty() && keep_order) {
+        ifstream in(read_file);
+        map_in_order([&in](const function<void(Alignment&)>& lambda) {
+                string line;
+                while (std::getline(in, line)) {
+                    if (!line.empty()) {
+                        Alignment unaligned;
+                        unaligned.set_sequence(line);
+                        lambda(unaligned);
+                    }
+                }
+            },
+            [&](vector<Alignment>& unaligned) {
+                vector<vector<Alignment>> results = align_chunk(unaligned);
+                for (auto& alignments : results) {
+                    for(auto& alignment : alignments) {
+                        // Set the alignment metadata
+                        if (!sample_name.empty()) alignment.set_sample_name(sample_name);
+                        if (!read_group.empty()) alignment.set_read_group(read_group);
+                    }
+                }
+                return results;
+            });
+    } else if (!read_file.empty()) {
         ifstream in(read_file);
         bool more_data = in.good();
 #pragma omp parallel shared(in)
         {
             string line;
-            int tid = omp_get_thread_num();
+            vector<Alignment> chunk;
             while (in.good()) {
-                line.clear();
+                chunk.clear();
+                // take a chunk of reads at once, so their seeds are found together
 #pragma omp critical (readq)
                 {
-                    std::getline(in,line);
-                }
-                if (!line.empty()) {
-                    // Make an alignment
-                    Alignment unaligned;
-                    unaligned.set_sequence(line);
-
-                    vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width);
-                    if(alignments.empty()) {
-                        alignments.push_back(unaligned);
+                    while (chunk.size() < chunk_reads && std::getline(in,line)) {
+                        if (!line.empty()) {
+                            // Make an alignment
+                            chunk.emplace_back();
+                            chunk.back().set_sequence(line);
+                        }
                     }
+                }
+                if (chunk.empty()) {
+                    continue;
+                }
 
+                for (auto& alignments : align_chunk(chunk)) {
                     for(auto& alignment : alignments) {
                         // Set the alignment metadata
                         if (!sample_name.empty()) alignment.set_sample_name(sample_name);
                         if (!read_group.empty()) alignment.set_read_group(read_group);
                     }
 
-
                     // Output the alignments in JSON or protobuf as appropriate.
                     output_alignments(alignments);
                 }
@@ -7690,33 +8320,27 @@ int main_map(int argc, char** argv) {
         }
     }
 
-    if (!hts_file.empty()) {
-        function<void(Alignment&)> lambda =
-            [&mapper,
-             &output_alignments,
-             &keep_secondary,
-             &kmer_size,
-             &kmer_stride,
-             &max_mem_length,
-             &band_width]
-                (Alignment& alignment) {
-
-                    if(alignment.is_secondary() && !keep_secondary) {
-                        // Skip over secondary alignments in the input; we don't want several output mappings for each input *mapping*.
-                        return;
-                    }
-
-                    int tid = omp_get_thread_num();
-                    vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
-                    if(alignments.empty()) {
-                        alignments.push_back(alignment);
-                    }
-
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments);
-                };
+    if (!hts_file.empty() && keep_order) {
+        map_in_order([&hts_file, &keep_secondary](const function<void(Alignment&)>& lambda) {
+                hts_for_each(hts_file, [&](Alignment& alignment) {
+                        if(alignment.is_secondary() && !keep_secondary) {
+                            // Skip over secondary alignments in the input, as below
+                            return;
+                        }
+                        lambda(alignment);
+                    });
+            }, align_chunk);
+    } else if (!hts_file.empty()) {
+        function<void(Alignment&)> lambda = [&](Alignment& alignment) {
+            if(alignment.is_secondary() && !keep_secondary) {
+                // Skip over secondary alignments in the input; we don't want several output mappings for each input *mapping*.
+                return;
+            }
+            chunk_read(alignment);
+        };
         // run
         hts_for_each_parallel(hts_file, lambda);
+        output_leftover_chunks();
     }
 
     if (!fastq1.empty()) {
@@ -7777,29 +8401,15 @@ int main_map(int argc, char** argv) {
                 }
                 our_mapper->imperfect_pairs_to_retry.clear();
             }
+        } else if (fastq2.empty() && keep_order) {
+            // single, in input order
+            map_in_order([&fastq1](const function<void(Alignment&)>& lambda) {
+                    fastq_unpaired_for_each(fastq1, lambda);
+                }, align_chunk);
         } else if (fastq2.empty()) {
             // single
-            function<void(Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width]
-                    (Alignment& alignment) {
-
-                        int tid = omp_get_thread_num();
-                        vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
-
-                        if(alignments.empty()) {
-                            // Make sure we have a "no alignment" alignment
-                            alignments.push_back(alignment);
-                        }
-
-                        //cerr << "This is just before output_alignments" << alignment.DebugString() << endl;
-                        output_alignments(alignments);
-                    };
-            fastq_unpaired_for_each_parallel(fastq1, lambda);
+            fastq_unpaired_for_each_parallel(fastq1, chunk_read);
+            output_leftover_chunks();
         } else {
             // paired two-file
             auto output_func = [&output_alignments]
@@ -7925,43 +8535,43 @@ int main_map(int argc, char** argv) {
                 }
                 our_mapper->imperfect_pairs_to_retry.clear();
             }
+        } else if (keep_order) {
+            map_in_order([&gam_in](const function<void(Alignment&)>& lambda) {
+                    stream::for_each(gam_in, lambda);
+                }, align_chunk);
         } else {
-            function<void(Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &compare_gam]
-                (Alignment& alignment) {
-                int tid = omp_get_thread_num();
-                vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
-                if(alignments.empty()) {
-                    alignments.push_back(alignment);
-                }
-                if (compare_gam) {
-#pragma omp critical (cout)
-                    cout << alignment.name() << "\t" << overlap(alignment.path(), alignments.front().path()) << endl;
-                } else {
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments);
-                }
-            };
-            stream::for_each_parallel(gam_in, lambda);
+            compare_chunks = compare_gam;
+            stream::for_each_parallel(gam_in, chunk_read);
+            output_leftover_chunks();
         }
         gam_in.close();
     }
 
+    if (debug && node_cache) {
+        cerr << "node cache: " << node_cache->hits() << " hits, "
+             << node_cache->misses() << " misses" << endl;
+    }
+    if (debug) {
+        // the mappers all share the first one's aligners
+        size_t banded_peak = 0;
+        for (auto& aligner : mapper[0]->regular_aligners) {
+            banded_peak = max(banded_peak, aligner->banded_alignment_peak_bytes());
+        }
+        for (auto& aligner : mapper[0]->qual_adj_aligners) {
+            banded_peak = max(banded_peak, aligner->banded_alignment_peak_bytes());
+        }
+        cerr << "banded alignment: " << banded_peak << " bytes at peak" << endl;
+    }
+
     // clean up
     for (int i = 0; i < thread_count; ++i) {
         delete mapper[i];
         auto& output_buf = output_buffer[i];
         if (!output_json) {
-            stream::write_buffered(cout, output_buf, 0);
+            writer.write_buffered(output_buf, 0);
         }
     }
+    writer.finish();
 
     if(idx)  {
         delete idx;
@@ -0,0 +1,391 @@
+#include "map_server.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <omp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "alignment.hpp"
+#include "stream.hpp"
+
+namespace vg {
+
+using namespace std;
+
+// how long the accepting thread waits on the socket before checking whether
+// it has been asked to stop, in milliseconds
+static const int ACCEPT_POLL_MS = 200;
+
+// fill in a Unix socket address, or return false if the path is too long
+static bool make_socket_address(const string& socket_path, sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    return true;
+}
+
+// send all of the data, returning false if the connection is gone
+static bool send_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        // don't die of SIGPIPE if the other end went away
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+// lets protobuf read the inflated contents of a gzFile
+class GzFileInputStream : public ::google::protobuf::io::CopyingInputStream {
+public:
+    GzFileInputStream(gzFile fp) : fp(fp) { }
+    int Read(void* buffer, int size) {
+        return gzread(fp, buffer, size);
+    }
+private:
+    gzFile fp;
+};
+
+// read the next FASTQ record, returning false at the end of the input or on
+// a truncated record, rather than exiting as get_next_alignment_from_fastq
+// would, since a bad client mustn't bring down the server
+static bool read_fastq_record(gzFile fp, vector<char>& buffer, Alignment& alignment) {
+    string lines[4];
+    for (auto& line : lines) {
+        line.clear();
+        // a line longer than the buffer comes back in pieces
+        while (line.empty() || line.back() != '\n') {
+            if (gzgets(fp, buffer.data(), buffer.size()) == nullptr) {
+                if (line.empty()) {
+                    return false;
+                }
+                // the last line of the input may have no newline
+                break;
+            }
+            line += buffer.data();
+        }
+        if (!line.empty() && line.back() == '\n') {
+            line.pop_back();
+        }
+    }
+    alignment.Clear();
+    alignment.set_name(lines[0].substr(1));
+    alignment.set_sequence(lines[1]);
+    alignment.set_quality(string_quality_char_to_short(lines[3]));
+    return true;
+}
+
+// call the lambda on each read the client sends, as FASTQ or GAM, gzipped or
+// not, until the client shuts down its side of the connection
+static void for_each_client_read(int fd, const function<bool(Alignment&)>& lambda) {
+    // gzclose closes its file descriptor, and we still need to reply on ours
+    gzFile fp = gzdopen(dup(fd), "r");
+    if (fp == nullptr) {
+        return;
+    }
+    int first = gzgetc(fp);
+    if (first == -1) {
+        gzclose(fp);
+        return;
+    }
+    gzungetc(first, fp);
+
+    Alignment alignment;
+    if (first == '@') {
+        vector<char> buffer(1 << 18);
+        while (read_fastq_record(fp, buffer, alignment)) {
+            if (!lambda(alignment)) break;
+        }
+    } else {
+        // zlib has already inflated the GAM, so read its groups directly
+        GzFileInputStream gz_in(fp);
+        ::google::protobuf::io::CopyingInputStreamAdaptor raw_in(&gz_in);
+        bool more = true;
+        while (more) {
+            uint64_t count;
+            {
+                ::google::protobuf::io::CodedInputStream coded_in(&raw_in);
+                if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                    break;
+                }
+            }
+            for (uint64_t i = 0; i < count && more; ++i) {
+                if (stream::read_object(&raw_in, alignment)) {
+                    more = lambda(alignment);
+                }
+            }
+        }
+    }
+    gzclose(fp);
+}
+
+MapServer::MapServer(const string& socket_path, const chunk_aligner_t& align_chunk, size_t chunk_reads) :
+    socket_path(socket_path),
+    align_chunk(align_chunk),
+    chunk_reads(max(chunk_reads, (size_t) 1)),
+    max_pending(1),
+    listen_fd(-1),
+    stop_requested(false),
+    jobs_done(false),
+    active_clients(0) {
+}
+
+MapServer::~MapServer(void) {
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+}
+
+void MapServer::request_stop(void) {
+    stop_requested = true;
+}
+
+void MapServer::serve(void) {
+    sockaddr_un address;
+    if (!make_socket_address(socket_path, address)) {
+        throw runtime_error("[MapServer] socket path is too long: " + socket_path);
+    }
+    // replace a socket left behind by a server that didn't get to clean up,
+    // but nothing else
+    struct stat info;
+    if (stat(socket_path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(socket_path.c_str());
+    }
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw runtime_error("[MapServer] could not create socket: " + string(strerror(errno)));
+    }
+    if (::bind(listen_fd, (sockaddr*) &address, sizeof(address)) != 0
+        || listen(listen_fd, SOMAXCONN) != 0) {
+        string error = strerror(errno);
+        close(listen_fd);
+        listen_fd = -1;
+        throw runtime_error("[MapServer] could not listen on " + socket_path + ": " + error);
+    }
+
+    // enough chunks in flight per client to keep all the workers busy with
+    // a single client
+    max_pending = 4 * omp_get_max_threads();
+    jobs_done = false;
+
+    thread acceptor(&MapServer::accept_clients, this);
+#pragma omp parallel
+    {
+        work();
+    }
+    acceptor.join();
+}
+
+void MapServer::accept_clients(void) {
+    pollfd listening = {listen_fd, POLLIN, 0};
+    while (!stop_requested) {
+        int ready = poll(&listening, 1, ACCEPT_POLL_MS);
+        if (ready <= 0) {
+            // a timeout, or a signal, so check whether to stop
+            continue;
+        }
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        {
+            lock_guard<mutex> lock(clients_mutex);
+            ++active_clients;
+        }
+        thread(&MapServer::handle_client, this, fd).detach();
+    }
+
+    // take no more connections
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path.c_str());
+
+    // let the clients we have finish, then let the workers go
+    {
+        unique_lock<mutex> lock(clients_mutex);
+        clients_done.wait(lock, [this]() { return active_clients == 0; });
+    }
+    {
+        lock_guard<mutex> lock(jobs_mutex);
+        jobs_done = true;
+    }
+    jobs_ready.notify_all();
+}
+
+void MapServer::submit(const shared_ptr<Job>& job) {
+    {
+        lock_guard<mutex> lock(jobs_mutex);
+        jobs.push_back(job);
+    }
+    jobs_ready.notify_one();
+}
+
+void MapServer::work(void) {
+    while (true) {
+        shared_ptr<Job> job;
+        {
+            unique_lock<mutex> lock(jobs_mutex);
+            jobs_ready.wait(lock, [this]() { return !jobs.empty() || jobs_done; });
+            if (jobs.empty()) {
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        try {
+            job->result.set_value(align_chunk(job->reads));
+        } catch (...) {
+            job->result.set_exception(current_exception());
+        }
+    }
+}
+
+void MapServer::handle_client(int fd) {
+    // the results of this client's chunks that are in flight, in input order
+    deque<future<vector<vector<Alignment>>>> pending;
+    bool connected = true;
+
+    // send back the alignments of the oldest chunk, waiting for them if need be
+    auto send_oldest = [&]() {
+        vector<vector<Alignment>> results;
+        try {
+            results = pending.front().get();
+        } catch (exception& e) {
+            cerr << "error:[MapServer] could not align reads: " << e.what() << endl;
+            connected = false;
+        }
+        pending.pop_front();
+        if (!connected) {
+            return;
+        }
+        vector<Alignment> alignments;
+        for (auto& read_alignments : results) {
+            for (auto& alignment : read_alignments) {
+                alignments.emplace_back(std::move(alignment));
+            }
+        }
+        string block;
+        stream::write_to_block(block, alignments);
+        connected = send_all(fd, block.data(), block.size());
+    };
+
+    vector<Alignment> chunk;
+    auto submit_chunk = [&]() {
+        if (chunk.empty()) {
+            return;
+        }
+        shared_ptr<Job> job = make_shared<Job>();
+        job->reads = std::move(chunk);
+        chunk.clear();
+        pending.push_back(job->result.get_future());
+        submit(job);
+        // send back whatever is done, and wait if we are too far ahead
+        while (connected && !pending.empty()
+               && (pending.size() > max_pending
+                   || pending.front().wait_for(chrono::seconds(0)) == future_status::ready)) {
+            send_oldest();
+        }
+    };
+
+    for_each_client_read(fd, [&](Alignment& read) {
+            chunk.push_back(read);
+            if (chunk.size() >= chunk_reads) {
+                submit_chunk();
+            }
+            // stop reading from a client that has gone away
+            return connected;
+        });
+    if (connected) {
+        submit_chunk();
+    }
+    while (!pending.empty()) {
+        if (connected) {
+            send_oldest();
+        } else {
+            // still wait, so that no job outlives the server
+            pending.front().wait();
+            pending.pop_front();
+        }
+    }
+    close(fd);
+
+    // notify while still holding the lock: once it is released the server
+    // may see no clients left and go away, so we can't touch it after that
+    lock_guard<mutex> lock(clients_mutex);
+    --active_clients;
+    clients_done.notify_all();
+}
+
+bool MapServer::run_client(const string& socket_path, int in_fd, ostream& out) {
+    sockaddr_un address;
+    if (!make_socket_address(socket_path, address)) {
+        cerr << "error:[vg map] socket path is too long: " << socket_path << endl;
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+        cerr << "error:[vg map] could not connect to " << socket_path << ": " << strerror(errno) << endl;
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    // the server answers while we are still sending, so send on another thread
+    bool sent = true;
+    thread sender([&]() {
+            vector<char> buffer(1 << 16);
+            while (true) {
+                ssize_t got = read(in_fd, buffer.data(), buffer.size());
+                if (got < 0 && errno == EINTR) continue;
+                if (got <= 0) {
+                    sent = got == 0;
+                    break;
+                }
+                if (!send_all(fd, buffer.data(), got)) {
+                    sent = false;
+                    break;
+                }
+            }
+            // tell the server that's all the reads
+            shutdown(fd, SHUT_WR);
+        });
+
+    vector<char> buffer(1 << 16);
+    bool received = true;
+    while (true) {
+        ssize_t got = recv(fd, buffer.data(), buffer.size(), 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            received = got == 0;
+            break;
+        }
+        out.write(buffer.data(), got);
+    }
+    sender.join();
+    close(fd);
+    out.flush();
+
+    if (!sent || !received) {
+        cerr << "error:[vg map] lost the connection to " << socket_path << endl;
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,104 @@
+#ifndef VG_MAP_SERVER_H
+#define VG_MAP_SERVER_H
+// map_server.hpp: defines MapServer, which keeps the mapping indexes loaded
+// and aligns batches of reads sent to it over a Unix socket
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Serves alignments over a Unix socket, so that the indexes only have to be
+ * loaded once for any number of batches of reads.
+ *
+ * A client connects, sends a batch of unpaired reads as FASTQ or GAM (either
+ * of which may be gzipped), and shuts down its side of the connection. The
+ * server sends the alignments back as GAM, in the order of the reads, and
+ * then closes the connection. Alignments are sent as soon as they are made,
+ * so a client has to read while it writes.
+ *
+ * Any number of clients can be connected at once. Their reads are cut into
+ * chunks, and the chunks are aligned by one shared pool of worker threads,
+ * the OpenMP threads of the thread that calls serve.
+ */
+class MapServer {
+public:
+
+    /// Aligns a chunk of reads, giving the alignments of each read, on the
+    /// worker with the current OpenMP thread number.
+    typedef function<vector<vector<Alignment>>(vector<Alignment>&)> chunk_aligner_t;
+
+    MapServer(const string& socket_path, const chunk_aligner_t& align_chunk, size_t chunk_reads = 16);
+    ~MapServer(void);
+
+    MapServer(const MapServer&) = delete;
+    MapServer& operator=(const MapServer&) = delete;
+
+    /// Listen on the socket and serve clients until stop is requested. Once
+    /// it is, the clients that are connected are finished, and the socket is
+    /// removed.
+    void serve(void);
+
+    /// Ask serve to stop. This is safe to call from a signal handler.
+    void request_stop(void);
+
+    /// Send the reads read from in_fd to the server listening at
+    /// socket_path, and write the alignments it sends back to out. Returns
+    /// false, after saying why on stderr, if anything goes wrong.
+    static bool run_client(const string& socket_path, int in_fd, ostream& out);
+
+private:
+
+    // a chunk of one client's reads, waiting to be aligned
+    struct Job {
+        vector<Alignment> reads;
+        promise<vector<vector<Alignment>>> result;
+    };
+
+    string socket_path;
+    chunk_aligner_t align_chunk;
+    size_t chunk_reads;
+    // how many chunks a client can have in flight before it waits for the
+    // first of them
+    size_t max_pending;
+    int listen_fd;
+
+    atomic<bool> stop_requested;
+    // jobs from all the clients, in the order they came in
+    deque<shared_ptr<Job>> jobs;
+    // set once no more jobs can come in
+    bool jobs_done;
+    mutex jobs_mutex;
+    condition_variable jobs_ready;
+
+    size_t active_clients;
+    mutex clients_mutex;
+    condition_variable clients_done;
+
+    // accept connections until stop is requested, handling each client on a
+    // thread of its own, then wait for the clients and tell the workers that
+    // there are no more jobs
+    void accept_clients(void);
+    // read the client's reads, queue them for alignment, and send back their
+    // alignments
+    void handle_client(int fd);
+    // align jobs until there are no more
+    void work(void);
+    void submit(const shared_ptr<Job>& job);
+};
+
+}
+
+#endif
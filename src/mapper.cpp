@@ -11,6 +11,9 @@ Mapper::Mapper(Index* idex,
     , xindex(xidex)
     , gcsa(g)
     , lcp(a)
+    , gcsa_anchors(nullptr)
+    , delta_gcsa(nullptr)
+    , delta_lcp(nullptr)
     , best_clusters(0)
     , cluster_min(1)
     , hit_max(0)
@@ -20,6 +23,7 @@ Mapper::Mapper(Index* idex,
     , thread_extension(10)
     , max_thread_gap(30)
     , context_depth(1)
+    , surject_by_projection(true)
     , max_multimaps(1)
     , max_attempts(0)
     , softclip_threshold(0)
@@ -88,15 +92,7 @@ Mapper::Mapper(void) : Mapper(nullptr, nullptr, nullptr, nullptr) {
 }
 
 Mapper::~Mapper(void) {
-    for (auto& aligner : qual_adj_aligners) {
-        delete aligner;
-    }
-    for (auto& aligner : regular_aligners) {
-        delete aligner;
-    }
-    for (auto& nc : node_cache) {
-        delete nc;
-    }
+    // Nothing to do. The aligners go when the last Mapper sharing them does.
 }
     
 double Mapper::estimate_gc_content() {
@@ -120,26 +116,28 @@ double Mapper::estimate_gc_content() {
 }
 
 void Mapper::init_node_cache(void) {
-    for (auto& nc : node_cache) {
-        delete nc;
+    // one node cache serves every thread, and we keep one we were given
+    if (xindex && !node_cache) {
+        node_cache = make_shared<NodeCache>(xindex);
     }
-    node_cache.clear();
-    for (int i = 0; i < alignment_threads; ++i) {
-        node_cache.push_back(new LRUCache<id_t, Node>(100));
+    // keep the subgraphs we share with other Mappers if there are enough
+    if (!cluster_subgraphs || cluster_subgraphs->size() != alignment_threads) {
+        cluster_subgraphs = make_shared<vector<ClusterSubgraph>>(alignment_threads);
     }
 }
 
 void Mapper::clear_aligners(void) {
-    for (auto& aligner : qual_adj_aligners) {
-        delete aligner;
-    }
     qual_adj_aligners.clear();
-    for (auto& aligner : regular_aligners) {
-        delete aligner;
-    }
     regular_aligners.clear();
 }
 
+void Mapper::share_aligners(const Mapper& other) {
+    alignment_threads = other.alignment_threads;
+    qual_adj_aligners = other.qual_adj_aligners;
+    regular_aligners = other.regular_aligners;
+    cluster_subgraphs = other.cluster_subgraphs;
+}
+
 void Mapper::init_aligner(int32_t match, int32_t mismatch, int32_t gap_open, int32_t gap_extend) {
     // hacky, find max score so that scaling doesn't change score
     int32_t max_score = match;
@@ -152,9 +150,9 @@ void Mapper::init_aligner(int32_t match, int32_t mismatch, int32_t gap_open, int
     qual_adj_aligners.resize(alignment_threads);
     regular_aligners.resize(alignment_threads);
     for (int i = 0; i < alignment_threads; ++i) {
-        qual_adj_aligners[i] = new QualAdjAligner(match, mismatch, gap_open, gap_extend, max_score,
-                                         255, gc_content);
-        regular_aligners[i] = new Aligner(match, mismatch, gap_open, gap_extend);
+        qual_adj_aligners[i] = make_shared<QualAdjAligner>(match, mismatch, gap_open, gap_extend, max_score,
+                                                           255, gc_content);
+        regular_aligners[i] = make_shared<Aligner>(match, mismatch, gap_open, gap_extend);
         regular_aligners[i]->init_mapping_quality(gc_content); // should be done in constructor
     }
 }
@@ -189,6 +187,26 @@ Alignment Mapper::align_to_graph(const Alignment& aln, VG& vg, size_t max_query_
     }
 }
 
+Alignment Mapper::align_to_subgraph(const Alignment& aln, ClusterSubgraph& sub) {
+    if (!sub.sort_for_alignment()) {
+        // cycles or inversions, which VG knows how to unroll
+        VG vg;
+        sub.to_vg(vg);
+        return align_to_graph(aln, vg, max_query_graph_ratio);
+    }
+    // pick the aligner just as align_to_graph does
+    Alignment aligned = aln;
+    if (aln.quality().empty()) {
+        get_regular_aligner()->align(aligned, sub.graph);
+    } else if (adjust_alignments_for_base_quality) {
+        get_qual_adj_aligner()->align(aligned, sub.graph);
+    } else {
+        get_qual_adj_aligner()->Aligner::align(aligned, sub.graph);
+    }
+    aligned.set_sequence(aln.sequence());
+    return aligned;
+}
+
 Alignment Mapper::align(const string& seq, int kmer_size, int stride, int max_mem_length, int band_width) {
     Alignment aln;
     aln.set_sequence(seq);
@@ -838,6 +856,200 @@ pair<Alignment, Alignment> Mapper::align_paired(const Alignment& read1,
     return make_pair(aln1, aln2);
 }
 
+void MEMClusterScorer::clear(void) {
+    hits.clear();
+    clusters.clear();
+}
+
+void MEMClusterScorer::add_hit(int64_t key, bool is_reverse, const MaximalExactMatch& mem, const string& read) {
+    hits.push_back({key, is_reverse,
+                (uint32_t) (mem.begin - read.begin()),
+                (uint32_t) (mem.end - read.begin())});
+}
+
+void MEMClusterScorer::cluster(int64_t max_gap) {
+    clusters.clear();
+    std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) {
+            return a.key < b.key;
+        });
+    size_t i = 0;
+    while (i < hits.size()) {
+        Cluster cluster = {i, i, 0, 0};
+        intervals.clear();
+        int64_t last_key = hits[i].key;
+        // extend the cluster while the next key is near enough to the last one
+        for (; i < hits.size() && (i == cluster.hits_begin || hits[i].key - last_key <= max_gap); ++i) {
+            auto& hit = hits[i];
+            if (i == cluster.hits_begin || hit.key != last_key) {
+                ++cluster.key_count;
+            }
+            last_key = hit.key;
+            intervals.emplace_back(hit.begin, hit.end);
+        }
+        cluster.hits_end = i;
+
+        // the coverage is the length of the union of the intervals
+        std::sort(intervals.begin(), intervals.end());
+        uint32_t covered_to = 0;
+        for (auto& interval : intervals) {
+            uint32_t begin = max(interval.first, covered_to);
+            if (interval.second > begin) {
+                cluster.coverage += interval.second - begin;
+                covered_to = interval.second;
+            }
+        }
+        clusters.push_back(cluster);
+    }
+}
+
+vector<size_t> MEMClusterScorer::ranked(void) const {
+    vector<size_t> order(clusters.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            auto& ca = clusters[a];
+            auto& cb = clusters[b];
+            // order by cluster coverage of query
+            // break ties on number of keys (fewer better)
+            if (ca.coverage == cb.coverage) {
+                return ca.key_count < cb.key_count;
+            } else {
+                return ca.coverage > cb.coverage;
+            }
+        });
+    return order;
+}
+
+void MEMClusterScorer::for_each_key(const Cluster& cluster, const function<void(int64_t)>& lambda) const {
+    for (size_t i = cluster.hits_begin; i < cluster.hits_end; ++i) {
+        if (i == cluster.hits_begin || hits[i].key != hits[i - 1].key) {
+            lambda(hits[i].key);
+        }
+    }
+}
+
+void ClusterSubgraph::clear(void) {
+    nodes.clear();
+    edges.clear();
+    graph.Clear();
+    // keep the table at the size the last clusters needed
+    node_index.clear_no_resize();
+}
+
+void ClusterSubgraph::add_node(xg::XG& xindex, id_t id) {
+    if (node_index.count(id)) return;
+    node_index[id] = nodes.size();
+    nodes.push_back(xindex.node(id));
+}
+
+void ClusterSubgraph::fetch_edges(xg::XG& xindex, size_t i, bool add_neighbors) {
+    // nodes may grow under us, so don't hold on to the node itself
+    id_t id = nodes[i].id();
+    for (bool on_start : {true, false}) {
+        for (auto& edge : on_start ? xindex.edges_on_start(id) : xindex.edges_on_end(id)) {
+            // every edge leaves exactly one node side, so we keep it only from
+            // there and never see it twice
+            bool leaves_here = edge.from() == id && edge.from_start() == on_start;
+            id_t other = leaves_here ? edge.to() : edge.from();
+            if (add_neighbors) {
+                add_node(xindex, other);
+            }
+            if (leaves_here && has_node(other)) {
+                edges.push_back(edge);
+            }
+        }
+    }
+}
+
+void ClusterSubgraph::expand_context(xg::XG& xindex, int steps) {
+    // nodes are added in breadth-first order, so each step's frontier is the
+    // run of nodes added by the step before
+    size_t fetched = 0;
+    for (int step = 0; step < steps && fetched < nodes.size(); ++step) {
+        size_t frontier_end = nodes.size();
+        for (; fetched < frontier_end; ++fetched) {
+            fetch_edges(xindex, fetched, true);
+        }
+    }
+    // the last frontier only contributes the edges among what we have
+    for (; fetched < nodes.size(); ++fetched) {
+        fetch_edges(xindex, fetched, false);
+    }
+}
+
+int64_t ClusterSubgraph::length(void) const {
+    int64_t total = 0;
+    for (auto& node : nodes) {
+        total += node.sequence().size();
+    }
+    return total;
+}
+
+bool ClusterSubgraph::sort_for_alignment(void) {
+    graph.Clear();
+    size_t n = nodes.size();
+    in_degree.assign(n, 0);
+    if (successors.size() < n) successors.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        successors[i].clear();
+    }
+    for (auto& edge : edges) {
+        // gssw can't follow an edge that changes strand
+        if (edge.from_start() != edge.to_end()) return false;
+        size_t from = node_index.find(edge.from())->second;
+        size_t to = node_index.find(edge.to())->second;
+        // an edge from start to end runs backward
+        if (edge.from_start()) swap(from, to);
+        successors[from].push_back(to);
+        ++in_degree[to];
+    }
+
+    // Kahn's algorithm, starting from the heads
+    order.clear();
+    id_t max_id = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (in_degree[i] == 0) order.push_back(i);
+        max_id = max(max_id, nodes[i].id());
+    }
+    size_t head_count = order.size();
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (auto next : successors[order[i]]) {
+            if (--in_degree[next] == 0) order.push_back(next);
+        }
+    }
+    // anything left over is on a cycle
+    if (order.size() < n) return false;
+
+    // the root comes first, so that the alignment covers the whole graph
+    Node* root = graph.add_node();
+    root->set_id(max_id + 1);
+    root->set_sequence("N");
+    for (size_t i = 0; i < head_count; ++i) {
+        Edge* edge = graph.add_edge();
+        edge->set_from(root->id());
+        edge->set_to(nodes[order[i]].id());
+    }
+    for (auto i : order) {
+        *graph.add_node() = nodes[i];
+    }
+    for (auto& edge : edges) {
+        *graph.add_edge() = edge;
+    }
+    return true;
+}
+
+void ClusterSubgraph::to_vg(VG& vg) const {
+    Graph g;
+    for (auto& node : nodes) {
+        *g.add_node() = node;
+    }
+    for (auto& edge : edges) {
+        *g.add_edge() = edge;
+    }
+    vg.extend(g);
+}
+
 // returns the SMEM clusters which are consistent with the distribution of the MEMs in the read
 // provided some tolerance +/-
 // uses the exact matches to generate as much of each alignment as possible
@@ -926,21 +1138,23 @@ Mapper::mems_pos_clusters_to_alignments(const Alignment& aln, vector<MaximalExac
         }
     }
 
-    auto mem_len_sum = [&](const vector<MaximalExactMatch>& cluster) {
-        int i = 0;
-        for (auto& mem : cluster) {
-            i += mem.length();
-        }
-        return i;
-    };
-
     // sort the threads by their coverage of the read
     // descending sort, so that the best clusters are at the front
-    std::sort(clusters.begin(), clusters.end(),
-              [&](const vector<MaximalExactMatch>& c1,
-                  const vector<MaximalExactMatch>& c2) {
-                  return mem_len_sum(c1) > mem_len_sum(c2);
-              });
+    // the MEMs in a thread don't overlap, so this is their total length
+    MEMClusterScorer scorer;
+    for (size_t i = 0; i < clusters.size(); ++i) {
+        for (auto& mem : clusters[i]) {
+            scorer.add_hit(i, gcsa::Node::rc(mem.nodes.front()), mem, aln.sequence());
+        }
+    }
+    // keying the hits on their thread keeps each thread a cluster of its own
+    scorer.cluster(0);
+    vector<vector<MaximalExactMatch> > ranked_clusters;
+    for (auto i : scorer.ranked()) {
+        auto& cluster = scorer.clusters[i];
+        ranked_clusters.emplace_back(std::move(clusters[scorer.hits[cluster.hits_begin].key]));
+    }
+    clusters = std::move(ranked_clusters);
 
     // remove duplicates by building up a reverse map from MEM to cluster
     // and adding new clusters by following the reverse map and checking for
@@ -1390,7 +1604,20 @@ Alignment Mapper::align_banded(const Alignment& read, int kmer_size, int stride,
         }
     };
     
-    if (alignment_threads > 1) {
+    if (alignment_threads > 1 && omp_in_parallel() && omp_get_num_threads() <= alignment_threads) {
+        // we're one of a team of threads mapping reads, so hand the bands to the team as
+        // tasks; each band is aligned with the aligner of the thread that runs it, and goes
+        // in its own slot. Threads busy with reads of their own only get to them once they
+        // run out of reads, at the barrier, so while there is input left most of the read
+        // is aligned here at the taskwait. The tasks are untied, so that threads waiting on
+        // bands of their own can take them too, which tied tasks from another thread's
+        // read can't be.
+        for (int i = 0; i < bands.size(); ++i) {
+#pragma omp task untied firstprivate(i) shared(do_band)
+            do_band(i);
+        }
+#pragma omp taskwait
+    } else if (alignment_threads > 1 && !omp_in_parallel()) {
 #pragma omp parallel for schedule(dynamic,1)
         for (int i = 0; i < bands.size(); ++i) {
             do_band(i);
@@ -1585,17 +1812,21 @@ bool Mapper::adjacent_positions(const Position& pos1, const Position& pos2) {
 
 QualAdjAligner* Mapper::get_qual_adj_aligner(void) {
     int tid = qual_adj_aligners.size() > 1 ? omp_get_thread_num() : 0;
-    return qual_adj_aligners[tid];
+    return qual_adj_aligners[tid].get();
 }
 
 Aligner* Mapper::get_regular_aligner(void) {
     int tid = regular_aligners.size() > 1 ? omp_get_thread_num() : 0;
-    return regular_aligners[tid];
+    return regular_aligners[tid].get();
 }
 
-LRUCache<id_t, Node>& Mapper::get_node_cache(void) {
-    int tid = node_cache.size() > 1 ? omp_get_thread_num() : 0;
-    return *node_cache[tid];
+NodeCache& Mapper::get_node_cache(void) {
+    return *node_cache;
+}
+
+ClusterSubgraph& Mapper::get_cluster_subgraph(void) {
+    int tid = cluster_subgraphs->size() > 1 ? omp_get_thread_num() : 0;
+    return (*cluster_subgraphs)[tid];
 }
 
 void Mapper::compute_mapping_qualities(vector<Alignment>& alns) {
@@ -1689,6 +1920,42 @@ void Mapper::filter_and_process_multimaps(vector<Alignment>& sorted_unique_align
 vector<Alignment> Mapper::align_multi(const Alignment& aln, int kmer_size, int stride, int max_mem_length, int band_width) {
     return align_multi_internal(true, aln, kmer_size, stride, max_mem_length, band_width, 0, nullptr);
 }
+
+vector<vector<Alignment>> Mapper::align_multi_batch(const vector<Alignment>& alns, int kmer_size, int stride,
+                                                    int max_mem_length, int band_width) {
+    vector<vector<Alignment>> results(alns.size());
+    if (kmer_size || xindex == nullptr) {
+        // the legacy kmer mapper has no MEMs to find
+        for (size_t i = 0; i < alns.size(); ++i) {
+            results[i] = align_multi(alns[i], kmer_size, stride, max_mem_length, band_width);
+        }
+        return results;
+    }
+
+    // find the MEMs of the reads that aren't banded all at once
+    vector<size_t> mem_reads;
+    vector<const string*> seqs;
+    for (size_t i = 0; i < alns.size(); ++i) {
+        if (alns[i].sequence().size() > band_width) {
+            results[i] = align_multi(alns[i], kmer_size, stride, max_mem_length, band_width);
+        } else {
+            mem_reads.push_back(i);
+            seqs.push_back(&alns[i].sequence());
+        }
+    }
+    vector<vector<MaximalExactMatch>> all_mems = find_smems_batch(seqs, max_mem_length);
+
+    for (size_t j = 0; j < mem_reads.size(); ++j) {
+        auto& mems = all_mems[j];
+        // query mem hits
+        if (debug) cerr << "mems before filtering " << mems_to_json(mems) << endl;
+        for (auto& mem : mems) { get_mem_hits_if_under_max(mem); }
+        if (debug) cerr << "mems after filtering " << mems_to_json(mems) << endl;
+        results[mem_reads[j]] = align_multi_internal(true, alns[mem_reads[j]], kmer_size, stride, max_mem_length,
+                                                     band_width, 0, &mems);
+    }
+    return results;
+}
     
 vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality, const Alignment& aln,
                                                int kmer_size, int stride,
@@ -1926,24 +2193,69 @@ set<pos_t> Mapper::sequence_positions(const string& seq) {
 // Use the GCSA2 index to find super-maximal exact matches.
 vector<MaximalExactMatch>
 Mapper::find_smems(const string& seq, int max_mem_length) {
+    vector<const string*> seqs = {&seq};
+    return std::move(find_smems_batch(seqs, max_mem_length).front());
+}
+
+vector<vector<MaximalExactMatch>>
+Mapper::find_smems_batch(const vector<string>& seqs, int max_mem_length) {
+    vector<const string*> seq_ptrs;
+    seq_ptrs.reserve(seqs.size());
+    for (auto& seq : seqs) {
+        seq_ptrs.push_back(&seq);
+    }
+    return find_smems_batch(seq_ptrs, max_mem_length);
+}
+
+vector<vector<MaximalExactMatch>>
+Mapper::find_smems_batch(const vector<const string*>& seqs, int max_mem_length) {
     
     if (!gcsa) {
         cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
         exit(1);
     }
 
-    string::const_iterator string_begin = seq.begin();
-    string::const_iterator cursor = seq.end();
-    vector<MaximalExactMatch> mems;
+    vector<vector<MaximalExactMatch>> all_mems = search_smems(seqs, max_mem_length, gcsa, lcp);
+    if (delta_gcsa) {
+        vector<vector<MaximalExactMatch>> all_delta_mems = search_smems(seqs, max_mem_length, delta_gcsa, delta_lcp);
+        for (size_t i = 0; i < seqs.size(); ++i) {
+            merge_delta_smems(all_mems[i], all_delta_mems[i]);
+        }
+    }
+    return all_mems;
+}
 
-    // an empty sequence matches the entire bwt
-    if (seq.empty()) {
-        mems.emplace_back(
-            MaximalExactMatch(seq.begin(), seq.end(),
-                              gcsa::range_type(0, gcsa->size() - 1)));
-        return mems;
+void Mapper::merge_delta_smems(vector<MaximalExactMatch>& mems, vector<MaximalExactMatch>& delta_mems) {
+    // a match found in both indexes gets both ranges, and one only in the
+    // delta index gets an empty main range
+    map<pair<string::const_iterator, string::const_iterator>, size_t> mem_at;
+    for (size_t i = 0; i < mems.size(); ++i) {
+        mem_at[make_pair(mems[i].begin, mems[i].end)] = i;
+    }
+    for (auto& delta_mem : delta_mems) {
+        auto found = mem_at.find(make_pair(delta_mem.begin, delta_mem.end));
+        if (found != mem_at.end()) {
+            mems[found->second].delta_range = delta_mem.range;
+        } else {
+            delta_mem.delta_range = delta_mem.range;
+            delta_mem.range = gcsa::range_type(1, 0);
+            mems.push_back(delta_mem);
+        }
     }
-    
+    // keep the matches in natural order
+    std::stable_sort(mems.begin(), mems.end(),
+                     [](const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
+                         return m1.begin < m2.begin || m1.begin == m2.begin && m1.end < m2.end;
+                     });
+}
+
+vector<vector<MaximalExactMatch>>
+Mapper::search_smems(const vector<const string*>& seqs, int max_mem_length,
+                     gcsa::GCSA* search_gcsa, gcsa::LCPArray* search_lcp) {
+
+    auto full_range = gcsa::range_type(0, search_gcsa->size() - 1);
+    vector<vector<MaximalExactMatch>> all_mems(seqs.size());
+
     // find SMEMs using GCSA+LCP array
     // algorithm sketch:
     // set up a cursor pointing to the last position in the sequence
@@ -1958,60 +2270,97 @@ Mapper::find_smems(const string& seq, int max_mem_length) {
     //           (effectively, this steps up the suffix tree)
     //           and calculate the new end point using the LCP of the parent node
     // emit the final MEM, if we finished in a matching state
+    //
+    // Each step depends on the range found by the one before, and almost
+    // every step misses the cache, so a single search spends most of its time
+    // waiting on memory. The searches of different sequences are independent,
+    // so we take one step of each in turn, letting their lookups overlap.
+    vector<SMEMSearch> searches;
+    searches.reserve(seqs.size());
+    // indexes of the searches that still have characters to search
+    vector<size_t> active;
+    for (size_t i = 0; i < seqs.size(); ++i) {
+        searches.emplace_back(*seqs[i], full_range);
+        if (seqs[i]->empty()) {
+            // an empty sequence matches the entire bwt
+            all_mems[i].emplace_back(
+                MaximalExactMatch(seqs[i]->begin(), seqs[i]->end(), full_range));
+        } else {
+            active.push_back(i);
+        }
+    }
 
-    // the temporary MEM we'll build up in this process
-    auto full_range = gcsa::range_type(0, gcsa->size() - 1);
-    MaximalExactMatch match(cursor, cursor, full_range);
-    gcsa::range_type last_range = match.range;
-    --cursor; // start off looking at the last character in the query
-    while (cursor >= string_begin) {
-        // hold onto our previous range
-        last_range = match.range;
-        // execute one step of LF mapping
-        match.range = gcsa->LF(match.range, gcsa->alpha.char2comp[*cursor]);
-        if (gcsa::Range::empty(match.range)
-            || max_mem_length && match.end-cursor > max_mem_length
-            || match.end-cursor > gcsa->order()) {
-            // break on N; which for DNA we assume is non-informative
-            // this *will* match many places in assemblies; this isn't helpful
-            if (*cursor == 'N' || last_range == full_range) {
-                // we mismatched in a single character
-                // there is no MEM here
-                match.begin = cursor+1;
-                match.range = last_range;
-                mems.push_back(match);
-                match.end = cursor;
-                match.range = full_range;
-                --cursor;
-            } else {
-                // we've exhausted our BWT range, so the last match range was maximal
-                // or: we have exceeded the order of the graph (FPs if we go further)
-                //     we have run over our parameter-defined MEM limit
-                // record the last MEM
-                match.begin = cursor+1;
-                match.range = last_range;
-                mems.push_back(match);
-                // set up the next MEM using the parent node range
-                // length of last MEM, which we use to update our end pointer for the next MEM
-                size_t last_mem_length = match.end - match.begin;
-                // get the parent suffix tree node corresponding to the parent of the last MEM's STNode
-                gcsa::STNode parent = lcp->parent(last_range);
-                // change the end for the next mem to reflect our step size
-                size_t step_size = last_mem_length - parent.lcp();
-                match.end = mems.back().end-step_size;
-                // and set up the next MEM using the parent node range
-                match.range = parent.range();
+    while (!active.empty()) {
+        size_t still_active = 0;
+        for (size_t i = 0; i < active.size(); ++i) {
+            SMEMSearch& search = searches[active[i]];
+            smem_search_step(search, max_mem_length, full_range, search_gcsa, search_lcp);
+            if (search.cursor >= 0) {
+                active[still_active++] = active[i];
+                continue;
             }
+            // if we have a non-empty MEM at the end, record it
+            if (search.match.end - search.match.begin > 0) search.mems.push_back(search.match);
+            all_mems[active[i]] = std::move(search.mems);
+            finish_smems(all_mems[active[i]]);
+        }
+        active.resize(still_active);
+    }
+
+    return all_mems;
+}
+
+void Mapper::smem_search_step(SMEMSearch& search, int max_mem_length, const gcsa::range_type& full_range,
+                              gcsa::GCSA* search_gcsa, gcsa::LCPArray* search_lcp) {
+    MaximalExactMatch& match = search.match;
+    auto& mems = search.mems;
+    string::const_iterator cursor = search.seq->begin() + search.cursor;
+    // hold onto our previous range
+    gcsa::range_type last_range = match.range;
+    // execute one step of LF mapping
+    match.range = search_gcsa->LF(match.range, search_gcsa->alpha.char2comp[*cursor]);
+    if (gcsa::Range::empty(match.range)
+        || max_mem_length && match.end-cursor > max_mem_length
+        || match.end-cursor > search_gcsa->order()) {
+        // break on N; which for DNA we assume is non-informative
+        // this *will* match many places in assemblies; this isn't helpful
+        if (*cursor == 'N' || last_range == full_range) {
+            // we mismatched in a single character
+            // there is no MEM here
+            match.begin = cursor+1;
+            match.range = last_range;
+            mems.push_back(match);
+            match.end = cursor;
+            match.range = full_range;
+            --search.cursor;
         } else {
-            // we are matching
-            match.begin = cursor;
-            // just step to the next position
-            --cursor;
+            // we've exhausted our BWT range, so the last match range was maximal
+            // or: we have exceeded the order of the graph (FPs if we go further)
+            //     we have run over our parameter-defined MEM limit
+            // record the last MEM
+            match.begin = cursor+1;
+            match.range = last_range;
+            mems.push_back(match);
+            // set up the next MEM using the parent node range
+            // length of last MEM, which we use to update our end pointer for the next MEM
+            size_t last_mem_length = match.end - match.begin;
+            // get the parent suffix tree node corresponding to the parent of the last MEM's STNode
+            gcsa::STNode parent = search_lcp->parent(last_range);
+            // change the end for the next mem to reflect our step size
+            size_t step_size = last_mem_length - parent.lcp();
+            match.end = mems.back().end-step_size;
+            // and set up the next MEM using the parent node range
+            match.range = parent.range();
         }
+    } else {
+        // we are matching
+        match.begin = cursor;
+        // just step to the next position
+        --search.cursor;
     }
-    // if we have a non-empty MEM at the end, record it
-    if (match.end - match.begin > 0) mems.push_back(match);
+}
 
+void Mapper::finish_smems(vector<MaximalExactMatch>& mems) {
     // find the SMEMs from the mostly-SMEM and some MEM list we've built
     // FIXME: un-hack this (it shouldn't be needed!)
     // the algorithm sometimes generates MEMs contained in SMEMs
@@ -2039,9 +2388,9 @@ Mapper::find_smems(const string& seq, int max_mem_length) {
                mems.end());
     // return the matches in natural order
     std::reverse(mems.begin(), mems.end());
-    // verify the matches (super costly at scale)
-    if (debug) { check_mems(mems); }
-    return mems;
+    // verify the matches (super costly at scale), which can only be checked
+    // against the main index if it's the only one
+    if (debug && !delta_gcsa && !gcsa_anchors) { check_mems(mems); }
 }
 
 void Mapper::check_mems(const vector<MaximalExactMatch>& mems) {
@@ -2763,13 +3112,45 @@ bool Mapper::get_mem_hits_if_under_max(MaximalExactMatch& mem) {
     // require a minimum length
     if (mem.end-mem.begin == 0
         || mem.end-mem.begin < min_mem_length) return false;
-    // use the counting interface to determine the number of hits
-    mem.fill_match_count(gcsa);
-    // if we aren't filtering on hit count, or if we have up to the max allowed hits
+    if (!delta_gcsa && !gcsa_anchors) {
+        // use the counting interface to determine the number of hits
+        mem.fill_match_count(gcsa);
+        // if we aren't filtering on hit count, or if we have up to the max allowed hits
+        if (mem.match_count > 0 && (!hit_max || mem.match_count <= hit_max)) {
+            // extract the graph positions matching the range
+            mem.fill_nodes(gcsa);
+            filled = true;
+        }
+        return filled;
+    }
+
+    // the match may be in the main index, the delta index, or both
+    bool in_main = !gcsa::Range::empty(mem.range);
+    bool in_delta = delta_gcsa && !gcsa::Range::empty(mem.delta_range);
+    mem.match_count = (in_main ? gcsa->count(mem.range) : 0)
+        + (in_delta ? delta_gcsa->count(mem.delta_range) : 0);
     if (mem.match_count > 0 && (!hit_max || mem.match_count <= hit_max)) {
-        // extract the graph positions matching the range
-        mem.fill_nodes(gcsa);
-        filled = true;
+        mem.nodes.clear();
+        if (in_main) {
+            gcsa->locate(mem.range, mem.nodes);
+            if (gcsa_anchors) {
+                // move the hits onto the graph as it is now, dropping any that can't be
+                size_t kept = 0;
+                for (auto& node : mem.nodes) {
+                    if (gcsa_anchors->translate(node)) mem.nodes[kept++] = node;
+                }
+                mem.nodes.resize(kept);
+            }
+        }
+        if (in_delta) {
+            std::vector<gcsa::node_type> delta_nodes;
+            delta_gcsa->locate(mem.delta_range, delta_nodes);
+            mem.nodes.insert(mem.nodes.end(), delta_nodes.begin(), delta_nodes.end());
+        }
+        // sequence near the new material is in both indexes
+        std::sort(mem.nodes.begin(), mem.nodes.end());
+        mem.nodes.erase(std::unique(mem.nodes.begin(), mem.nodes.end()), mem.nodes.end());
+        filled = !mem.nodes.empty();
     }
     return filled;
 }
@@ -2794,105 +3175,51 @@ vector<Alignment>
 Mapper::mems_id_clusters_to_alignments(const Alignment& alignment, vector<MaximalExactMatch>& mems, int additional_multimaps) {
 
     struct StrandCounts {
+        id_t id;
         uint32_t forward;
         uint32_t reverse;
     };
     
     int total_multimaps = max_multimaps + additional_multimaps;
 
-    // we will use these to determine the alignment strand for each subgraph
-    map<id_t, StrandCounts> node_strands;
-    // records a mapping of id->MEMs, for cluster ranking
-    map<id_t, vector<MaximalExactMatch*> > id_to_mems;
-    // for clustering
-    vector<id_t> ids;
-
-    // run through the mems, generating a set of alignments for each
+    // collect ids and orientations of hits to them on the forward mem
+    MEMClusterScorer scorer;
     for (auto& mem : mems) {
         //if (debug) cerr << "on mem " << mem.sequence() << endl;
-        size_t len = mem.begin - mem.end;
-        // collect ids and orientations of hits to them on the forward mem
         for (auto& node : mem.nodes) {
-            id_t id = gcsa::Node::id(node);
-            id_to_mems[id].push_back(&mem);
-            ids.push_back(id);
-            if (gcsa::Node::rc(node)) {
-                node_strands[id].reverse++;
-            } else {
-                node_strands[id].forward++;
-            }
+            scorer.add_hit(gcsa::Node::id(node), gcsa::Node::rc(node), mem, alignment.sequence());
         }
     }
 
-    std::sort(ids.begin(), ids.end());
-    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
-
     // establish clusters using approximate distance metric based on ids
     // we pick up ranges between successive nodes
     // when these are below our thread_extension length
-    vector<vector<id_t> > clusters;
-    for (auto& id : ids) {
-        if (clusters.empty()) {
-            clusters.emplace_back();
-            auto& l = clusters.back();
-            l.push_back(id);
+    // and rank them by the fraction of the read that they cover
+    scorer.cluster(thread_extension);
+    vector<size_t> ranked_clusters = scorer.ranked();
+
+    // we will use these to determine the alignment strand for each subgraph,
+    // sorted by id (as the hits are)
+    vector<StrandCounts> node_strands;
+    for (auto& hit : scorer.hits) {
+        if (node_strands.empty() || node_strands.back().id != hit.key) {
+            node_strands.push_back({hit.key, 0, 0});
+        }
+        if (hit.is_reverse) {
+            node_strands.back().reverse++;
         } else {
-            auto& prev = clusters.back().back();
-            if (id - prev <= thread_extension) {
-                clusters.back().push_back(id);
-            } else {
-                clusters.emplace_back();
-                auto& l = clusters.back();
-                l.push_back(id);
-            }
-        }
-    }
-
-    // rank the clusters by the fraction of the read that they cover
-    map<vector<id_t>*, int> cluster_query_coverage;
-    std::for_each(clusters.begin(), clusters.end(),
-                  [&cluster_query_coverage,
-                   &id_to_mems](vector<id_t>& cluster) {
-                      set<string::const_iterator> query_coverage;
-                      for (auto& id : cluster) {
-                          auto& mems = id_to_mems[id];
-                          std::for_each(mems.begin(), mems.end(),
-                                        [&](MaximalExactMatch* m) {
-                                            string::const_iterator c = m->begin;
-                                            while (c != m->end) query_coverage.insert(c++);
-                                        });
-                      }
-                      cluster_query_coverage[&cluster] = query_coverage.size();
-                  });
-
-    vector<vector<id_t>*> ranked_clusters;
-    std::for_each(clusters.begin(), clusters.end(),
-                  [&ranked_clusters](vector<id_t>& cluster) {
-                      ranked_clusters.push_back(&cluster); });
-
-    std::sort(ranked_clusters.begin(), ranked_clusters.end(),
-              [&cluster_query_coverage](vector<id_t>* a,
-                                        vector<id_t>* b) {
-                  auto len_a = cluster_query_coverage[a];
-                  auto len_b = cluster_query_coverage[b];
-                  // order by cluster coverage of query
-                  // break ties on number of MEMs (fewer better)
-                  if (len_a == len_b) {
-                      return a->size() < b->size();
-                  } else {
-                      return len_a > len_b;
-                  }
-              });
-
+            node_strands.back().forward++;
+        }
+    }
 
     // generate an alignment for each subgraph/orientation combination for which we have hits
-    if (debug) cerr << "aligning to " << clusters.size() << " clusters" << endl;
+    if (debug) cerr << "aligning to " << scorer.clusters.size() << " clusters" << endl;
     if (debug) {
-        for (auto cptr : ranked_clusters) {
-            auto& c = *cptr;
-            cerr << cluster_query_coverage[cptr] << ":"
-                 << c.size() << " "
-                 << c.front() << "-" << c.back() << endl;
+        for (auto i : ranked_clusters) {
+            auto& c = scorer.clusters[i];
+            cerr << c.coverage << ":"
+                 << c.key_count << " "
+                 << scorer.hits[c.hits_begin].key << "-" << scorer.hits[c.hits_end - 1].key << endl;
         }
     }
 
@@ -2908,48 +3235,62 @@ Mapper::mems_id_clusters_to_alignments(const Alignment& alignment, vector<Maxima
     int max_target_length = alignment.sequence().size() * max_target_factor;
 
     size_t attempts = 0;
-    for (auto& cptr : ranked_clusters) {
-        auto& cluster = *cptr;
+    for (auto i : ranked_clusters) {
+        auto& cluster = scorer.clusters[i];
         // skip if our cluster is too small
-        if (cluster.size() < cluster_min) continue;
+        if (cluster.key_count < cluster_min) continue;
         // record our attempt count
         ++attempts;
         // bail out if we've passed our maximum number of attempts
         if (attempts > max(max_attempts, total_multimaps)) break;
         if (debug) {
             cerr << "attempt " << attempts
-                 << " on cluster " << cluster.front() << "-" << cluster.back() << endl;
-        }
-        VG sub; // the subgraph we'll align against
-        set<id_t> seen;
-        for (auto& id : cluster) {
-            if (seen.count(id)) continue; // avoid double-gets
-            seen.insert(id);
-            xindex->get_id_range(id, id, sub.graph);
+                 << " on cluster " << scorer.hits[cluster.hits_begin].key
+                 << "-" << scorer.hits[cluster.hits_end - 1].key << endl;
         }
+        ClusterSubgraph& sub = get_cluster_subgraph(); // the subgraph we'll align against
+        sub.clear();
+        // the keys come out distinct, so there are no double-gets
+        scorer.for_each_key(cluster, [&](int64_t id) {
+                sub.add_node(*xindex, id);
+            });
         // expand using our context depth
-        xindex->expand_context(sub.graph, context_depth, false);
-        sub.rebuild_indexes();
+        sub.expand_context(*xindex, context_depth);
         // if the graph is now too big to attempt, bail out
         if (max_target_factor && sub.length() > max_target_length) continue;
         if (debug) {
             cerr << "attempt " << attempts
-                 << " on subgraph " << sub.min_node_id() << "-" << sub.max_node_id() << endl;
+                 << " on subgraph of " << sub.nodes.size() << " nodes" << endl;
         }
         // determine the likely orientation
         uint32_t fw_mems = 0;
         uint32_t rc_mems = 0;
-        sub.for_each_node([&](Node* n) {
-                auto ns = node_strands.find(n->id());
-                if (ns != node_strands.end()) {
-                    fw_mems += ns->second.forward;
-                    rc_mems += ns->second.reverse;
-                }
-            });
+        for (auto& n : sub.nodes) {
+            auto ns = std::lower_bound(node_strands.begin(), node_strands.end(), n.id(),
+                                       [](const StrandCounts& counts, id_t id) {
+                                           return counts.id < id;
+                                       });
+            if (ns != node_strands.end() && ns->id == n.id()) {
+                fw_mems += ns->forward;
+                rc_mems += ns->reverse;
+            }
+        }
         if (debug) cerr << "got " << fw_mems << " forward and " << rc_mems << " reverse mems" << endl;
+        // softclip resolution grows the graph, so it needs a VG of its own,
+        // which we only build for the reads that want it
+        auto align_to_cluster = [&](const Alignment& base) {
+            Alignment aln = align_to_subgraph(base, sub);
+            if (max_softclip_iterations && aln.path().mapping_size()
+                && (softclip_start(aln) > softclip_threshold
+                    || softclip_end(aln) > softclip_threshold)) {
+                VG graph;
+                sub.to_vg(graph);
+                resolve_softclips(aln, graph);
+            }
+            return aln;
+        };
         if (fw_mems) {
-            Alignment aln = align_to_graph(aln_fw, sub, max_query_graph_ratio);
-            resolve_softclips(aln, sub);
+            Alignment aln = align_to_cluster(aln_fw);
             alns.push_back(aln);
             if (attempts >= total_multimaps &&
                 greedy_accept &&
@@ -2958,8 +3299,7 @@ Mapper::mems_id_clusters_to_alignments(const Alignment& alignment, vector<Maxima
             }
         }
         if (rc_mems) {
-            Alignment aln = align_to_graph(aln_rc, sub, max_query_graph_ratio);
-            resolve_softclips(aln, sub);
+            Alignment aln = align_to_cluster(aln_rc);
             alns.push_back(reverse_complement_alignment(aln,
                                                         (function<int64_t(int64_t)>)
                                                         ([&](int64_t id) { return get_node_length(id); })));
@@ -3533,6 +3873,255 @@ vector<Alignment> Mapper::align_threaded(const Alignment& alignment, int& kmer_c
 // realign to this graph
 // cross fingers
 
+// score a path as a local alignment of it would be scored, with the insertions at
+// its ends taken as soft clips, and gaps that run across mappings opened only once
+static int32_t score_projected_path(const Path& path, const Aligner& aligner) {
+    int32_t score = 0;
+    // 'D' or 'I' while inside a gap
+    char in_gap = 0;
+    for (size_t i = 0; i < path.mapping_size(); ++i) {
+        auto& mapping = path.mapping(i);
+        for (size_t j = 0; j < mapping.edit_size(); ++j) {
+            auto& edit = mapping.edit(j);
+            if (edit.from_length() == edit.to_length()) {
+                in_gap = 0;
+                if (edit.sequence().empty()) {
+                    score += aligner.match * edit.from_length();
+                } else {
+                    score -= aligner.mismatch * edit.from_length();
+                }
+                continue;
+            }
+            bool soft_clip = edit.from_length() == 0
+                && ((i == 0 && j == 0)
+                    || (i + 1 == path.mapping_size() && j + 1 == mapping.edit_size()));
+            if (soft_clip) {
+                in_gap = 0;
+                continue;
+            }
+            char gap = edit.from_length() ? 'D' : 'I';
+            int32_t length = max(edit.from_length(), edit.to_length());
+            score -= (in_gap == gap ? 0 : aligner.gap_open - aligner.gap_extension)
+                + aligner.gap_extension * length;
+            in_gap = gap;
+        }
+    }
+    return max(0, score);
+}
+
+bool Mapper::project_alignment(const Alignment& source,
+                               const set<string>& path_names,
+                               Alignment& surjection,
+                               string& path_name,
+                               int64_t& path_pos,
+                               bool& path_reverse) {
+
+    if (adjust_alignments_for_base_quality && !source.quality().empty()) {
+        // we can't rescore quality adjusted alignments by their edits
+        return false;
+    }
+
+    // the start of the node's single visit along the path, and which strand of
+    // it the path takes, or false if the path doesn't visit it exactly once
+    auto node_on_path = [&](id_t id, const string& name, int64_t& node_start, bool& backward) {
+        auto starts = xindex->node_positions_in_path(id, name);
+        if (starts.size() != 1) {
+            return false;
+        }
+        node_start = starts.front();
+        backward = xindex->mapping_at_path_position(name, node_start).position().is_reverse();
+        return true;
+    };
+
+    // the alignment has to start on just one of the paths
+    auto& first_position = source.path().mapping(0).position();
+    string target;
+    int64_t node_start;
+    bool backward;
+    for (auto& name : path_names) {
+        if (xindex->path_rank(name) == 0
+            || !node_on_path(first_position.node_id(), name, node_start, backward)) {
+            continue;
+        }
+        if (!target.empty()) {
+            return false;
+        }
+        target = name;
+    }
+    if (target.empty()) {
+        return false;
+    }
+
+    // project the alignment as it reads along the path, and flip it back at the end
+    function<int64_t(id_t)> node_length = [&](id_t id) {
+        return xindex->node_length(id);
+    };
+    bool reversed = first_position.is_reverse() != backward;
+    Alignment aln = reversed ? reverse_complement_alignment(source, node_length) : source;
+    const string& sequence = aln.sequence();
+
+    // an unaligned stretch of the reference path, along the strand the path takes
+    struct Piece {
+        id_t id;
+        bool backward;
+        size_t offset;
+        string sequence;
+    };
+    auto path_pieces = [&](int64_t begin, int64_t end) {
+        vector<Piece> pieces;
+        for (int64_t pos = begin; pos < end; ) {
+            Position step = xindex->mapping_at_path_position(target, pos).position();
+            int64_t step_start = -1;
+            for (auto start : xindex->node_positions_in_path(step.node_id(), target)) {
+                if ((int64_t) start <= pos && (int64_t) start > step_start) {
+                    step_start = start;
+                }
+            }
+            string node_sequence = xindex->node_sequence(step.node_id());
+            if (step.is_reverse()) {
+                node_sequence = reverse_complement(node_sequence);
+            }
+            size_t offset = pos - step_start;
+            size_t length = min<int64_t>(node_sequence.size() - offset, end - pos);
+            pieces.push_back(Piece{step.node_id(), step.is_reverse(), offset,
+                                   node_sequence.substr(offset, length)});
+            pos += length;
+        }
+        return pieces;
+    };
+    auto piece_mapping = [](const Piece& piece, Path& path) {
+        Mapping* mapping = path.add_mapping();
+        mapping->mutable_position()->set_node_id(piece.id);
+        mapping->mutable_position()->set_is_reverse(piece.backward);
+        mapping->mutable_position()->set_offset(piece.offset);
+        return mapping;
+    };
+    auto add_edit = [](Mapping* mapping, size_t from_length, size_t to_length, const string& sequence) {
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(from_length);
+        edit->set_to_length(to_length);
+        if (!sequence.empty()) {
+            edit->set_sequence(sequence);
+        }
+    };
+
+    // put the read bases from read_begin to read_end where the alignment left the path, onto
+    // the path from path_begin to path_end
+    auto realign_divergence = [&](size_t read_begin, size_t read_end, int64_t path_begin, int64_t path_end,
+                                  Path& projected) {
+        string read = sequence.substr(read_begin, read_end - read_begin);
+        if (path_begin == path_end) {
+            // an insertion, at the end of the last mapping on the path
+            add_edit(projected.mutable_mapping(projected.mapping_size() - 1), 0, read.size(), read);
+            return;
+        }
+        vector<Piece> pieces = path_pieces(path_begin, path_end);
+        if (read.empty()) {
+            // a deletion
+            for (auto& piece : pieces) {
+                add_edit(piece_mapping(piece, projected), piece.sequence.size(), 0, "");
+            }
+        } else if ((int64_t) read.size() == path_end - path_begin) {
+            // a substitution, which doesn't need aligning
+            size_t read_pos = 0;
+            for (auto& piece : pieces) {
+                Mapping* mapping = piece_mapping(piece, projected);
+                for (size_t i = 0; i < piece.sequence.size(); ) {
+                    bool match = read[read_pos + i] == piece.sequence[i];
+                    size_t j = i + 1;
+                    while (j < piece.sequence.size() && (read[read_pos + j] == piece.sequence[j]) == match) {
+                        ++j;
+                    }
+                    add_edit(mapping, j - i, j - i, match ? "" : read.substr(read_pos + i, j - i));
+                    i = j;
+                }
+                read_pos += piece.sequence.size();
+            }
+        } else {
+            // an indel, which we align globally against the stretch of the path
+            Graph graph;
+            for (size_t i = 0; i < pieces.size(); ++i) {
+                Node* node = graph.add_node();
+                node->set_id(i + 1);
+                node->set_sequence(pieces[i].sequence);
+                if (i > 0) {
+                    Edge* edge = graph.add_edge();
+                    edge->set_from(i);
+                    edge->set_to(i + 1);
+                }
+            }
+            Alignment divergence;
+            divergence.set_sequence(read);
+            get_regular_aligner()->align_global_banded(divergence, graph, 0, true);
+            for (auto& mapping : divergence.path().mapping()) {
+                auto& piece = pieces[mapping.position().node_id() - 1];
+                Mapping* placed = projected.add_mapping();
+                *placed = mapping;
+                placed->mutable_position()->set_node_id(piece.id);
+                placed->mutable_position()->set_is_reverse(piece.backward);
+                placed->mutable_position()->set_offset(piece.offset + mapping.position().offset());
+            }
+        }
+    };
+
+    Path projected;
+    int64_t first_start = -1;
+    int64_t last_end = -1;
+    // the read bases from divergence_begin to read_pos are off of the path
+    size_t read_pos = 0;
+    size_t divergence_begin = 0;
+    for (auto& mapping : aln.path().mapping()) {
+        auto& position = mapping.position();
+        if (!node_on_path(position.node_id(), target, node_start, backward)) {
+            read_pos += mapping_to_length(mapping);
+            continue;
+        }
+        if (position.is_reverse() != backward) {
+            // an inversion
+            return false;
+        }
+        int64_t start = node_start + position.offset();
+        if (first_start < 0) {
+            if (read_pos > 0) {
+                // the alignment starts off of the path
+                return false;
+            }
+            first_start = start;
+        } else if (start < last_end) {
+            // the alignment goes back along the path
+            return false;
+        } else if (start > last_end || divergence_begin < read_pos) {
+            if (start - last_end > (int64_t) sequence.size()) {
+                // a stretch of the path longer than the read is too long to realign cheaply
+                return false;
+            }
+            realign_divergence(divergence_begin, read_pos, last_end, start, projected);
+        }
+        *projected.add_mapping() = mapping;
+        read_pos += mapping_to_length(mapping);
+        divergence_begin = read_pos;
+        last_end = start + mapping_from_length(mapping);
+    }
+    if (divergence_begin < read_pos) {
+        // the alignment leaves the path at its end
+        return false;
+    }
+    for (size_t i = 0; i < projected.mapping_size(); ++i) {
+        projected.mutable_mapping(i)->set_rank(i + 1);
+    }
+    projected.set_name(aln.path().name());
+
+    *aln.mutable_path() = projected;
+    aln.clear_mapping_quality();
+    aln.set_score(score_projected_path(projected, *get_regular_aligner()));
+    aln.set_identity(identity(projected));
+    surjection = reversed ? reverse_complement_alignment(aln, node_length) : aln;
+    path_name = target;
+    path_pos = first_start;
+    path_reverse = reversed;
+    return true;
+}
+
 Alignment Mapper::surject_alignment(const Alignment& source,
                                     set<string>& path_names,
                                     string& path_name,
@@ -3558,6 +4147,12 @@ Alignment Mapper::surject_alignment(const Alignment& source,
         return surjection;
     }
 
+    // most alignments already follow the path, and don't need any dynamic programming
+    if (surject_by_projection
+        && project_alignment(source, path_names, surjection, path_name, path_pos, path_reverse)) {
+        return surjection;
+    }
+
     set<id_t> nodes;
     for (int i = 0; i < source.path().mapping_size(); ++ i) {
         nodes.insert(source.path().mapping(i).position().node_id());
@@ -13,7 +13,8 @@
 #include "alignment.hpp"
 #include "path.hpp"
 #include "position.hpp"
-#include "lru_cache.h"
+#include "node_cache.hpp"
+#include "path_anchors.hpp"
 #include "json2pb.h"
 #include "entropy.hpp"
 #include "gssw_aligner.hpp"
@@ -31,13 +32,16 @@ public:
     string::const_iterator begin;
     string::const_iterator end;
     gcsa::range_type range;
+    // the range of the match in a Mapper's delta index, if it has one; empty
+    // if the match isn't there
+    gcsa::range_type delta_range;
     size_t match_count;
     std::vector<gcsa::node_type> nodes;
     MaximalExactMatch(string::const_iterator b,
                       string::const_iterator e,
                       gcsa::range_type r,
                       size_t m = 0)
-        : begin(b), end(e), range(r), match_count(m) { }
+        : begin(b), end(e), range(r), delta_range(1, 0), match_count(m) { }
 
     // construct the sequence of the MEM; useful in debugging
     string sequence(void) const {
@@ -63,6 +67,101 @@ public:
 
 };
 
+/**
+ * Ranks clusters of MEM hits by how much of the read they cover.
+ *
+ * A hit is one match of a MEM, keyed by where it falls (a node ID, or the
+ * index of a cluster built some other way). Clusters are runs of the hits,
+ * sorted by key, in which successive distinct keys are no more than a gap
+ * apart. Everything is kept in flat arrays, and each cluster's coverage of the
+ * read is the length of the union of its MEMs' intervals, found by sorting
+ * them, so scoring takes O(n log n) in the number of hits.
+ */
+class MEMClusterScorer {
+public:
+
+    struct Hit {
+        int64_t key;
+        bool is_reverse;
+        // the MEM's interval in the read
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    struct Cluster {
+        // the cluster's hits are hits[hits_begin, hits_end)
+        size_t hits_begin;
+        size_t hits_end;
+        // number of distinct keys among the hits
+        size_t key_count;
+        // bases of the read covered by the cluster's MEMs
+        size_t coverage;
+    };
+
+    vector<Hit> hits;
+    vector<Cluster> clusters;
+
+    void clear(void);
+    // record a hit of the MEM, which must point into the read
+    void add_hit(int64_t key, bool is_reverse, const MaximalExactMatch& mem, const string& read);
+    // sort the hits and cut them into scored clusters
+    void cluster(int64_t max_gap);
+    // get the indexes of the clusters, best first: by coverage, with ties
+    // broken in favor of fewer distinct keys
+    vector<size_t> ranked(void) const;
+    // call the lambda on each distinct key in the cluster, in order
+    void for_each_key(const Cluster& cluster, const function<void(int64_t)>& lambda) const;
+
+private:
+    // reused for sorting the intervals of a cluster
+    vector<pair<uint32_t, uint32_t>> intervals;
+};
+
+/**
+ * A subgraph of the xg index to align one cluster against, made to be cleared
+ * and refilled for cluster after cluster. Its nodes and edges live in flat
+ * arrays that keep their storage between uses, and it is put in alignment
+ * order by its own topological sort, so none of VG's indexes are ever built.
+ */
+class ClusterSubgraph {
+public:
+
+    // the nodes, in the order they were added
+    vector<Node> nodes;
+    // every edge between two of the nodes, once each
+    vector<Edge> edges;
+    // the nodes in topological order, joined to a root, after sort_for_alignment
+    Graph graph;
+
+    void clear(void);
+    // add the node with the given ID from the index, if we don't have it yet
+    void add_node(xg::XG& xindex, id_t id);
+    // pull in the nodes within the given number of steps of those we have, and
+    // all the edges between our nodes; call once, after adding the nodes
+    void expand_context(xg::XG& xindex, int steps);
+    // total sequence length of the nodes
+    int64_t length(void) const;
+    bool has_node(id_t id) const { return node_index.count(id); }
+    // put the nodes in topological order in graph, behind an "N" root that
+    // leads to all the heads, as VG::align does for a DAG; returns false,
+    // leaving graph empty, if there are cycles or reversing edges, in which
+    // case the subgraph must go through VG to be aligned
+    bool sort_for_alignment(void);
+    // copy the nodes and edges (but not the root) into a VG
+    void to_vg(VG& vg) const;
+
+private:
+    // index of each node in nodes
+    hash_map<id_t, size_t> node_index;
+    // reused by the sort
+    vector<size_t> in_degree;
+    vector<size_t> order;
+    vector<vector<size_t>> successors;
+    // look up the edges of the i-th node, adding its neighbors to nodes if
+    // asked to, and keep each edge that leaves the node and reaches one of ours
+    void fetch_edges(xg::XG& xindex, size_t i, bool add_neighbors);
+};
+
 
 class Mapper {
 
@@ -75,6 +174,8 @@ private:
     Mapper(Index* idex, xg::XG* xidex, gcsa::GCSA* g, gcsa::LCPArray* a);
     
     Alignment align_to_graph(const Alignment& aln, VG& vg, size_t max_query_graph_ratio);
+    // align against a cluster's subgraph, going through VG only if it can't be sorted directly
+    Alignment align_to_subgraph(const Alignment& aln, ClusterSubgraph& sub);
     vector<Alignment> align_multi_internal(bool compute_unpaired_qualities,
                                            const Alignment& aln,
                                            int kmer_size,
@@ -83,6 +184,33 @@ private:
                                            int band_width,
                                            int additional_multimaps = 0,
                                            vector<MaximalExactMatch>* restricted_mems = nullptr);
+
+    // the state of the backward search for the SMEMs of one sequence, so that
+    // the searches for several sequences can be advanced in turn
+    struct SMEMSearch {
+        const string* seq;
+        // position of the next character to search, or -1 when done
+        int64_t cursor;
+        // the MEM being extended
+        MaximalExactMatch match;
+        // MEMs found so far, in reverse order
+        vector<MaximalExactMatch> mems;
+        SMEMSearch(const string& s, const gcsa::range_type& full_range)
+            : seq(&s), cursor((int64_t) s.size() - 1), match(s.end(), s.end(), full_range) { }
+    };
+    // take one step of LF mapping (or of moving up the suffix tree) in the search
+    void smem_search_step(SMEMSearch& search, int max_mem_length, const gcsa::range_type& full_range,
+                          gcsa::GCSA* search_gcsa, gcsa::LCPArray* search_lcp);
+    // reduce the MEMs of a finished search to the SMEMs, in natural order
+    void finish_smems(vector<MaximalExactMatch>& mems);
+    // find the SMEMs of each of the sequences, which must outlive the MEMs
+    vector<vector<MaximalExactMatch>> find_smems_batch(const vector<const string*>& seqs, int max_mem_length);
+    // find the SMEMs of each of the sequences in the given index
+    vector<vector<MaximalExactMatch>> search_smems(const vector<const string*>& seqs, int max_mem_length,
+                                                   gcsa::GCSA* search_gcsa, gcsa::LCPArray* search_lcp);
+    // add the SMEMs found in the delta index to those found in the main one
+    void merge_delta_smems(vector<MaximalExactMatch>& mems, vector<MaximalExactMatch>& delta_mems);
+
     void compute_mapping_qualities(vector<Alignment>& alns);
     void compute_mapping_qualities(pair<vector<Alignment>, vector<Alignment>>& pair_alns);
     vector<Alignment> score_sort_and_deduplicate_alignments(vector<Alignment>& all_alns, const Alignment& original_alignment);
@@ -121,18 +249,37 @@ public:
     // GCSA index and its LCP array
     gcsa::GCSA* gcsa;
     gcsa::LCPArray* lcp;
-    // GSSW aligner(s)
-    vector<QualAdjAligner*> qual_adj_aligners;
-    vector<Aligner*> regular_aligners;
+    // If the GCSA index was built on an earlier version of the graph than the
+    // xg index, the anchors that move its hits onto the graph as it is now.
+    PathAnchors* gcsa_anchors;
+    // A smaller GCSA index and LCP array, over the sequence the graph has
+    // gained since the main GCSA index was built, searched as well if set.
+    gcsa::GCSA* delta_gcsa;
+    gcsa::LCPArray* delta_lcp;
+    // GSSW aligner(s), one for each alignment thread, which can be shared with
+    // other Mappers working in the same team of threads
+    vector<shared_ptr<QualAdjAligner>> qual_adj_aligners;
+    vector<shared_ptr<Aligner>> regular_aligners;
     void clear_aligners(void);
+    // use the aligners and cluster subgraphs of another Mapper, so a team of
+    // threads each with its own Mapper needs only one of each per thread;
+    // also takes on the other Mapper's alignment_threads
+    void share_aligners(const Mapper& other);
     QualAdjAligner* get_qual_adj_aligner(void);
     Aligner* get_regular_aligner(void);
 
-    // match walking support to prevent repeated calls to the xg index for the same node
-    vector<LRUCache<id_t, Node>* > node_cache;
-    LRUCache<id_t, Node>& get_node_cache(void);
+    // match walking support to prevent repeated calls to the xg index for the
+    // same node; shared by all the threads, and by any other Mappers (or
+    // Samplers) that are handed the same cache
+    shared_ptr<NodeCache> node_cache;
+    NodeCache& get_node_cache(void);
     void init_node_cache(void);
 
+    // per-thread subgraphs for aligning against MEM clusters, sized in
+    // init_node_cache and shared along with the aligners
+    shared_ptr<vector<ClusterSubgraph>> cluster_subgraphs;
+    ClusterSubgraph& get_cluster_subgraph(void);
+
     // a collection of read pairs which we'd like to realign once we have estimated the fragment_size
     vector<pair<Alignment, Alignment> > imperfect_pairs_to_retry;
 
@@ -207,6 +354,15 @@ public:
                                   int stride = 0,
                                   int max_mem_length = 0,
                                   int band_width = 1000);
+
+    // Align each of the reads as align_multi does. The seeds of all the reads
+    // that are aligned with MEMs are found together with find_smems_batch, so
+    // it pays to pass several reads at once.
+    vector<vector<Alignment>> align_multi_batch(const vector<Alignment>& alns,
+                                                int kmer_size = 0,
+                                                int stride = 0,
+                                                int max_mem_length = 0,
+                                                int band_width = 1000);
     
     // paired-end based
     
@@ -244,9 +400,26 @@ public:
                                 bool& path_reverse,
                                 int window);
 
+    // Surject the alignment onto the one of the paths that it follows by projecting
+    // its mappings into the path's coordinates, realigning only the stretches where
+    // it leaves the path for nodes that aren't on it. Returns false if the alignment
+    // can't be projected, because it doesn't start and end on exactly one of the
+    // paths or doesn't move along it in order, and then it has to be realigned whole.
+    bool project_alignment(const Alignment& source,
+                           const set<string>& path_names,
+                           Alignment& surjection,
+                           string& path_name,
+                           int64_t& path_pos,
+                           bool& path_reverse);
+
     // MEM-based mapping
     // finds absolute super-maximal exact matches
     vector<MaximalExactMatch> find_smems(const string& seq, int max_length);
+    // finds the super-maximal exact matches of several sequences at once,
+    // interleaving the steps of their backward searches so that the index
+    // lookups of different sequences overlap. The MEMs point into the
+    // sequences, which must outlive them.
+    vector<vector<MaximalExactMatch>> find_smems_batch(const vector<string>& seqs, int max_length);
     bool get_mem_hits_if_under_max(MaximalExactMatch& mem);
     // debugging, checking of mems using find interface to gcsa
     void check_mems(const vector<MaximalExactMatch>& mems);
@@ -271,7 +444,10 @@ public:
     map<string, int> approx_pair_fragment_length(const Alignment& aln1, const Alignment& aln2);
     
     bool debug;
-    int alignment_threads; // how many threads will *this* mapper use when running banded alignmentsx
+    // how many threads will *this* mapper use when running banded alignments; if it is
+    // used inside a parallel region no bigger than this, the bands of a long read become
+    // tasks that the rest of the team takes up once it runs out of reads of its own
+    int alignment_threads;
 
     // kmer/"threaded" mapper parameters
     //
@@ -297,6 +473,7 @@ public:
     //
     int hit_max;       // ignore kmers or MEMs (TODO) with more than this many hits
     int context_depth; // how deeply the mapper will extend out the subgraph prior to alignment
+    bool surject_by_projection; // project alignments that follow the path onto it in surject_alignment, rather than realigning them
     int max_attempts;  // maximum number of times to try to increase sensitivity or use a lower-hit subgraph
     int thread_extension; // add this many nodes in id space to the end of the thread when building thread into a subgraph
     int max_target_factor; // the maximum multiple of the read length we'll try to align to
@@ -0,0 +1,93 @@
+#include "node_cache.hpp"
+
+#include <stdexcept>
+
+namespace vg {
+
+using namespace std;
+
+NodeCache::NodeCache(xg::XG* xindex, size_t capacity, size_t shard_count) : xindex(xindex) {
+    if (shard_count == 0) {
+        throw runtime_error("[NodeCache] need at least one shard");
+    }
+    shard_capacity = max((size_t) 1, capacity / shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.emplace_back(new Shard());
+    }
+}
+
+NodeCache::Shard& NodeCache::shard_for(id_t id) {
+    // node IDs tend to be dense, so neighboring nodes land in different shards
+    return *shards[(uint64_t) id % shards.size()];
+}
+
+shared_ptr<const Node> NodeCache::get(id_t id) {
+    Shard& shard = shard_for(id);
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto found = shard.slot_of.find(id);
+        if (found != shard.slot_of.end()) {
+            Slot& slot = shard.slots[found->second];
+            slot.referenced = true;
+            shard.hits.fetch_add(1, memory_order_relaxed);
+            return slot.node;
+        }
+    }
+    shard.misses.fetch_add(1, memory_order_relaxed);
+
+    // go to the index without holding the lock
+    shared_ptr<const Node> node = make_shared<Node>(xindex->node(id));
+
+    lock_guard<mutex> guard(shard.lock);
+    auto found = shard.slot_of.find(id);
+    if (found != shard.slot_of.end()) {
+        // another thread got it in first
+        return shard.slots[found->second].node;
+    }
+    if (shard.slots.size() < shard_capacity) {
+        shard.slot_of[id] = shard.slots.size();
+        shard.slots.push_back({id, node, true});
+        return node;
+    }
+    // sweep the hand around, giving each referenced node a second chance,
+    // until it lands on one to evict
+    while (shard.slots[shard.hand].referenced) {
+        shard.slots[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.slots.size();
+    }
+    Slot& slot = shard.slots[shard.hand];
+    shard.slot_of.erase(slot.id);
+    shard.slot_of[id] = shard.hand;
+    slot.id = id;
+    slot.node = node;
+    slot.referenced = true;
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+    return node;
+}
+
+void NodeCache::clear(void) {
+    for (auto& shard : shards) {
+        lock_guard<mutex> guard(shard->lock);
+        shard->slots.clear();
+        shard->slot_of.clear();
+        shard->hand = 0;
+    }
+}
+
+uint64_t NodeCache::hits(void) const {
+    uint64_t total = 0;
+    for (auto& shard : shards) {
+        total += shard->hits.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t NodeCache::misses(void) const {
+    uint64_t total = 0;
+    for (auto& shard : shards) {
+        total += shard->misses.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+}
@@ -0,0 +1,81 @@
+#ifndef VG_NODE_CACHE_H
+#define VG_NODE_CACHE_H
+// node_cache.hpp: defines NodeCache, a cache of xg nodes shared by all the
+// threads that walk the graph
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "vg.pb.h"
+#include "types.hpp"
+#include "hash_map.hpp"
+#include "xg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A fixed-size cache of the nodes of an xg index, safe to share between
+ * threads, so that a node that is hot for one thread is cached once for all
+ * of them instead of once per thread.
+ *
+ * The cache is split into shards by node ID, each behind its own lock, which
+ * is held only to find a node or to put one in; nodes are fetched from the
+ * index outside of it. Each shard evicts with the CLOCK algorithm: a node
+ * that is looked up gets a reference bit, and the clock hand clears bits
+ * until it finds a node without one to replace. Nodes are handed out as
+ * shared pointers, so a node stays good for as long as it is held, even if
+ * it is evicted.
+ */
+class NodeCache {
+public:
+
+    /// Cache up to capacity nodes of the index, in the given number of shards.
+    NodeCache(xg::XG* xindex, size_t capacity = 1 << 16, size_t shard_count = 64);
+
+    /// Get the node, from the cache or else from the index.
+    shared_ptr<const Node> get(id_t id);
+
+    /// Get the length of the node's sequence.
+    size_t node_length(id_t id) { return get(id)->sequence().size(); }
+
+    /// Drop all the cached nodes. Not safe to call while other threads use the cache.
+    void clear(void);
+
+    /// Number of lookups that found their node in the cache.
+    uint64_t hits(void) const;
+    /// Number of lookups that had to go to the index.
+    uint64_t misses(void) const;
+
+    xg::XG* xindex;
+
+private:
+
+    struct Slot {
+        id_t id;
+        shared_ptr<const Node> node;
+        bool referenced;
+    };
+
+    struct Shard {
+        mutex lock;
+        vector<Slot> slots;
+        // index of each cached node in slots
+        hash_map<id_t, size_t> slot_of;
+        // where the clock hand points
+        size_t hand = 0;
+        atomic<uint64_t> hits{0};
+        atomic<uint64_t> misses{0};
+    };
+
+    size_t shard_capacity;
+    vector<unique_ptr<Shard>> shards;
+
+    Shard& shard_for(id_t id);
+};
+
+}
+
+#endif
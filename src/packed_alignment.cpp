@@ -0,0 +1,324 @@
+#include "packed_alignment.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace vg {
+
+using namespace std;
+
+// 2-bit code of an upper case base, or 4 for anything that has to be kept as
+// an exception
+static inline uint8_t base_code(char c) {
+    switch (c) {
+    case 'A': return 0;
+    case 'C': return 1;
+    case 'G': return 2;
+    case 'T': return 3;
+    default: return 4;
+    }
+}
+
+static const char CODE_BASES[4] = {'A', 'C', 'G', 'T'};
+
+// find the first exception at or after position i
+static vector<pair<uint32_t, char>>::const_iterator first_exception(const vector<pair<uint32_t, char>>& exceptions,
+                                                                    size_t i) {
+    return lower_bound(exceptions.begin(), exceptions.end(), i,
+                       [](const pair<uint32_t, char>& exception, size_t pos) {
+                           return exception.first < pos;
+                       });
+}
+
+PackedSequence::PackedSequence(const string& seq) {
+    append(seq);
+}
+
+void PackedSequence::append(const string& seq) {
+    if (length + seq.size() > numeric_limits<uint32_t>::max()) {
+        throw runtime_error("[PackedSequence] sequence too long to pack");
+    }
+    words.resize((length + seq.size() + 31) / 32, 0);
+    for (size_t i = 0; i < seq.size(); ++i, ++length) {
+        uint8_t code = base_code(seq[i]);
+        if (code == 4) {
+            // the packed bits stay 0 under an exception
+            exceptions.emplace_back(length, seq[i]);
+            continue;
+        }
+        words[length / 32] |= (uint64_t) code << (2 * (length % 32));
+    }
+}
+
+void PackedSequence::clear() {
+    words.clear();
+    exceptions.clear();
+    length = 0;
+}
+
+char PackedSequence::at(size_t i) const {
+    if (!exceptions.empty()) {
+        auto found = first_exception(exceptions, i);
+        if (found != exceptions.end() && found->first == i) {
+            return found->second;
+        }
+    }
+    return CODE_BASES[(words[i / 32] >> (2 * (i % 32))) & 3];
+}
+
+string PackedSequence::substr(size_t i, size_t len) const {
+    string seq(len, 'N');
+    for (size_t j = 0; j < len; ++j) {
+        seq[j] = CODE_BASES[(words[(i + j) / 32] >> (2 * ((i + j) % 32))) & 3];
+    }
+    // patch in the exceptions that fall in the range
+    auto found = first_exception(exceptions, i);
+    for (; found != exceptions.end() && found->first < i + len; ++found) {
+        seq[found->first - i] = found->second;
+    }
+    return seq;
+}
+
+size_t PackedSequence::memory_size() const {
+    return sizeof(*this) + words.capacity() * sizeof(uint64_t)
+        + exceptions.capacity() * sizeof(pair<uint32_t, char>);
+}
+
+PackedAlignment::PackedAlignment(const Alignment& aln) {
+    pack(aln);
+}
+
+void PackedAlignment::clear() {
+    _name.clear();
+    _quality.clear();
+    _sequence.clear();
+    _score = 0;
+    _mapping_quality = 0;
+    _identity = 0;
+    _is_secondary = false;
+    _node_id.clear();
+    _offset.clear();
+    _mapping_flags.clear();
+    _rank.clear();
+    _edit_end.clear();
+    _edit_op.clear();
+    _edit_length.clear();
+    _edit_sequence_end.clear();
+    _other_lengths.clear();
+    _edit_sequences.clear();
+    _rest.clear();
+}
+
+void PackedAlignment::pack(const Alignment& aln) {
+    clear();
+
+    _name = aln.name();
+    _quality = aln.quality();
+    _sequence.append(aln.sequence());
+    _score = aln.score();
+    _mapping_quality = aln.mapping_quality();
+    _identity = aln.identity();
+    _is_secondary = aln.is_secondary();
+
+    const Path& path = aln.path();
+    size_t mapping_count = path.mapping_size();
+    _node_id.reserve(mapping_count);
+    _offset.reserve(mapping_count);
+    _mapping_flags.reserve(mapping_count);
+    _edit_end.reserve(mapping_count);
+
+    for (size_t i = 0; i < mapping_count; ++i) {
+        const Mapping& mapping = path.mapping(i);
+        const Position& position = mapping.position();
+        _node_id.push_back(position.node_id());
+        _offset.push_back(position.offset());
+        _mapping_flags.push_back((position.is_reverse() ? IS_REVERSE : 0) |
+                                 (mapping.has_position() ? HAS_POSITION : 0));
+        if (_rank.empty() && mapping.rank() != (int64_t) i + 1) {
+            // ranks aren't just the indexes, so store all of them
+            _rank.reserve(mapping_count);
+            for (size_t j = 0; j < i; ++j) {
+                _rank.push_back(j + 1);
+            }
+        }
+        if (!_rank.empty()) {
+            _rank.push_back(mapping.rank());
+        }
+
+        for (size_t j = 0; j < mapping.edit_size(); ++j) {
+            const Edit& edit = mapping.edit(j);
+            int32_t from = edit.from_length();
+            int32_t to = edit.to_length();
+            size_t seq_len = edit.sequence().size();
+            EditOp op;
+            if (from == to && from > 0 && seq_len == 0) {
+                op = MATCH;
+            } else if (from == to && from > 0 && seq_len == to) {
+                op = SUBSTITUTION;
+            } else if (from == 0 && to > 0 && seq_len == to) {
+                op = INSERTION;
+            } else if (to == 0 && from > 0 && seq_len == 0) {
+                op = DELETION;
+            } else {
+                op = OTHER;
+            }
+            _edit_op.push_back(op);
+            switch (op) {
+            case INSERTION:
+                _edit_length.push_back(to);
+                break;
+            case OTHER:
+                _edit_length.push_back(_other_lengths.size());
+                _other_lengths.emplace_back(from, to);
+                break;
+            default:
+                _edit_length.push_back(from);
+                break;
+            }
+            _edit_sequences.append(edit.sequence());
+            _edit_sequence_end.push_back(_edit_sequences.size());
+        }
+        _edit_end.push_back(_edit_op.size());
+    }
+
+    // keep whatever else is set, which for most reads is nothing
+    Alignment rest;
+    bool has_rest = false;
+    if (aln.has_path() && (path.mapping_size() == 0 || !path.name().empty() ||
+                           path.is_circular() || path.length() != 0)) {
+        Path* rest_path = rest.mutable_path();
+        rest_path->set_name(path.name());
+        rest_path->set_is_circular(path.is_circular());
+        rest_path->set_length(path.length());
+        has_rest = true;
+    }
+    if (aln.query_position() != 0) {
+        rest.set_query_position(aln.query_position());
+        has_rest = true;
+    }
+    if (!aln.sample_name().empty()) {
+        rest.set_sample_name(aln.sample_name());
+        has_rest = true;
+    }
+    if (!aln.read_group().empty()) {
+        rest.set_read_group(aln.read_group());
+        has_rest = true;
+    }
+    if (aln.has_fragment_prev()) {
+        *rest.mutable_fragment_prev() = aln.fragment_prev();
+        has_rest = true;
+    }
+    if (aln.has_fragment_next()) {
+        *rest.mutable_fragment_next() = aln.fragment_next();
+        has_rest = true;
+    }
+    if (aln.fragment_size() > 0) {
+        *rest.mutable_fragment() = aln.fragment();
+        has_rest = true;
+    }
+    if (aln.locus_size() > 0) {
+        *rest.mutable_locus() = aln.locus();
+        has_rest = true;
+    }
+    if (has_rest) {
+        rest.SerializeToString(&_rest);
+    }
+}
+
+void PackedAlignment::unpack(Alignment& aln) const {
+    aln.Clear();
+    if (!_rest.empty() && !aln.ParseFromString(_rest)) {
+        throw runtime_error("[PackedAlignment] could not restore alignment " + _name);
+    }
+
+    aln.set_name(_name);
+    aln.set_quality(_quality);
+    aln.set_sequence(_sequence.str());
+    aln.set_score(_score);
+    aln.set_mapping_quality(_mapping_quality);
+    aln.set_identity(_identity);
+    aln.set_is_secondary(_is_secondary);
+
+    if (mapping_size() == 0) {
+        return;
+    }
+    Path* path = aln.mutable_path();
+    for (size_t i = 0; i < mapping_size(); ++i) {
+        Mapping* mapping = path->add_mapping();
+        if (has_position(i)) {
+            Position* position = mapping->mutable_position();
+            position->set_node_id(_node_id[i]);
+            position->set_offset(_offset[i]);
+            position->set_is_reverse(is_reverse(i));
+        }
+        mapping->set_rank(rank(i));
+        for (size_t e = edit_begin(i); e < edit_end(i); ++e) {
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(from_length(e));
+            edit->set_to_length(to_length(e));
+            if (edit_sequence_length(e) > 0) {
+                edit->set_sequence(edit_sequence(e));
+            }
+        }
+    }
+}
+
+Alignment PackedAlignment::to_alignment() const {
+    Alignment aln;
+    unpack(aln);
+    return aln;
+}
+
+int32_t PackedAlignment::from_length(size_t e) const {
+    switch (_edit_op[e]) {
+    case INSERTION:
+        return 0;
+    case OTHER:
+        return _other_lengths[_edit_length[e]].first;
+    default:
+        return _edit_length[e];
+    }
+}
+
+int32_t PackedAlignment::to_length(size_t e) const {
+    switch (_edit_op[e]) {
+    case DELETION:
+        return 0;
+    case OTHER:
+        return _other_lengths[_edit_length[e]].second;
+    default:
+        return _edit_length[e];
+    }
+}
+
+pair<id_t, id_t> PackedAlignment::id_range() const {
+    pair<id_t, id_t> range(0, 0);
+    for (id_t id : _node_id) {
+        if (id == 0) {
+            continue;
+        }
+        if (range.first == 0 || id < range.first) {
+            range.first = id;
+        }
+        range.second = max(range.second, id);
+    }
+    return range;
+}
+
+size_t PackedAlignment::memory_size() const {
+    return sizeof(*this) + _name.capacity() + _quality.capacity() + _rest.capacity()
+        + _sequence.memory_size() - sizeof(_sequence)
+        + _edit_sequences.memory_size() - sizeof(_edit_sequences)
+        + _node_id.capacity() * sizeof(id_t)
+        + _offset.capacity() * sizeof(int64_t)
+        + _mapping_flags.capacity() * sizeof(uint8_t)
+        + _rank.capacity() * sizeof(int64_t)
+        + _edit_end.capacity() * sizeof(uint32_t)
+        + _edit_op.capacity() * sizeof(uint8_t)
+        + _edit_length.capacity() * sizeof(int32_t)
+        + _edit_sequence_end.capacity() * sizeof(uint32_t)
+        + _other_lengths.capacity() * sizeof(pair<int32_t, int32_t>);
+}
+
+}
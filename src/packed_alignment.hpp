@@ -0,0 +1,179 @@
+#ifndef VG_PACKED_ALIGNMENT_H
+#define VG_PACKED_ALIGNMENT_H
+// packed_alignment.hpp: defines PackedAlignment, a flat in-memory form of an
+// Alignment for loops that walk many alignments' paths
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A DNA sequence stored at 2 bits per base. Anything other than upper case
+ * A, C, G or T is kept as an exception next to the packed bases, so any
+ * string round-trips exactly.
+ */
+class PackedSequence {
+public:
+    PackedSequence(void) = default;
+    PackedSequence(const string& seq);
+
+    /// Add bases to the end.
+    void append(const string& seq);
+    void clear();
+
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    /// Get the base at the given position.
+    char at(size_t i) const;
+    /// Get len bases starting at the given position.
+    string substr(size_t i, size_t len) const;
+    string str() const { return substr(0, length); }
+
+    /// Bytes used by this sequence, including its own footprint.
+    size_t memory_size() const;
+
+private:
+    // 32 bases per word, first base in the low bits
+    vector<uint64_t> words;
+    size_t length = 0;
+    // position and character of every base that isn't ACGT, sorted by position
+    vector<pair<uint32_t, char>> exceptions;
+};
+
+/**
+ * An Alignment flattened into arrays, one entry per mapping and one per edit,
+ * with its read and edit sequences 2-bit packed. Walking its path touches a
+ * few contiguous arrays instead of a tree of protobuf objects and strings.
+ *
+ * Packing is lossless: fields with no slot here are kept serialized and
+ * restored by unpack. Edits are classified into ops so that the common cases
+ * need only a single length; any edit that doesn't fit one of them is an
+ * OTHER edit whose lengths are kept to the side.
+ *
+ * A PackedAlignment can be packed over and over, reusing its storage.
+ */
+class PackedAlignment {
+public:
+
+    enum EditOp : uint8_t {
+        // from_length == to_length, no sequence
+        MATCH,
+        // from_length == to_length, sequence of that length
+        SUBSTITUTION,
+        // from_length == 0, sequence of to_length
+        INSERTION,
+        // to_length == 0, no sequence
+        DELETION,
+        // anything else
+        OTHER
+    };
+
+    PackedAlignment(void) = default;
+    explicit PackedAlignment(const Alignment& aln);
+
+    /// Replace the contents with the given alignment.
+    void pack(const Alignment& aln);
+    /// Fill in aln (which is cleared first) with the packed alignment.
+    void unpack(Alignment& aln) const;
+    Alignment to_alignment() const;
+    void clear();
+
+    /// Bytes used by this packed alignment, including its own footprint.
+    size_t memory_size() const;
+
+    // Alignment fields
+
+    const string& name() const { return _name; }
+    const string& quality() const { return _quality; }
+    size_t sequence_length() const { return _sequence.size(); }
+    char base(size_t i) const { return _sequence.at(i); }
+    string sequence() const { return _sequence.str(); }
+    int32_t score() const { return _score; }
+    int32_t mapping_quality() const { return _mapping_quality; }
+    double identity() const { return _identity; }
+    bool is_secondary() const { return _is_secondary; }
+
+    // Path fields, addressed by mapping index
+
+    size_t mapping_size() const { return _node_id.size(); }
+    id_t node_id(size_t m) const { return _node_id[m]; }
+    int64_t offset(size_t m) const { return _offset[m]; }
+    bool is_reverse(size_t m) const { return _mapping_flags[m] & IS_REVERSE; }
+    bool has_position(size_t m) const { return _mapping_flags[m] & HAS_POSITION; }
+    /// The mapping's rank as stored, which may be 0 if it was never set.
+    int64_t rank(size_t m) const { return _rank.empty() ? m + 1 : _rank[m]; }
+
+    /// Index of the first edit of the mapping.
+    size_t edit_begin(size_t m) const { return m == 0 ? 0 : _edit_end[m - 1]; }
+    /// Index past the last edit of the mapping.
+    size_t edit_end(size_t m) const { return _edit_end[m]; }
+    size_t edit_size() const { return _edit_op.size(); }
+
+    // Edit fields, addressed by edit index
+
+    EditOp edit_op(size_t e) const { return (EditOp) _edit_op[e]; }
+    int32_t from_length(size_t e) const;
+    int32_t to_length(size_t e) const;
+    /// Is the edit a match or substitution (from_length == to_length)?
+    bool is_aligned(size_t e) const { return from_length(e) == to_length(e); }
+    size_t edit_sequence_length(size_t e) const { return _edit_sequence_end[e] - edit_sequence_begin(e); }
+    /// Get the i-th base of the edit's sequence.
+    char edit_base(size_t e, size_t i) const { return _edit_sequences.at(edit_sequence_begin(e) + i); }
+    string edit_sequence(size_t e) const {
+        return _edit_sequences.substr(edit_sequence_begin(e), edit_sequence_length(e));
+    }
+
+    /// Get the smallest and largest node IDs visited, or 0 and 0 if unmapped.
+    pair<id_t, id_t> id_range() const;
+
+private:
+
+    enum MappingFlag : uint8_t {
+        IS_REVERSE = 1,
+        HAS_POSITION = 2
+    };
+
+    size_t edit_sequence_begin(size_t e) const { return e == 0 ? 0 : _edit_sequence_end[e - 1]; }
+
+    string _name;
+    string _quality;
+    PackedSequence _sequence;
+    int32_t _score = 0;
+    int32_t _mapping_quality = 0;
+    double _identity = 0;
+    bool _is_secondary = false;
+
+    // per mapping
+    vector<id_t> _node_id;
+    vector<int64_t> _offset;
+    vector<uint8_t> _mapping_flags;
+    // empty when every mapping's rank is its 1-based index
+    vector<int64_t> _rank;
+    vector<uint32_t> _edit_end;
+
+    // per edit
+    vector<uint8_t> _edit_op;
+    // from_length for MATCH, SUBSTITUTION and DELETION, to_length for
+    // INSERTION, and an index into _other_lengths for OTHER
+    vector<int32_t> _edit_length;
+    vector<uint32_t> _edit_sequence_end;
+    // from_length and to_length of each OTHER edit
+    vector<pair<int32_t, int32_t>> _other_lengths;
+    // all the edits' sequences, end to end
+    PackedSequence _edit_sequences;
+
+    // every other field of the alignment, serialized, or empty if there are none
+    string _rest;
+};
+
+}
+
+#endif
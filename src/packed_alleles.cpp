@@ -0,0 +1,155 @@
+#include "packed_alleles.hpp"
+
+#include <algorithm>
+#include <smmintrin.h>
+
+namespace vg {
+
+using namespace std;
+
+const size_t PackedAlleles::NO_MATCH = numeric_limits<size_t>::max();
+
+PackedAlleles::PackedAlleles(const vector<string>& alleles) :
+    lengths(alleles.size()), forward((alleles.size() + 1) / 2), reversed((alleles.size() + 1) / 2) {
+    for (size_t i = 0; i < alleles.size(); ++i) {
+        lengths[i] = alleles[i].size();
+    }
+    for (size_t pair = 0; pair < forward.size() && all_packed; ++pair) {
+        // make room for the longer allele of the pair
+        size_t words = (lengths[2 * pair] + 31) / 32;
+        if (2 * pair + 1 < alleles.size()) {
+            words = max(words, (lengths[2 * pair + 1] + 31) / 32);
+        }
+        forward[pair].assign(words * 2, 0);
+        reversed[pair].assign(words * 2, 0);
+        for (size_t i = 2 * pair; i < 2 * pair + 2 && i < alleles.size() && all_packed; ++i) {
+            all_packed = pack(alleles[i], false, forward[pair].data() + i % 2, 2) &&
+                pack(alleles[i], true, reversed[pair].data() + i % 2, 2);
+        }
+    }
+}
+
+/// The 2-bit code for each character, or 4 for anything but ACGT. The codes
+/// are (c >> 1) & 3, which is what pack_16 computes.
+static const uint8_t* base_codes() {
+    static uint8_t codes[256];
+    static bool filled = [&]() {
+        fill(codes, codes + 256, 4);
+        for (uint8_t c : {'A', 'C', 'G', 'T'}) {
+            codes[c] = (c >> 1) & 3;
+        }
+        return true;
+    }();
+    (void) filled;
+    return codes;
+}
+
+/// Pack the 16 characters at chars, reversed if reverse is set, into the 32
+/// bits of packed. Returns false if any of them isn't ACGT.
+static inline bool pack_16(const uint8_t* chars, bool reverse, uint32_t& packed) {
+    __m128i c = _mm_loadu_si128((const __m128i*) chars);
+    if (reverse) {
+        c = _mm_shuffle_epi8(c, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    }
+    __m128i acgt = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('A')), _mm_cmpeq_epi8(c, _mm_set1_epi8('C'))),
+                                _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('G')), _mm_cmpeq_epi8(c, _mm_set1_epi8('T'))));
+    if (_mm_movemask_epi8(acgt) != 0xFFFF) {
+        return false;
+    }
+    __m128i codes = _mm_and_si128(_mm_srli_epi16(c, 1), _mm_set1_epi8(3));
+    // gather the codes 2, then 4, then 16 to a lane
+    __m128i pairs = _mm_maddubs_epi16(codes, _mm_set1_epi16(0x0401));
+    __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00100001));
+    __m128i all = _mm_shuffle_epi8(quads, _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+    packed = _mm_cvtsi128_si32(all);
+    return true;
+}
+
+bool PackedAlleles::pack(const string& seq, bool reverse, uint64_t* words, size_t stride) {
+    const uint8_t* chars = (const uint8_t*) seq.data();
+    size_t size = seq.size();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint32_t packed;
+        if (!pack_16(reverse ? chars + size - i - 16 : chars + i, reverse, packed)) {
+            return false;
+        }
+        words[(i / 32) * stride] |= (uint64_t) packed << (2 * (i % 32));
+    }
+    // the bases past the last 16
+    const uint8_t* codes = base_codes();
+    for (; i < size; ++i) {
+        uint8_t code = codes[chars[reverse ? size - 1 - i : i]];
+        if (code > 3) {
+            return false;
+        }
+        words[(i / 32) * stride] |= (uint64_t) code << (2 * (i % 32));
+    }
+    return true;
+}
+
+void PackedAlleles::count_packed_mismatches(const uint64_t* pair, const uint64_t* seq, size_t length,
+                                            size_t counts[2]) {
+    // the low bit of each base, where we collect whether either of its bits differ
+    const __m128i low_bits = _mm_set1_epi64x(0x5555555555555555ull);
+    // the set bits in each nibble, to count without popcnt
+    const __m128i nibble_counts = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low_nibbles = _mm_set1_epi8(0x0f);
+    // one running count for each allele
+    __m128i totals = _mm_setzero_si128();
+    for (size_t i = 0; i < length; i += 32) {
+        // the same word of the sequence against that word of both alleles
+        __m128i diff = _mm_xor_si128(_mm_set1_epi64x(seq[i / 32]),
+                                     _mm_loadu_si128((const __m128i*) (pair + (i / 32) * 2)));
+        diff = _mm_and_si128(_mm_or_si128(diff, _mm_srli_epi64(diff, 1)), low_bits);
+        if (length - i < 32) {
+            // only count the bases the sequence has
+            diff = _mm_and_si128(diff, _mm_set1_epi64x((1ull << (2 * (length - i))) - 1));
+        }
+        __m128i byte_counts = _mm_add_epi8(_mm_shuffle_epi8(nibble_counts, _mm_and_si128(diff, low_nibbles)),
+                                           _mm_shuffle_epi8(nibble_counts, _mm_and_si128(_mm_srli_epi16(diff, 4), low_nibbles)));
+        // which sum to a count in each 64-bit half
+        totals = _mm_add_epi64(totals, _mm_sad_epu8(byte_counts, _mm_setzero_si128()));
+    }
+    counts[0] = _mm_cvtsi128_si64(totals);
+    counts[1] = _mm_extract_epi64(totals, 1);
+}
+
+bool PackedAlleles::count_mismatches(const string& seq, bool anchored_start, bool anchored_end,
+                                     vector<size_t>& mismatches) const {
+    if (!all_packed) {
+        return false;
+    }
+    // line up the starts, or else the ends by comparing reversed
+    size_t word_count = (seq.size() + 31) / 32;
+    uint64_t stack_words[STACK_WORDS];
+    vector<uint64_t> heap_words;
+    uint64_t* packed_seq = stack_words;
+    if (word_count > STACK_WORDS) {
+        heap_words.resize(word_count);
+        packed_seq = heap_words.data();
+    }
+    fill(packed_seq, packed_seq + word_count, 0);
+    if (!pack(seq, !anchored_start, packed_seq, 1)) {
+        return false;
+    }
+    const vector<vector<uint64_t>>& pairs = anchored_start ? forward : reversed;
+
+    mismatches.resize(lengths.size());
+    for (size_t pair = 0; pair < pairs.size(); ++pair) {
+        size_t counts[2];
+        if (pairs[pair].size() / 2 >= word_count) {
+            count_packed_mismatches(pairs[pair].data(), packed_seq, seq.size(), counts);
+        }
+        for (size_t i = 2 * pair; i < 2 * pair + 2 && i < lengths.size(); ++i) {
+            if (seq.size() > lengths[i] || (anchored_start && anchored_end && seq.size() != lengths[i])) {
+                mismatches[i] = NO_MATCH;
+            } else {
+                mismatches[i] = counts[i % 2];
+            }
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,81 @@
+#ifndef VG_PACKED_ALLELES_H
+#define VG_PACKED_ALLELES_H
+// packed_alleles.hpp: defines PackedAlleles, which packs the allele sequences
+// of a site 2 bits to the base so a read can be compared to all of them fast
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * The sequences of the alleles of a site, packed 2 bits to the base both
+ * forward and reversed, so that a read's sequence through the site can be
+ * lined up against the start or the end of each allele and its mismatches
+ * counted. The alleles are interleaved two to a 128-bit vector, so each SSE4.1
+ * step compares 32 bases of the read against two alleles at once, however
+ * short they are. Only sequences made entirely of ACGT can be packed; others
+ * have to be compared as strings.
+ */
+class PackedAlleles {
+public:
+
+    /// What count_mismatches gives for an allele the sequence can't be lined
+    /// up against.
+    static const size_t NO_MATCH;
+
+    /// Pack the alleles, if they are all made of ACGT.
+    PackedAlleles(const vector<string>& alleles);
+
+    /// Could all the alleles be packed?
+    bool packed() const { return all_packed; }
+
+    /// Number of alleles.
+    size_t size() const { return lengths.size(); }
+
+    /**
+     * Count the mismatches between seq and each allele, lining seq up with
+     * the start of the allele if anchored_start and with its end if
+     * anchored_end (so with both, seq has to be the same length as the
+     * allele). Alleles that seq is too long for, or not the same length as
+     * when anchored at both ends, get NO_MATCH. At least one end must be
+     * anchored.
+     *
+     * Returns false, and leaves mismatches alone, if the alleles or seq
+     * couldn't be packed.
+     */
+    bool count_mismatches(const string& seq, bool anchored_start, bool anchored_end,
+                          vector<size_t>& mismatches) const;
+
+private:
+
+    /// How many words of a packed sequence count_mismatches keeps on the
+    /// stack, before it has to allocate.
+    static const size_t STACK_WORDS = 16;
+
+    /// Pack seq, reversed if reverse is set, 32 bases to the word, into every
+    /// stride-th word starting at words, which must be zeroed. Returns false
+    /// if seq has anything but ACGT in it.
+    static bool pack(const string& seq, bool reverse, uint64_t* words, size_t stride);
+
+    /// Count the mismatched bases among the first length bases of a packed
+    /// sequence and each of the two interleaved alleles in a pair, into
+    /// counts.
+    static void count_packed_mismatches(const uint64_t* pair, const uint64_t* seq, size_t length,
+                                        size_t counts[2]);
+
+    vector<size_t> lengths;
+    /// The alleles in pairs: word w of allele 2 * p + i is at
+    /// forward[p][2 * w + i], padded with zeroes to the longer allele.
+    vector<vector<uint64_t>> forward;
+    vector<vector<uint64_t>> reversed;
+    bool all_packed = true;
+};
+
+}
+
+#endif
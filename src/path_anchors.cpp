@@ -0,0 +1,98 @@
+#include "path_anchors.hpp"
+
+#include <algorithm>
+
+namespace vg {
+
+using namespace std;
+
+PathAnchors::PathAnchors(VG& graph) {
+    graph.paths.for_each_name([&](const string& name) {
+            size_t path = path_names.size();
+            path_names.push_back(name);
+            size_t path_offset = 0;
+            for (auto& mapping : graph.paths.get_path(name)) {
+                id_t id = mapping.position().node_id();
+                size_t span = mapping_from_length(mapping);
+                if (anchors.find(id) == anchors.end()) {
+                    anchors[id] = make_pair(path, Step{path_offset, id,
+                                                       mapping.position().is_reverse(),
+                                                       (size_t) mapping.position().offset(),
+                                                       span,
+                                                       graph.get_node(id)->sequence().size()});
+                }
+                path_offset += span;
+            }
+        });
+    update(graph);
+}
+
+void PathAnchors::update(VG& graph) {
+    layouts.clear();
+    layouts.resize(path_names.size());
+    anchoring_path_nodes.clear();
+    for (size_t path = 0; path < path_names.size(); ++path) {
+        if (!graph.paths.has_path(path_names[path])) {
+            continue;
+        }
+        auto& layout = layouts[path];
+        size_t path_offset = 0;
+        for (auto& mapping : graph.paths.get_path(path_names[path])) {
+            id_t id = mapping.position().node_id();
+            size_t span = mapping_from_length(mapping);
+            layout.push_back(Step{path_offset, id,
+                                  mapping.position().is_reverse(),
+                                  (size_t) mapping.position().offset(),
+                                  span,
+                                  graph.get_node(id)->sequence().size()});
+            anchoring_path_nodes.insert(id);
+            path_offset += span;
+        }
+    }
+}
+
+bool PathAnchors::translate(pos_t& pos) const {
+    auto found = anchors.find(id(pos));
+    if (found == anchors.end()) {
+        return false;
+    }
+    const Step& anchor = found->second.second;
+    const vector<Step>& layout = layouts[found->second.first];
+
+    // where the base falls along the strand of the node that the path takes
+    size_t forward_offset = is_rev(pos) ? anchor.node_length - 1 - (size_t) offset(pos) : (size_t) offset(pos);
+    size_t strand_offset = anchor.backward ? anchor.node_length - 1 - forward_offset : forward_offset;
+    if (strand_offset < anchor.node_offset || strand_offset >= anchor.node_offset + anchor.span) {
+        return false;
+    }
+    size_t path_offset = anchor.path_offset + strand_offset - anchor.node_offset;
+
+    // find the step of the path that now covers that offset
+    auto step = upper_bound(layout.begin(), layout.end(), path_offset,
+                            [](size_t o, const Step& s) { return o < s.path_offset; });
+    if (step == layout.begin()) {
+        return false;
+    }
+    --step;
+    if (path_offset >= step->path_offset + step->span) {
+        return false;
+    }
+    strand_offset = step->node_offset + (path_offset - step->path_offset);
+
+    // the position is on the path's strand if it was before, and on the other one if not
+    bool backward = (is_rev(pos) != anchor.backward) != step->backward;
+    pos = make_pos_t(step->id, backward,
+                     backward == step->backward ? strand_offset : step->node_length - 1 - strand_offset);
+    return true;
+}
+
+bool PathAnchors::translate(gcsa::node_type& node) const {
+    pos_t pos = make_pos_t(gcsa::Node::id(node), gcsa::Node::rc(node), gcsa::Node::offset(node));
+    if (!translate(pos)) {
+        return false;
+    }
+    node = gcsa::Node::encode(id(pos), offset(pos), is_rev(pos));
+    return true;
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef VG_PATH_ANCHORS_H
+#define VG_PATH_ANCHORS_H
+// path_anchors.hpp: defines PathAnchors, which finds positions in a graph
+// again in later versions of it, by way of its embedded paths
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "gcsa.h"
+#include "vg.hpp"
+#include "hash_map.hpp"
+#include "position.hpp"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Remembers where each node of a graph falls along one of its embedded
+ * paths, so that a position in the graph can be found again after the graph
+ * has been edited, had its nodes divided, been sorted, and had its IDs
+ * compacted, as vg msga does to it, as long as the paths keep their
+ * sequences. Nodes that aren't on any path can't be found again.
+ *
+ * This lets an index built on the graph as it was keep being used, with its
+ * hits moved onto the graph as it is now.
+ */
+class PathAnchors {
+public:
+
+    PathAnchors(void) = default;
+    /// Anchor the nodes of the graph on its paths.
+    PathAnchors(VG& graph);
+
+    /// Take the layout of the paths in a later version of the anchored graph,
+    /// to translate positions onto.
+    void update(VG& graph);
+
+    /// Move a position on the anchored graph to the same base in the graph
+    /// as of the last update. Returns false if it can't be placed.
+    bool translate(pos_t& pos) const;
+    /// Move a GCSA2 hit in the same way.
+    bool translate(gcsa::node_type& node) const;
+
+    /// Is the node, in the graph as of the last update, on one of the paths
+    /// the anchored graph had? Nodes that aren't hold sequence that the
+    /// anchored graph didn't have.
+    bool on_anchoring_path(id_t id) const { return anchoring_path_nodes.count(id); }
+
+private:
+
+    // a mapping of a path onto a node
+    struct Step {
+        // the offset along the path where the mapping starts
+        size_t path_offset;
+        id_t id;
+        bool backward;
+        // the offset along the node strand where the mapping starts
+        size_t node_offset;
+        // how many bases of the node it covers
+        size_t span;
+        size_t node_length;
+    };
+
+    vector<string> path_names;
+    // for each node of the anchored graph, its first step along a path, and
+    // which path that is
+    hash_map<id_t, pair<size_t, Step>> anchors;
+    // the steps of each path, as of the last update
+    vector<vector<Step>> layouts;
+    unordered_set<id_t> anchoring_path_nodes;
+};
+
+}
+
+#endif
@@ -1,8 +1,10 @@
 #include <cstdlib>
 #include <stdexcept>
 #include <regex>
+#include <omp.h>
 #include "json2pb.h"
 #include "pileup.hpp"
+#include "compact_pileup.hpp"
 #include "stream.hpp"
 
 using namespace std;
@@ -806,4 +808,153 @@ string Pileups::extract(const BasePileup& bp, int64_t offset) {
     }
 }
 
+PileupShards::PileupShards(VG* graph, size_t num_shards, int min_quality, int max_mismatches,
+                           int window_size, int max_depth, bool use_mapq, bool compact) :
+    _shards(max(num_shards, (size_t)1),
+            Pileups(graph, min_quality, max_mismatches, window_size, max_depth, use_mapq)),
+    _locks(max(num_shards, (size_t)1)) {
+    if (compact) {
+        for (size_t i = 0; i < _shards.size(); ++i) {
+            _compact_shards.emplace_back(max_depth);
+        }
+    }
+}
+
+void PileupShards::absorb(Pileups& pileups) {
+    if (_shards.size() == 1 && _compact_shards.empty()) {
+        lock_guard<mutex> guard(_locks.front());
+        Pileups& shard = _shards.front();
+        if (shard._node_pileups.empty() && shard._edge_pileups.empty()) {
+            // nothing to merge into, so the pileups can be handed over whole
+            swap(shard._node_pileups, pileups._node_pileups);
+            swap(shard._edge_pileups, pileups._edge_pileups);
+            swap(shard._min_quality_count, pileups._min_quality_count);
+            swap(shard._max_mismatch_count, pileups._max_mismatch_count);
+            swap(shard._bases_count, pileups._bases_count);
+            return;
+        }
+    }
+
+    // sort the pileups by shard first, so that each shard's lock is taken once
+    vector<vector<NodePileup*>> node_pileups(_shards.size());
+    vector<vector<EdgePileup*>> edge_pileups(_shards.size());
+    for (auto& p : pileups._node_pileups) {
+        node_pileups[shard_of(p.first)].push_back(p.second);
+    }
+    for (auto& p : pileups._edge_pileups) {
+        edge_pileups[shard_of(p.first)].push_back(p.second);
+    }
+    // the shards own them now
+    pileups._node_pileups.clear();
+    pileups._edge_pileups.clear();
+
+    // start from a different shard in each thread, so that threads absorbing
+    // at the same time don't queue up on the same locks
+    size_t first = omp_get_thread_num() % _shards.size();
+    for (size_t i = 0; i < _shards.size(); ++i) {
+        size_t shard = (first + i) % _shards.size();
+        lock_guard<mutex> guard(_locks[shard]);
+        if (!_compact_shards.empty()) {
+            // count up the bases as they come, so they're never kept
+            for (auto pileup : node_pileups[shard]) {
+                _compact_shards[shard].add(*pileup);
+                delete pileup;
+            }
+            for (auto pileup : edge_pileups[shard]) {
+                _compact_shards[shard].add(*pileup);
+                delete pileup;
+            }
+        } else {
+            for (auto pileup : node_pileups[shard]) {
+                _shards[shard].insert_node_pileup(pileup);
+            }
+            for (auto pileup : edge_pileups[shard]) {
+                _shards[shard].insert_edge_pileup(pileup);
+            }
+        }
+        if (i == 0) {
+            _shards[shard]._min_quality_count += pileups._min_quality_count;
+            _shards[shard]._max_mismatch_count += pileups._max_mismatch_count;
+            _shards[shard]._bases_count += pileups._bases_count;
+        }
+    }
+    pileups._min_quality_count = 0;
+    pileups._max_mismatch_count = 0;
+    pileups._bases_count = 0;
+}
+
+void PileupShards::write(ostream& out, uint64_t buffer_size) {
+    for (auto& shard : _shards) {
+        if (!shard._node_pileups.empty() || !shard._edge_pileups.empty()) {
+            shard.write(out, buffer_size);
+        }
+    }
+}
+
+void PileupShards::write_compact(ostream& out) {
+    CompactPileups compact(_shards.front()._max_depth);
+    for (auto& shard : _compact_shards) {
+        // the shards hold different nodes, so this only moves them over
+        compact.merge(shard);
+    }
+    for (auto& shard : _shards) {
+        // not shard.clear(), which would lose the filter counts
+        for (auto& p : shard._node_pileups) {
+            compact.add(*p.second);
+            delete p.second;
+        }
+        shard._node_pileups.clear();
+        for (auto& p : shard._edge_pileups) {
+            compact.add(*p.second);
+            delete p.second;
+        }
+        shard._edge_pileups.clear();
+    }
+    compact.write(out);
+}
+
+void PileupShards::to_json(ostream& out) {
+    bool first = true;
+    out << "{\"node_pileups\": [";
+    for (auto& shard : _shards) {
+        for (auto& p : shard._node_pileups) {
+            out << (first ? "" : ",") << pb2json(*p.second);
+            first = false;
+        }
+    }
+    first = true;
+    out << "]," << endl << "\"edge_pileups\": [";
+    for (auto& shard : _shards) {
+        for (auto& p : shard._edge_pileups) {
+            out << (first ? "" : ",") << pb2json(*p.second);
+            first = false;
+        }
+    }
+    out << "]}" << endl;
+}
+
+uint64_t PileupShards::min_quality_count() const {
+    uint64_t count = 0;
+    for (auto& shard : _shards) {
+        count += shard._min_quality_count;
+    }
+    return count;
+}
+
+uint64_t PileupShards::max_mismatch_count() const {
+    uint64_t count = 0;
+    for (auto& shard : _shards) {
+        count += shard._max_mismatch_count;
+    }
+    return count;
+}
+
+uint64_t PileupShards::bases_count() const {
+    uint64_t count = 0;
+    for (auto& shard : _shards) {
+        count += shard._bases_count;
+    }
+    return count;
+}
+
 }
@@ -4,10 +4,12 @@
 #include <iostream>
 #include <algorithm>
 #include <functional>
+#include <mutex>
 #include "vg.pb.h"
 #include "vg.hpp"
 #include "hash_map.hpp"
 #include "utility.hpp"
+#include "compact_pileup.hpp"
 
 namespace vg {
 
@@ -275,6 +277,69 @@ public:
     static string extract(const BasePileup& bp, int64_t offset);
 };
 
+// A table of pileups split by node ID into shards, so that many threads can
+// compute pileups at once into one table instead of each into a copy of the
+// whole thing. Each thread piles up its own reads into a small Pileups, which
+// it hands over with absorb() once it gets big; each shard only takes the
+// pileups on its nodes, under its own lock. Since no two shards hold the same
+// node or edge, they never need to be merged with each other: they're written
+// out one after another. If compact is set, the shards keep what they absorb
+// as compact pileups (see compact_pileup.hpp) rather than as protobuf, so the
+// table takes the same space at any depth, and can only be written with
+// write_compact().
+class PileupShards {
+public:
+
+    PileupShards(VG* graph, size_t num_shards, int min_quality = 0, int max_mismatches = 1,
+                 int window_size = 0, int max_depth = 1000, bool use_mapq = false,
+                 bool compact = false);
+
+    // a Pileups with the same settings as the shards, for a thread to fill
+    Pileups make_pileups() const {
+        const Pileups& shard = _shards.front();
+        return Pileups(shard._graph, shard._min_quality, shard._max_mismatches, shard._window_size,
+                       shard._max_depth, shard._use_mapq);
+    }
+
+    // move the contents of pileups into the shards, leaving it empty
+    void absorb(Pileups& pileups);
+
+    // absorb the pileups if they've taken in this many bases since they were
+    // last absorbed (with only one protobuf shard, there's no other thread to
+    // share with, so they may as well be absorbed whole at the end)
+    void absorb_if_full(Pileups& pileups, uint64_t max_bases = 1 << 20) {
+        if ((_shards.size() > 1 || !_compact_shards.empty()) && pileups._bases_count >= max_bases) {
+            absorb(pileups);
+        }
+    }
+
+    // which shard the pileups on this node belong to
+    size_t shard_of(int64_t node_id) const { return node_id % _shards.size(); }
+    // which shard the pileup on this edge belongs to, given its sides as they
+    // key Pileups::_edge_pileups
+    size_t shard_of(const pair<NodeSide, NodeSide>& sides) const { return shard_of(sides.first.node); }
+
+    // write all the shards to protobuf
+    void write(ostream& out, uint64_t buffer_size = 5);
+    // write all the shards to JSON, as a single Pileups would be
+    void to_json(ostream& out);
+    // write all the shards out as one table of compact pileups, converting
+    // and freeing each shard's pileups if they're not compact already
+    void write_compact(ostream& out);
+
+    // the filter counts from all the pileups absorbed so far
+    uint64_t min_quality_count() const;
+    uint64_t max_mismatch_count() const;
+    uint64_t bases_count() const;
+
+private:
+
+    vector<Pileups> _shards;
+    // what the shards have absorbed, if they keep it compact
+    vector<CompactPileups> _compact_shards;
+    vector<mutex> _locks;
+};
+
 
 
 }
@@ -74,29 +74,15 @@ ostream& operator<<(ostream& out, const pos_t& pos) {
     return out << id(pos) << (is_rev(pos) ? "-" : "+") << offset(pos);
 }
 
-size_t xg_cached_node_length(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
-    //cerr << "Looking for position " << pos << endl;
-    pair<Node, bool> cached = node_cache.retrieve(id);
-    if(!cached.second) {
-        //cerr << "Not in the cache" << endl;
-        // If it's not in the cache, put it in
-        cached.first = xgidx->node(id);
-        node_cache.put(id, cached.first);
-    }
-    Node& node = cached.first;
-    return node.sequence().size();
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, NodeCache& node_cache) {
+    return node_cache.node_length(id);
 }
 
-char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, NodeCache& node_cache) {
     //cerr << "Looking for position " << pos << endl;
-    pair<Node, bool> cached = node_cache.retrieve(id(pos));
-    if(!cached.second) {
-        //cerr << "Not in the cache" << endl;
-        // If it's not in the cache, put it in
-        cached.first = xgidx->node(id(pos));
-        node_cache.put(id(pos), cached.first);
-    }
-    Node& node = cached.first;
+    // hold on to the node, in case another thread evicts it
+    shared_ptr<const Node> cached = node_cache.get(id(pos));
+    const Node& node = *cached;
     if (is_rev(pos)) {
         /*
         cerr << "reversed... " << endl;
@@ -114,17 +100,12 @@ char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cac
     }
 }
 
-map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, NodeCache& node_cache) {
 
     map<pos_t, char> nexts;
     // See if the node is cached (did we just visit it?)
-    pair<Node, bool> cached = node_cache.retrieve(id(pos));
-    if(!cached.second) {
-        // If it's not in the cache, put it in
-        cached.first = xgidx->node(id(pos));
-        node_cache.put(id(pos), cached.first);
-    }
-    Node& node = cached.first;
+    shared_ptr<const Node> cached = node_cache.get(id(pos));
+    const Node& node = *cached;
     // if we are still in the node, return the next position and character
     if (offset(pos) < node.sequence().size()-1) {
         ++get_offset(pos);
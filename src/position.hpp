@@ -4,7 +4,7 @@
 #include "vg.pb.h"
 #include "types.hpp"
 #include "xg.hpp"
-#include "lru_cache.h"
+#include "node_cache.hpp"
 #include "utility.hpp"
 #include "json2pb.h"
 #include <iostream>
@@ -30,9 +30,9 @@ Position make_position(id_t id, bool is_rev, off_t off);
 
 // xg/position traversal helpers with caching
 // used by the Sampler and by the Mapper
-size_t xg_cached_node_length(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
-char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
-map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, NodeCache& node_cache);
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, NodeCache& node_cache);
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, NodeCache& node_cache);
 
 }
 
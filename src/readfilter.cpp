@@ -560,9 +560,10 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
         }
     };
 
-    // buffered output (one buffer per chunk), one set of chunks per thread
-    // buffer[THREAD][CHUNK] = vector<Alignment>
-    vector<vector<vector<Alignment> > > buffer(threads);
+    // buffered output (one buffer per chunk), one set of chunks per thread.
+    // reads wait in packed form, which takes a fraction of the memory
+    // buffer[THREAD][CHUNK] = vector<PackedAlignment>
+    vector<vector<vector<PackedAlignment> > > buffer(threads);
     for (int i = 0; i < buffer.size(); ++i) {
         buffer[i].resize(chunk_names.size());
     }
@@ -580,8 +581,10 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
             outfile.open(chunk_names[cur_buffer], chunk_append[cur_buffer] ? ios::app : ios_base::out);
             chunk_append[cur_buffer] = true;
         }
-        function<Alignment&(uint64_t)> write_buffer = [&buffer, &tid, &cur_buffer](uint64_t i) -> Alignment& {
-            return buffer[tid][cur_buffer][i];
+        Alignment unpacked;
+        function<Alignment&(uint64_t)> write_buffer = [&buffer, &tid, &cur_buffer, &unpacked](uint64_t i) -> Alignment& {
+            buffer[tid][cur_buffer][i].unpack(unpacked);
+            return unpacked;
         };
         stream::write(outbuf, buffer[tid][cur_buffer].size(), write_buffer);
         buffer[tid][cur_buffer].clear();
@@ -593,7 +596,7 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
         vector<int> aln_chunks;
         get_chunks(aln, aln_chunks);
         for (auto chunk : aln_chunks) {
-            buffer[tid][chunk].push_back(aln);
+            buffer[tid][chunk].emplace_back(aln);
             if (buffer[tid][chunk].size() >= buffer_size) {
                 // flush buffer (could get fancier and allow parallel writes to different
                 // files, but unlikely to be worth effort as we're mostly trying to
@@ -8,6 +8,7 @@
 #include "vg.hpp"
 #include "xg.hpp"
 #include "vg.pb.h"
+#include "packed_alignment.hpp"
 
 /**
  * Provides a way to filter and transform reads, implementing the bulk of the
@@ -265,15 +265,15 @@ Alignment Sampler::alignment_with_error(size_t length,
 }
 
 size_t Sampler::node_length(id_t id) {
-    return xg_cached_node_length(id, xgidx, node_cache);
+    return xg_cached_node_length(id, xgidx, *node_cache);
 }
 
 char Sampler::pos_char(pos_t pos) {
-    return xg_cached_pos_char(pos, xgidx, node_cache);
+    return xg_cached_pos_char(pos, xgidx, *node_cache);
 }
 
 map<pos_t, char> Sampler::next_pos_chars(pos_t pos) {
-    return xg_cached_next_pos_chars(pos, xgidx, node_cache);
+    return xg_cached_next_pos_chars(pos, xgidx, *node_cache);
 }
 
 }
@@ -10,7 +10,7 @@
 #include "alignment.hpp"
 #include "path.hpp"
 #include "position.hpp"
-#include "lru_cache.h"
+#include "node_cache.hpp"
 #include "json2pb.h"
 
 namespace vg {
@@ -23,14 +23,15 @@ public:
 
     xg::XG* xgidx;
     // We need this so we don't re-load the node for every character we visit in
-    // it.
-    LRUCache<id_t, Node> node_cache;
+    // it. It can be shared with other Samplers and Mappers on the same index.
+    shared_ptr<NodeCache> node_cache;
     mt19937 rng;
     int64_t nonce;
     // If set, only sample positions/start reads on the forward strands of their
     // nodes.
     bool forward_only;
-    Sampler(xg::XG* x, int seed = 0, bool forward_only = false) : xgidx(x), node_cache(100), forward_only(forward_only), nonce(0) {
+    Sampler(xg::XG* x, int seed = 0, bool forward_only = false, shared_ptr<NodeCache> cache = nullptr)
+        : xgidx(x), node_cache(cache ? cache : make_shared<NodeCache>(x)), forward_only(forward_only), nonce(0) {
         if (!seed) {
             seed = time(NULL);
         }
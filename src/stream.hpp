@@ -9,6 +9,11 @@
 #include <functional>
 #include <vector>
 #include <list>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "google/protobuf/stubs/common.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
@@ -20,12 +25,12 @@ namespace stream {
 // write objects
 // count should be equal to the number of objects to write
 // count is written before the objects, but if it is 0, it is not written
+// each call writes its group as its own gzip member, which can be inflated
+// independently of the rest of the stream (see BlockIndex in stream_index.hpp)
 // if not all objects are written, return false, otherwise true
 template <typename T>
-bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
+bool write(::google::protobuf::io::ZeroCopyOutputStream* raw_out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
 
-    ::google::protobuf::io::ZeroCopyOutputStream *raw_out =
-          new ::google::protobuf::io::OstreamOutputStream(&out);
     ::google::protobuf::io::GzipOutputStream *gzip_out =
           new ::google::protobuf::io::GzipOutputStream(raw_out);
     ::google::protobuf::io::CodedOutputStream *coded_out =
@@ -47,26 +52,158 @@ bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>&
 
     delete coded_out;
     delete gzip_out;
-    delete raw_out;
 
     return !count || written == count;
 }
 
+template <typename T>
+bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
+    ::google::protobuf::io::OstreamOutputStream raw_out(&out);
+    return write(&raw_out, count, lambda);
+}
+
+// compress the objects in the buffer into a block in memory, exactly as write
+// would put them in a stream, so the calling thread pays for the compression
+// and the block can be appended to the stream later
+template <typename T>
+void write_to_block(std::string& block, const std::vector<T>& buffer) {
+    block.clear();
+    ::google::protobuf::io::StringOutputStream raw_out(&block);
+    std::function<const T&(uint64_t)> lambda = [&buffer](uint64_t n) -> const T& { return buffer[n]; };
+    write(&raw_out, buffer.size(), lambda);
+}
+
 template <typename T>
 bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_limit) {
     bool wrote = false;
     if (buffer.size() >= buffer_limit) {
-        std::function<T(uint64_t)> lambda = [&buffer](uint64_t n) { return buffer.at(n); };
+        // compress outside of the critical section, so threads only wait on
+        // each other for the copy to the stream
+        std::string block;
+        write_to_block(block, buffer);
 #pragma omp critical (stream_out)
-        wrote = write(out, buffer.size(), lambda);
+        {
+            out.write(block.data(), block.size());
+            wrote = out.good();
+        }
         buffer.clear();
     }
     return wrote;
 }
 
+// appends compressed blocks to a stream from a dedicated writer thread
+// producers (usually one per OpenMP thread) compress their own blocks and
+// hand them over through a bounded queue, so they never wait on each other
+// or on the stream except when the queue is full
+// blocks are written in the order they are enqueued
+class BlockWriter {
+public:
+    BlockWriter(std::ostream& out, size_t max_queued = 256) :
+        out(out), max_queued(max_queued), finished(false) {
+        writer = std::thread(&BlockWriter::write_blocks, this);
+    }
+
+    ~BlockWriter() {
+        finish();
+    }
+
+    BlockWriter(const BlockWriter&) = delete;
+    BlockWriter& operator=(const BlockWriter&) = delete;
+
+    // hand over a compressed block, waiting if the queue is full
+    void enqueue(std::string&& block) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        queue_space.wait(lock, [this]() { return queue.size() < max_queued; });
+        queue.push_back(std::move(block));
+        queue_ready.notify_one();
+    }
+
+    // compress the buffer in the calling thread and queue it for writing
+    // if it holds at least buffer_limit objects, clearing it if so
+    template <typename T>
+    bool write_buffered(std::vector<T>& buffer, uint64_t buffer_limit) {
+        if (buffer.size() < buffer_limit) {
+            return false;
+        }
+        std::string block;
+        write_to_block(block, buffer);
+        enqueue(std::move(block));
+        buffer.clear();
+        return true;
+    }
+
+    // write out everything queued and stop the writer thread
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (finished) {
+                return;
+            }
+            finished = true;
+        }
+        queue_ready.notify_one();
+        writer.join();
+        out.flush();
+    }
+
+private:
+    std::ostream& out;
+    size_t max_queued;
+    bool finished;
+    std::deque<std::string> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    std::condition_variable queue_space;
+    std::thread writer;
+
+    void write_blocks() {
+        std::string block;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_ready.wait(lock, [this]() { return !queue.empty() || finished; });
+                if (queue.empty()) {
+                    // finished, and nothing left to write
+                    return;
+                }
+                block = std::move(queue.front());
+                queue.pop_front();
+                queue_space.notify_all();
+            }
+            out.write(block.data(), block.size());
+        }
+    }
+};
+
+// read the next size-prefixed object from the stream straight into object,
+// without copying its bytes to a string first; object is cleared and reused,
+// so the allocations for its fields are recycled from one object to the next
+// returns false if the object was empty or truncated, and should be skipped
+template <typename T>
+bool read_object(::google::protobuf::io::ZeroCopyInputStream* in, T& object) {
+    // use a fresh coded stream per object to stay under its total bytes
+    // limit; it lives on the stack, so this costs no allocation
+    ::google::protobuf::io::CodedInputStream coded_in(in);
+    uint32_t msgSize = 0;
+    // the messages are prefixed by their size
+    if (!coded_in.ReadVarint32(&msgSize) || msgSize == 0) {
+        return false;
+    }
+    ::google::protobuf::io::CodedInputStream::Limit limit = coded_in.PushLimit(msgSize);
+    if (!object.ParseFromCodedStream(&coded_in)) {
+        // skip whatever is left of a malformed object
+        coded_in.Skip(coded_in.BytesUntilLimit());
+    }
+    bool complete = coded_in.BytesUntilLimit() == 0;
+    coded_in.PopLimit(limit);
+    return complete;
+}
+
 // deserialize the input stream into the objects
 // skips over groups of objects with count 0
 // takes a callback function to be called on the objects, and another to be called per object group.
+// the object passed to the callback is reused for the next one, so the
+// callback must copy (or swap out) anything it wants to keep
 
 template <typename T>
 void for_each(std::istream& in,
@@ -77,33 +214,28 @@ void for_each(std::istream& in,
           new ::google::protobuf::io::IstreamInputStream(&in);
     ::google::protobuf::io::GzipInputStream *gzip_in =
           new ::google::protobuf::io::GzipInputStream(raw_in);
-    ::google::protobuf::io::CodedInputStream *coded_in =
-          new ::google::protobuf::io::CodedInputStream(gzip_in);
 
     uint64_t count;
+    T object;
     // this loop handles a chunked file with many pieces
     // such as we might write in a multithreaded process
-    while (coded_in->ReadVarint64((::google::protobuf::uint64*) &count)) {
+    while (true) {
+        {
+            ::google::protobuf::io::CodedInputStream coded_in(gzip_in);
+            if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                break;
+            }
+        }
 
         handle_count(count);
 
-        std::string s;
         for (uint64_t i = 0; i < count; ++i) {
-            uint32_t msgSize = 0;
-            delete coded_in;
-            coded_in = new ::google::protobuf::io::CodedInputStream(gzip_in);
-            // the messages are prefixed by their size
-            coded_in->ReadVarint32(&msgSize);
-            if ((msgSize > 0) &&
-                (coded_in->ReadString(&s, msgSize))) {
-                T object;
-                object.ParseFromString(s);
+            if (read_object(gzip_in, object)) {
                 lambda(object);
             }
         }
     }
 
-    delete coded_in;
     delete gzip_in;
     delete raw_in;
 }
@@ -115,6 +247,58 @@ void for_each(std::istream& in,
     for_each(in, lambda, noop);
 }
 
+// read up to batch_size serialized objects from the stream into batch, which
+// is resized to the number actually read
+// group_remaining carries the number of objects left in the current
+// count-prefixed group between calls, so whole groups are handed out when
+// they fit and large groups are split across several batches
+// returns false once the input is exhausted and the batch is empty
+inline bool read_batch(::google::protobuf::io::ZeroCopyInputStream* gzip_in,
+                       std::vector<std::string>& batch,
+                       uint64_t batch_size,
+                       uint64_t& group_remaining,
+                       const std::function<void(uint64_t)>& handle_count) {
+    // reuse the strings (and their capacity) from the previous batch
+    batch.resize(batch_size);
+    uint64_t n = 0;
+    while (n < batch_size) {
+        if (group_remaining == 0) {
+            // start the next group, or stop if there are no more
+            ::google::protobuf::io::CodedInputStream coded_in(gzip_in);
+            uint64_t count;
+            if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                break;
+            }
+            handle_count(count);
+            group_remaining = count;
+            if (n > 0 && count > batch_size - n) {
+                // don't split this group if it fits whole into the next batch
+                if (count <= batch_size) {
+                    break;
+                }
+            }
+            continue;
+        }
+        uint32_t msgSize = 0;
+        ::google::protobuf::io::CodedInputStream coded_in(gzip_in);
+        // the messages are prefixed by their size
+        coded_in.ReadVarint32(&msgSize);
+        --group_remaining;
+        if ((msgSize > 0) &&
+            (coded_in.ReadString(&batch[n], msgSize))) {
+            ++n;
+        }
+    }
+    batch.resize(n);
+    return n > 0;
+}
+
+// deserialize the input stream into the objects using all available threads
+// each thread in turn takes the input, inflates the next batch of whole
+// count-prefixed groups, and then parses and processes that batch while other
+// threads read theirs; at most one batch per thread is held in memory
+// objects are processed in no particular order, but each exactly once, as
+// they would be by for_each
 template <typename T>
 void for_each_parallel(std::istream& in,
                        const std::function<void(T&)>& lambda,
@@ -124,70 +308,36 @@ void for_each_parallel(std::istream& in,
           new ::google::protobuf::io::IstreamInputStream(&in);
     ::google::protobuf::io::GzipInputStream *gzip_in =
           new ::google::protobuf::io::GzipInputStream(raw_in);
-    ::google::protobuf::io::CodedInputStream *coded_in =
-          new ::google::protobuf::io::CodedInputStream(gzip_in);
 
-    uint64_t count;
-    bool more_input = coded_in->ReadVarint64((::google::protobuf::uint64*) &count);
-    bool more_objects = false;
-    // this loop handles a chunked file with many pieces
-    // such as we might write in a multithreaded process
-    std::list<T> objects;
-    int64_t object_count = 0;
-    int64_t read_threshold = 5000;
-#pragma omp parallel shared(more_input, more_objects, objects, count, in, lambda, handle_count, raw_in, gzip_in, coded_in)
-    while (more_input || more_objects) {
+    // objects left to read from the current group
+    uint64_t group_remaining = 0;
+    bool more_input = true;
+    // number of serialized objects each thread takes at once
+    const uint64_t batch_size = 256;
 
-        bool has_object = false;
+#pragma omp parallel shared(more_input, group_remaining, lambda, handle_count, gzip_in)
+    {
+        std::vector<std::string> batch;
         T object;
-#pragma omp critical (objects)
-        {
-            if (!objects.empty()) {
-                object = objects.back();
-                objects.pop_back();
-                --object_count;
-                has_object = true;
-            }
-        }
-        if (has_object) {
-            lambda(object);
-        }
-
-#pragma omp master
-        {
-            while (more_input && object_count < read_threshold) {
-                handle_count(count);
-                std::string s;
-                for (uint64_t i = 0; i < count; ++i) {
-                    uint32_t msgSize = 0;
-                    // the messages are prefixed by their size
-                    delete coded_in;
-                    coded_in = new ::google::protobuf::io::CodedInputStream(gzip_in);
-                    coded_in->ReadVarint32(&msgSize);
-                    if ((msgSize > 0) &&
-                        (coded_in->ReadString(&s, msgSize))) {
-                        T object;
-                        object.ParseFromString(s);
-#pragma omp critical (objects)
-                        {
-                            objects.push_front(object);
-                            ++object_count;
-                        }
-                    }
+        bool has_batch = true;
+        while (has_batch) {
+#pragma omp critical (stream_in)
+            {
+                if (more_input) {
+                    more_input = read_batch(gzip_in, batch, batch_size, group_remaining, handle_count);
+                } else {
+                    batch.clear();
                 }
-                more_input = coded_in->ReadVarint64((::google::protobuf::uint64*) &count);
+                has_batch = more_input;
+            }
+            for (auto& s : batch) {
+                object.Clear();
+                object.ParseFromString(s);
+                lambda(object);
             }
-            
-            // TODO: Between when the master announces there is no more input,
-            // and when it says there are again more objects to process, the
-            // other threads can all quit out, leaving it alone to finish up.
-            
         }
-#pragma omp critical (objects)
-        more_objects = (object_count > 0);
     }
 
-    delete coded_in;
     delete gzip_in;
     delete raw_in;
 }
@@ -0,0 +1,184 @@
+#include "stream_index.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace vg {
+
+using namespace std;
+
+const string BlockIndex::EXTENSION = ".gbi";
+
+// identifies the file format, and its version
+static const char BLOCK_INDEX_MAGIC[8] = {'V', 'G', 'B', 'L', 'K', 'I', 'X', '1'};
+
+BlockIndex::BlockIndex(istream& in) {
+    load(in);
+}
+
+vector<BlockIndex::Block> BlockIndex::find(id_t min_id, id_t max_id) const {
+    vector<Block> found;
+    for (auto& block : blocks) {
+        if (block.min_id == 0 && block.max_id == 0) {
+            // nothing in this block touches any node
+            continue;
+        }
+        if (block.min_id <= max_id && block.max_id >= min_id) {
+            found.push_back(block);
+        }
+    }
+    return found;
+}
+
+void BlockIndex::save(ostream& out) const {
+    out.write(BLOCK_INDEX_MAGIC, sizeof(BLOCK_INDEX_MAGIC));
+    int64_t count = blocks.size();
+    out.write((const char*) &count, sizeof(count));
+    for (auto& block : blocks) {
+        out.write((const char*) &block.offset, sizeof(block.offset));
+        out.write((const char*) &block.length, sizeof(block.length));
+        out.write((const char*) &block.min_id, sizeof(block.min_id));
+        out.write((const char*) &block.max_id, sizeof(block.max_id));
+    }
+}
+
+void BlockIndex::load(istream& in) {
+    char magic[sizeof(BLOCK_INDEX_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, BLOCK_INDEX_MAGIC, sizeof(magic)) != 0) {
+        throw runtime_error("[BlockIndex] not a block index");
+    }
+    int64_t count = 0;
+    in.read((char*) &count, sizeof(count));
+    blocks.resize(count);
+    for (auto& block : blocks) {
+        in.read((char*) &block.offset, sizeof(block.offset));
+        in.read((char*) &block.length, sizeof(block.length));
+        in.read((char*) &block.min_id, sizeof(block.min_id));
+        in.read((char*) &block.max_id, sizeof(block.max_id));
+    }
+    if (!in) {
+        throw runtime_error("[BlockIndex] truncated block index");
+    }
+}
+
+void BlockIndex::for_each_block(istream& in, const function<void(int64_t, int64_t, const string&)>& lambda) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 16 selects the gzip wrapper
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        throw runtime_error("[BlockIndex] could not initialize zlib");
+    }
+
+    vector<char> in_buf(1 << 16);
+    vector<char> out_buf(1 << 16);
+    string data;
+    // how far into the file we have read, and where the current block started
+    int64_t read_total = 0;
+    int64_t block_start = 0;
+    bool in_block = false;
+
+    while (true) {
+        if (zs.avail_in == 0) {
+            in.read(in_buf.data(), in_buf.size());
+            if (in.gcount() == 0) {
+                break;
+            }
+            zs.next_in = (Bytef*) in_buf.data();
+            zs.avail_in = in.gcount();
+            read_total += in.gcount();
+        }
+        in_block = true;
+        zs.next_out = (Bytef*) out_buf.data();
+        zs.avail_out = out_buf.size();
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        data.append(out_buf.data(), out_buf.size() - zs.avail_out);
+        if (ret == Z_STREAM_END) {
+            // a whole gzip member has been inflated
+            int64_t block_end = read_total - zs.avail_in;
+            lambda(block_start, block_end - block_start, data);
+            data.clear();
+            block_start = block_end;
+            in_block = false;
+            inflateReset(&zs);
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            inflateEnd(&zs);
+            throw runtime_error("[BlockIndex] corrupt gzip block at offset " + to_string(block_start));
+        }
+    }
+    inflateEnd(&zs);
+
+    if (in_block) {
+        throw runtime_error("[BlockIndex] truncated gzip block at offset " + to_string(block_start));
+    }
+}
+
+void BlockIndex::read_block(istream& in, const Block& block, string& data) {
+    data.clear();
+    string compressed(block.length, '\0');
+    in.clear();
+    in.seekg(block.offset);
+    in.read(&compressed[0], block.length);
+    if (in.gcount() != block.length) {
+        throw runtime_error("[BlockIndex] could not read block at offset " + to_string(block.offset));
+    }
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        throw runtime_error("[BlockIndex] could not initialize zlib");
+    }
+    zs.next_in = (Bytef*) compressed.data();
+    zs.avail_in = compressed.size();
+    vector<char> out_buf(1 << 16);
+    int ret;
+    do {
+        zs.next_out = (Bytef*) out_buf.data();
+        zs.avail_out = out_buf.size();
+        ret = inflate(&zs, Z_NO_FLUSH);
+        data.append(out_buf.data(), out_buf.size() - zs.avail_out);
+    } while (ret == Z_OK);
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        throw runtime_error("[BlockIndex] corrupt gzip block at offset " + to_string(block.offset));
+    }
+}
+
+pair<id_t, id_t> alignment_id_range(const Alignment& aln) {
+    pair<id_t, id_t> range(0, 0);
+    for (size_t i = 0; i < aln.path().mapping_size(); ++i) {
+        id_t id = aln.path().mapping(i).position().node_id();
+        if (id == 0) {
+            continue;
+        }
+        if (range.first == 0 || id < range.first) {
+            range.first = id;
+        }
+        range.second = max(range.second, id);
+    }
+    return range;
+}
+
+pair<id_t, id_t> pileup_id_range(const Pileup& pileup) {
+    pair<id_t, id_t> range(0, 0);
+    auto include = [&range](id_t id) {
+        if (id == 0) {
+            return;
+        }
+        if (range.first == 0 || id < range.first) {
+            range.first = id;
+        }
+        range.second = max(range.second, id);
+    };
+    for (size_t i = 0; i < pileup.node_pileups_size(); ++i) {
+        include(pileup.node_pileups(i).node_id());
+    }
+    for (size_t i = 0; i < pileup.edge_pileups_size(); ++i) {
+        include(pileup.edge_pileups(i).edge().from());
+        include(pileup.edge_pileups(i).edge().to());
+    }
+    return range;
+}
+
+}
@@ -0,0 +1,150 @@
+#ifndef VG_STREAM_INDEX_H
+#define VG_STREAM_INDEX_H
+// stream_index.hpp: defines the BlockIndex, a sidecar index that maps node ID
+// ranges to the independently compressed blocks of a GAM or pileup file
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include "vg.pb.h"
+#include "types.hpp"
+#include "stream.hpp"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/io/coded_stream.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Every call to stream::write produces one count-prefixed group of objects in
+ * its own gzip member, so a GAM (or pileup) file is a series of blocks, one
+ * per write_buffered flush, each of which can be inflated on its own starting
+ * from its offset in the file. Plain gzip readers just see an ordinary
+ * multi-member gzip file.
+ *
+ * A BlockIndex records where each block starts, how long it is, and the range
+ * of node IDs its objects touch, so that the objects touching a range of nodes
+ * can be read without inflating the whole file. It is most selective on files
+ * sorted by node ID, where the blocks' ranges don't overlap. The index lives
+ * next to the file it indexes, named with EXTENSION appended.
+ */
+class BlockIndex {
+public:
+
+    struct Block {
+        // where the block's gzip member starts in the file
+        int64_t offset;
+        // compressed length of the gzip member
+        int64_t length;
+        // smallest and largest node IDs touched by objects in the block, or 0
+        // and 0 if they touch none
+        id_t min_id;
+        id_t max_id;
+    };
+
+    static const string EXTENSION;
+
+    vector<Block> blocks;
+
+    BlockIndex(void) = default;
+    BlockIndex(istream& in);
+
+    /// Index all the blocks of a stream of T objects, using id_range to get
+    /// the smallest and largest node IDs that an object touches.
+    template<typename T>
+    void index_stream(istream& in, const function<pair<id_t, id_t>(const T&)>& id_range);
+
+    /// Get the blocks that may hold objects touching nodes in the inclusive
+    /// range, in file order.
+    vector<Block> find(id_t min_id, id_t max_id) const;
+
+    /// Call the lambda on every object in every block that may touch nodes in
+    /// the inclusive range. Blocks only bound the IDs of their objects, so the
+    /// lambda still sees some objects that fall outside the range. The stream
+    /// must be seekable.
+    template<typename T>
+    void for_each_in_range(istream& in, id_t min_id, id_t max_id, const function<void(T&)>& lambda) const;
+
+    void load(istream& in);
+    void save(ostream& out) const;
+
+    /// Call the lambda with the offset, compressed length, and inflated
+    /// contents of each gzip member in the stream, in order.
+    static void for_each_block(istream& in, const function<void(int64_t, int64_t, const string&)>& lambda);
+
+    /// Inflate just the given block of the (seekable) stream into data.
+    static void read_block(istream& in, const Block& block, string& data);
+
+    /// Call the lambda on every object in the count-prefixed groups of an
+    /// inflated block.
+    template<typename T>
+    static void for_each_in_block(const string& data, const function<void(T&)>& lambda);
+};
+
+/// Get the smallest and largest node IDs visited by an alignment, or 0 and 0 if
+/// it is unmapped.
+pair<id_t, id_t> alignment_id_range(const Alignment& aln);
+/// Get the smallest and largest node IDs with node or edge pileups in a pileup
+/// chunk, or 0 and 0 if it is empty.
+pair<id_t, id_t> pileup_id_range(const Pileup& pileup);
+
+template<typename T>
+void BlockIndex::for_each_in_block(const string& data, const function<void(T&)>& lambda) {
+    ::google::protobuf::io::ArrayInputStream array_in(data.data(), data.size());
+    uint64_t count;
+    T object;
+    while (true) {
+        {
+            ::google::protobuf::io::CodedInputStream coded_in(&array_in);
+            if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                break;
+            }
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            if (stream::read_object(&array_in, object)) {
+                lambda(object);
+            }
+        }
+    }
+}
+
+template<typename T>
+void BlockIndex::index_stream(istream& in, const function<pair<id_t, id_t>(const T&)>& id_range) {
+    blocks.clear();
+    for_each_block(in, [&](int64_t offset, int64_t length, const string& data) {
+        Block block = {offset, length, 0, 0};
+        function<void(T&)> lambda = [&](T& object) {
+            auto range = id_range(object);
+            if (range.first == 0 && range.second == 0) {
+                // touches no nodes
+                return;
+            }
+            if (block.min_id == 0 && block.max_id == 0) {
+                block.min_id = range.first;
+                block.max_id = range.second;
+            } else {
+                block.min_id = min(block.min_id, range.first);
+                block.max_id = max(block.max_id, range.second);
+            }
+        };
+        for_each_in_block(data, lambda);
+        blocks.push_back(block);
+    });
+}
+
+template<typename T>
+void BlockIndex::for_each_in_range(istream& in, id_t min_id, id_t max_id, const function<void(T&)>& lambda) const {
+    string data;
+    for (auto& block : find(min_id, max_id)) {
+        read_block(in, block, data);
+        for_each_in_block(data, lambda);
+    }
+}
+
+}
+
+#endif
@@ -21,6 +21,8 @@ Translator::Translator(const vector<Translation>& trans) {
 
 void Translator::load(const vector<Translation>& trans) {
     translations = trans;
+    // the old table points into the old translations
+    pos_to_trans.clear();
     build_position_table();
 }
 
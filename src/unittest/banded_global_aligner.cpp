@@ -10,6 +10,7 @@
 #include "vg.hpp"
 #include "path.hpp"
 #include "banded_global_aligner.hpp"
+#include "banded_global_aligner_simd.hpp"
 #include "json2pb.h"
 
 using namespace google::protobuf;
@@ -2197,11 +2198,183 @@ namespace vg {
                 }
             }
         }
+
+        TEST_CASE( "Banded global aligner fills the same matrices with and without SIMD instructions",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            Node* n0 = graph.create_node("ATGCTTACGGATCGATTACGATCGGCTAGCATTACGGACTAGCGATCA");
+            Node* n1 = graph.create_node("GGCATTAGCCAGTACGACTAGCTACG");
+            Node* n2 = graph.create_node("GGCATTCGCCAGTAACGACTGCTACG");
+            Node* n3 = graph.create_node("TTAGCGACTAGCATCAGCGGCATTACGACTACGGACTTAGCAT");
+            
+            graph.create_edge(n0, n1);
+            graph.create_edge(n0, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n3);
+            
+            // a substitution, a deletion, and an insertion
+            string read = string("ATGCTTACGGATCGATTACGATCGGCTAGCATTTCGGACTAGCGATCAGGCATTAGCCAGTACGCTAGCTACGTTAGCGACTAGCATCAGCGGGCATTACGACTACGGACTTAGCAT");
+            
+            int band_padding = 12;
+            
+            SECTION( "Vectorized and scalar fills produce the same 16 bit alignments" ) {
+                
+                Aligner aligner;
+                
+                Alignment scalar_aln, vector_aln;
+                scalar_aln.set_sequence(read);
+                vector_aln.set_sequence(read);
+                vector<Alignment> scalar_alts, vector_alts;
+                
+                BandedGlobalAligner<int16_t> scalar_aligner(scalar_aln, graph.graph, scalar_alts, 10, band_padding, true);
+                scalar_aligner.vectorize = false;
+                scalar_aligner.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                
+                BandedGlobalAligner<int16_t> vector_aligner(vector_aln, graph.graph, vector_alts, 10, band_padding, true);
+                vector_aligner.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                
+                REQUIRE(pb2json(vector_aln) == pb2json(scalar_aln));
+                REQUIRE(vector_alts.size() == scalar_alts.size());
+                for (size_t i = 0; i < scalar_alts.size(); i++) {
+                    REQUIRE(pb2json(vector_alts[i]) == pb2json(scalar_alts[i]));
+                }
+            }
+            
+            SECTION( "Vectorized and scalar fills produce the same 8 bit base quality adjusted alignments" ) {
+                
+                QualAdjAligner aligner = QualAdjAligner();
+                
+                Alignment scalar_aln, vector_aln;
+                scalar_aln.set_sequence(read);
+                string qual;
+                for (size_t i = 0; i < read.size(); i++) {
+                    qual.push_back(i % 7 == 3 ? '+' : 'H');
+                }
+                scalar_aln.set_quality(qual);
+                alignment_quality_char_to_short(scalar_aln);
+                vector_aln = scalar_aln;
+                
+                BandedGlobalAligner<int8_t> scalar_aligner(scalar_aln, graph.graph, band_padding, true, true);
+                scalar_aligner.vectorize = false;
+                scalar_aligner.align(aligner.adjusted_score_matrix, aligner.nt_table, aligner.scaled_gap_open,
+                                     aligner.scaled_gap_extension);
+                
+                BandedGlobalAligner<int8_t> vector_aligner(vector_aln, graph.graph, band_padding, true, true);
+                vector_aligner.align(aligner.adjusted_score_matrix, aligner.nt_table, aligner.scaled_gap_open,
+                                     aligner.scaled_gap_extension);
+                
+                REQUIRE(pb2json(vector_aln) == pb2json(scalar_aln));
+            }
+            
+            SECTION( "SSE4.1 and AVX2 kernels match the scalar kernel, including where the scores underflow" ) {
+                
+                int64_t length = 45;
+                vector<int16_t> prev_match(length + 1), prev_insert_row(length + 1), prev_insert_col(length + 1);
+                vector<int8_t> read_codes(length);
+                int8_t node_scores[5] = {1, -4, -4, -4, 0};
+                for (int64_t i = 0; i <= length; i++) {
+                    // some cells down at the bottom of the type, which have to wrap the same way
+                    prev_match[i] = i % 5 == 0 ? numeric_limits<int16_t>::min() + 2 : (int16_t) (3 * i - 40);
+                    prev_insert_row[i] = i % 3 == 0 ? numeric_limits<int16_t>::min() : (int16_t) (20 - 2 * i);
+                    prev_insert_col[i] = (int16_t) (i * i % 17 - 8);
+                    if (i < length) {
+                        read_codes[i] = i % 5;
+                    }
+                }
+                
+                auto fill = [&](void (*kernel)(const BandedColumn<int16_t>&), vector<int16_t>& match,
+                                vector<int16_t>& insert_col) {
+                    match.resize(length);
+                    insert_col.resize(length);
+                    BandedColumn<int16_t> column;
+                    column.length = length;
+                    column.prev_match = prev_match.data();
+                    column.prev_insert_row = prev_insert_row.data();
+                    column.prev_insert_col = prev_insert_col.data();
+                    column.match = match.data();
+                    column.insert_col = insert_col.data();
+                    column.read_codes = read_codes.data();
+                    column.node_scores = node_scores;
+                    column.row_scores = nullptr;
+                    column.gap_open = 6;
+                    column.gap_extend = 1;
+                    kernel(column);
+                };
+                
+                vector<int16_t> scalar_match, scalar_insert_col, sse_match, sse_insert_col;
+                fill([](const BandedColumn<int16_t>& column) { fill_banded_column_scalar(column); },
+                     scalar_match, scalar_insert_col);
+                fill([](const BandedColumn<int16_t>& column) { fill_banded_column_sse41(column); },
+                     sse_match, sse_insert_col);
+                REQUIRE(sse_match == scalar_match);
+                REQUIRE(sse_insert_col == scalar_insert_col);
+                
+                if (cpu_has_avx2()) {
+                    vector<int16_t> avx2_match, avx2_insert_col;
+                    fill([](const BandedColumn<int16_t>& column) { fill_banded_column_avx2(column); },
+                         avx2_match, avx2_insert_col);
+                    REQUIRE(avx2_match == scalar_match);
+                    REQUIRE(avx2_insert_col == scalar_insert_col);
+                }
+            }
+        }
+        
+        TEST_CASE( "Banded global aligner reuses its workspace across alignments",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            Node* n0 = graph.create_node("AGTG");
+            Node* n1 = graph.create_node("C");
+            Node* n2 = graph.create_node("A");
+            Node* n3 = graph.create_node("TGAAGT");
+            
+            graph.create_edge(n0, n1);
+            graph.create_edge(n0, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n3);
+            
+            Aligner aligner;
+            BandedAlignmentWorkspace workspace;
+            
+            SECTION( "Later alignments the same size don't allocate any more memory" ) {
+                
+                Alignment first_aln;
+                first_aln.set_sequence("AGTGCTGAAGT");
+                {
+                    BandedGlobalAligner<int16_t> banded_aligner(first_aln, graph.graph, 1, true, false, &workspace);
+                    banded_aligner.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                }
+                size_t allocations = workspace.system_allocations();
+                size_t peak = workspace.peak_bytes();
+                REQUIRE(allocations > 0);
+                REQUIRE(peak > 0);
+                REQUIRE(workspace.capacity_bytes() >= peak);
+                
+                for (int i = 0; i < 3; i++) {
+                    Alignment aln;
+                    aln.set_sequence("AGTGATGAAGT");
+                    {
+                        BandedGlobalAligner<int16_t> banded_aligner(aln, graph.graph, 1, true, false, &workspace);
+                        banded_aligner.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open, aligner.gap_extension);
+                    }
+                    REQUIRE(aln.score() == first_aln.score());
+                    REQUIRE(aln.path().mapping(1).position().node_id() == n2->id());
+                }
+                REQUIRE(workspace.system_allocations() == allocations);
+                REQUIRE(workspace.peak_bytes() == peak);
+            }
+            
+            SECTION( "Aligner reports the peak memory of its banded alignments" ) {
+                
+                Alignment aln;
+                aln.set_sequence("AGTGCTGAAGT");
+                aligner.align_global_banded(aln, graph.graph, 1, true);
+                
+                REQUIRE(aligner.banded_alignment_peak_bytes() > 0);
+            }
+        }
     }
 }
-
-
-
-
-
-
@@ -0,0 +1,173 @@
+/**
+ * unittest/compact_pileup.cpp: test cases for the compact pileup format
+ */
+
+#include <sstream>
+#include "catch.hpp"
+#include "compact_pileup.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+// a one-base node pileup on an A, with a match and a T on each strand, an
+// insertion of AC on each strand, and a deletion on each strand
+static NodePileup make_node_pileup(int64_t node_id) {
+    NodePileup pileup;
+    pileup.set_node_id(node_id);
+    BasePileup* base = pileup.add_base_pileup();
+    base->set_ref_base('A');
+    base->set_bases(".,Ta+2AC+2gt-1;5;2;0;6;0;0-0;5;2;0;6;0;0");
+    base->set_num_bases(8);
+    base->set_qualities("ABCDEFGH");
+    return pileup;
+}
+
+static uint32_t count_of(const CompactBasePileup& base, const string& allele) {
+    uint32_t count = 0;
+    base.for_each_allele([&](const string& a, const AlleleSupport& support) {
+            if (a == allele) {
+                count = support.count();
+            }
+        });
+    return count;
+}
+
+TEST_CASE("CompactNodePileup counts the alleles of a NodePileup", "[pileup]") {
+    CompactNodePileup compact(make_node_pileup(5));
+    REQUIRE(compact.node_id == 5);
+    REQUIRE(compact.base_pileup.size() == 1);
+    const CompactBasePileup& base = compact.base_pileup[0];
+
+    REQUIRE(base.ref_base == 'A');
+    REQUIRE(base.depth() == 8);
+    REQUIRE(base.insertions() == 2);
+
+    SECTION("Matches count toward the reference base and each strand is kept") {
+        const AlleleSupport& a = base.bases[0];
+        REQUIRE(a.forward == 1);
+        REQUIRE(a.reverse == 1);
+        REQUIRE(a.no_quality == 0);
+        vector<pair<char, uint32_t>> qualities{{'A', 1}, {'B', 1}};
+        REQUIRE(a.qualities == qualities);
+        REQUIRE(base.bases[3].forward == 1);
+        REQUIRE(base.bases[3].reverse == 1);
+    }
+
+    SECTION("Indels on the reverse strand are counted on the forward one") {
+        REQUIRE(count_of(base, "+2AC") == 2);
+        REQUIRE(count_of(base, "-0;5;2;0;6;0;0") == 2);
+        REQUIRE(count_of(base, "-1;5;2;0;6;0;0") == 0);
+        REQUIRE(base.indels.size() == 2);
+    }
+}
+
+TEST_CASE("CompactEdgePileup counts reads without qualities", "[pileup]") {
+    EdgePileup pileup;
+    pileup.mutable_edge()->set_from(1);
+    pileup.mutable_edge()->set_to(2);
+    pileup.set_num_reads(3);
+    pileup.set_num_forward_reads(2);
+    CompactEdgePileup compact(pileup);
+    REQUIRE(compact.reads.forward == 2);
+    REQUIRE(compact.reads.reverse == 1);
+    REQUIRE(compact.reads.no_quality == 3);
+    REQUIRE(compact.reads.qualities.empty());
+}
+
+TEST_CASE("CompactPileups caps and merges pileups", "[pileup]") {
+
+    SECTION("Observations past the max depth are dropped in order") {
+        CompactPileups pileups(5);
+        pileups.add(make_node_pileup(5));
+        const CompactBasePileup& base = pileups._node_pileups[5]->base_pileup[0];
+        REQUIRE(base.depth() == 5);
+        REQUIRE(count_of(base, "A") == 2);
+        REQUIRE(count_of(base, "T") == 2);
+        REQUIRE(count_of(base, "+2AC") == 1);
+        REQUIRE(count_of(base, "-0;5;2;0;6;0;0") == 0);
+    }
+
+    SECTION("Merging adds up the counts and the quality histograms") {
+        CompactPileups pileups;
+        CompactPileups other;
+        pileups.add(make_node_pileup(5));
+        other.add(make_node_pileup(5));
+        other.add(make_node_pileup(6));
+        pileups.merge(other);
+        REQUIRE(other._node_pileups.empty());
+        REQUIRE(pileups._node_pileups.size() == 2);
+        const CompactBasePileup& base = pileups._node_pileups[5]->base_pileup[0];
+        REQUIRE(base.depth() == 16);
+        vector<pair<char, uint32_t>> qualities{{'A', 2}, {'B', 2}};
+        REQUIRE(base.bases[0].qualities == qualities);
+        REQUIRE(count_of(base, "+2AC") == 4);
+    }
+
+    SECTION("Merging past the max depth keeps the best qualities") {
+        CompactPileups pileups(9);
+        CompactPileups other;
+        pileups.add(make_node_pileup(5));
+        other.add(make_node_pileup(5));
+        pileups.merge(other);
+        const CompactBasePileup& base = pileups._node_pileups[5]->base_pileup[0];
+        REQUIRE(base.depth() == 9);
+        vector<pair<char, uint32_t>> qualities{{'A', 1}, {'B', 2}};
+        REQUIRE(base.bases[0].qualities == qualities);
+    }
+}
+
+TEST_CASE("CompactPileups round-trip through a stream", "[pileup]") {
+    CompactPileups pileups;
+    pileups.add(make_node_pileup(5));
+    EdgePileup edge_pileup;
+    edge_pileup.mutable_edge()->set_from(5);
+    edge_pileup.mutable_edge()->set_to(6);
+    edge_pileup.mutable_edge()->set_to_end(true);
+    edge_pileup.set_num_reads(2);
+    edge_pileup.set_num_forward_reads(1);
+    edge_pileup.set_qualities("II");
+    pileups.add(edge_pileup);
+
+    stringstream stream;
+    pileups.write(stream);
+    REQUIRE(CompactPileups::is_compact(stream));
+
+    size_t node_count = 0;
+    size_t edge_count = 0;
+    CompactPileups::for_each(stream,
+                             [&](CompactNodePileup& pileup) {
+                                 ++node_count;
+                                 REQUIRE(pileup.node_id == 5);
+                                 REQUIRE(pileup.base_pileup.size() == 1);
+                                 const CompactBasePileup& base = pileup.base_pileup[0];
+                                 const CompactBasePileup& original = pileups._node_pileups[5]->base_pileup[0];
+                                 REQUIRE(base.ref_base == 'A');
+                                 REQUIRE(base.depth() == original.depth());
+                                 REQUIRE(base.bases[0].qualities == original.bases[0].qualities);
+                                 REQUIRE(base.indels.size() == original.indels.size());
+                                 REQUIRE(count_of(base, "-0;5;2;0;6;0;0") == 2);
+                             },
+                             [&](CompactEdgePileup& pileup) {
+                                 ++edge_count;
+                                 REQUIRE(pileup.edge.from() == 5);
+                                 REQUIRE(pileup.edge.to() == 6);
+                                 REQUIRE(pileup.edge.to_end());
+                                 REQUIRE(pileup.reads.forward == 1);
+                                 REQUIRE(pileup.reads.reverse == 1);
+                                 vector<pair<char, uint32_t>> qualities{{'I', 2}};
+                                 REQUIRE(pileup.reads.qualities == qualities);
+                             });
+    REQUIRE(node_count == 1);
+    REQUIRE(edge_count == 1);
+
+    SECTION("A gzipped protobuf stream isn't taken for compact pileups") {
+        stringstream gzipped(string("\x1f\x8b", 2));
+        REQUIRE(!CompactPileups::is_compact(gzipped));
+    }
+}
+
+}
+}
@@ -0,0 +1,83 @@
+/**
+ * unittest/kmer_sort.cpp: test cases for sorting and merging GCSA2 kmers
+ */
+
+#include "catch.hpp"
+#include "kmer_sort.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+// a kmer from the forward strand of one node to the start of another
+static gcsa::KMer make_kmer(const gcsa::Alphabet& alpha, const string& label,
+                            char pred, char succ, size_t from_id, size_t to_id) {
+    gcsa::KMer kmer;
+    kmer.key = gcsa::Key::encode(alpha, label,
+                                 1 << alpha.char2comp[(gcsa::byte_type) pred],
+                                 1 << alpha.char2comp[(gcsa::byte_type) succ]);
+    kmer.from = gcsa::Node::encode(from_id, 0, false);
+    kmer.to = gcsa::Node::encode(to_id, 0, false);
+    return kmer;
+}
+
+TEST_CASE("KmerSorter merges kmers with the same label and start", "[gcsa][kmers]") {
+
+    const gcsa::Alphabet alpha;
+
+    SECTION("Kmers come out sorted, once each, with their characters merged") {
+        KmerSorter sorter(4);
+        vector<gcsa::KMer> run = {
+            make_kmer(alpha, "GGTA", 'A', 'C', 5, 6),
+            make_kmer(alpha, "ACGT", 'A', 'C', 1, 2),
+            make_kmer(alpha, "ACGT", 'G', 'T', 1, 3),
+            make_kmer(alpha, "ACGT", 'A', 'C', 1, 2)
+        };
+        sorter.add_run(run);
+        REQUIRE(run.empty());
+        REQUIRE(sorter.kmers_in() == 4);
+
+        vector<gcsa::KMer> out;
+        sorter.for_each_kmer([&](const gcsa::KMer& kmer) { out.push_back(kmer); });
+        REQUIRE(out.size() == 3);
+        REQUIRE(gcsa::Key::label(out[0].key) == gcsa::Key::label(out[1].key));
+        REQUIRE(out[0].key == out[1].key);
+        REQUIRE(gcsa::Node::id(out[0].to) == 2);
+        REQUIRE(gcsa::Node::id(out[1].to) == 3);
+        REQUIRE(gcsa::Key::predecessors(out[0].key) ==
+                ((1 << alpha.char2comp['A']) | (1 << alpha.char2comp['G'])));
+        REQUIRE(gcsa::Key::successors(out[0].key) ==
+                ((1 << alpha.char2comp['C']) | (1 << alpha.char2comp['T'])));
+        REQUIRE(gcsa::Node::id(out[2].from) == 5);
+    }
+
+    SECTION("Runs from many threads merge in a small memory limit") {
+        // little enough memory that the runs have to be merged in several passes
+        KmerSorter sorter(4, 1);
+        vector<vector<gcsa::KMer>> runs(16);
+#pragma omp parallel for
+        for (size_t i = 0; i < runs.size(); ++i) {
+            for (size_t j = 0; j < 100; ++j) {
+                runs[i].push_back(make_kmer(alpha, "ACGT", "ACGT"[i % 4], 'A', j + 1, j + 2));
+            }
+            sorter.add_run(runs[i]);
+        }
+        REQUIRE(sorter.kmers_in() == 1600);
+
+        size_t count = 0;
+        size_t last_from = 0;
+        sorter.for_each_kmer([&](const gcsa::KMer& kmer) {
+                REQUIRE(gcsa::Node::id(kmer.from) > last_from);
+                last_from = gcsa::Node::id(kmer.from);
+                REQUIRE(gcsa::Key::predecessors(kmer.key) ==
+                        ((1 << alpha.char2comp['A']) | (1 << alpha.char2comp['C'])
+                         | (1 << alpha.char2comp['G']) | (1 << alpha.char2comp['T'])));
+                ++count;
+            });
+        REQUIRE(count == 100);
+    }
+}
+
+}
+}
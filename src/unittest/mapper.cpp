@@ -0,0 +1,169 @@
+/**
+ * unittest/mapper.cpp: test cases for projecting alignments onto paths in the Mapper
+ */
+
+#include <string>
+#include <set>
+#include "catch.hpp"
+#include "mapper.hpp"
+#include "json2pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("Mapper projects alignments that leave a path back onto it", "[surject]") {
+
+    // the path x runs 1, 2, 4, 5, 9, 6, 8; 3 is a SNP allele, 5 and 9 can be
+    // deleted or replaced by 10, and 7 is an insertion
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTACAGATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "G"},
+            {"id": 4, "sequence": "CATTAGCATTAG"},
+            {"id": 5, "sequence": "T"},
+            {"id": 9, "sequence": "T"},
+            {"id": 10, "sequence": "CCC"},
+            {"id": 6, "sequence": "GACCAGGACCA"},
+            {"id": 7, "sequence": "AA"},
+            {"id": 8, "sequence": "TGCATGCATG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4},
+            {"from": 4, "to": 5},
+            {"from": 5, "to": 9},
+            {"from": 9, "to": 6},
+            {"from": 4, "to": 6},
+            {"from": 4, "to": 10},
+            {"from": 10, "to": 6},
+            {"from": 6, "to": 7},
+            {"from": 7, "to": 8},
+            {"from": 6, "to": 8}
+        ],
+        "path": [
+            {"name": "x", "mapping": [
+                {"position": {"node_id": 1}},
+                {"position": {"node_id": 2}},
+                {"position": {"node_id": 4}},
+                {"position": {"node_id": 5}},
+                {"position": {"node_id": 9}},
+                {"position": {"node_id": 6}},
+                {"position": {"node_id": 8}}
+            ]}
+        ]
+    }
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    xg::XG index(graph);
+
+    Mapper mapper;
+    mapper.xindex = &index;
+    set<string> path_names{"x"};
+
+    // an alignment that matches each node it visits all the way through
+    auto alignment_through = [&](const vector<id_t>& ids) {
+        Alignment aln;
+        string sequence;
+        for (auto id : ids) {
+            size_t length = index.node_length(id);
+            sequence += index.node_sequence(id);
+            Mapping* mapping = aln.mutable_path()->add_mapping();
+            mapping->mutable_position()->set_node_id(id);
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(length);
+            edit->set_to_length(length);
+        }
+        aln.set_sequence(sequence);
+        return aln;
+    };
+
+    Alignment surjection;
+    string path_name;
+    int64_t path_pos;
+    bool path_reverse;
+
+    SECTION("A SNP allele becomes a mismatch on the reference allele") {
+        Alignment aln = alignment_through({1, 3, 4});
+        REQUIRE(mapper.project_alignment(aln, path_names, surjection, path_name, path_pos, path_reverse));
+        REQUIRE(path_name == "x");
+        REQUIRE(path_pos == 0);
+        REQUIRE(!path_reverse);
+        REQUIRE(surjection.sequence() == aln.sequence());
+        auto& path = surjection.path();
+        REQUIRE(path.mapping_size() == 3);
+        REQUIRE(path.mapping(1).position().node_id() == 2);
+        REQUIRE(path.mapping(1).edit_size() == 1);
+        REQUIRE(path.mapping(1).edit(0).from_length() == 1);
+        REQUIRE(path.mapping(1).edit(0).to_length() == 1);
+        REQUIRE(path.mapping(1).edit(0).sequence() == "G");
+        // 26 matches and a mismatch
+        REQUIRE(surjection.score() == 22);
+    }
+
+    SECTION("Skipping nodes on the path is one deletion, opened once") {
+        Alignment aln = alignment_through({4, 6});
+        REQUIRE(mapper.project_alignment(aln, path_names, surjection, path_name, path_pos, path_reverse));
+        REQUIRE(path_pos == 15);
+        auto& path = surjection.path();
+        REQUIRE(path.mapping_size() == 4);
+        REQUIRE(path.mapping(1).position().node_id() == 5);
+        REQUIRE(path.mapping(2).position().node_id() == 9);
+        for (size_t i : {1, 2}) {
+            REQUIRE(path.mapping(i).edit_size() == 1);
+            REQUIRE(path.mapping(i).edit(0).from_length() == 1);
+            REQUIRE(path.mapping(i).edit(0).to_length() == 0);
+        }
+        // 23 matches and a gap of 2 that runs across both mappings
+        REQUIRE(surjection.score() == 23 - 6 - 1);
+    }
+
+    SECTION("A node off the path with nothing skipped is an insertion") {
+        Alignment aln = alignment_through({6, 7, 8});
+        REQUIRE(mapper.project_alignment(aln, path_names, surjection, path_name, path_pos, path_reverse));
+        REQUIRE(path_pos == 29);
+        auto& path = surjection.path();
+        REQUIRE(path.mapping_size() == 2);
+        REQUIRE(path.mapping(0).position().node_id() == 6);
+        REQUIRE(path.mapping(0).edit_size() == 2);
+        REQUIRE(path.mapping(0).edit(1).from_length() == 0);
+        REQUIRE(path.mapping(0).edit(1).to_length() == 2);
+        REQUIRE(path.mapping(0).edit(1).sequence() == "AA");
+        REQUIRE(path.mapping(1).position().node_id() == 8);
+        // 21 matches and a gap of 2
+        REQUIRE(surjection.score() == 21 - 6 - 1);
+    }
+
+    SECTION("A node off the path that replaces a stretch of another length is realigned") {
+        Alignment aln = alignment_through({4, 10, 6});
+        REQUIRE(mapper.project_alignment(aln, path_names, surjection, path_name, path_pos, path_reverse));
+        REQUIRE(path_pos == 15);
+        auto& path = surjection.path();
+        size_t from_length = 0;
+        size_t to_length = 0;
+        for (auto& mapping : path.mapping()) {
+            REQUIRE(mapping.position().node_id() != 10);
+            from_length += mapping_from_length(mapping);
+            to_length += mapping_to_length(mapping);
+        }
+        REQUIRE(from_length == 12 + 2 + 11);
+        REQUIRE(to_length == aln.sequence().size());
+        // CCC against TT is best as two mismatches and a 1 base insertion
+        REQUIRE(surjection.score() == 23 - 4 - 4 - 6);
+    }
+
+    SECTION("Alignments that start off the path aren't projected") {
+        Alignment aln = alignment_through({3, 4});
+        REQUIRE(!mapper.project_alignment(aln, path_names, surjection, path_name, path_pos, path_reverse));
+    }
+}
+
+}
+}
@@ -0,0 +1,87 @@
+/**
+ * unittest/node_cache.cpp: test cases for the shared node cache
+ */
+
+#include "catch.hpp"
+#include "node_cache.hpp"
+#include "position.hpp"
+#include "json2pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("NodeCache serves nodes from a shared cache", "[cache]") {
+
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTAC"},
+            {"id": 2, "sequence": "A"},
+            {"id": 3, "sequence": "CATTAG"},
+            {"id": 4, "sequence": "TAG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 3},
+            {"from": 1, "to": 3},
+            {"from": 3, "to": 4}
+        ]
+    }
+    )";
+
+    Graph chunk;
+    json2pb(chunk, graph_json.c_str(), graph_json.size());
+    xg::XG index(chunk);
+
+    SECTION("Nodes come back whole, and repeat lookups are hits") {
+        NodeCache cache(&index, 16, 2);
+        REQUIRE(cache.get(1)->sequence() == "GATTAC");
+        REQUIRE(cache.get(3)->id() == 3);
+        REQUIRE(cache.misses() == 2);
+        REQUIRE(cache.hits() == 0);
+        REQUIRE(cache.get(1)->sequence() == "GATTAC");
+        REQUIRE(cache.node_length(3) == 6);
+        REQUIRE(cache.misses() == 2);
+        REQUIRE(cache.hits() == 2);
+    }
+
+    SECTION("A full cache evicts, but nodes that are held stay good") {
+        // one slot in one shard
+        NodeCache cache(&index, 1, 1);
+        shared_ptr<const Node> held = cache.get(1);
+        REQUIRE(cache.get(2)->sequence() == "A");
+        REQUIRE(held->sequence() == "GATTAC");
+        REQUIRE(cache.get(1)->sequence() == "GATTAC");
+        REQUIRE(cache.misses() == 3);
+        REQUIRE(cache.hits() == 0);
+    }
+
+    SECTION("The position helpers read through the cache") {
+        NodeCache cache(&index);
+        REQUIRE(xg_cached_pos_char(make_pos_t(1, false, 1), &index, cache) == 'A');
+        REQUIRE(xg_cached_pos_char(make_pos_t(1, true, 0), &index, cache) == 'G');
+        auto nexts = xg_cached_next_pos_chars(make_pos_t(1, false, 5), &index, cache);
+        REQUIRE(nexts.size() == 2);
+        REQUIRE(nexts[make_pos_t(2, false, 0)] == 'A');
+        REQUIRE(nexts[make_pos_t(3, false, 0)] == 'C');
+        REQUIRE(cache.misses() == 3);
+    }
+
+    SECTION("Threads can share the cache") {
+        NodeCache cache(&index, 2, 1);
+        vector<size_t> lengths(1000);
+#pragma omp parallel for
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            lengths[i] = cache.node_length(i % 4 + 1);
+        }
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            REQUIRE(lengths[i] == index.node_length(i % 4 + 1));
+        }
+        REQUIRE(cache.hits() + cache.misses() == lengths.size());
+    }
+}
+
+}
+}
@@ -0,0 +1,152 @@
+/**
+ * unittest/packed_alignment.cpp: test cases for the packed in-memory alignment format
+ */
+
+#include "catch.hpp"
+#include "packed_alignment.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+// add a mapping with the given edits, as (from_length, to_length, sequence)
+static Mapping* add_mapping(Alignment& aln, id_t node_id, int64_t offset, bool is_reverse,
+                            const vector<tuple<int32_t, int32_t, string>>& edits) {
+    Mapping* mapping = aln.mutable_path()->add_mapping();
+    mapping->mutable_position()->set_node_id(node_id);
+    mapping->mutable_position()->set_offset(offset);
+    mapping->mutable_position()->set_is_reverse(is_reverse);
+    mapping->set_rank(aln.path().mapping_size());
+    for (auto& e : edits) {
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(get<0>(e));
+        edit->set_to_length(get<1>(e));
+        edit->set_sequence(get<2>(e));
+    }
+    return mapping;
+}
+
+TEST_CASE("PackedSequence stores any string exactly", "[packed]") {
+
+    SECTION("Plain DNA round-trips across word boundaries") {
+        string seq;
+        for (size_t i = 0; i < 100; ++i) {
+            seq += "ACGT"[(i * 7 + i / 3) % 4];
+        }
+        PackedSequence packed(seq);
+        REQUIRE(packed.size() == seq.size());
+        REQUIRE(packed.str() == seq);
+        for (size_t i = 0; i < seq.size(); ++i) {
+            REQUIRE(packed.at(i) == seq[i]);
+        }
+        REQUIRE(packed.substr(30, 40) == seq.substr(30, 40));
+    }
+
+    SECTION("Other characters are kept as exceptions") {
+        string seq = "NNGATTacaXT\x80G";
+        PackedSequence packed;
+        packed.append(seq.substr(0, 5));
+        packed.append(seq.substr(5));
+        REQUIRE(packed.str() == seq);
+        for (size_t i = 0; i < seq.size(); ++i) {
+            REQUIRE(packed.at(i) == seq[i]);
+        }
+        REQUIRE(packed.substr(4, 6) == seq.substr(4, 6));
+    }
+}
+
+TEST_CASE("PackedAlignment converts to and from Alignment without loss", "[packed]") {
+
+    Alignment aln;
+    aln.set_name("read1");
+    aln.set_sequence("GATTNCAGGACCAT");
+    aln.set_quality(string(14, 30));
+    aln.set_score(17);
+    aln.set_mapping_quality(60);
+    aln.set_identity(0.75);
+    aln.set_is_secondary(true);
+    // match, substitution, insertion
+    add_mapping(aln, 1, 2, false, {make_tuple(3, 3, ""), make_tuple(2, 2, "TN"), make_tuple(0, 2, "CA")});
+    // deletion, and an edit that isn't any of the simple ops
+    add_mapping(aln, 2, 0, false, {make_tuple(4, 0, ""), make_tuple(2, 3, "GGa")});
+    // reverse strand match
+    add_mapping(aln, 7, 5, true, {make_tuple(4, 4, "")});
+
+    SECTION("Fields can be read from the packed form") {
+        PackedAlignment packed(aln);
+        REQUIRE(packed.name() == "read1");
+        REQUIRE(packed.sequence() == aln.sequence());
+        REQUIRE(packed.base(4) == 'N');
+        REQUIRE(packed.mapping_size() == 3);
+        REQUIRE(packed.edit_size() == 6);
+        REQUIRE(packed.node_id(2) == 7);
+        REQUIRE(packed.offset(2) == 5);
+        REQUIRE(packed.is_reverse(2));
+        REQUIRE(!packed.is_reverse(0));
+        REQUIRE(packed.rank(1) == 2);
+        REQUIRE(packed.edit_begin(1) == 3);
+        REQUIRE(packed.edit_end(1) == 5);
+
+        REQUIRE(packed.edit_op(0) == PackedAlignment::MATCH);
+        REQUIRE(packed.edit_op(1) == PackedAlignment::SUBSTITUTION);
+        REQUIRE(packed.edit_op(2) == PackedAlignment::INSERTION);
+        REQUIRE(packed.edit_op(3) == PackedAlignment::DELETION);
+        REQUIRE(packed.edit_op(4) == PackedAlignment::OTHER);
+        REQUIRE(packed.from_length(2) == 0);
+        REQUIRE(packed.to_length(2) == 2);
+        REQUIRE(packed.from_length(3) == 4);
+        REQUIRE(packed.to_length(3) == 0);
+        REQUIRE(packed.from_length(4) == 2);
+        REQUIRE(packed.to_length(4) == 3);
+        REQUIRE(packed.edit_sequence(1) == "TN");
+        REQUIRE(packed.edit_base(4, 2) == 'a');
+        REQUIRE(packed.edit_sequence_length(0) == 0);
+
+        REQUIRE(packed.id_range() == make_pair((id_t) 1, (id_t) 7));
+    }
+
+    SECTION("Unpacking gives back the same alignment") {
+        PackedAlignment packed(aln);
+        Alignment unpacked = packed.to_alignment();
+        REQUIRE(unpacked.SerializeAsString() == aln.SerializeAsString());
+    }
+
+    SECTION("Unusual ranks, missing positions and other fields survive") {
+        aln.mutable_path()->mutable_mapping(1)->set_rank(0);
+        aln.mutable_path()->mutable_mapping(2)->clear_position();
+        aln.mutable_path()->set_name("a path");
+        aln.set_sample_name("sample");
+        aln.mutable_fragment_next()->set_name("read2");
+        aln.add_fragment()->set_length(300);
+        PackedAlignment packed(aln);
+        REQUIRE(packed.rank(1) == 0);
+        REQUIRE(!packed.has_position(2));
+        REQUIRE(packed.to_alignment().SerializeAsString() == aln.SerializeAsString());
+    }
+
+    SECTION("Unmapped reads, with or without an empty path, survive") {
+        Alignment unmapped;
+        unmapped.set_name("read3");
+        unmapped.set_sequence("GATTACA");
+        REQUIRE(PackedAlignment(unmapped).to_alignment().SerializeAsString() == unmapped.SerializeAsString());
+        unmapped.mutable_path();
+        REQUIRE(PackedAlignment(unmapped).to_alignment().SerializeAsString() == unmapped.SerializeAsString());
+        REQUIRE(PackedAlignment(unmapped).id_range() == make_pair((id_t) 0, (id_t) 0));
+    }
+
+    SECTION("A packed alignment can be reused") {
+        PackedAlignment packed(aln);
+        Alignment other;
+        other.set_name("read4");
+        add_mapping(other, 9, 0, false, {make_tuple(2, 2, "")});
+        packed.pack(other);
+        REQUIRE(packed.mapping_size() == 1);
+        REQUIRE(packed.edit_size() == 1);
+        REQUIRE(packed.to_alignment().SerializeAsString() == other.SerializeAsString());
+    }
+}
+
+}
+}
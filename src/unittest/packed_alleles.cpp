@@ -0,0 +1,90 @@
+/**
+ * unittest/packed_alleles.cpp: test cases for comparing reads against packed alleles
+ */
+
+#include <string>
+#include <vector>
+#include "catch.hpp"
+#include "packed_alleles.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("PackedAlleles counts mismatches against each allele", "[genotype]") {
+    // long enough to take whole vectors and a partial word
+    string long_allele;
+    for (size_t i = 0; i < 150; ++i) {
+        long_allele.push_back("ACGT"[(i * 7 + i / 5) % 4]);
+    }
+    vector<string> alleles{"GATTACA", "GATCACA", "GATT", long_allele};
+    PackedAlleles packed(alleles);
+    REQUIRE(packed.packed());
+    REQUIRE(packed.size() == 4);
+    vector<size_t> mismatches;
+
+    SECTION("Anchoring both ends needs the same length") {
+        REQUIRE(packed.count_mismatches("GATTACA", true, true, mismatches));
+        vector<size_t> expected{0, 1, PackedAlleles::NO_MATCH, PackedAlleles::NO_MATCH};
+        REQUIRE(mismatches == expected);
+    }
+
+    SECTION("Anchoring the start compares prefixes") {
+        REQUIRE(packed.count_mismatches("GATC", true, false, mismatches));
+        vector<size_t> expected{1, 0, 1, 4};
+        expected[3] = (long_allele[0] != 'G') + (long_allele[1] != 'A') + (long_allele[2] != 'T') + (long_allele[3] != 'C');
+        REQUIRE(mismatches == expected);
+    }
+
+    SECTION("Anchoring the end compares suffixes") {
+        REQUIRE(packed.count_mismatches("TACA", false, true, mismatches));
+        REQUIRE(mismatches[0] == 0);
+        REQUIRE(mismatches[1] == 1);
+        REQUIRE(mismatches[2] == 3);
+    }
+
+    SECTION("Mismatches are counted across whole vectors and the words past them") {
+        string read = long_allele.substr(0, 140);
+        read[3] = read[3] == 'A' ? 'C' : 'A';
+        read[70] = read[70] == 'A' ? 'C' : 'A';
+        read[139] = read[139] == 'A' ? 'C' : 'A';
+        REQUIRE(packed.count_mismatches(read, true, false, mismatches));
+        REQUIRE(mismatches[0] == PackedAlleles::NO_MATCH);
+        REQUIRE(mismatches[3] == 3);
+
+        string suffix = long_allele.substr(20);
+        suffix[0] = suffix[0] == 'G' ? 'T' : 'G';
+        REQUIRE(packed.count_mismatches(suffix, false, true, mismatches));
+        REQUIRE(mismatches[3] == 1);
+    }
+
+    SECTION("An odd allele out and sequences too long for the stack are counted") {
+        string long_read;
+        for (size_t i = 0; i < 600; ++i) {
+            long_read.push_back("ACGT"[(i * 3 + i / 7) % 4]);
+        }
+        string mismatched = long_read;
+        mismatched[0] = mismatched[0] == 'A' ? 'C' : 'A';
+        mismatched[599] = mismatched[599] == 'A' ? 'C' : 'A';
+        vector<string> odd_alleles{"GATTACA", mismatched, long_read};
+        PackedAlleles odd(odd_alleles);
+        REQUIRE(odd.count_mismatches(long_read, true, true, mismatches));
+        vector<size_t> expected{PackedAlleles::NO_MATCH, 2, 0};
+        REQUIRE(mismatches == expected);
+        REQUIRE(odd.count_mismatches(long_read.substr(1), false, true, mismatches));
+        REQUIRE(mismatches[1] == 1);
+        REQUIRE(mismatches[2] == 0);
+    }
+
+    SECTION("Sequences with other bases can't be packed") {
+        REQUIRE(!packed.count_mismatches("GANT", true, false, mismatches));
+        vector<string> with_n{"GATTACA", "GANTACA"};
+        PackedAlleles unpacked(with_n);
+        REQUIRE(!unpacked.packed());
+        REQUIRE(!unpacked.count_mismatches("GATTACA", true, true, mismatches));
+    }
+}
+
+}
+}
@@ -0,0 +1,201 @@
+/**
+ * unittest/stream.cpp: test cases for reading and writing streams of protobuf objects
+ */
+
+#include "catch.hpp"
+#include "stream.hpp"
+#include "stream_index.hpp"
+#include "vg.pb.h"
+
+#include <sstream>
+#include <set>
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("for_each_parallel sees the same objects as for_each", "[stream]") {
+
+    // Write a stream of several groups of different sizes, including one
+    // bigger than a parallel reader batch.
+    stringstream data;
+    vector<size_t> group_sizes = {1, 7, 1000, 0, 3, 300};
+    size_t total = 0;
+    for (auto group_size : group_sizes) {
+        function<Alignment(uint64_t)> lambda = [&total](uint64_t i) {
+            Alignment aln;
+            aln.set_name("read" + to_string(total + i));
+            aln.set_sequence("GATTACA");
+            return aln;
+        };
+        stream::write(data, group_size, lambda);
+        total += group_size;
+    }
+    string serialized = data.str();
+
+    SECTION("Every object is read exactly once") {
+        multiset<string> serial_names;
+        stringstream serial_in(serialized);
+        function<void(Alignment&)> serial_lambda = [&serial_names](Alignment& aln) {
+            serial_names.insert(aln.name());
+        };
+        stream::for_each(serial_in, serial_lambda);
+        REQUIRE(serial_names.size() == total);
+
+        multiset<string> parallel_names;
+        stringstream parallel_in(serialized);
+        size_t bad_sequences = 0;
+        function<void(Alignment&)> parallel_lambda = [&parallel_names, &bad_sequences](Alignment& aln) {
+#pragma omp critical (parallel_names)
+            {
+                parallel_names.insert(aln.name());
+                bad_sequences += (aln.sequence() != "GATTACA");
+            }
+        };
+        stream::for_each_parallel(parallel_in, parallel_lambda);
+        REQUIRE(parallel_names == serial_names);
+        REQUIRE(bad_sequences == 0);
+    }
+
+    SECTION("Every group count is reported") {
+        uint64_t counted = 0;
+        size_t groups = 0;
+        stringstream parallel_in(serialized);
+        function<void(Alignment&)> noop = [](Alignment&) { };
+        // counts are reported while holding the input, so this is safe
+        function<void(uint64_t)> handle_count = [&counted, &groups](uint64_t count) {
+            counted += count;
+            ++groups;
+        };
+        stream::for_each_parallel(parallel_in, noop, handle_count);
+        REQUIRE(counted == total);
+        // the empty group is never written
+        REQUIRE(groups == group_sizes.size() - 1);
+    }
+}
+
+TEST_CASE("for_each does not carry fields over between reused objects", "[stream]") {
+
+    stringstream data;
+    function<Alignment(uint64_t)> lambda = [](uint64_t i) {
+        Alignment aln;
+        aln.set_name("read" + to_string(i));
+        if (i % 2 == 0) {
+            // only every other read is mapped and has a quality
+            aln.set_quality("IIII");
+            aln.mutable_path()->add_mapping()->mutable_position()->set_node_id(i + 1);
+        }
+        return aln;
+    };
+    stream::write(data, 10, lambda);
+
+    size_t seen = 0;
+    function<void(Alignment&)> check = [&seen](Alignment& aln) {
+        bool even = seen % 2 == 0;
+        REQUIRE(aln.name() == "read" + to_string(seen));
+        REQUIRE(aln.quality().empty() == !even);
+        REQUIRE(aln.path().mapping_size() == (even ? 1 : 0));
+        ++seen;
+    };
+    stream::for_each(data, check);
+    REQUIRE(seen == 10);
+}
+
+TEST_CASE("BlockWriter output matches write_buffered", "[stream]") {
+
+    vector<vector<Alignment>> groups(20);
+    for (size_t i = 0; i < groups.size(); ++i) {
+        for (size_t j = 0; j <= i; ++j) {
+            Alignment aln;
+            aln.set_name("read" + to_string(i) + "_" + to_string(j));
+            groups[i].push_back(aln);
+        }
+    }
+
+    stringstream expected;
+    for (auto group : groups) {
+        stream::write_buffered(expected, group, 0);
+    }
+
+    stringstream written;
+    {
+        stream::BlockWriter writer(written, 2);
+        for (auto group : groups) {
+            REQUIRE(writer.write_buffered(group, 1));
+            REQUIRE(group.empty());
+        }
+        // too small to write
+        vector<Alignment> small(1);
+        REQUIRE(!writer.write_buffered(small, 2));
+        REQUIRE(small.size() == 1);
+    }
+
+    REQUIRE(written.str() == expected.str());
+}
+
+TEST_CASE("BlockIndex finds the blocks touching a node range", "[stream]") {
+
+    // Write one block per node, with reads visiting nodes i and i + 1
+    stringstream data;
+    for (id_t block = 1; block <= 10; ++block) {
+        function<Alignment(uint64_t)> lambda = [&block](uint64_t i) {
+            Alignment aln;
+            aln.set_name("read" + to_string(block) + "_" + to_string(i));
+            aln.mutable_path()->add_mapping()->mutable_position()->set_node_id(block);
+            aln.mutable_path()->add_mapping()->mutable_position()->set_node_id(block + 1);
+            return aln;
+        };
+        stream::write(data, 5, lambda);
+    }
+    // And some unmapped reads
+    function<Alignment(uint64_t)> unmapped = [](uint64_t i) {
+        Alignment aln;
+        aln.set_name("unmapped" + to_string(i));
+        return aln;
+    };
+    stream::write(data, 3, unmapped);
+
+    BlockIndex index;
+    function<pair<id_t, id_t>(const Alignment&)> id_range = alignment_id_range;
+    index.index_stream(data, id_range);
+
+    SECTION("Each write is a block with the right node range") {
+        REQUIRE(index.blocks.size() == 11);
+        for (size_t i = 0; i < 10; ++i) {
+            REQUIRE(index.blocks[i].min_id == i + 1);
+            REQUIRE(index.blocks[i].max_id == i + 2);
+        }
+        REQUIRE(index.blocks[10].min_id == 0);
+        REQUIRE(index.blocks[10].max_id == 0);
+        REQUIRE(index.blocks[0].offset == 0);
+        for (size_t i = 1; i < index.blocks.size(); ++i) {
+            REQUIRE(index.blocks[i].offset == index.blocks[i - 1].offset + index.blocks[i - 1].length);
+        }
+    }
+
+    SECTION("Only reads from overlapping blocks are read") {
+        set<string> names;
+        function<void(Alignment&)> lambda = [&names](Alignment& aln) {
+            names.insert(aln.name());
+        };
+        index.for_each_in_range(data, 4, 5, lambda);
+        // blocks 3, 4, and 5 touch nodes 4 or 5
+        REQUIRE(names.size() == 15);
+        REQUIRE(names.count("read3_0"));
+        REQUIRE(names.count("read5_4"));
+        REQUIRE(!names.count("read6_0"));
+    }
+
+    SECTION("The index survives saving and loading") {
+        stringstream saved;
+        index.save(saved);
+        BlockIndex loaded(saved);
+        REQUIRE(loaded.blocks.size() == index.blocks.size());
+        REQUIRE(loaded.find(11, 100).size() == 1);
+        REQUIRE(loaded.find(11, 100).front().offset == index.blocks[9].offset);
+    }
+}
+
+}
+}
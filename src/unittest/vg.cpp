@@ -144,5 +144,52 @@ TEST_CASE("is_acyclic should return whether the graph is acyclic", "[vg][cycles]
     }
 }
 
+TEST_CASE("align_many should give the same alignments as aligning each read alone", "[vg][alignment]") {
+    
+    VG graph;
+    
+    Node* n0 = graph.create_node("AGTGCTAGCTAG");
+    Node* n1 = graph.create_node("C");
+    Node* n2 = graph.create_node("A");
+    Node* n3 = graph.create_node("TGAAGTCGATCG");
+    
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+    
+    vector<Alignment> reads(4);
+    reads[0].set_sequence("AGTGCTAGCTAGCTGAAGTCGATCG");
+    reads[1].set_sequence("CTAGCTAGATGAAGTC");
+    reads[2].set_sequence("GCTAGCTAGTTGAAG");
+    reads[3].set_sequence("GATTACA");
+    
+    SECTION("reads aligned as a batch match reads aligned one at a time") {
+        Aligner aligner;
+        vector<Alignment> batch = graph.align_many(reads, aligner);
+        REQUIRE(batch.size() == reads.size());
+        for (size_t i = 0; i < reads.size(); i++) {
+            Alignment alone = graph.align(reads[i], aligner);
+            REQUIRE(pb2json(batch[i]) == pb2json(alone));
+        }
+    }
+    
+    SECTION("a prepared graph can be aligned to more than once") {
+        Aligner aligner;
+        graph.sort();
+        PreparedGraph prepared(aligner, graph.graph);
+        vector<Alignment> first = reads;
+        aligner.align_many(first, prepared);
+        vector<Alignment> second = reads;
+        aligner.align_many(second, prepared);
+        for (size_t i = 0; i < reads.size(); i++) {
+            Alignment alone = reads[i];
+            aligner.align(alone, graph.graph);
+            REQUIRE(pb2json(first[i]) == pb2json(alone));
+            REQUIRE(pb2json(second[i]) == pb2json(alone));
+        }
+    }
+}
+
 }
 }
@@ -172,20 +172,19 @@ vector<double> Vectorizer::alignment_to_identity_hot(Alignment a){
     return ret;
 }
 
-bit_vector Vectorizer::alignment_to_onehot(Alignment a){
+bit_vector Vectorizer::alignment_to_onehot(const Alignment& a){
     // Make a vector as large as the | |nodes| + |edges| | space
     // TODO handle edges
     int64_t entity_size = my_xg->node_count + my_xg->edge_count;
     bit_vector ret(entity_size, 0);
-    Path path = a.path();
+    const Path& path = a.path();
     for (int i = 0; i < path.mapping_size(); i++){
-        Mapping mapping = path.mapping(i);
+        const Mapping& mapping = path.mapping(i);
         if(! mapping.has_position()){
             continue;
         }
 
-        Position pos = mapping.position();
-        int64_t node_id = pos.node_id();
+        int64_t node_id = mapping.position().node_id();
         int64_t key = my_xg->node_rank_as_entity(node_id);
         // Okay, solved the previous out of range errors:
         // We have to use an entity-space that is |nodes + edges + 1|
@@ -198,9 +197,7 @@ bit_vector Vectorizer::alignment_to_onehot(Alignment a){
         // we can check the orientation, though it shouldn't **really** matter
         // whether we catch them in the forward or reverse direction.
         if (i > 0){
-            Mapping prev_mapping = path.mapping(i - 1);
-            Position prev_pos = prev_mapping.position();
-            int64_t prev_node_id = prev_pos.node_id();
+            int64_t prev_node_id = path.mapping(i - 1).position().node_id();
             if (my_xg->has_edge(prev_node_id, false, node_id, false)){
                 int64_t edge_key = my_xg->edge_rank_as_entity(prev_node_id, false, node_id, false);
                 ret[edge_key - 1] = 1;
@@ -27,7 +27,7 @@ class Vectorizer{
     void add_bv(bit_vector v);
     void add_name(string n);
     void emit(ostream& out, bool r_format, bool annotate);
-    bit_vector alignment_to_onehot(Alignment a);
+    bit_vector alignment_to_onehot(const Alignment& a);
     vector<int> alignment_to_a_hot(Alignment a);
     vector<double> alignment_to_custom_score(Alignment a, std::function<double(Alignment)> lambda);
     vector<double> alignment_to_identity_hot(Alignment a);
@@ -6237,13 +6237,16 @@ map<id_t, pair<id_t, bool> > VG::overlay_node_translations(const map<id_t, pair<
     return overlay;
 }
 
-Alignment VG::align(const Alignment& alignment,
-                    Aligner* aligner,
-                    QualAdjAligner* qual_adj_aligner,
-                    size_t max_query_graph_ratio,
-                    bool print_score_matrices) {
+vector<Alignment> VG::align(const vector<Alignment>& alignments,
+                            Aligner* aligner,
+                            QualAdjAligner* qual_adj_aligner,
+                            size_t max_query_graph_ratio,
+                            bool print_score_matrices) {
 
-    auto aln = alignment;
+    auto alns = alignments;
+    if (alns.empty()) {
+        return alns;
+    }
 
     /*
     for(auto& character : *(aln.mutable_sequence())) {
@@ -6252,12 +6255,15 @@ Alignment VG::align(const Alignment& alignment,
     }
     */
 
+    // convert the graph for the aligner once for all of the reads
     auto do_align = [&](Graph& g) {
         if (aligner && !qual_adj_aligner) {
-            aligner->align(aln, g, print_score_matrices);
+            PreparedGraph prepared(*aligner, g);
+            aligner->align_many(alns, prepared, print_score_matrices);
         }
         else if (qual_adj_aligner && !aligner) {
-            qual_adj_aligner->align(aln, g, print_score_matrices);
+            PreparedGraph prepared(*qual_adj_aligner, g);
+            qual_adj_aligner->align_many(alns, prepared, print_score_matrices);
         }
         else {
             cerr << "error:[VG] cannot both adjust and not adjust alignment for base quality" << endl;
@@ -6280,7 +6286,11 @@ Alignment VG::align(const Alignment& alignment,
     } else {
         map<id_t, pair<id_t, bool> > unfold_trans;
         map<id_t, pair<id_t, bool> > dagify_trans;
-        size_t max_length = alignment.sequence().size();
+        // unroll far enough for the longest read
+        size_t max_length = 0;
+        for (auto& alignment : alignments) {
+            max_length = max(max_length, alignment.sequence().size());
+        }
         size_t component_length_max = 100*max_length; // hard coded to be 100x
 
         // dagify the graph by unfolding inversions and then applying dagify forward unroll
@@ -6328,10 +6338,12 @@ Alignment VG::align(const Alignment& alignment,
         };
         check_aln(dag, aln);
         */
-        translate_nodes(aln, trans, [&](id_t node_id) {
-                // We need to feed in the lengths of nodes, so the offsets in the alignment can be updated.
-                return get_node(node_id)->sequence().size();
-            });
+        for (auto& aln : alns) {
+            translate_nodes(aln, trans, [&](id_t node_id) {
+                    // We need to feed in the lengths of nodes, so the offsets in the alignment can be updated.
+                    return get_node(node_id)->sequence().size();
+                });
+        }
         //check_aln(*this, aln);
 
         // Clean up the node we added. This is important because this graph will
@@ -6341,10 +6353,21 @@ Alignment VG::align(const Alignment& alignment,
 
     }
 
-    // Copy back the not-case-corrected sequence
-    aln.set_sequence(alignment.sequence());
+    // Copy back the not-case-corrected sequences
+    for (size_t i = 0; i < alns.size(); i++) {
+        alns[i].set_sequence(alignments[i].sequence());
+    }
 
-    return aln;
+    return alns;
+}
+
+Alignment VG::align(const Alignment& alignment,
+                    Aligner* aligner,
+                    QualAdjAligner* qual_adj_aligner,
+                    size_t max_query_graph_ratio,
+                    bool print_score_matrices) {
+    return align(vector<Alignment>{alignment}, aligner, qual_adj_aligner,
+                 max_query_graph_ratio, print_score_matrices).front();
 }
 
 Alignment VG::align(const Alignment& alignment,
@@ -6394,6 +6417,20 @@ Alignment VG::align_qual_adjusted(const string& sequence,
     return align_qual_adjusted(alignment, qual_adj_aligner, max_query_graph_ratio, print_score_matrices);
 }
 
+vector<Alignment> VG::align_many(const vector<Alignment>& alignments,
+                                 Aligner& aligner,
+                                 size_t max_query_graph_ratio,
+                                 bool print_score_matrices) {
+    return align(alignments, &aligner, nullptr, max_query_graph_ratio, print_score_matrices);
+}
+
+vector<Alignment> VG::align_many_qual_adjusted(const vector<Alignment>& alignments,
+                                               QualAdjAligner& qual_adj_aligner,
+                                               size_t max_query_graph_ratio,
+                                               bool print_score_matrices) {
+    return align(alignments, nullptr, &qual_adj_aligner, max_query_graph_ratio, print_score_matrices);
+}
+
 const string VG::hash(void) {
     stringstream s;
     serialize_to_ostream(s);
@@ -7034,6 +7071,15 @@ void VG::kmer_context(string& kmer,
     }
 }
 
+// Orders kmer positions the way their "id:offset" strings sort, which is the
+// order the kmer records were written in when positions were kept as strings.
+static bool kmer_node_position_token_less(const KmerNodePosition& a, const KmerNodePosition& b) {
+    char a_token[48], b_token[48];
+    snprintf(a_token, sizeof(a_token), "%lld:%s%d", (long long) a.id, a.backward ? "-" : "", (int) a.offset);
+    snprintf(b_token, sizeof(b_token), "%lld:%s%d", (long long) b.id, b.backward ? "-" : "", (int) b.offset);
+    return strcmp(a_token, b_token) < 0;
+}
+
 void VG::gcsa_handle_node_in_graph(Node* node, int kmer_size,
                                    bool path_only,
                                    int edge_max, int stride,
@@ -7128,21 +7174,17 @@ void VG::gcsa_handle_node_in_graph(Node* node, int kmer_size,
                 next_positions.insert(make_tuple(c, node_id, is_backward, pos));
             }
 
-            // Add in the kmer string
-            if (forward_kmer.kmer.empty()) forward_kmer.kmer = kmer;
-
-            // Add in the start position
-            if (forward_kmer.pos.empty()) {
+            // Add in the kmer string, and the start position, when we first see the kmer
+            if (forward_kmer.kmer.empty()) {
+                forward_kmer.kmer = kmer;
                 // And the distance from the end of the kmer to the end of its ending node.
-                stringstream ps;
                 if (start_node->node->id() == tail_node->id() && start_node->backward) {
-                    ps << head_node->id() << ":" << start_pos;
+                    forward_kmer.pos = {head_node->id(), false, start_pos};
                 } else if (start_node->node->id() == head_node->id() && start_node->backward) {
-                    ps << tail_node->id() << ":" << start_pos;
+                    forward_kmer.pos = {tail_node->id(), false, start_pos};
                 } else {
-                    ps << start_node->node->id() << ":" << (start_node->backward?"-":"") << start_pos;
+                    forward_kmer.pos = {start_node->node->id(), start_node->backward, start_pos};
                 }
-                forward_kmer.pos = ps.str();
             }
 
             // Add in the prev and next characters.
@@ -7162,9 +7204,7 @@ void VG::gcsa_handle_node_in_graph(Node* node, int kmer_size,
                 bool target_node_backward = get<2>(p);
                 int32_t target_off = get<3>(p);
                 // Say we go to it at the correct offset
-                stringstream ps;
-                ps << target_node << ":" << (target_node_backward?"-":"") << target_off;
-                forward_kmer.next_positions.insert(ps.str());
+                forward_kmer.next_positions.push_back({target_node, target_node_backward, target_off});
             }
         }
 
@@ -7212,22 +7252,18 @@ void VG::gcsa_handle_node_in_graph(Node* node, int kmer_size,
                 prev_positions.insert(make_tuple(c, node_id, is_backward, pos));
             }
 
-            // Add in the kmer string
-            if (reverse_kmer.kmer.empty()) reverse_kmer.kmer = reverse_complement(kmer);
-
-            // Add in the start position
-            if (reverse_kmer.pos.empty()) {
+            // Add in the kmer string, and the start position, when we first see the kmer
+            if (reverse_kmer.kmer.empty()) {
+                reverse_kmer.kmer = reverse_complement(kmer);
                 // Use the other node ID, facing the other way
-                stringstream ps;
+                // And the distance from the end of the kmer to the end of its ending node.
                 if (end_node->node->id() == tail_node->id() && !end_node->backward) {
-                    ps << head_node->id() << ":" << end_pos;
+                    reverse_kmer.pos = {head_node->id(), false, end_pos};
                 } else if (end_node->node->id() == head_node->id() && !end_node->backward) {
-                    ps << tail_node->id() << ":" << end_pos;
+                    reverse_kmer.pos = {tail_node->id(), false, end_pos};
                 } else {
-                    ps << (*end_node).node->id() << ":" << (!end_node->backward?"-":"") << end_pos;
+                    reverse_kmer.pos = {(*end_node).node->id(), !end_node->backward, end_pos};
                 }
-                // And the distance from the end of the kmer to the end of its ending node.
-                reverse_kmer.pos = ps.str();
             }
 
             // Add in the prev and next characters.
@@ -7249,9 +7285,7 @@ void VG::gcsa_handle_node_in_graph(Node* node, int kmer_size,
                 int32_t off = get<3>(p);
 
                 // Say we go to it at the correct offset
-                stringstream ps;
-                ps << target_node << ":" << (!target_node_backward?"-":"") << off;
-                reverse_kmer.next_positions.insert(ps.str());
+                reverse_kmer.next_positions.push_back({target_node, !target_node_backward, off});
             }
         }
     };
@@ -7263,8 +7297,12 @@ void VG::gcsa_handle_node_in_graph(Node* node, int kmer_size,
     for_each_kmer_of_node(node, kmer_size, path_only, edge_max, visit_kmer, stride, true, false);
 
     // Now that the cache is full and correct, containing each kmer starting
-    // on either strand of this node, send out all its entries.
+    // on either strand of this node, send out all its entries, with their
+    // next positions in order and without repeats.
     for(auto& kv : cache) {
+        auto& next_positions = kv.second.next_positions;
+        sort(next_positions.begin(), next_positions.end(), kmer_node_position_token_less);
+        next_positions.erase(unique(next_positions.begin(), next_positions.end()), next_positions.end());
         lambda(kv.second);
     }
 
@@ -7373,17 +7411,19 @@ void VG::write_gcsa_kmers(int kmer_size, bool path_only,
                           int edge_max, int stride,
                           bool forward_only,
                           ostream& out,
-                          id_t& head_id, id_t& tail_id) {
-    size_t buffer_limit = 1e5; // 100k kmers per buffer
+                          id_t& head_id, id_t& tail_id,
+                          size_t memory_limit) {
+    // each thread fills its own run, and hands it to the sorter when it's full
+    KmerSorter sorter(kmer_size, memory_limit);
+    size_t run_kmers = sorter.run_kmers();
     auto handle_kmers = [&](vector<gcsa::KMer>& kmers, bool more) {
-        if (!more || kmers.size() > buffer_limit) {
-#pragma omp critical (gcsa_kmer_out)
-            gcsa::writeBinary(out, kmers, kmer_size);
-            kmers.clear();
+        if (!more || kmers.size() >= run_kmers) {
+            sorter.add_run(kmers);
         }
     };
     get_gcsa_kmers(kmer_size, path_only, edge_max, stride, forward_only,
                    handle_kmers, head_id, tail_id);
+    sorter.write(out);
 }
 
 void VG::get_gcsa_kmers(int kmer_size, bool path_only,
@@ -7392,10 +7432,7 @@ void VG::get_gcsa_kmers(int kmer_size, bool path_only,
                         const function<void(vector<gcsa::KMer>&, bool)>& handle_kmers,
                         id_t& head_id, id_t& tail_id) {
 
-    // TODO: This function goes through an internal string format that should
-    // really be replaced by making some API changes to gcsa2.
-
-    // We need an alphabet to parse the internal string format
+    // We need the alphabet to pack the kmers and their neighboring characters
     const gcsa::Alphabet alpha;
 
     // Each thread is going to make its own KMers, then we'll concatenate these all together at the end.
@@ -7410,60 +7447,52 @@ void VG::get_gcsa_kmers(int kmer_size, bool path_only,
         }
     }
 
-    auto convert_kmer = [&thread_outputs, &alpha, &head_id, &tail_id, &handle_kmers](KmerPosition& kp) {
-        // Convert this KmerPosition to several gcsa::Kmers, and save them in thread_outputs
-        vector<gcsa::KMer>& thread_output = thread_outputs[omp_get_thread_num()];
-
-        // We need to make this kmer into a series of tokens
-        vector<string> tokens;
-
-        // First the kmer
-        tokens.push_back(kp.kmer);
-
-        // Then the node id:offset
-        tokens.push_back(kp.pos);
-
-        // Then the comma-separated preceeding characters. See <http://stackoverflow.com/a/18427254/402891>
-        stringstream preceeding;
-        copy(kp.prev_chars.begin(), kp.prev_chars.end(), ostream_iterator<char>(preceeding, ","));
-        if(kp.prev_chars.empty()) {
-            // If we don't have any previous characters, we come from "$"
-            preceeding << "$";
-        }
-        tokens.push_back(preceeding.str());
-
-        // And the comma-separated subsequent characters.
-        stringstream subsequent;
-        copy(kp.next_chars.begin(), kp.next_chars.end(), ostream_iterator<char>(subsequent, ","));
-        if(kp.next_chars.empty()) {
-            // If we don't have any next characters, we go to "#"
-            subsequent << "#";
-        }
-        tokens.push_back(subsequent.str());
-
-        // Finally, each of the node id:offset positions you can go to next (the successors).
-        tokens.insert(tokens.end(), kp.next_positions.begin(), kp.next_positions.end());
-
-        if (kp.next_positions.empty()) {
-            // If we didn't have any successors, we have to say we go to the start of the start node
-            tokens.push_back(to_string(tail_id) + ":0");
+    // Pack a set of characters into the bitmask gcsa2 keeps in its keys,
+    // standing in the given character for an empty set
+    auto char_mask = [&alpha](const KmerCharSet& chars, char if_empty) {
+        gcsa::byte_type mask = 0;
+        if (chars.empty()) {
+            mask = 1 << alpha.char2comp[(gcsa::byte_type) if_empty];
         }
+        chars.for_each([&](char c) {
+                mask |= 1 << alpha.char2comp[(gcsa::byte_type) c];
+            });
+        return mask;
+    };
 
-        for(size_t successor_index = 4; successor_index < tokens.size(); successor_index++) {
-            // Now make a GCSA KMer for each of those successors, by passing the
-            // tokens, the alphabet, and the index in the tokens of the
-            // successor.
+    auto convert_kmer = [&thread_outputs, &alpha, &char_mask, &head_id, &tail_id, &handle_kmers](KmerPosition& kp) {
+        // Convert this KmerPosition to several gcsa::Kmers, and save them in thread_outputs
+        vector<gcsa::KMer>& thread_output = thread_outputs[omp_get_thread_num()];
 
-            thread_output.emplace_back(tokens, alpha, successor_index);
+        // If we don't have any previous characters, we come from "$", and if
+        // we don't have any next characters, we go to "#"
+        gcsa::key_type key = gcsa::Key::encode(alpha, kp.kmer,
+                                               char_mask(kp.prev_chars, '$'),
+                                               char_mask(kp.next_chars, '#'));
+        gcsa::node_type from = gcsa::Node::encode(kp.pos.id, kp.pos.offset, kp.pos.backward);
 
+        auto add_kmer = [&](gcsa::node_type to) {
+            // Make a GCSA KMer for each of the successors
+            thread_output.emplace_back();
+            auto& kmer = thread_output.back();
+            kmer.key = key;
+            kmer.from = from;
+            kmer.to = to;
 
             // Mark kmers that go to the sink node as "sorted", since they have stop
             // characters in them and can't be extended.
             // If we don't do this GCSA will get unhappy and we'll see random segfalts and stack smashing errors
-            auto& kmer = thread_output.back();
             if(gcsa::Node::id(kmer.to) == tail_id && gcsa::Node::offset(kmer.to) > 0) {
                 kmer.makeSorted();
             }
+        };
+
+        for (auto& next : kp.next_positions) {
+            add_kmer(gcsa::Node::encode(next.id, next.offset, next.backward));
+        }
+        if (kp.next_positions.empty()) {
+            // If we didn't have any successors, we have to say we go to the start of the start node
+            add_kmer(gcsa::Node::encode(tail_id, 0, false));
         }
 
         //handle kmers, and we have more to get
@@ -7489,13 +7518,14 @@ void VG::get_gcsa_kmers(int kmer_size, bool path_only,
 string VG::write_gcsa_kmers_to_tmpfile(int kmer_size, bool path_only, bool forward_only,
                                        id_t& head_id, id_t& tail_id,
                                        size_t doubling_steps, size_t size_limit,
-                                       const string& base_file_name) {
+                                       const string& base_file_name,
+                                       size_t memory_limit) {
     // open a temporary file for the kmers
     string tmpfile = tmpfilename(base_file_name);
     ofstream out(tmpfile);
     // write the kmers to the temporary file
     write_gcsa_kmers(kmer_size, path_only, 0, 1, forward_only,
-                     out, head_id, tail_id);
+                     out, head_id, tail_id, memory_limit);
     out.close();
     return tmpfile;
 }
@@ -46,6 +46,7 @@
 #include "helperDefs.hpp"
 
 #include "bubbles.hpp"
+#include "kmer_sort.hpp"
 
 #include "nodetraversal.hpp"
 #include "nodeside.hpp"
@@ -55,13 +56,51 @@
 
 namespace vg {
 
+// A set of characters, kept as a bitmask over the byte values
+struct KmerCharSet {
+    uint64_t bits[4] = {0, 0, 0, 0};
+    void insert(char c) {
+        unsigned char u = c;
+        bits[u >> 6] |= (uint64_t) 1 << (u & 63);
+    }
+    bool empty(void) const {
+        return !(bits[0] | bits[1] | bits[2] | bits[3]);
+    }
+    // call the lambda on each character in the set, in order
+    template<typename Lambda>
+    void for_each(const Lambda& lambda) const {
+        for (int i = 0; i < 4; ++i) {
+            for (uint64_t word = bits[i]; word; word &= word - 1) {
+                lambda((char) (i * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+};
+
+// An offset along a strand of a node, which gcsa2 writes as "id:offset", or
+// "id:-offset" on the reverse strand
+struct KmerNodePosition {
+    id_t id;
+    bool backward;
+    int32_t offset;
+    bool operator==(const KmerNodePosition& other) const {
+        return id == other.id && backward == other.backward && offset == other.offset;
+    }
+};
+
+inline ostream& operator<<(ostream& out, const KmerNodePosition& pos) {
+    return out << pos.id << ":" << (pos.backward ? "-" : "") << pos.offset;
+}
+
 // We create a struct that represents each kmer record we want to send to gcsa2
 struct KmerPosition {
     string kmer;
-    string pos;
-    set<char> prev_chars;
-    set<char> next_chars;
-    set<string> next_positions;
+    KmerNodePosition pos;
+    KmerCharSet prev_chars;
+    KmerCharSet next_chars;
+    // deduplicated, and sorted in the order of their "id:offset" strings,
+    // which is the order the kmer records have always been written in
+    vector<KmerNodePosition> next_positions;
 };
 
 }
@@ -776,6 +815,18 @@ public:
                                   size_t max_query_graph_ratio = 0,
                                   bool print_score_matrices = false);
     
+    // align many reads, converting the graph for the aligner only once instead of once per
+    // read, and return the alignments in the same order (the graph is unrolled for the
+    // longest read if it has cycles)
+    vector<Alignment> align_many(const vector<Alignment>& alignments,
+                                 Aligner& aligner,
+                                 size_t max_query_graph_ratio = 0,
+                                 bool print_score_matrices = false);
+    vector<Alignment> align_many_qual_adjusted(const vector<Alignment>& alignments,
+                                               QualAdjAligner& qual_adj_aligner,
+                                               size_t max_query_graph_ratio = 0,
+                                               bool print_score_matrices = false);
+    
     
 
 
@@ -976,11 +1027,14 @@ public:
                         const function<void(vector<gcsa::KMer>&, bool)>& handle_kmers,
                         id_t& head_id, id_t& tail_id);
 
+    // write the kmers, sorted and with duplicates merged, sorting in about
+    // memory_limit bytes of memory
     void write_gcsa_kmers(int kmer_size, bool path_only,
                           int edge_max, int stride,
                           bool forward_only,
                           ostream& out,
-                          id_t& head_id, id_t& tail_id);
+                          id_t& head_id, id_t& tail_id,
+                          size_t memory_limit = KmerSorter::DEFAULT_MEMORY_LIMIT);
 
     // write the kmers to a tmp file with the given base, return the name of the file
     string write_gcsa_kmers_to_tmpfile(int kmer_size,
@@ -989,7 +1043,8 @@ public:
                                        id_t& head_id, id_t& tail_id,
                                        size_t doubling_steps = 2,
                                        size_t size_limit = 200,
-                                       const string& base_file_name = ".vg-kmers-tmp-");
+                                       const string& base_file_name = ".vg-kmers-tmp-",
+                                       size_t memory_limit = KmerSorter::DEFAULT_MEMORY_LIMIT);
 
     // construct the GCSA index for this graph
     void build_gcsa_lcp(gcsa::GCSA*& gcsa,
@@ -1023,12 +1078,17 @@ private:
                         bool allow_negatives,
                         Node* node = nullptr);
     
-    // private method to funnel other align options into
+    // private methods to funnel other align options into
     Alignment align(const Alignment& alignment,
                     Aligner* aligner,
                     QualAdjAligner* qual_adj_aligner,
                     size_t max_query_graph_ratio,
                     bool print_score_matrices);
+    vector<Alignment> align(const vector<Alignment>& alignments,
+                            Aligner* aligner,
+                            QualAdjAligner* qual_adj_aligner,
+                            size_t max_query_graph_ratio,
+                            bool print_score_matrices);
 
 
 public:
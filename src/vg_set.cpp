@@ -279,13 +279,13 @@ void VGset::write_gcsa_out(ostream& out, int kmer_size, bool path_only, bool for
         // Columns 1 and 2 are the kmer string and the node id:offset start position.
         line << kp.kmer << '\t' << kp.pos << '\t';
         // Column 3 is the comma-separated preceeding character options for this kmer instance.
-        for (auto c : kp.prev_chars) line << c << ',';
+        kp.prev_chars.for_each([&](char c) { line << c << ','; });
         // If there are previous characters, kill the last comma. Otherwise, say "$" is the only previous character.
         if (!kp.prev_chars.empty()) { line.seekp(-1, line.cur);
         } else { line << '$'; }
         line << '\t';
         // Column 4 is the next character options from this kmer instance. Works just like column 3.
-        for (auto c : kp.next_chars) line << c << ',';
+        kp.next_chars.for_each([&](char c) { line << c << ','; });
         if (!kp.next_chars.empty()) { line.seekp(-1, line.cur);
         } else { line << '#'; }
         line << '\t';
@@ -348,21 +348,18 @@ void VGset::get_gcsa_kmers(int kmer_size,
         });
 }
 
-// writes to a set of temp files and returns their names
+// writes to a temp file and returns its name
 vector<string> VGset::write_gcsa_kmers_binary(int kmer_size,
                                               bool path_only,
                                               bool forward_only,
-                                              int64_t head_id, int64_t tail_id) {
-    vector<string> tmpnames;
-    for_each([&](VG* g) {
-            tmpnames.push_back(
-                g->write_gcsa_kmers_to_tmpfile(kmer_size,
-                                               path_only,
-                                               forward_only,
-                                               head_id,
-                                               tail_id));
-        });
-    return tmpnames;
+                                              int64_t head_id, int64_t tail_id,
+                                              size_t memory_limit) {
+    string tmpname = tmpfilename(".vg-kmers-tmp-");
+    ofstream out(tmpname);
+    write_gcsa_kmers_binary(out, kmer_size, path_only, forward_only,
+                            head_id, tail_id, memory_limit);
+    out.close();
+    return { tmpname };
 }
 
 // writes to a specific output stream
@@ -370,11 +367,20 @@ void VGset::write_gcsa_kmers_binary(ostream& out,
                                     int kmer_size,
                                     bool path_only,
                                     bool forward_only,
-                                    int64_t head_id, int64_t tail_id) {
-    for_each([&](VG* g) {
-            g->write_gcsa_kmers(kmer_size, path_only, 0, 1, forward_only,
-                                out, head_id, tail_id);
-        });
+                                    int64_t head_id, int64_t tail_id,
+                                    size_t memory_limit) {
+    // kmers from all the graphs go through the one sorter, so kmers that
+    // more than one graph has, like those on the start and end nodes, are
+    // merged too
+    KmerSorter sorter(kmer_size, memory_limit);
+    size_t run_kmers = sorter.run_kmers();
+    auto handle_kmers = [&](vector<gcsa::KMer>& kmers, bool more) {
+        if (!more || kmers.size() >= run_kmers) {
+            sorter.add_run(kmers);
+        }
+    };
+    get_gcsa_kmers(kmer_size, path_only, forward_only, handle_kmers, head_id, tail_id);
+    sorter.write(out);
 }
 
 }
@@ -57,10 +57,13 @@ public:
                         bool path_only, bool forward_only,
                         int64_t head_id=0, int64_t tail_id=0);
 
+    // Write out the kmers of all the graphs in GCSA2's binary format, sorted
+    // and with duplicates merged, sorting in about memory_limit bytes
     void write_gcsa_kmers_binary(ostream& out,
                                  int kmer_size,
                                  bool path_only, bool forward_only,
-                                 int64_t head_id=0, int64_t tail_id=0);
+                                 int64_t head_id=0, int64_t tail_id=0,
+                                 size_t memory_limit = KmerSorter::DEFAULT_MEMORY_LIMIT);
 
     // gets all the kmers in GCSA's internal format.
     void get_gcsa_kmers(int kmer_size,
@@ -68,9 +71,11 @@ public:
                         const function<void(vector<gcsa::KMer>&, bool)>& handle_kmers,
                         int64_t head_id=0, int64_t tail_id=0);
 
+    // As above, but to a temporary file, and return its name
     vector<string> write_gcsa_kmers_binary(int kmer_size,
                                            bool path_only, bool forward_only,
-                                           int64_t head_id=0, int64_t tail_id=0);
+                                           int64_t head_id=0, int64_t tail_id=0,
+                                           size_t memory_limit = KmerSorter::DEFAULT_MEMORY_LIMIT);
 
     bool show_progress;
 
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 31
+plan tests 36
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg -g x.gcsa -k 11 x.vg
@@ -37,6 +37,10 @@ is $(vg map -b small/x.bam -x x.xg -g x.gcsa -J | jq .quality | grep null | wc -
 
 is $(vg map -s $seq -B 30 -x x.xg -g x.gcsa | vg surject -x x.xg -s - | wc -l) 4 "banded alignment produces a correct alignment"
 
+vg sim -s 52 -n 20 -l 400 x.vg >x.long.reads
+is "$(vg map -r x.long.reads -B 50 -x x.xg -g x.gcsa -t 4 --keep-order | vg view -a - | jq -c '[.score, .path]' | md5sum)" "$(vg map -r x.long.reads -B 50 -x x.xg -g x.gcsa -t 1 | vg view -a - | jq -c '[.score, .path]' | md5sum)" "banded alignment of long reads on many threads matches one thread"
+rm -f x.long.reads
+
 scores=$(vg map -s GCACCAGGACCCAGAGAGTTGGAATGCCAGGCATTTCCTCTGTTTTCTTTCACCG -x x.xg -g x.gcsa -J -M 2 | jq -r '.score' | tr '\n' ',')
 is "${scores}" $(printf ${scores} | tr ',' '\n' | sort -nr | tr '\n' ',')  "multiple alignments are returned in descending score order"
 
@@ -127,4 +131,21 @@ is $(vg map -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f
 
 is $(vg map -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f reads/grch38_lrc_kir_paired.fq -i -W 300 -u 0 -U -W 750 -J | jq -r 'select(.name == "ERR194147.679985061/1") | .path.mapping[0].position.node_id') 8121 "rescue can replace extra multimappings"
 
+awk '{ print "@read" NR; print $1; print "+"; gsub(/./, "I"); print }' x.reads >x.fq
+vg map -x x.xg -g x.gcsa --serve x.sock &
+server=$!
+# wait for the indexes to load
+for i in $(seq 1 100); do [ -S x.sock ] && break; sleep 0.1; done
+is "$(vg map --connect x.sock -f x.fq | vg view -a - | jq -c '[.name, .score, .path]' | md5sum)" "$(vg map -x x.xg -g x.gcsa -f x.fq --keep-order | vg view -a - | jq -c '[.name, .score, .path]' | md5sum)" "a mapping server aligns reads as vg map does"
+vg map --connect x.sock -f x.fq >x.served1.gam &
+gzip -c x.fq | vg map --connect x.sock >x.served2.gam
+wait $!
+is $(cat x.served1.gam x.served2.gam | vg view -a - | jq -r .name | sort | uniq -c | awk '$1 == 2' | wc -l) 1000 "a mapping server serves concurrent clients"
+kill $server
+wait $server
+is $([ -e x.sock ] && echo 1 || echo 0) 0 "a mapping server removes its socket when it stops"
+head -n 200 x.fq >x.head.fq
+is "$(vg map -x x.xg -g x.gcsa -f x.head.fq -t 2 | vg view -a - | jq -c '[.sequence, .score, .path]' | sort | md5sum)" "$(awk 'NR % 4 == 2' x.head.fq | while read s; do vg map -s $s -x x.xg -g x.gcsa -t 1 -J | jq -c '[.sequence, .score, .path]'; done | sort | md5sum)" "reads aligned a chunk at a time align as they do one at a time"
+rm -f x.fq x.head.fq x.served1.gam x.served2.gam
+
 rm -f x.vg.idx x.vg.gcsa x.vg.gcsa.lcp x.vg x.reads x.xg x.gcsa graphs/refonly-lrc_kir.vg.xg graphs/refonly-lrc_kir.vg.gcsa graphs/refonly-lrc_kir.vg.gcsa.lcp
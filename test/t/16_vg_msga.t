@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 16
+plan tests 18
 
 is $(vg msga -a 2 -i 2 -o 3 -e 1 -f GRCh38_alts/FASTA/HLA/V-352962.fa -t 1 -Y 64 | vg mod -n - | vg mod -n - | vg view - | grep ^S | cut -f 3 | sort | md5sum | cut -f 1 -d\ ) 16e56f0090b310d2b1479d49cf790324 "MSGA produces the expected graph for GRCh38 HLA-V"
 
@@ -47,3 +47,8 @@ is $? 0 "edges in cycles with two nodes are correctly included"
 
 vg msga -f GRCh38_alts/FASTA/HLA/B-3106.fa -B 64 -K 11 -X 1 | vg validate -
 is $? 0 "HLA B-3106 is assembled into a valid graph"
+
+vg msga -f GRCh38_alts/FASTA/HLA/B-3106.fa -B 64 -K 11 -X 1 -u 0.5 | vg validate -
+is $? 0 "incremental indexing assembles HLA B-3106 into a valid graph"
+
+is $((for seq in $(vg msga -f msgas/w.fa -b x -K 16 -u 1 | vg paths -x - | vg view -a - | jq .sequence | sed s/\"//g ); do grep $seq msgas/w.fa ; done) | wc -l) 2 "with incremental indexing the paths of the graph encode the original sequences used to build it"
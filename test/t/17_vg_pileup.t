@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 1
+plan tests 2
 
 # Compare output of pileup on tiny.vg and pileup/alignment.json
 # with pileup/truth.json, which has been manually vetted.
@@ -17,3 +17,10 @@ vg pileup tiny.vg alignment.gam > tiny.gpu
 vg view tiny.gpu -l -j | jq . > tiny.gpu.json
 is $(jq --argfile a tiny.gpu.json --argfile b pileup/truth.json -n '($a == $b)') true "vg pileup produces the expected output for test case on tiny graph."
 rm -f alignment.gam tiny.vg tiny.gpu tiny.gpu.json
+
+vg construct -r small/x.fa -v small/x.vcf.gz > x.vg
+vg index -x x.xg x.vg
+vg sim -s 1 -n 1000 -l 100 -e 0.01 -i 0.005 -a -x x.xg > x.gam
+depths='[([.[].node_pileups[]?.base_pileup[]?.num_bases] | add), ([.[].edge_pileups[]?.num_reads] | add)]'
+is "$(vg pileup x.vg x.gam -t 4 | vg view -l -j - | jq -s -c "$depths")" "$(vg pileup x.vg x.gam -t 1 | vg view -l -j - | jq -s -c "$depths")" "vg pileup piles up the same reads with several threads as with one"
+rm -f x.vg x.xg x.gam
@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 2
+plan tests 5
 
 # Toy example of hand-made pileup (and hand inspected truth) to make sure some
 # obvious (and only obvious) SNPs are detected by vg call
@@ -24,4 +24,14 @@ is $? "0" "vg call doesn't crash in multiallelic mode"
 
 rm -f calls_l.json calls_l.vg tiny.vg tiny.vgpu
 
-
+vg construct -r small/x.fa -v small/x.vcf.gz > x.vg
+vg index -x x.xg x.vg
+vg sim -s 1 -n 1000 -l 100 -e 0.01 -i 0.005 -a -x x.xg > x.gam
+vg pileup x.vg x.gam > x.vgpu
+vg pileup x.vg x.gam -c > x.cvgpu
+is "$(vg call x.vg x.cvgpu | md5sum)" "$(vg call x.vg x.vgpu | md5sum)" "vg call makes the same calls from a compact pileup as from a protobuf one"
+is "$(vg call x.vg x.vgpu -t 4 | md5sum)" "$(vg call x.vg x.vgpu -t 1 | md5sum)" "vg call makes the same calls with several threads as with one"
+vg call x.vg x.vgpu -T x.tsv > /dev/null
+is "$(cut -f 1 x.tsv | sort -u | tr '\n' ' ')" "E N " "vg call can write its calls out as TSV"
+
+rm -f x.vg x.xg x.gam x.vgpu x.cvgpu x.tsv
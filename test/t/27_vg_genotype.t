@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 6
+plan tests 9
 
 vg construct -v tiny/tiny.vcf.gz -r tiny/tiny.fa > tiny.vg
 vg index -x tiny.vg.xg tiny.vg
@@ -20,7 +20,15 @@ is "$?" "0" "vg genotype runs successfully"
 vg genotype tiny.vg tiny.gam.index -v > /dev/null
 is "$?" "0" "vg genotype runs successfully when emitting vcf"
 
-rm -Rf tiny.vg tiny.vg.xg tiny.gam.index tiny.gam reads.txt
+# Sites come out in no particular order, so compare the sorted records
+vg genotype tiny.vg tiny.gam.index -v -t 1 | grep -v '^#' | sort > whole.vcf
+is "$(vg genotype tiny.vg tiny.gam.index -v -t 1 -w 1000 | grep -v '^#' | sort | md5sum)" "$(md5sum < whole.vcf)" "vg genotype in one window matches genotyping the whole graph"
+
+is "$(vg genotype tiny.vg tiny.gam.index -v -w 10 -W 5 | grep -v '^#' | sort | md5sum)" "$(md5sum < whole.vcf)" "vg genotype in small windows matches genotyping the whole graph"
+
+is "$(vg genotype tiny.vg tiny.gam.index -v -t 1 -i | grep -v '^#' | sort | md5sum)" "$(vg genotype tiny.vg tiny.gam.index -v -t 1 -i -M -1 | grep -v '^#' | sort | md5sum)" "vg genotype indel realignment gives the same calls when reads matching an allele skip realigning"
+
+rm -Rf tiny.vg tiny.vg.xg tiny.gam.index tiny.gam reads.txt whole.vcf
 
 vg construct -v tiny/tiny.vcf.gz -r tiny/tiny.fa > tiny.vg
 vg index -x tiny.vg.xg tiny.vg